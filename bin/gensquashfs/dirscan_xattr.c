@@ -6,6 +6,64 @@
  */
 #include "mkfs.h"
 
+typedef struct {
+	tree_node_t *node;
+	xattr_pair_t *pairs;
+	xattr_pair_t *last;
+	int status;
+} xattr_job_t;
+
+typedef struct {
+	const char *path_prefix;
+	void *selinux_handle;
+	bool scan_xattr;
+} xattr_scan_t;
+
+xattr_pair_t *xattr_pair_create(const char *key, const void *value,
+				size_t size)
+{
+	size_t keylen = strlen(key) + 1;
+	xattr_pair_t *pair;
+
+	pair = malloc(sizeof(*pair) + size + keylen);
+	if (pair == NULL) {
+		perror("recording xattr key-value pair");
+		return NULL;
+	}
+
+	pair->next = NULL;
+	pair->value_len = size;
+	pair->key = (char *)pair->value + size;
+
+	memcpy(pair->value, value, size);
+	memcpy(pair->key, key, keylen);
+	return pair;
+}
+
+static void job_append(xattr_job_t *job, xattr_pair_t *pair)
+{
+	if (job->last == NULL) {
+		job->pairs = pair;
+	} else {
+		job->last->next = pair;
+	}
+
+	job->last = pair;
+}
+
+static void job_destroy(xattr_job_t *job)
+{
+	xattr_pair_t *pair;
+
+	while (job->pairs != NULL) {
+		pair = job->pairs;
+		job->pairs = pair->next;
+		free(pair);
+	}
+
+	free(job);
+}
+
 #ifdef HAVE_SYS_XATTR_H
 static char *get_full_path(const char *prefix, tree_node_t *node)
 {
@@ -45,11 +103,11 @@ fail:
 	return NULL;
 }
 
-static int xattr_from_path(sqfs_xattr_writer_t *xwr, const char *path)
+static int xattr_from_path(xattr_job_t *job, const char *path)
 {
 	char *key, *value = NULL, *buffer = NULL;
 	ssize_t buflen, vallen, keylen;
-	int ret;
+	xattr_pair_t *pair;
 
 	buflen = llistxattr(path, NULL, 0);
 	if (buflen < 0) {
@@ -95,14 +153,11 @@ static int xattr_from_path(sqfs_xattr_writer_t *xwr, const char *path)
 				goto fail;
 			}
 
-			ret = sqfs_xattr_writer_add(xwr, key, value, vallen);
-			if (ret) {
-				sqfs_perror(path,
-					    "storing xattr key-value pairs",
-					    ret);
+			pair = xattr_pair_create(key, value, vallen);
+			if (pair == NULL)
 				goto fail;
-			}
 
+			job_append(job, pair);
 			free(value);
 			value = NULL;
 		}
@@ -121,80 +176,183 @@ fail:
 }
 #endif
 
-static int xattr_xcan_dfs(const char *path_prefix, void *selinux_handle,
-			  sqfs_xattr_writer_t *xwr, bool scan_xattr,
-			  tree_node_t *node)
+static int xattr_scan_worker(void *user, void *ptr)
 {
+	const xattr_scan_t *scan = user;
+	xattr_job_t *job = ptr;
+	xattr_pair_t *pair;
 	char *path;
-	int ret;
-
-	ret = sqfs_xattr_writer_begin(xwr, 0);
-	if (ret) {
-		sqfs_perror(node->name, "recoding xattr key-value pairs\n",
-			    ret);
-		return -1;
-	}
 
+	/*
+	  Errors are reported right away, but only recorded in the job, so
+	  the main thread stops at the first failed node in tree order.
+	*/
 #ifdef HAVE_SYS_XATTR_H
-	if (scan_xattr) {
-		path = get_full_path(path_prefix, node);
+	if (scan->scan_xattr) {
+		int ret;
+
+		path = get_full_path(scan->path_prefix, job->node);
 		if (path == NULL)
-			return -1;
+			goto fail;
 
-		ret = xattr_from_path(xwr, path);
+		ret = xattr_from_path(job, path);
 		free(path);
 
 		if (ret)
-			return -1;
+			goto fail;
 	}
-#else
-	(void)path_prefix;
 #endif
 
-	if (selinux_handle != NULL) {
-		path = fstree_get_path(node);
+	if (scan->selinux_handle != NULL) {
+		path = fstree_get_path(job->node);
 		if (path == NULL) {
 			perror("reconstructing absolute path");
-			return -1;
+			goto fail;
 		}
 
-		ret = selinux_relable_node(selinux_handle, xwr, node, path);
+		pair = selinux_relable_node(scan->selinux_handle,
+					    job->node, path);
 		free(path);
 
-		if (ret)
-			return -1;
+		if (pair == NULL)
+			goto fail;
+
+		job_append(job, pair);
 	}
 
-	if (sqfs_xattr_writer_end(xwr, &node->xattr_idx)) {
-		sqfs_perror(node->name, "completing xattr key-value pairs",
+	return 0;
+fail:
+	job->status = -1;
+	return 0;
+}
+
+static tree_node_t *next_node_dfs(tree_node_t *root, tree_node_t *n)
+{
+	if (S_ISDIR(n->mode) && n->data.dir.children != NULL)
+		return n->data.dir.children;
+
+	while (n != root && n->next == NULL)
+		n = n->parent;
+
+	return n == root ? NULL : n->next;
+}
+
+static int store_xattrs(sqfs_xattr_writer_t *xwr, xattr_job_t *job)
+{
+	tree_node_t *node = job->node;
+	xattr_pair_t *pair;
+	int ret;
+
+	ret = sqfs_xattr_writer_begin(xwr, 0);
+	if (ret) {
+		sqfs_perror(node->name, "recoding xattr key-value pairs\n",
 			    ret);
 		return -1;
 	}
 
-	if (S_ISDIR(node->mode)) {
-		node = node->data.dir.children;
-
-		while (node != NULL) {
-			if (xattr_xcan_dfs(path_prefix, selinux_handle, xwr,
-					   scan_xattr, node)) {
-				return -1;
-			}
-
-			node = node->next;
+	for (pair = job->pairs; pair != NULL; pair = pair->next) {
+		ret = sqfs_xattr_writer_add(xwr, pair->key, pair->value,
+					    pair->value_len);
+		if (ret) {
+			sqfs_perror(node->name,
+				    "storing xattr key-value pairs", ret);
+			return -1;
 		}
 	}
 
+	ret = sqfs_xattr_writer_end(xwr, &node->xattr_idx);
+	if (ret) {
+		sqfs_perror(node->name, "completing xattr key-value pairs",
+			    ret);
+		return -1;
+	}
+
 	return 0;
 }
 
 int xattrs_from_dir(fstree_t *fs, const char *path, void *selinux_handle,
-		    sqfs_xattr_writer_t *xwr, bool scan_xattr)
+		    sqfs_xattr_writer_t *xwr, bool scan_xattr,
+		    size_t num_jobs)
 {
+	size_t i, in_flight = 0, max_in_flight;
+	tree_node_t *node = fs->root;
+	xattr_scan_t scan;
+	thread_pool_t *pool;
+	xattr_job_t *job;
+	int ret = -1;
+
 	if (xwr == NULL)
 		return 0;
 
 	if (selinux_handle == NULL && !scan_xattr)
 		return 0;
 
-	return xattr_xcan_dfs(path, selinux_handle, xwr, scan_xattr, fs->root);
+	scan.path_prefix = path;
+	scan.selinux_handle = selinux_handle;
+	scan.scan_xattr = scan_xattr;
+
+	/*
+	  Nodes are submitted in depth-first order and the thread pool hands
+	  them back in the same order, so the xattr writer always sees the
+	  same sequence of key-value blocks, no matter how many workers
+	  gathered them.
+	*/
+	if (num_jobs > 1) {
+		pool = thread_pool_create(num_jobs, xattr_scan_worker);
+	} else {
+		pool = thread_pool_create_serial(xattr_scan_worker);
+	}
+
+	if (pool == NULL) {
+		fputs("Error creating xattr scanner thread pool\n", stderr);
+		return -1;
+	}
+
+	for (i = 0; i < pool->get_worker_count(pool); ++i)
+		pool->set_worker_ptr(pool, i, &scan);
+
+	max_in_flight = 10 * pool->get_worker_count(pool);
+
+	for (;;) {
+		while (node != NULL && in_flight < max_in_flight) {
+			job = calloc(1, sizeof(*job));
+			if (job == NULL) {
+				perror("allocating xattr scan job");
+				goto out;
+			}
+
+			job->node = node;
+
+			if (pool->submit(pool, job) != 0) {
+				fputs("Error submitting node to xattr "
+				      "scanner thread pool\n", stderr);
+				job_destroy(job);
+				goto out;
+			}
+
+			node = next_node_dfs(fs->root, node);
+			in_flight += 1;
+		}
+
+		job = pool->dequeue(pool);
+		if (job == NULL)
+			break;
+
+		in_flight -= 1;
+
+		if (job->status != 0 || store_xattrs(xwr, job)) {
+			job_destroy(job);
+			goto out;
+		}
+
+		job_destroy(job);
+	}
+
+	ret = 0;
+out:
+	while ((job = pool->dequeue(pool)) != NULL)
+		job_destroy(job);
+
+	pool->destroy(pool);
+	return ret;
 }
@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * input_file.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "mkfs.h"
+
+#ifdef HAVE_POSIX_FADVISE
+typedef struct {
+	sqfs_file_t base;
+
+	sqfs_u64 size;
+	int fd;
+} input_file_t;
+
+static void input_file_destroy(sqfs_object_t *base)
+{
+	input_file_t *file = (input_file_t *)base;
+
+	close(file->fd);
+	free(file);
+}
+
+static int input_file_read_at(sqfs_file_t *base, sqfs_u64 offset,
+			      void *buffer, size_t size)
+{
+	input_file_t *file = (input_file_t *)base;
+	ssize_t ret;
+
+	while (size > 0) {
+		ret = pread(file->fd, buffer, size, offset);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return SQFS_ERROR_IO;
+		}
+
+		if (ret == 0)
+			return SQFS_ERROR_OUT_OF_BOUNDS;
+
+		buffer = (char *)buffer + ret;
+		size -= ret;
+		offset += ret;
+	}
+
+	return 0;
+}
+
+static int input_file_write_at(sqfs_file_t *base, sqfs_u64 offset,
+			       const void *buffer, size_t size)
+{
+	(void)base; (void)offset; (void)buffer; (void)size;
+	return SQFS_ERROR_UNSUPPORTED;
+}
+
+static sqfs_u64 input_file_get_size(const sqfs_file_t *base)
+{
+	return ((const input_file_t *)base)->size;
+}
+
+static int input_file_truncate(sqfs_file_t *base, sqfs_u64 size)
+{
+	(void)base; (void)size;
+	return SQFS_ERROR_UNSUPPORTED;
+}
+
+sqfs_file_t *open_input_file(const char *path, bool read_ahead)
+{
+	input_file_t *file = calloc(1, sizeof(*file));
+	sqfs_file_t *base = (sqfs_file_t *)file;
+	struct stat sb;
+	int err;
+
+	if (file == NULL)
+		return NULL;
+
+	file->fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (file->fd < 0)
+		goto fail;
+
+	if (fstat(file->fd, &sb))
+		goto fail_fd;
+
+	file->size = sb.st_size;
+
+	if (read_ahead)
+		posix_fadvise(file->fd, 0, 0, POSIX_FADV_WILLNEED);
+
+	base->read_at = input_file_read_at;
+	base->write_at = input_file_write_at;
+	base->get_size = input_file_get_size;
+	base->truncate = input_file_truncate;
+	((sqfs_object_t *)base)->destroy = input_file_destroy;
+	return base;
+fail_fd:
+	err = errno;
+	close(file->fd);
+	errno = err;
+fail:
+	err = errno;
+	free(file);
+	errno = err;
+	return NULL;
+}
+#else
+sqfs_file_t *open_input_file(const char *path, bool read_ahead)
+{
+	(void)read_ahead;
+	return sqfs_open_file(path, SQFS_FILE_OPEN_READ_ONLY);
+}
+#endif
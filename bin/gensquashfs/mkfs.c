@@ -6,108 +6,246 @@
  */
 #include "mkfs.h"
 
-static int pack_files(sqfs_block_processor_t *data, fstree_t *fs,
-		      options_t *opt)
-{
-	sqfs_u64 filesize;
-	sqfs_file_t *file;
-	tree_node_t *node;
-	const char *path;
-	char *node_path;
+typedef struct {
 	file_info_t *fi;
-	int flags;
-	int ret;
+	char *node_path;
+	const char *path;
 
-	if (opt->packdir != NULL && chdir(opt->packdir) != 0) {
-		perror(opt->packdir);
-		return -1;
-	}
+	sqfs_file_t *file;
+	sqfs_u64 filesize;
+	sqfs_u8 *data;
+	int open_errno;
 
-	for (fi = fs->files; fi != NULL; fi = fi->next) {
-		if (fi->input_file == NULL) {
-			node = container_of(fi, tree_node_t, data.file);
+	const sqfs_inode_generic_t *old;
+	bool reuse;
+} prefetch_t;
 
-			node_path = fstree_get_path(node);
-			if (node_path == NULL) {
-				perror("reconstructing file path");
-				return -1;
-			}
+static int file_flags(const options_t *opt, const prefetch_t *pf,
+		      sqfs_u64 filesize)
+{
+	int flags = pf->fi->flags;
 
-			ret = canonicalize_name(node_path);
-			assert(ret == 0);
+	if (opt->no_tail_packing && filesize > opt->cfg.block_size)
+		flags |= SQFS_BLK_DONT_FRAGMENT;
 
-			path = node_path;
-		} else {
-			node_path = NULL;
-			path = fi->input_file;
-		}
+	return flags;
+}
 
-		if (!opt->cfg.quiet)
-			printf("packing %s\n", path);
+static int prefetch_worker(void *user, void *ptr)
+{
+	const options_t *opt = user;
+	prefetch_t *pf = ptr;
+	struct stat sb;
+
+	if (pf->old != NULL && stat(pf->path, &sb) == 0 &&
+	    reuse_can_copy(pf->old, &sb, file_flags(opt, pf, sb.st_size),
+			   opt->cfg.block_size)) {
+		pf->filesize = sb.st_size;
+		pf->reuse = true;
+		return 0;
+	}
+
+	pf->file = open_input_file(pf->path, opt->prefetch > 0);
+	if (pf->file == NULL) {
+		pf->open_errno = errno;
+		return 0;
+	}
 
-		file = sqfs_open_file(path, SQFS_FILE_OPEN_READ_ONLY);
-		if (file == NULL) {
-			perror(path);
-			free(node_path);
-			return -1;
+	pf->filesize = pf->file->get_size(pf->file);
+
+	/*
+	  Small files are read in one go, so the main thread does not have
+	  to touch the input file at all. Everything else is left open and
+	  the kernel was already asked to start reading it ahead of time. If
+	  anything goes wrong here, we leave it to the main thread to read
+	  the file the slow way and report errors in the proper order.
+	*/
+	if (pf->filesize <= opt->cfg.block_size) {
+		pf->data = malloc(pf->filesize > 0 ? pf->filesize : 1);
+		if (pf->data == NULL)
+			return 0;
+
+		if (pf->file->read_at(pf->file, 0, pf->data, pf->filesize)) {
+			free(pf->data);
+			pf->data = NULL;
+			return 0;
 		}
 
-		flags = fi->flags;
-		filesize = file->get_size(file);
+		sqfs_destroy(pf->file);
+		pf->file = NULL;
+	}
 
-		if (opt->no_tail_packing && filesize > opt->cfg.block_size)
-			flags |= SQFS_BLK_DONT_FRAGMENT;
+	return 0;
+}
 
-		ret = write_data_from_file(path, data, &fi->inode, file, flags);
-		sqfs_destroy(file);
-		free(node_path);
+static prefetch_t *prefetch_create(file_info_t *fi, reuse_t *re)
+{
+	prefetch_t *pf = calloc(1, sizeof(*pf));
+	tree_node_t *node;
+	int ret;
 
-		if (ret)
-			return -1;
+	if (pf == NULL) {
+		perror("allocating prefetch request");
+		return NULL;
 	}
 
-	return 0;
+	pf->fi = fi;
+
+	if (fi->input_file == NULL || re != NULL) {
+		node = container_of(fi, tree_node_t, data.file);
+
+		pf->node_path = fstree_get_path(node);
+		if (pf->node_path == NULL) {
+			perror("reconstructing file path");
+			free(pf);
+			return NULL;
+		}
+
+		if (re != NULL)
+			pf->old = reuse_lookup(re, pf->node_path);
+	}
+
+	if (fi->input_file == NULL) {
+		ret = canonicalize_name(pf->node_path);
+		assert(ret == 0);
+
+		pf->path = pf->node_path;
+	} else {
+		pf->path = fi->input_file;
+	}
+
+	return pf;
 }
 
-static int relabel_tree_dfs(const char *filename, sqfs_xattr_writer_t *xwr,
-			    tree_node_t *n, void *selinux_handle)
+static void prefetch_destroy(prefetch_t *pf)
 {
-	char *path = fstree_get_path(n);
-	int ret;
+	if (pf->file != NULL)
+		sqfs_destroy(pf->file);
+
+	free(pf->data);
+	free(pf->node_path);
+	free(pf);
+}
+
+static int pack_prefetched(sqfs_block_processor_t *data, prefetch_t *pf,
+			   options_t *opt, reuse_t *re)
+{
+	int flags = file_flags(opt, pf, pf->filesize);
 
-	if (path == NULL) {
-		perror("getting absolute node path for SELinux relabeling");
+	if (!opt->cfg.quiet)
+		printf("packing %s\n", pf->path);
+
+	if (pf->file == NULL && pf->data == NULL && !pf->reuse) {
+		errno = pf->open_errno;
+		perror(pf->path);
 		return -1;
 	}
 
-	ret = sqfs_xattr_writer_begin(xwr, 0);
-	if (ret) {
-		sqfs_perror(filename, "recording xattr key-value pairs", ret);
-		return -1;
+	if (pf->reuse) {
+		return reuse_copy_file(re, data, pf->path, pf->old,
+				       &pf->fi->inode, flags);
 	}
 
-	if (selinux_relable_node(selinux_handle, xwr, n, path)) {
-		free(path);
+	if (pf->data != NULL) {
+		return write_data_from_memory(pf->path, data, &pf->fi->inode,
+					      pf->data, pf->filesize, flags);
+	}
+
+	return write_data_from_file(pf->path, data, &pf->fi->inode,
+				    pf->file, flags);
+}
+
+static int pack_files(sqfs_block_processor_t *data, fstree_t *fs,
+		      options_t *opt, reuse_t *re)
+{
+	size_t i, in_flight = 0, max_in_flight, num_workers;
+	thread_pool_t *pool;
+	file_info_t *fi;
+	prefetch_t *pf;
+	int ret = -1;
+
+	if (opt->packdir != NULL && chdir(opt->packdir) != 0) {
+		perror(opt->packdir);
 		return -1;
 	}
 
-	ret = sqfs_xattr_writer_end(xwr, &n->xattr_idx);
-	if (ret) {
-		sqfs_perror(filename, "flushing completed key-value pairs",
-			    ret);
+	/*
+	  The thread pool hands back the opened files in the order they were
+	  submitted, so the block processor is always fed in the same order
+	  as the file list. Without prefetching, the serial implementation
+	  opens and reads each file in place once we ask for it.
+	*/
+	if (opt->prefetch > 0) {
+		num_workers = opt->prefetch;
+		if (num_workers > MAX_PREFETCH_JOBS)
+			num_workers = MAX_PREFETCH_JOBS;
+
+		pool = thread_pool_create(num_workers, prefetch_worker);
+	} else {
+		pool = thread_pool_create_serial(prefetch_worker);
+	}
+
+	if (pool == NULL) {
+		fputs("Error creating file prefetch thread pool\n", stderr);
 		return -1;
 	}
 
-	free(path);
+	for (i = 0; i < pool->get_worker_count(pool); ++i)
+		pool->set_worker_ptr(pool, i, opt);
+
+	/*
+	  Every file larger than a block stays open until it is packed. The
+	  serial pool only opens a file once it is dequeued, so it is fed
+	  one file at a time.
+	*/
+	max_in_flight = opt->prefetch;
+	if (max_in_flight < 1)
+		max_in_flight = 1;
+	if (max_in_flight > MAX_PREFETCH_FILES)
+		max_in_flight = MAX_PREFETCH_FILES;
+
+	fi = fs->files;
+
+	for (;;) {
+		while (fi != NULL && in_flight < max_in_flight) {
+			pf = prefetch_create(fi, re);
+			if (pf == NULL) {
+				ret = -1;
+				goto out;
+			}
 
-	if (S_ISDIR(n->mode)) {
-		for (n = n->data.dir.children; n != NULL; n = n->next) {
-			if (relabel_tree_dfs(filename, xwr, n, selinux_handle))
-				return -1;
+			if (pool->submit(pool, pf) != 0) {
+				fputs("Error submitting file to prefetch "
+				      "thread pool\n", stderr);
+				prefetch_destroy(pf);
+				ret = -1;
+				goto out;
+			}
+
+			fi = fi->next;
+			in_flight += 1;
 		}
+
+		pf = pool->dequeue(pool);
+		if (pf == NULL)
+			break;
+
+		in_flight -= 1;
+
+		ret = pack_prefetched(data, pf, opt, re);
+		prefetch_destroy(pf);
+
+		if (ret)
+			goto out;
 	}
 
-	return 0;
+	ret = 0;
+out:
+	while ((pf = pool->dequeue(pool)) != NULL)
+		prefetch_destroy(pf);
+
+	pool->destroy(pool);
+	return ret;
 }
 
 static int read_fstree(fstree_t *fs, options_t *opt, sqfs_xattr_writer_t *xwr,
@@ -117,9 +255,10 @@ static int read_fstree(fstree_t *fs, options_t *opt, sqfs_xattr_writer_t *xwr,
 
 	ret = fstree_from_file(fs, opt->infile, opt->packdir);
 
-	if (ret == 0 && selinux_handle != NULL)
-		ret = relabel_tree_dfs(opt->cfg.filename, xwr,
-				       fs->root, selinux_handle);
+	if (ret == 0 && selinux_handle != NULL) {
+		ret = xattrs_from_dir(fs, NULL, selinux_handle, xwr, false,
+				      opt->cfg.num_jobs);
+	}
 
 	return ret;
 }
@@ -143,6 +282,7 @@ int main(int argc, char **argv)
 	int status = EXIT_FAILURE;
 	istream_t *sortfile = NULL;
 	void *sehnd = NULL;
+	reuse_t *re = NULL;
 	sqfs_writer_t sqfs;
 	options_t opt;
 
@@ -163,6 +303,12 @@ int main(int argc, char **argv)
 			goto out;
 	}
 
+	if (opt.reuse_image != NULL) {
+		re = reuse_open(opt.reuse_image, sqfs.cmp, opt.cfg.block_size);
+		if (re == NULL)
+			goto out;
+	}
+
 	if (opt.infile == NULL) {
 		if (fstree_from_dir(&sqfs.fs, sqfs.fs.root, opt.packdir,
 				    NULL, NULL, opt.dirscan_flags)) {
@@ -181,7 +327,8 @@ int main(int argc, char **argv)
 
 	if (opt.infile == NULL) {
 		if (xattrs_from_dir(&sqfs.fs, opt.packdir, sehnd,
-				    sqfs.xwr, opt.scan_xattr)) {
+				    sqfs.xwr, opt.scan_xattr,
+				    opt.cfg.num_jobs)) {
 			goto out;
 		}
 	}
@@ -191,12 +338,17 @@ int main(int argc, char **argv)
 			goto out;
 	}
 
-	if (pack_files(sqfs.data, &sqfs.fs, &opt))
+	if (pack_files(sqfs.data, &sqfs.fs, &opt, re))
 		goto out;
 
 	if (sqfs_writer_finish(&sqfs, &opt.cfg))
 		goto out;
 
+	if (re != NULL && !opt.cfg.quiet) {
+		printf("Files reused from %s: " PRI_U64 "\n",
+		       opt.reuse_image, reuse_get_file_count(re));
+	}
+
 	status = EXIT_SUCCESS;
 out:
 	sqfs_writer_cleanup(&sqfs, status);
@@ -204,6 +356,8 @@ out:
 		selinux_close_context_file(sehnd);
 	if (sortfile != NULL)
 		sqfs_destroy(sortfile);
+	if (re != NULL)
+		reuse_destroy(re);
 	free(opt.packdir);
 	return status;
 }
@@ -11,6 +11,9 @@
 
 #include "common.h"
 #include "fstree.h"
+#include "threadpool.h"
+#include "hash_table.h"
+#include "util.h"
 
 #ifdef HAVE_SYS_XATTR_H
 #include <sys/xattr.h>
@@ -29,6 +32,11 @@
 #include <selinux/label.h>
 #endif
 
+#ifdef HAVE_POSIX_FADVISE
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include <getopt.h>
 #include <assert.h>
 #include <stdlib.h>
@@ -38,13 +46,24 @@
 #include <errno.h>
 #include <ctype.h>
 
+/*
+  Upper bound for the number of threads used for opening and reading
+  input files ahead of time, independent of how many files are in flight.
+ */
+#define MAX_PREFETCH_JOBS (16)
+
+/* upper bound for the number of input files that are opened ahead */
+#define MAX_PREFETCH_FILES (4 * MAX_PREFETCH_JOBS)
+
 typedef struct {
 	sqfs_writer_cfg_t cfg;
 	unsigned int dirscan_flags;
 	const char *infile;
 	const char *selinux;
 	const char *sortfile;
+	const char *reuse_image;
 	bool no_tail_packing;
+	size_t prefetch;
 
 	/* copied from command line or constructed from infile argument
 	   if not specified. Must be free'd. */
@@ -58,16 +77,58 @@ typedef struct {
 	bool scan_xattr;
 } options_t;
 
+/* A single extended attribute, gathered ahead of time by a worker thread */
+typedef struct xattr_pair_t {
+	struct xattr_pair_t *next;
+	char *key;
+	size_t value_len;
+	sqfs_u8 value[];
+} xattr_pair_t;
+
+/* A previous image that unchanged file data can be copied from */
+typedef struct reuse_t reuse_t;
+
 void process_command_line(options_t *opt, int argc, char **argv);
 
 int xattrs_from_dir(fstree_t *fs, const char *path, void *selinux_handle,
-		    sqfs_xattr_writer_t *xwr, bool scan_xattr);
+		    sqfs_xattr_writer_t *xwr, bool scan_xattr,
+		    size_t num_jobs);
+
+xattr_pair_t *xattr_pair_create(const char *key, const void *value,
+				size_t size);
 
 void *selinux_open_context_file(const char *filename);
 
-int selinux_relable_node(void *sehnd, sqfs_xattr_writer_t *xwr,
-			 tree_node_t *node, const char *path);
+xattr_pair_t *selinux_relable_node(void *sehnd, tree_node_t *node,
+				   const char *path);
 
 void selinux_close_context_file(void *sehnd);
 
+reuse_t *reuse_open(const char *filename, const sqfs_compressor_t *cmp,
+		    size_t block_size);
+
+void reuse_destroy(reuse_t *re);
+
+/* Returns the inode of a regular file in the old image or NULL */
+const sqfs_inode_generic_t *reuse_lookup(reuse_t *re, const char *path);
+
+/*
+  Check if the input file still has the same size and mtime and if the
+  stored blocks can be copied with the given block processor flags.
+ */
+bool reuse_can_copy(const sqfs_inode_generic_t *inode, const struct stat *sb,
+		    int flags, size_t block_size);
+
+int reuse_copy_file(reuse_t *re, sqfs_block_processor_t *data,
+		    const char *path, const sqfs_inode_generic_t *old,
+		    sqfs_inode_generic_t **inode, int flags);
+
+sqfs_u64 reuse_get_file_count(const reuse_t *re);
+
+/*
+  Open an input file for reading. If read_ahead is set, the operating system
+  is asked to start reading the entire file in the background, if supported.
+ */
+sqfs_file_t *open_input_file(const char *path, bool read_ahead);
+
 #endif /* MKFS_H */
@@ -8,6 +8,7 @@
 
 enum {
 	ALL_ROOT_OPTION = 1,
+	IO_STATS_OPTION,
 };
 
 static struct option long_opts[] = {
@@ -23,6 +24,7 @@ static struct option long_opts[] = {
 	{ "pack-dir", required_argument, NULL, 'D' },
 	{ "num-jobs", required_argument, NULL, 'j' },
 	{ "queue-backlog", required_argument, NULL, 'Q' },
+	{ "prefetch", required_argument, NULL, 'P' },
 	{ "keep-time", no_argument, NULL, 'k' },
 #ifdef HAVE_SYS_XATTR_H
 	{ "keep-xattr", no_argument, NULL, 'x' },
@@ -31,17 +33,19 @@ static struct option long_opts[] = {
 	{ "exportable", no_argument, NULL, 'e' },
 	{ "no-tail-packing", no_argument, NULL, 'T' },
 	{ "force", no_argument, NULL, 'f' },
+	{ "io-stats", no_argument, NULL, IO_STATS_OPTION },
 	{ "quiet", no_argument, NULL, 'q' },
 #ifdef WITH_SELINUX
 	{ "selinux", required_argument, NULL, 's' },
 #endif
 	{ "sort-file", required_argument, NULL, 'S' },
+	{ "reuse-image", required_argument, NULL, 'R' },
 	{ "version", no_argument, NULL, 'V' },
 	{ "help", no_argument, NULL, 'h' },
 	{ NULL, 0, NULL, 0 },
 };
 
-static const char *short_opts = "F:D:X:c:b:B:d:u:g:j:Q:S:kxoefqThV"
+static const char *short_opts = "F:D:X:c:b:B:d:u:g:j:Q:P:S:R:kxoefqThV"
 #ifdef WITH_SELINUX
 "s:"
 #endif
@@ -78,6 +82,8 @@ static const char *help_string =
 "                              worker queue before the packer starts waiting\n"
 "                              for the block processors to catch up.\n"
 "                              Defaults to 10 times the number of jobs.\n"
+"  --prefetch, -P <count>      Number of input files to open and read ahead\n"
+"                              in the background. Defaults to 0.\n"
 "  --block-size, -b <size>     Block size to use for Squashfs image.\n"
 "                              Defaults to %u.\n"
 "  --dev-block-size, -B <size> Device block size to padd the image to.\n"
@@ -98,10 +104,16 @@ static const char *help_string =
 "                              this value, no matter what the pack file or\n"
 "                              directory entries actually specify.\n"
 "  --all-root                  A short hand for `--set-uid 0 --set-gid 0`.\n"
-"\n"
+"\n";
+
+static const char *help_string_cont =
 "  --sort-file, -S <file>      Specify a \"sort file\" that can be used to\n"
 "                              micro manage the order of files during packing\n"
 "                              and behaviour (compression, fragmentation, ..)\n"
+"  --reuse-image, -R <file>    Copy the data blocks of files that have the\n"
+"                              same path, size and modification time in the\n"
+"                              given, previously built image instead of\n"
+"                              compressing them again.\n"
 "\n"
 #ifdef WITH_SELINUX
 "  --selinux, -s <file>        Specify an SELinux label file to get context\n"
@@ -118,6 +130,9 @@ static const char *help_string =
 "  --no-tail-packing, -T       Do not perform tail end packing on files that\n"
 "                              are larger than block size.\n"
 "  --force, -f                 Overwrite the output file if it exists.\n"
+"  --io-stats                  Print statistics about all reads and writes\n"
+"                              on the image to stderr when done, including\n"
+"                              request sizes, latencies and seek distances.\n"
 "  --quiet, -q                 Do not print out progress reports.\n"
 "  --help, -h                  Print help text and exit.\n"
 "  --version, -V               Print version information and exit.\n"
@@ -140,9 +155,9 @@ const char *help_details =
 "\n"
 "<path>       Absolute path of the entry in the image. Can be put in quotes\n"
 "             if some components contain spaces.\n"
-"<location>   If given, location of the input file. Either absolute or relative\n"
-"             to the description file. If omitted, the image path is used,\n"
-"             relative to the description file.\n"
+"<location>   If given, location of the input file. Either absolute or\n"
+"             relative to the description file. If omitted, the image path\n"
+"             is used, relative to the description file.\n"
 "<target>     Symlink or hardlink target.\n"
 "<mode>       Mode/permissions of the entry.\n"
 "<uid>        Numeric user id.\n"
@@ -210,6 +225,8 @@ const char *sort_details =
 void process_command_line(options_t *opt, int argc, char **argv)
 {
 	bool have_compressor;
+	long prefetch;
+	char *end;
 	int i, ret;
 
 	memset(opt, 0, sizeof(*opt));
@@ -270,6 +287,15 @@ void process_command_line(options_t *opt, int argc, char **argv)
 		case 'Q':
 			opt->cfg.max_backlog = strtol(optarg, NULL, 0);
 			break;
+		case 'P':
+			prefetch = strtol(optarg, &end, 0);
+			if (end == optarg || *end != '\0' || prefetch < 0) {
+				fprintf(stderr, "Invalid number of files to "
+					"prefetch '%s'.\n", optarg);
+				goto fail_arg;
+			}
+			opt->prefetch = prefetch;
+			break;
 		case 'B':
 			if (parse_size("Device block size",
 				       &opt->cfg.devblksize, optarg, 0)) {
@@ -304,6 +330,9 @@ void process_command_line(options_t *opt, int argc, char **argv)
 		case 'q':
 			opt->cfg.quiet = true;
 			break;
+		case IO_STATS_OPTION:
+			opt->cfg.io_stats = true;
+			break;
 		case 'X':
 			opt->cfg.comp_extra = optarg;
 			break;
@@ -326,9 +355,13 @@ void process_command_line(options_t *opt, int argc, char **argv)
 		case 'S':
 			opt->sortfile = optarg;
 			break;
+		case 'R':
+			opt->reuse_image = optarg;
+			break;
 		case 'h':
 			printf(help_string,
 			       SQFS_DEFAULT_BLOCK_SIZE, SQFS_DEVBLK_SIZE);
+			fputs(help_string_cont, stdout);
 			fputs(help_details, stdout);
 			fputs(sort_details, stdout);
 			compressor_print_available();
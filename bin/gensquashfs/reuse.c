@@ -0,0 +1,420 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * reuse.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "mkfs.h"
+
+typedef struct {
+	const sqfs_inode_generic_t *inode;
+	char path[];
+} file_entry_t;
+
+struct reuse_t {
+	const char *filename;
+	sqfs_file_t *file;
+	sqfs_compressor_t *cmp;
+	sqfs_id_table_t *idtbl;
+	sqfs_dir_reader_t *dirrd;
+	sqfs_data_reader_t *data;
+	sqfs_tree_node_t *root;
+	struct hash_table *files;
+	sqfs_super_t super;
+	sqfs_u8 *buffer;
+
+	sqfs_u64 files_reused;
+};
+
+static sqfs_u32 path_hash(const char *path)
+{
+	return xxh32(path, strlen(path));
+}
+
+static bool path_equals(void *user, const void *a, const void *b)
+{
+	(void)user;
+	return strcmp(a, b) == 0;
+}
+
+static void free_file_entry(struct hash_entry *ent)
+{
+	free(ent->data);
+}
+
+static int index_files(reuse_t *re, const sqfs_tree_node_t *n)
+{
+	file_entry_t *ent;
+	char *path;
+
+	if (S_ISREG(n->inode->base.mode)) {
+		path = sqfs_tree_node_get_path(n);
+		if (path == NULL)
+			goto fail_alloc;
+
+		ent = alloc_flex(sizeof(*ent), 1, strlen(path) + 1);
+		if (ent == NULL) {
+			free(path);
+			goto fail_alloc;
+		}
+
+		ent->inode = n->inode;
+		strcpy(ent->path, path);
+		free(path);
+
+		if (hash_table_insert_pre_hashed(re->files,
+						 path_hash(ent->path),
+						 ent->path, ent) == NULL) {
+			free(ent);
+			goto fail_alloc;
+		}
+	}
+
+	for (n = n->children; n != NULL; n = n->next) {
+		if (index_files(re, n))
+			return -1;
+	}
+
+	return 0;
+fail_alloc:
+	fprintf(stderr, "%s: indexing files: %s\n",
+		re->filename, strerror(errno));
+	return -1;
+}
+
+static bool same_compressor(reuse_t *re, const sqfs_compressor_t *cmp)
+{
+	sqfs_compressor_config_t a, b;
+
+	re->cmp->get_configuration(re->cmp, &a);
+	cmp->get_configuration(cmp, &b);
+
+	a.flags &= ~SQFS_COMP_FLAG_UNCOMPRESS;
+	b.flags &= ~SQFS_COMP_FLAG_UNCOMPRESS;
+
+	return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static int open_tables(reuse_t *re)
+{
+	sqfs_compressor_config_t cfg;
+	int ret;
+
+	ret = sqfs_super_read(&re->super, re->file);
+	if (ret) {
+		sqfs_perror(re->filename, "reading super block", ret);
+		return -1;
+	}
+
+	sqfs_compressor_config_init(&cfg, re->super.compression_id,
+				    re->super.block_size,
+				    SQFS_COMP_FLAG_UNCOMPRESS);
+
+	ret = sqfs_compressor_create(&cfg, &re->cmp);
+
+#ifdef WITH_LZO
+	if (re->super.compression_id == SQFS_COMP_LZO && ret != 0)
+		ret = lzo_compressor_create(&cfg, &re->cmp);
+#endif
+
+	if (ret != 0) {
+		sqfs_perror(re->filename, "creating compressor", ret);
+		return -1;
+	}
+
+	if (re->super.flags & SQFS_FLAG_COMPRESSOR_OPTIONS) {
+		ret = re->cmp->read_options(re->cmp, re->file);
+		if (ret) {
+			sqfs_perror(re->filename, "reading compressor options",
+				    ret);
+			return -1;
+		}
+	}
+
+	re->idtbl = sqfs_id_table_create(0);
+	if (re->idtbl == NULL) {
+		sqfs_perror(re->filename, "creating ID table",
+			    SQFS_ERROR_ALLOC);
+		return -1;
+	}
+
+	ret = sqfs_id_table_read(re->idtbl, re->file, &re->super, re->cmp);
+	if (ret) {
+		sqfs_perror(re->filename, "loading ID table", ret);
+		return -1;
+	}
+
+	re->dirrd = sqfs_dir_reader_create(&re->super, re->cmp, re->file, 0);
+	if (re->dirrd == NULL) {
+		sqfs_perror(re->filename, "creating dir reader",
+			    SQFS_ERROR_ALLOC);
+		return -1;
+	}
+
+	re->data = sqfs_data_reader_create(re->file, re->super.block_size,
+					   re->cmp, 0);
+	if (re->data == NULL) {
+		sqfs_perror(re->filename, "creating data reader",
+			    SQFS_ERROR_ALLOC);
+		return -1;
+	}
+
+	ret = sqfs_data_reader_load_fragment_table(re->data, &re->super);
+	if (ret) {
+		sqfs_perror(re->filename, "loading fragment table", ret);
+		return -1;
+	}
+
+	ret = sqfs_dir_reader_get_full_hierarchy(re->dirrd, re->idtbl, NULL,
+						 SQFS_TREE_NO_DEVICES |
+						 SQFS_TREE_NO_SOCKETS |
+						 SQFS_TREE_NO_FIFO |
+						 SQFS_TREE_NO_SLINKS |
+						 SQFS_TREE_NO_EMPTY,
+						 &re->root);
+	if (ret) {
+		sqfs_perror(re->filename, "reading filesystem tree", ret);
+		return -1;
+	}
+
+	return 0;
+}
+
+reuse_t *reuse_open(const char *filename, const sqfs_compressor_t *cmp,
+		    size_t block_size)
+{
+	reuse_t *re = calloc(1, sizeof(*re));
+
+	if (re == NULL) {
+		perror(filename);
+		return NULL;
+	}
+
+	re->filename = filename;
+
+	re->file = sqfs_open_file(filename, SQFS_FILE_OPEN_READ_ONLY);
+	if (re->file == NULL) {
+		perror(filename);
+		goto fail;
+	}
+
+	if (open_tables(re))
+		goto fail;
+
+	/*
+	  Data blocks are copied as they are, so they have to be decodable
+	  with exactly the same settings the new image advertises.
+	*/
+	if (re->super.block_size != block_size || !same_compressor(re, cmp)) {
+		fprintf(stderr, "%s: block size or compressor settings "
+			"differ from the new image, cannot reuse file data.\n",
+			filename);
+		goto fail;
+	}
+
+	re->buffer = malloc(block_size);
+	if (re->buffer == NULL) {
+		perror(filename);
+		goto fail;
+	}
+
+	re->files = hash_table_create(NULL, path_equals);
+	if (re->files == NULL) {
+		perror(filename);
+		goto fail;
+	}
+
+	if (index_files(re, re->root))
+		goto fail;
+
+	return re;
+fail:
+	reuse_destroy(re);
+	return NULL;
+}
+
+void reuse_destroy(reuse_t *re)
+{
+	if (re->files != NULL)
+		hash_table_destroy(re->files, free_file_entry);
+
+	sqfs_dir_tree_destroy(re->root);
+
+	if (re->data != NULL)
+		sqfs_destroy(re->data);
+	if (re->dirrd != NULL)
+		sqfs_destroy(re->dirrd);
+	if (re->idtbl != NULL)
+		sqfs_destroy(re->idtbl);
+	if (re->cmp != NULL)
+		sqfs_destroy(re->cmp);
+	if (re->file != NULL)
+		sqfs_destroy(re->file);
+
+	free(re->buffer);
+	free(re);
+}
+
+const sqfs_inode_generic_t *reuse_lookup(reuse_t *re, const char *path)
+{
+	struct hash_entry *ent;
+
+	ent = hash_table_search_pre_hashed(re->files, path_hash(path), path);
+	if (ent == NULL)
+		return NULL;
+
+	return ((const file_entry_t *)ent->data)->inode;
+}
+
+bool reuse_can_copy(const sqfs_inode_generic_t *inode, const struct stat *sb,
+		    int flags, size_t block_size)
+{
+	sqfs_u32 frag_idx, frag_offset;
+	size_t i, count;
+	sqfs_u64 size;
+
+	sqfs_inode_get_file_size(inode, &size);
+
+	if (size != (sqfs_u64)sb->st_size ||
+	    inode->base.mod_time != (sqfs_u32)sb->st_mtime) {
+		return false;
+	}
+
+	/* the blocks are copied as they are, so they must fit the flags */
+	if (flags & SQFS_BLK_DONT_COMPRESS) {
+		count = sqfs_inode_get_file_block_count(inode);
+
+		for (i = 0; i < count; ++i) {
+			if (!SQFS_IS_SPARSE_BLOCK(inode->extra[i]) &&
+			    SQFS_IS_BLOCK_COMPRESSED(inode->extra[i])) {
+				return false;
+			}
+		}
+	}
+
+	/* a tail end stored in a block cannot be moved to a fragment */
+	sqfs_inode_get_frag_location(inode, &frag_idx, &frag_offset);
+
+	if (frag_idx == 0xFFFFFFFF && (size % block_size) != 0 &&
+	    !(flags & SQFS_BLK_DONT_FRAGMENT)) {
+		return false;
+	}
+
+	return true;
+}
+
+static int append_zero_block(sqfs_block_processor_t *data, size_t size)
+{
+	sqfs_u8 *zero = calloc(1, size);
+	int ret;
+
+	if (zero == NULL)
+		return SQFS_ERROR_ALLOC;
+
+	ret = sqfs_block_processor_append(data, zero, size);
+	free(zero);
+	return ret;
+}
+
+static int copy_blocks(reuse_t *re, sqfs_block_processor_t *data,
+		       const sqfs_inode_generic_t *old, sqfs_u64 filesize,
+		       bool have_frag)
+{
+	size_t i, count, size, disk_size;
+	sqfs_u64 location;
+	int ret;
+
+	count = sqfs_inode_get_file_block_count(old);
+	sqfs_inode_get_file_block_start(old, &location);
+
+	for (i = 0; i < count; ++i) {
+		size = re->super.block_size;
+
+		if (i == count - 1 && !have_frag &&
+		    (filesize % re->super.block_size) != 0) {
+			size = filesize % re->super.block_size;
+		}
+
+		disk_size = SQFS_ON_DISK_BLOCK_SIZE(old->extra[i]);
+
+		if (disk_size == 0) {
+			ret = append_zero_block(data, size);
+			if (ret)
+				return ret;
+			continue;
+		}
+
+		if (disk_size > re->super.block_size)
+			return SQFS_ERROR_CORRUPTED;
+
+		ret = re->file->read_at(re->file, location,
+					re->buffer, disk_size);
+		if (ret)
+			return ret;
+
+		ret = sqfs_block_processor_append_raw(data, re->buffer,
+						      old->extra[i], size);
+		if (ret)
+			return ret;
+
+		location += disk_size;
+	}
+
+	return 0;
+}
+
+int reuse_copy_file(reuse_t *re, sqfs_block_processor_t *data,
+		    const char *path, const sqfs_inode_generic_t *old,
+		    sqfs_inode_generic_t **inode, int flags)
+{
+	sqfs_u32 frag_idx, frag_offset;
+	sqfs_u8 *tail = NULL;
+	sqfs_u64 filesize;
+	size_t tail_size;
+	bool have_frag;
+	int ret;
+
+	sqfs_inode_get_file_size(old, &filesize);
+	sqfs_inode_get_frag_location(old, &frag_idx, &frag_offset);
+
+	have_frag = (frag_idx != 0xFFFFFFFF);
+
+	ret = sqfs_block_processor_begin_file(data, inode, NULL, flags);
+	if (ret)
+		goto fail;
+
+	ret = copy_blocks(re, data, old, filesize, have_frag);
+	if (ret)
+		goto fail;
+
+	/*
+	  Fragment blocks are shared with other files, so the tail end is
+	  extracted and packed again like any other file data.
+	*/
+	if (have_frag) {
+		ret = sqfs_data_reader_get_fragment(re->data, old,
+						    &tail_size, &tail);
+		if (ret)
+			goto fail;
+
+		ret = sqfs_block_processor_append(data, tail, tail_size);
+		sqfs_free(tail);
+		if (ret)
+			goto fail;
+	}
+
+	ret = sqfs_block_processor_end_file(data);
+	if (ret)
+		goto fail;
+
+	re->files_reused += 1;
+	return 0;
+fail:
+	sqfs_perror(path, "copying file data from previous image", ret);
+	return -1;
+}
+
+sqfs_u64 reuse_get_file_count(const reuse_t *re)
+{
+	return re->files_reused;
+}
@@ -10,11 +10,11 @@
 #define XATTR_VALUE_SELINUX "system_u:object_r:unlabeled_t:s0"
 
 #ifdef WITH_SELINUX
-int selinux_relable_node(void *sehnd, sqfs_xattr_writer_t *xwr,
-			 tree_node_t *node, const char *path)
+xattr_pair_t *selinux_relable_node(void *sehnd, tree_node_t *node,
+				   const char *path)
 {
 	char *context = NULL;
-	int ret;
+	xattr_pair_t *pair;
 
 	if (selabel_lookup(sehnd, &context, path, node->mode) < 0) {
 		context = strdup(XATTR_VALUE_SELINUX);
@@ -22,17 +22,13 @@ int selinux_relable_node(void *sehnd, sqfs_xattr_writer_t *xwr,
 			goto fail;
 	}
 
-	ret = sqfs_xattr_writer_add(xwr, XATTR_NAME_SELINUX,
-				    context, strlen(context));
+	pair = xattr_pair_create(XATTR_NAME_SELINUX, context,
+				 strlen(context));
 	free(context);
-
-	if (ret)
-		sqfs_perror(node->name, "storing SELinux xattr", ret);
-
-	return ret;
+	return pair;
 fail:
 	perror("relabeling files");
-	return -1;
+	return NULL;
 }
 
 void *selinux_open_context_file(const char *filename)
@@ -54,13 +50,13 @@ void selinux_close_context_file(void *sehnd)
 	selabel_close(sehnd);
 }
 #else
-int selinux_relable_node(void *sehnd, sqfs_xattr_writer_t *xwr,
-			 tree_node_t *node, const char *path)
+xattr_pair_t *selinux_relable_node(void *sehnd, tree_node_t *node,
+				   const char *path)
 {
-	(void)sehnd; (void)xwr; (void)node; (void)path;
+	(void)sehnd; (void)node; (void)path;
 	fputs("Built without SELinux support, cannot add SELinux labels\n",
 	      stderr);
-	return -1;
+	return NULL;
 }
 
 void *selinux_open_context_file(const char *filename)
@@ -7,6 +7,24 @@
 #include "config.h"
 #include "rdsquashfs.h"
 
+/* runs of files that each worker thread gets on average */
+#define RUNS_PER_WORKER (4)
+
+/* weight of creating a file when splitting the work, in bytes of data */
+#define FILE_COST (16384)
+
+typedef struct {
+	size_t first;
+	size_t count;
+} file_run_t;
+
+typedef struct {
+	sqfs_file_t *file;
+	sqfs_compressor_t *cmp;
+	sqfs_data_reader_t *data;
+	int flags;
+} unpack_worker_t;
+
 static struct file_ent {
 	char *path;
 	const sqfs_inode_generic_t *inode;
@@ -14,6 +32,7 @@ static struct file_ent {
 
 static size_t num_files = 0, max_files = 0;
 static size_t block_size = 0;
+static int img_fd = -1;
 
 static int compare_files(const void *l, const void *r)
 {
@@ -133,18 +152,20 @@ static int gen_file_list_dfs(const sqfs_tree_node_t *n)
 	return 0;
 }
 
-static int fill_files(sqfs_data_reader_t *data, int flags)
+static int fill_files(sqfs_data_reader_t *data, size_t first, size_t count,
+		      int flags)
 {
 	int ret, openflags;
+	sqfs_u64 filesz;
 	ostream_t *fp;
 	size_t i;
 
 	openflags = OSTREAM_OPEN_OVERWRITE;
 
-	if (flags & UNPACK_NO_SPARSE)
+	if (!(flags & UNPACK_NO_SPARSE))
 		openflags |= OSTREAM_OPEN_SPARSE;
 
-	for (i = 0; i < num_files; ++i) {
+	for (i = first; i < first + count; ++i) {
 		fp = ostream_open_file(files[i].path, openflags);
 		if (fp == NULL)
 			return -1;
@@ -152,8 +173,19 @@ static int fill_files(sqfs_data_reader_t *data, int flags)
 		if (!(flags & UNPACK_QUIET))
 			printf("unpacking %s\n", files[i].path);
 
-		ret = sqfs_data_reader_dump(files[i].path, data, files[i].inode,
-					    fp, block_size);
+		ret = 0;
+
+		if (flags & UNPACK_PREALLOC) {
+			sqfs_inode_get_file_size(files[i].inode, &filesz);
+			ret = ostream_preallocate(fp, filesz);
+		}
+
+		if (ret == 0) {
+			ret = sqfs_data_reader_dump(files[i].path, data,
+						    files[i].inode, fp,
+						    block_size, img_fd);
+		}
+
 		if (ret == 0)
 			ret = ostream_flush(fp);
 
@@ -165,12 +197,192 @@ static int fill_files(sqfs_data_reader_t *data, int flags)
 	return 0;
 }
 
-int fill_unpacked_files(size_t blk_sz, const sqfs_tree_node_t *root,
-			sqfs_data_reader_t *data, int flags)
+/*****************************************************************************/
+
+static sqfs_u32 get_frag_index(const sqfs_inode_generic_t *inode)
+{
+	sqfs_u32 frag_idx, frag_off;
+	sqfs_u64 size;
+
+	sqfs_inode_get_frag_location(inode, &frag_idx, &frag_off);
+	sqfs_inode_get_file_size(inode, &size);
+
+	if ((size % block_size) == 0 || frag_off >= block_size)
+		return 0xFFFFFFFF;
+
+	return frag_idx;
+}
+
+/*
+  Split the sorted file list into contiguous runs with roughly the same
+  amount of data, that are extracted in parallel. Files that share a
+  fragment block are kept in the same run, so the block is only read and
+  uncompressed once.
+ */
+static size_t split_runs(file_run_t *runs, size_t max_runs)
+{
+	sqfs_u64 size, total = 0, acc = 0, target;
+	size_t i, count = 0;
+	sqfs_u32 frag_idx;
+
+	for (i = 0; i < num_files; ++i) {
+		sqfs_inode_get_file_size(files[i].inode, &size);
+		total += size + FILE_COST;
+	}
+
+	target = total / max_runs + 1;
+	runs[0].first = 0;
+
+	for (i = 0; i < num_files; ++i) {
+		sqfs_inode_get_file_size(files[i].inode, &size);
+		acc += size + FILE_COST;
+
+		if (acc < target || count == (max_runs - 1) ||
+		    (i + 1) == num_files)
+			continue;
+
+		frag_idx = get_frag_index(files[i].inode);
+
+		if (frag_idx != 0xFFFFFFFF &&
+		    frag_idx == get_frag_index(files[i + 1].inode))
+			continue;
+
+		runs[count].count = i + 1 - runs[count].first;
+		runs[++count].first = i + 1;
+		acc = 0;
+	}
+
+	runs[count].count = num_files - runs[count].first;
+	return count + 1;
+}
+
+static int unpack_worker(void *user, void *ptr)
+{
+	unpack_worker_t *worker = user;
+	file_run_t *run = ptr;
+
+	return fill_files(worker->data, run->first, run->count,
+			  worker->flags);
+}
+
+static int create_worker(unpack_worker_t *worker, const sqfs_super_t *super,
+			 sqfs_file_t *file, sqfs_compressor_t *cmp)
+{
+	int ret;
+
+	worker->file = sqfs_copy(file);
+	if (worker->file == NULL) {
+		perror("duplicating squashfs image handle");
+		return -1;
+	}
+
+	worker->cmp = sqfs_copy(cmp);
+	if (worker->cmp == NULL) {
+		sqfs_perror(NULL, "creating compressor", SQFS_ERROR_ALLOC);
+		return -1;
+	}
+
+	worker->data = sqfs_data_reader_create(worker->file, super->block_size,
+					       worker->cmp, 0);
+	if (worker->data == NULL) {
+		sqfs_perror(NULL, "creating data reader", SQFS_ERROR_ALLOC);
+		return -1;
+	}
+
+	ret = sqfs_data_reader_load_fragment_table(worker->data, super);
+	if (ret) {
+		sqfs_perror(NULL, "loading fragment table", ret);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void destroy_worker(unpack_worker_t *worker)
+{
+	if (worker->data != NULL)
+		sqfs_destroy(worker->data);
+
+	if (worker->cmp != NULL)
+		sqfs_destroy(worker->cmp);
+
+	if (worker->file != NULL)
+		sqfs_destroy(worker->file);
+}
+
+static int fill_files_parallel(const sqfs_super_t *super, sqfs_file_t *file,
+			       sqfs_compressor_t *cmp, int flags,
+			       size_t num_jobs)
+{
+	unpack_worker_t *workers = NULL;
+	size_t i, num_workers = 0;
+	file_run_t *runs = NULL;
+	thread_pool_t *pool;
+	int status = -1;
+	size_t num_runs;
+
+	pool = thread_pool_create(num_jobs, unpack_worker);
+	if (pool == NULL) {
+		fputs("Error creating file unpacking thread pool\n", stderr);
+		return -1;
+	}
+
+	num_workers = pool->get_worker_count(pool);
+	workers = calloc(num_workers, sizeof(workers[0]));
+	runs = calloc(num_workers * RUNS_PER_WORKER, sizeof(runs[0]));
+
+	if (workers == NULL || runs == NULL) {
+		perror("creating file unpacking workers");
+		goto out;
+	}
+
+	for (i = 0; i < num_workers; ++i) {
+		if (create_worker(workers + i, super, file, cmp))
+			goto out;
+
+		workers[i].flags = flags;
+		pool->set_worker_ptr(pool, i, workers + i);
+	}
+
+	num_runs = split_runs(runs, num_workers * RUNS_PER_WORKER);
+
+	for (i = 0; i < num_runs; ++i) {
+		if (pool->submit(pool, runs + i) != 0)
+			goto out;
+	}
+
+	/* runs that are still queued when a worker fails are never done */
+	for (i = 0; i < num_runs; ++i) {
+		if (pool->get_status(pool) != 0)
+			goto out;
+
+		pool->dequeue(pool);
+	}
+
+	if (pool->get_status(pool) == 0)
+		status = 0;
+out:
+	pool->destroy(pool);
+
+	if (workers != NULL) {
+		for (i = 0; i < num_workers; ++i)
+			destroy_worker(workers + i);
+	}
+
+	free(workers);
+	free(runs);
+	return status;
+}
+
+int fill_unpacked_files(const sqfs_super_t *super,
+			const sqfs_tree_node_t *root, sqfs_file_t *file,
+			int image_fd, sqfs_compressor_t *cmp,
+			sqfs_data_reader_t *data, int flags, size_t num_jobs)
 {
 	int status;
 
-	block_size = blk_sz;
+	block_size = super->block_size;
+	img_fd = image_fd;
 
 	if (gen_file_list_dfs(root)) {
 		clear_file_list();
@@ -179,7 +391,13 @@ int fill_unpacked_files(size_t blk_sz, const sqfs_tree_node_t *root,
 
 	qsort(files, num_files, sizeof(files[0]), compare_files);
 
-	status = fill_files(data, flags);
+	if (num_jobs > 1 && num_files > 1) {
+		status = fill_files_parallel(super, file, cmp, flags,
+					     num_jobs);
+	} else {
+		status = fill_files(data, 0, num_files, flags);
+	}
+
 	clear_file_list();
 	return status;
 }
@@ -6,6 +6,10 @@
  */
 #include "rdsquashfs.h"
 
+enum {
+	IO_STATS_OPTION = 1,
+};
+
 static struct option long_opts[] = {
 	{ "list", required_argument, NULL, 'l' },
 	{ "cat", required_argument, NULL, 'c' },
@@ -13,27 +17,33 @@ static struct option long_opts[] = {
 	{ "stat", required_argument, NULL, 's' },
 	{ "unpack-root", required_argument, NULL, 'p' },
 	{ "unpack-path", required_argument, NULL, 'u' },
+	{ "unpack-list", required_argument, NULL, 'U' },
 	{ "no-dev", no_argument, NULL, 'D' },
 	{ "no-sock", no_argument, NULL, 'S' },
 	{ "no-fifo", no_argument, NULL, 'F' },
 	{ "no-slink", no_argument, NULL, 'L' },
 	{ "no-empty-dir", no_argument, NULL, 'E' },
 	{ "no-sparse", no_argument, NULL, 'Z' },
+	{ "preallocate", no_argument, NULL, 'P' },
 #ifdef HAVE_SYS_XATTR_H
 	{ "set-xattr", no_argument, NULL, 'X' },
 #endif
 	{ "set-times", no_argument, NULL, 'T' },
 	{ "describe", no_argument, NULL, 'd' },
+	{ "manifest", no_argument, NULL, 'm' },
 	{ "chmod", no_argument, NULL, 'C' },
 	{ "chown", no_argument, NULL, 'O' },
 	{ "quiet", no_argument, NULL, 'q' },
+	{ "num-jobs", required_argument, NULL, 'j' },
+	{ "table-stats", no_argument, NULL, 't' },
+	{ "io-stats", no_argument, NULL, IO_STATS_OPTION },
 	{ "help", no_argument, NULL, 'h' },
 	{ "version", no_argument, NULL, 'V' },
 	{ NULL, 0, NULL, 0 },
 };
 
 static const char *short_opts =
-	"l:c:u:p:x:s:DSFLCOEZTj:dqhV"
+	"l:c:u:U:p:x:s:DSFLCOEZPTj:tdmqhV"
 #ifdef HAVE_SYS_XATTR_H
 	"X"
 #endif
@@ -54,15 +64,21 @@ static const char *help_string =
 "                            an inode that the given path resolves to.\n"
 "  --unpack-path, -u <path>  Unpack this sub directory from the image. To\n"
 "                            unpack everything, simply specify /.\n"
+"  --unpack-list, -U <file>  Unpack all paths listed in a file, one per line,\n"
+"                            in a single pass. The paths are unpacked with\n"
+"                            their parent directories. Use - for stdin.\n"
 "  --stat, -s <path>         Dump all information that can be extracted from\n"
 "                            the inode coresponding to a path, including\n"
 "                            SquashFS specific internals.\n"
 "  --describe, -d            Produce a file listing from the image.\n"
+"  --manifest, -m            Print a manifest of the image, listing every\n"
+"                            entry with its meta data and the SHA-256 of\n"
+"                            file contents, for use with sqfsdiff.\n"
 "\n"
-"  --unpack-root, -p <path>  If used with --unpack-path, this is where the\n"
-"                            data unpacked to. If used with --describe, this\n"
-"                            is used as a prefix for the input path of\n"
-"                            regular files.\n"
+"  --unpack-root, -p <path>  If used with --unpack-path or --unpack-list,\n"
+"                            this is where the data unpacked to. If used\n"
+"                            with --describe, this is used as a prefix for\n"
+"                            the input path of regular files.\n"
 "\n"
 "  --no-dev, -D              Do not unpack device special files.\n"
 "  --no-sock, -S             Do not unpack socket files.\n"
@@ -72,6 +88,8 @@ static const char *help_string =
 "                            empty after applying the above rules.\n"
 "  --no-sparse, -Z           Do not create sparse files, always write zero\n"
 "                            blocks to disk.\n"
+"  --preallocate, -P         Reserve the disk space for each unpacked file\n"
+"                            up front, so it is allocated in one piece.\n"
 #ifdef HAVE_SYS_XATTR_H
 "  --set-xattr, -X           When unpacking files to disk, set the extended\n"
 "                            attributes from the squashfs image.\n"
@@ -83,6 +101,15 @@ static const char *help_string =
 "  --chown, -O               Change ownership of unpacked files to the\n"
 "                            UID/GID set in the squashfs image.\n"
 "  --quiet, -q               Do not print out progress while unpacking.\n"
+"  --num-jobs, -j <count>    Number of threads to use for unpacking or\n"
+"                            hashing file data. Defaults to 1.\n"
+"  --table-stats, -t         Print the number of reads, the amount of data\n"
+"                            read and the time spent on reading and\n"
+"                            decompressing each table while loading the\n"
+"                            image to stderr.\n"
+"  --io-stats                Print statistics about all reads from the\n"
+"                            image to stderr when done, including request\n"
+"                            sizes, latencies and seek distances.\n"
 "\n"
 "  --help, -h                Print help text and exit.\n"
 "  --version, -V             Print version information and exit.\n"
@@ -111,6 +138,8 @@ static char *get_path(char *old, const char *arg)
 
 void process_command_line(options_t *opt, int argc, char **argv)
 {
+	char *end;
+	long jobs;
 	int i;
 
 	opt->op = OP_NONE;
@@ -119,6 +148,10 @@ void process_command_line(options_t *opt, int argc, char **argv)
 	opt->cmdpath = NULL;
 	opt->unpack_root = NULL;
 	opt->image_name = NULL;
+	opt->list_file = NULL;
+	opt->num_jobs = 1;
+	opt->table_stats = false;
+	opt->io_stats = false;
 
 	for (;;) {
 		i = getopt_long(argc, argv, short_opts, long_opts, NULL);
@@ -150,6 +183,9 @@ void process_command_line(options_t *opt, int argc, char **argv)
 		case 'Z':
 			opt->flags |= UNPACK_NO_SPARSE;
 			break;
+		case 'P':
+			opt->flags |= UNPACK_PREALLOC;
+			break;
 #ifdef HAVE_SYS_XATTR_H
 		case 'X':
 			opt->flags |= UNPACK_SET_XATTR;
@@ -167,6 +203,17 @@ void process_command_line(options_t *opt, int argc, char **argv)
 			free(opt->cmdpath);
 			opt->cmdpath = NULL;
 			break;
+		case 'U':
+			opt->op = OP_UNPACK_LIST;
+			opt->list_file = optarg;
+			free(opt->cmdpath);
+			opt->cmdpath = NULL;
+			break;
+		case 'm':
+			opt->op = OP_MANIFEST;
+			free(opt->cmdpath);
+			opt->cmdpath = NULL;
+			break;
 		case 'x':
 			opt->op = OP_RDATTR;
 			opt->cmdpath = get_path(opt->cmdpath, optarg);
@@ -189,6 +236,21 @@ void process_command_line(options_t *opt, int argc, char **argv)
 		case 'q':
 			opt->flags |= UNPACK_QUIET;
 			break;
+		case 'j':
+			jobs = strtol(optarg, &end, 0);
+			if (end == optarg || *end != '\0' || jobs < 1) {
+				fprintf(stderr, "Invalid number of jobs '%s'.\n",
+					optarg);
+				goto fail_arg;
+			}
+			opt->num_jobs = jobs;
+			break;
+		case 't':
+			opt->table_stats = true;
+			break;
+		case IO_STATS_OPTION:
+			opt->io_stats = true;
+			break;
 		case 'h':
 			fputs(help_string, stdout);
 			free(opt->cmdpath);
@@ -93,6 +93,7 @@ int main(int argc, char **argv)
 {
 	sqfs_xattr_reader_t *xattr = NULL;
 	sqfs_compressor_config_t cfg;
+	table_stats_t *ts = NULL;
 	int status = EXIT_FAILURE;
 	sqfs_data_reader_t *data;
 	sqfs_dir_reader_t *dirrd;
@@ -101,23 +102,45 @@ int main(int argc, char **argv)
 	sqfs_tree_node_t *n;
 	sqfs_super_t super;
 	sqfs_file_t *file;
+	int img_fd = -1;
 	options_t opt;
 	int ret;
 
 	process_command_line(&opt, argc, argv);
 
+	if (opt.table_stats) {
+		ts = table_stats_create();
+		if (ts == NULL)
+			goto out_cmd;
+	}
+
 	file = sqfs_open_file(opt.image_name, SQFS_FILE_OPEN_READ_ONLY);
 	if (file == NULL) {
 		perror(opt.image_name);
 		goto out_cmd;
 	}
 
+	if (opt.io_stats && io_stats_wrap(&file))
+		goto out_file;
+
+	if (table_stats_wrap_file(ts, &file))
+		goto out_file;
+
+	table_stats_begin(ts);
+
 	ret = sqfs_super_read(&super, file);
 	if (ret) {
 		sqfs_perror(opt.image_name, "reading super block", ret);
 		goto out_file;
 	}
 
+	table_stats_end(ts, "super block");
+
+#ifndef _WIN32
+	/* optional, for copying uncompressed blocks without a buffer */
+	img_fd = open(opt.image_name, O_RDONLY);
+#endif
+
 	sqfs_compressor_config_init(&cfg, super.compression_id,
 				    super.block_size,
 				    SQFS_COMP_FLAG_UNCOMPRESS);
@@ -134,6 +157,9 @@ int main(int argc, char **argv)
 		goto out_file;
 	}
 
+	if (table_stats_wrap_compressor(ts, &cmp))
+		goto out_cmp;
+
 	if (!(super.flags & SQFS_FLAG_NO_XATTRS)) {
 		xattr = sqfs_xattr_reader_create(0);
 		if (xattr == NULL) {
@@ -142,12 +168,16 @@ int main(int argc, char **argv)
 			goto out_cmp;
 		}
 
+		table_stats_begin(ts);
+
 		ret = sqfs_xattr_reader_load(xattr, &super, file, cmp);
 		if (ret) {
 			sqfs_perror(opt.image_name, "loading xattr table",
 				    ret);
 			goto out_xr;
 		}
+
+		table_stats_end(ts, "xattr table");
 	}
 
 	idtbl = sqfs_id_table_create(0);
@@ -157,12 +187,16 @@ int main(int argc, char **argv)
 		goto out_xr;
 	}
 
+	table_stats_begin(ts);
+
 	ret = sqfs_id_table_read(idtbl, file, &super, cmp);
 	if (ret) {
 		sqfs_perror(opt.image_name, "loading ID table", ret);
 		goto out_id;
 	}
 
+	table_stats_end(ts, "ID table");
+
 	dirrd = sqfs_dir_reader_create(&super, cmp, file, 0);
 	if (dirrd == NULL) {
 		sqfs_perror(opt.image_name, "creating dir reader",
@@ -177,12 +211,17 @@ int main(int argc, char **argv)
 		goto out_dr;
 	}
 
+	table_stats_begin(ts);
+
 	ret = sqfs_data_reader_load_fragment_table(data, &super);
 	if (ret) {
 		sqfs_perror(opt.image_name, "loading fragment table", ret);
 		goto out_data;
 	}
 
+	table_stats_end(ts, "fragment table");
+	table_stats_begin(ts);
+
 	ret = sqfs_dir_reader_get_full_hierarchy(dirrd, idtbl, opt.cmdpath,
 						 opt.rdtree_flags, &n);
 	if (ret) {
@@ -190,6 +229,9 @@ int main(int argc, char **argv)
 		goto out_data;
 	}
 
+	table_stats_end(ts, "directory tree");
+	table_stats_print(ts, opt.image_name);
+
 	switch (opt.op) {
 	case OP_LS:
 		list_files(n);
@@ -212,7 +254,7 @@ int main(int argc, char **argv)
 			goto out;
 
 		if (sqfs_data_reader_dump(opt.cmdpath, data, n->inode,
-					  fp, super.block_size)) {
+					  fp, super.block_size, img_fd)) {
 			sqfs_destroy(fp);
 			goto out;
 		}
@@ -220,6 +262,10 @@ int main(int argc, char **argv)
 		sqfs_destroy(fp);
 		break;
 	}
+	case OP_UNPACK_LIST:
+		if (select_unpack_list(n, opt.list_file))
+			goto out;
+		/* fall-through */
 	case OP_UNPACK:
 		if (tree_sort(n))
 			goto out;
@@ -237,8 +283,10 @@ int main(int argc, char **argv)
 		if (restore_fstree(n, opt.flags))
 			goto out;
 
-		if (fill_unpacked_files(super.block_size, n, data, opt.flags))
+		if (fill_unpacked_files(&super, n, file, img_fd, cmp, data,
+					opt.flags, opt.num_jobs)) {
 			goto out;
+		}
 
 		if (update_tree_attribs(xattr, n, opt.flags))
 			goto out;
@@ -247,6 +295,29 @@ int main(int argc, char **argv)
 		if (describe_tree(n, opt.unpack_root))
 			goto out;
 		break;
+	case OP_MANIFEST: {
+		manifest_t *manifest;
+		ostream_t *fp;
+
+		manifest = manifest_from_tree(opt.image_name, file, cmp,
+					      &super, n, opt.num_jobs);
+		if (manifest == NULL)
+			goto out;
+
+		fp = ostream_open_stdout();
+		if (fp == NULL) {
+			manifest_destroy(manifest);
+			goto out;
+		}
+
+		ret = manifest_write(manifest, fp);
+		sqfs_destroy(fp);
+		manifest_destroy(manifest);
+
+		if (ret)
+			goto out;
+		break;
+	}
 	case OP_RDATTR:
 		if (dump_xattrs(xattr, n->inode))
 			goto out;
@@ -270,8 +341,12 @@ out_xr:
 out_cmp:
 	sqfs_destroy(cmp);
 out_file:
+	if (img_fd >= 0)
+		close(img_fd);
+	io_stats_print(file, opt.image_name);
 	sqfs_destroy(file);
 out_cmd:
+	table_stats_destroy(ts);
 	free(opt.cmdpath);
 	return status;
 }
@@ -10,6 +10,8 @@
 #include "config.h"
 #include "common.h"
 #include "fstree.h"
+#include "threadpool.h"
+#include "manifest.h"
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -21,6 +23,8 @@
 #if defined(__APPLE__) && defined(__MACH__)
 #define lsetxattr(path, name, value, size, flags) \
 	setxattr(path, name, value, size, 0, flags | XATTR_NOFOLLOW)
+#define fsetxattr(fd, name, value, size, flags) \
+	fsetxattr(fd, name, value, size, 0, flags)
 #endif
 #endif
 #include <string.h>
@@ -39,6 +43,7 @@ enum UNPACK_FLAGS {
 	UNPACK_NO_SPARSE = 0x08,
 	UNPACK_SET_XATTR = 0x10,
 	UNPACK_SET_TIMES = 0x20,
+	UNPACK_PREALLOC = 0x40,
 };
 
 enum {
@@ -49,6 +54,8 @@ enum {
 	OP_DESCRIBE,
 	OP_RDATTR,
 	OP_STAT,
+	OP_MANIFEST,
+	OP_UNPACK_LIST,
 };
 
 typedef struct {
@@ -58,6 +65,10 @@ typedef struct {
 	char *cmdpath;
 	const char *unpack_root;
 	const char *image_name;
+	const char *list_file;
+	size_t num_jobs;
+	bool table_stats;
+	bool io_stats;
 } options_t;
 
 void list_files(const sqfs_tree_node_t *node);
@@ -67,10 +78,18 @@ int stat_file(const sqfs_tree_node_t *node);
 int restore_fstree(sqfs_tree_node_t *root, int flags);
 
 int update_tree_attribs(sqfs_xattr_reader_t *xattr,
-			const sqfs_tree_node_t *root, int flags);
+			sqfs_tree_node_t *root, int flags);
 
-int fill_unpacked_files(size_t blk_sz, const sqfs_tree_node_t *root,
-			sqfs_data_reader_t *data, int flags);
+int fill_unpacked_files(const sqfs_super_t *super,
+			const sqfs_tree_node_t *root, sqfs_file_t *file,
+			int img_fd, sqfs_compressor_t *cmp,
+			sqfs_data_reader_t *data, int flags, size_t num_jobs);
+
+/*
+  Reads a list of paths, one per line, and prunes everything from the tree
+  that is not one of them, below one of them or a parent directory of one.
+ */
+int select_unpack_list(sqfs_tree_node_t *root, const char *list_file);
 
 int describe_tree(const sqfs_tree_node_t *root, const char *unpack_root);
 
@@ -45,33 +45,142 @@ fail:
 	free(wpath);
 	return -1;
 }
+
+static int create_node_dfs(int *dirfd, const sqfs_tree_node_t *n, int flags)
+{
+	const sqfs_tree_node_t *c;
+	char *name;
+	int ret;
+
+	if (!is_filename_sane((const char *)n->name, true)) {
+		fprintf(stderr, "Found an entry named '%s', skipping.\n",
+			n->name);
+		return 0;
+	}
+
+	name = sqfs_tree_node_get_path(n);
+	if (name == NULL) {
+		fprintf(stderr, "Constructing full path for '%s': %s\n",
+			(const char *)n->name, strerror(errno));
+		return -1;
+	}
+
+	ret = canonicalize_name(name);
+	assert(ret == 0);
+
+	if (!(flags & UNPACK_QUIET))
+		printf("creating %s\n", name);
+
+	ret = create_node(n, name, flags);
+	free(name);
+	if (ret)
+		return -1;
+
+	if (S_ISDIR(n->inode->base.mode)) {
+		for (c = n->children; c != NULL; c = c->next) {
+			if (create_node_dfs(dirfd, c, flags))
+				return -1;
+		}
+	}
+	return 0;
+}
 #else
-static int create_node(const sqfs_tree_node_t *n, const char *name, int flags)
+/*
+  Entries are created and updated relative to a file descriptor of their
+  parent directory, instead of going through the full path every time.
+  Full paths are only assembled for printing them.
+
+  Only the descriptor of the directory currently being worked on is kept
+  open. The parent is closed while descending into a directory and then
+  reopened through "..", so arbitrarily deep trees do not run into the
+  limit on open files.
+ */
+static char *get_path(const sqfs_tree_node_t *n)
 {
+	char *path = sqfs_tree_node_get_path(n);
+	int ret;
+
+	if (path == NULL) {
+		fprintf(stderr, "Constructing full path for '%s': %s\n",
+			(const char *)n->name, strerror(errno));
+		return NULL;
+	}
+
+	ret = canonicalize_name(path);
+	assert(ret == 0);
+	(void)ret;
+	return path;
+}
+
+static void print_error(const char *what, const sqfs_tree_node_t *n)
+{
+	int err = errno;
+	char *path = get_path(n);
+
+	fprintf(stderr, "%s %s: %s\n", what,
+		path == NULL ? (const char *)n->name : path, strerror(err));
+	free(path);
+}
+
+static int open_dir(int dirfd, const sqfs_tree_node_t *n)
+{
+	int fd = openat(dirfd, (const char *)n->name,
+			O_DIRECTORY | O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+
+	if (fd < 0)
+		print_error("opening", n);
+
+	return fd;
+}
+
+static int enter_dir(int *dirfd, const sqfs_tree_node_t *n)
+{
+	int fd = open_dir(*dirfd, n);
+
+	if (fd >= 0) {
+		if (*dirfd != AT_FDCWD)
+			close(*dirfd);
+		*dirfd = -1;
+	}
+
+	return fd;
+}
+
+static int leave_dir(int *dirfd, int fd, const sqfs_tree_node_t *n)
+{
+	*dirfd = openat(fd, "..", O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+	if (*dirfd < 0) {
+		print_error("returning to the parent directory of", n);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int create_node(int dirfd, const sqfs_tree_node_t *n, int flags)
+{
+	const char *name = (const char *)n->name;
 	sqfs_u32 devno;
 	int fd, mode;
 
 	switch (n->inode->base.mode & S_IFMT) {
 	case S_IFDIR:
-		if (mkdir(name, 0755) && errno != EEXIST) {
-			fprintf(stderr, "mkdir %s: %s\n",
-				name, strerror(errno));
+		if (mkdirat(dirfd, name, 0755) && errno != EEXIST) {
+			print_error("mkdir", n);
 			return -1;
 		}
 		break;
 	case S_IFLNK:
-		if (symlink((const char *)n->inode->extra, name)) {
-			fprintf(stderr, "ln -s %s %s: %s\n",
-				(const char *)n->inode->extra, name,
-				strerror(errno));
+		if (symlinkat((const char *)n->inode->extra, dirfd, name)) {
+			print_error("creating symlink", n);
 			return -1;
 		}
 		break;
 	case S_IFSOCK:
 	case S_IFIFO:
-		if (mknod(name, (n->inode->base.mode & S_IFMT) | 0700, 0)) {
-			fprintf(stderr, "creating %s: %s\n",
-				name, strerror(errno));
+		if (mknodat(dirfd, name,
+			    (n->inode->base.mode & S_IFMT) | 0700, 0)) {
+			print_error("creating", n);
 			return -1;
 		}
 		break;
@@ -84,9 +193,8 @@ static int create_node(const sqfs_tree_node_t *n, const char *name, int flags)
 			devno = n->inode->data.dev.devno;
 		}
 
-		if (mknod(name, n->inode->base.mode & S_IFMT, devno)) {
-			fprintf(stderr, "creating device %s: %s\n",
-				name, strerror(errno));
+		if (mknodat(dirfd, name, n->inode->base.mode & S_IFMT, devno)) {
+			print_error("creating device", n);
 			return -1;
 		}
 		break;
@@ -97,11 +205,11 @@ static int create_node(const sqfs_tree_node_t *n, const char *name, int flags)
 			mode = 0644;
 		}
 
-		fd = open(name, O_WRONLY | O_CREAT | O_EXCL, mode);
+		fd = openat(dirfd, name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+			    mode);
 
 		if (fd < 0) {
-			fprintf(stderr, "creating %s: %s\n",
-				name, strerror(errno));
+			print_error("creating", n);
 			return -1;
 		}
 
@@ -113,13 +221,12 @@ static int create_node(const sqfs_tree_node_t *n, const char *name, int flags)
 
 	return 0;
 }
-#endif
 
-static int create_node_dfs(const sqfs_tree_node_t *n, int flags)
+static int create_node_dfs(int *dirfd, const sqfs_tree_node_t *n, int flags)
 {
 	const sqfs_tree_node_t *c;
-	char *name;
-	int ret;
+	char *path;
+	int fd;
 
 	if (!is_filename_sane((const char *)n->name, true)) {
 		fprintf(stderr, "Found an entry named '%s', skipping.\n",
@@ -127,41 +234,55 @@ static int create_node_dfs(const sqfs_tree_node_t *n, int flags)
 		return 0;
 	}
 
-	name = sqfs_tree_node_get_path(n);
-	if (name == NULL) {
-		fprintf(stderr, "Constructing full path for '%s': %s\n",
-			(const char *)n->name, strerror(errno));
-		return -1;
+	if (!(flags & UNPACK_QUIET)) {
+		path = get_path(n);
+		if (path == NULL)
+			return -1;
+
+		printf("creating %s\n", path);
+		free(path);
 	}
 
-	ret = canonicalize_name(name);
-	assert(ret == 0);
+	if (create_node(*dirfd, n, flags))
+		return -1;
 
-	if (!(flags & UNPACK_QUIET))
-		printf("creating %s\n", name);
+	if (!S_ISDIR(n->inode->base.mode) || n->children == NULL)
+		return 0;
 
-	ret = create_node(n, name, flags);
-	free(name);
-	if (ret)
+	fd = enter_dir(dirfd, n);
+	if (fd < 0)
 		return -1;
 
-	if (S_ISDIR(n->inode->base.mode)) {
-		for (c = n->children; c != NULL; c = c->next) {
-			if (create_node_dfs(c, flags))
-				return -1;
-		}
+	for (c = n->children; c != NULL; c = c->next) {
+		if (create_node_dfs(&fd, c, flags))
+			goto fail;
 	}
+
+	if (leave_dir(dirfd, fd, n))
+		goto fail;
+
+	close(fd);
 	return 0;
+fail:
+	if (fd >= 0)
+		close(fd);
+	return -1;
 }
 
 #ifdef HAVE_SYS_XATTR_H
-static int set_xattr(const char *path, sqfs_xattr_reader_t *xattr,
+/*
+  There is no lsetxattr counterpart that works relative to a directory, so
+  for anything but directories, which are set through their own file
+  descriptor, this changes into the parent directory first.
+ */
+static int set_xattr(sqfs_xattr_reader_t *xattr, int dirfd, int fd,
 		     const sqfs_tree_node_t *n)
 {
 	sqfs_xattr_value_t *value;
 	sqfs_xattr_entry_t *key;
 	sqfs_xattr_id_t desc;
 	sqfs_u32 index;
+	char *path;
 	size_t i;
 	int ret;
 
@@ -180,6 +301,11 @@ static int set_xattr(const char *path, sqfs_xattr_reader_t *xattr,
 		return -1;
 	}
 
+	if (fd < 0 && fchdir(dirfd)) {
+		print_error("changing into directory of", n);
+		return -1;
+	}
+
 	for (i = 0; i < desc.count; ++i) {
 		if (sqfs_xattr_reader_read_key(xattr, &key)) {
 			fputs("Error reading xattr key\n", stderr);
@@ -192,11 +318,21 @@ static int set_xattr(const char *path, sqfs_xattr_reader_t *xattr,
 			return -1;
 		}
 
-		ret = lsetxattr(path, (const char *)key->key,
-				value->value, value->size, 0);
+		if (fd >= 0) {
+			ret = fsetxattr(fd, (const char *)key->key,
+					value->value, value->size, 0);
+		} else {
+			ret = lsetxattr((const char *)n->name,
+					(const char *)key->key,
+					value->value, value->size, 0);
+		}
+
 		if (ret) {
+			path = get_path(n);
 			fprintf(stderr, "setting xattr '%s' on %s: %s\n",
-				key->key, path, strerror(errno));
+				key->key, path == NULL ?
+				(const char *)n->name : path, strerror(errno));
+			free(path);
 		}
 
 		sqfs_free(key);
@@ -209,41 +345,39 @@ static int set_xattr(const char *path, sqfs_xattr_reader_t *xattr,
 }
 #endif
 
-static int set_attribs(sqfs_xattr_reader_t *xattr,
+static int set_attribs(sqfs_xattr_reader_t *xattr, int *dirfd,
 		       const sqfs_tree_node_t *n, int flags)
 {
+	const char *name = (const char *)n->name;
 	const sqfs_tree_node_t *c;
-	char *path;
-	int ret;
+	int fd = -1, ret;
 
-	if (!is_filename_sane((const char *)n->name, true))
+	if (!is_filename_sane(name, true))
 		return 0;
 
+	/* directories are updated through a descriptor opened for them */
 	if (S_ISDIR(n->inode->base.mode)) {
+		fd = enter_dir(dirfd, n);
+		if (fd < 0)
+			return -1;
+
 		for (c = n->children; c != NULL; c = c->next) {
-			if (set_attribs(xattr, c, flags))
-				return -1;
+			if (set_attribs(xattr, &fd, c, flags))
+				goto fail;
 		}
-	}
 
-	path = sqfs_tree_node_get_path(n);
-	if (path == NULL) {
-		fprintf(stderr, "Reconstructing full path: %s\n",
-			strerror(errno));
-		return -1;
+		/* the new mode may not allow looking up ".." anymore */
+		if (leave_dir(dirfd, fd, n))
+			goto fail;
 	}
 
-	ret = canonicalize_name(path);
-	assert(ret == 0);
-
 #ifdef HAVE_SYS_XATTR_H
 	if ((flags & UNPACK_SET_XATTR) && xattr != NULL) {
-		if (set_xattr(path, xattr, n))
+		if (set_xattr(xattr, *dirfd, fd, n))
 			goto fail;
 	}
 #endif
 
-#ifndef _WIN32
 	if (flags & UNPACK_SET_TIMES) {
 		struct timespec times[2];
 
@@ -251,41 +385,61 @@ static int set_attribs(sqfs_xattr_reader_t *xattr,
 		times[0].tv_sec = n->inode->base.mod_time;
 		times[1].tv_sec = n->inode->base.mod_time;
 
-		if (utimensat(AT_FDCWD, path, times, AT_SYMLINK_NOFOLLOW)) {
-			fprintf(stderr, "setting timestamp on %s: %s\n",
-				path, strerror(errno));
+		if (fd >= 0) {
+			ret = futimens(fd, times);
+		} else {
+			ret = utimensat(*dirfd, name, times,
+					AT_SYMLINK_NOFOLLOW);
+		}
+
+		if (ret) {
+			print_error("setting timestamp on", n);
 			goto fail;
 		}
 	}
-#endif
+
 	if (flags & UNPACK_CHOWN) {
-		if (fchownat(AT_FDCWD, path, n->uid, n->gid,
-			     AT_SYMLINK_NOFOLLOW)) {
-			fprintf(stderr, "chown %s: %s\n",
-				path, strerror(errno));
+		if (fd >= 0) {
+			ret = fchown(fd, n->uid, n->gid);
+		} else {
+			ret = fchownat(*dirfd, name, n->uid, n->gid,
+				       AT_SYMLINK_NOFOLLOW);
+		}
+
+		if (ret) {
+			print_error("chown", n);
 			goto fail;
 		}
 	}
 
 	if (flags & UNPACK_CHMOD && !S_ISLNK(n->inode->base.mode)) {
-		if (fchmodat(AT_FDCWD, path,
-			     n->inode->base.mode & ~S_IFMT, 0)) {
-			fprintf(stderr, "chmod %s: %s\n",
-				path, strerror(errno));
+		if (fd >= 0) {
+			ret = fchmod(fd, n->inode->base.mode & ~S_IFMT);
+		} else {
+			ret = fchmodat(*dirfd, name,
+				       n->inode->base.mode & ~S_IFMT, 0);
+		}
+
+		if (ret) {
+			print_error("chmod", n);
 			goto fail;
 		}
 	}
 
-	free(path);
+	if (fd >= 0)
+		close(fd);
 	return 0;
 fail:
-	free(path);
+	if (fd >= 0)
+		close(fd);
 	return -1;
 }
+#endif
 
 int restore_fstree(sqfs_tree_node_t *root, int flags)
 {
 	sqfs_tree_node_t *n, *old_parent;
+	int dirfd = AT_FDCWD, ret = 0;
 
 	/* make sure fstree_get_path() stops at this node */
 	old_parent = root->parent;
@@ -293,37 +447,75 @@ int restore_fstree(sqfs_tree_node_t *root, int flags)
 
 	if (S_ISDIR(root->inode->base.mode)) {
 		for (n = root->children; n != NULL; n = n->next) {
-			if (create_node_dfs(n, flags))
-				return -1;
+			ret = create_node_dfs(&dirfd, n, flags);
+			if (ret)
+				break;
 		}
 	} else {
-		if (create_node_dfs(root, flags))
-			return -1;
+		ret = create_node_dfs(&dirfd, root, flags);
 	}
 
 	root->parent = old_parent;
-	return 0;
+
+	if (dirfd >= 0 && dirfd != AT_FDCWD)
+		close(dirfd);
+	return ret;
 }
 
+#ifdef _WIN32
 int update_tree_attribs(sqfs_xattr_reader_t *xattr,
-			const sqfs_tree_node_t *root, int flags)
+			sqfs_tree_node_t *root, int flags)
 {
-	const sqfs_tree_node_t *n;
+	/* ownership, permissions, timestamps and xattrs are not restored */
+	(void)xattr; (void)root; (void)flags;
+	return 0;
+}
+#else
+int update_tree_attribs(sqfs_xattr_reader_t *xattr,
+			sqfs_tree_node_t *root, int flags)
+{
+	sqfs_tree_node_t *n, *old_parent;
+	int cwd, ret = 0;
 
 	if ((flags & (UNPACK_CHOWN | UNPACK_CHMOD |
 		      UNPACK_SET_TIMES | UNPACK_SET_XATTR)) == 0) {
 		return 0;
 	}
 
+	/*
+	  Setting xattrs can change the working directory, so AT_FDCWD
+	  cannot be used to refer to the unpack root.
+	 */
+	cwd = open(".", O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+	if (cwd < 0) {
+		perror("opening unpack root directory");
+		return -1;
+	}
+
+	old_parent = root->parent;
+	root->parent = NULL;
+
 	if (S_ISDIR(root->inode->base.mode)) {
 		for (n = root->children; n != NULL; n = n->next) {
-			if (set_attribs(xattr, n, flags))
-				return -1;
+			ret = set_attribs(xattr, &cwd, n, flags);
+			if (ret)
+				break;
 		}
 	} else {
-		if (set_attribs(xattr, root, flags))
-			return -1;
+		ret = set_attribs(xattr, &cwd, root, flags);
 	}
 
-	return 0;
+	root->parent = old_parent;
+
+	if (cwd < 0)
+		return -1;
+
+	if (fchdir(cwd)) {
+		perror("returning to unpack root directory");
+		ret = -1;
+	}
+
+	close(cwd);
+	return ret;
 }
+#endif
@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * unpack_list.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "rdsquashfs.h"
+
+typedef struct {
+	sqfs_tree_node_t **nodes;
+	size_t count;
+	size_t max;
+} selection_t;
+
+static int compare_ptr(const void *lhs, const void *rhs)
+{
+	uintptr_t a = (uintptr_t)*((sqfs_tree_node_t *const *)lhs);
+	uintptr_t b = (uintptr_t)*((sqfs_tree_node_t *const *)rhs);
+
+	return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static bool is_selected(const selection_t *sel, sqfs_tree_node_t *n)
+{
+	return bsearch(&n, sel->nodes, sel->count, sizeof(sel->nodes[0]),
+		       compare_ptr) != NULL;
+}
+
+static sqfs_tree_node_t *resolve(sqfs_tree_node_t *n, const char *path)
+{
+	const char *end;
+	size_t len;
+
+	while (n != NULL && *path != '\0') {
+		end = strchr(path, '/');
+		len = end == NULL ? strlen(path) : (size_t)(end - path);
+
+		for (n = n->children; n != NULL; n = n->next) {
+			if (strncmp((const char *)n->name, path, len) == 0 &&
+			    n->name[len] == '\0') {
+				break;
+			}
+		}
+
+		path += len;
+		if (*path == '/')
+			++path;
+	}
+
+	return n;
+}
+
+static int select_path(selection_t *sel, sqfs_tree_node_t *root, char *path)
+{
+	sqfs_tree_node_t **new, *n;
+	size_t new_max;
+
+	if (canonicalize_name(path)) {
+		fprintf(stderr, "Invalid path: %s\n", path);
+		return -1;
+	}
+
+	n = resolve(root, path);
+	if (n == NULL) {
+		fprintf(stderr, "/%s: no such file or directory in image\n",
+			path);
+		return -1;
+	}
+
+	if (sel->count == sel->max) {
+		new_max = sel->max ? sel->max * 2 : 64;
+
+		new = realloc(sel->nodes, new_max * sizeof(sel->nodes[0]));
+		if (new == NULL) {
+			perror("reading list of paths to unpack");
+			return -1;
+		}
+
+		sel->nodes = new;
+		sel->max = new_max;
+	}
+
+	sel->nodes[sel->count++] = n;
+	return 0;
+}
+
+/*
+  Keeps selected nodes with everything below them, as well as the parent
+  directories leading up to them. Returns true if the node is kept.
+ */
+static bool prune(const selection_t *sel, sqfs_tree_node_t *n)
+{
+	sqfs_tree_node_t *it, **next_ptr;
+
+	if (is_selected(sel, n))
+		return true;
+
+	next_ptr = &n->children;
+
+	while (*next_ptr != NULL) {
+		it = *next_ptr;
+
+		if (prune(sel, it)) {
+			next_ptr = &it->next;
+		} else {
+			*next_ptr = it->next;
+			it->next = NULL;
+			sqfs_dir_tree_destroy(it);
+		}
+	}
+
+	return n->children != NULL;
+}
+
+int select_unpack_list(sqfs_tree_node_t *root, const char *list_file)
+{
+	selection_t sel = { NULL, 0, 0 };
+	size_t line_num = 1;
+	int ret, status = 0;
+	char *line = NULL;
+	istream_t *in;
+
+	if (strcmp(list_file, "-") == 0) {
+		in = istream_open_stdin();
+	} else {
+		in = istream_open_file(list_file);
+	}
+
+	if (in == NULL)
+		return -1;
+
+	for (;; ++line_num) {
+		free(line);
+		line = NULL;
+
+		ret = istream_get_line(in, &line, &line_num,
+				       ISTREAM_LINE_LTRIM |
+				       ISTREAM_LINE_RTRIM |
+				       ISTREAM_LINE_SKIP_EMPTY);
+		if (ret < 0) {
+			status = -1;
+			break;
+		}
+
+		if (ret > 0)
+			break;
+
+		/* report every path that is missing, not just the first */
+		if (select_path(&sel, root, line))
+			status = -1;
+	}
+
+	free(line);
+	sqfs_destroy(in);
+
+	if (status == 0) {
+		qsort(sel.nodes, sel.count, sizeof(sel.nodes[0]), compare_ptr);
+		prune(&sel, root);
+	}
+
+	free(sel.nodes);
+	return status;
+}
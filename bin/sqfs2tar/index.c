@@ -0,0 +1,199 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * index.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "sqfs2tar.h"
+
+/* amount of tar data after which a new compressor frame is started */
+#define INDEX_FRAME_SIZE (1024 * 1024)
+
+typedef struct {
+	ostream_t base;
+
+	ostream_t *wrapped;
+	sqfs_u64 *counter;
+} counter_ostream_t;
+
+static ostream_t *index_out = NULL;
+static ostream_t *comp_strm = NULL;
+
+/* offsets in the uncompressed tar stream and in the actual output */
+static sqfs_u64 tar_offset = 0;
+static sqfs_u64 out_offset = 0;
+
+static sqfs_u64 frame_tar_offset = 0;
+static sqfs_u64 frame_out_offset = 0;
+static sqfs_u64 header_offset = 0;
+
+static int counter_append(ostream_t *base, const void *data, size_t size)
+{
+	counter_ostream_t *strm = (counter_ostream_t *)base;
+
+	if (ostream_append(strm->wrapped, data, size))
+		return -1;
+
+	*(strm->counter) += size;
+	return 0;
+}
+
+static int counter_append_sparse(ostream_t *base, size_t size)
+{
+	counter_ostream_t *strm = (counter_ostream_t *)base;
+
+	if (ostream_append_sparse(strm->wrapped, size))
+		return -1;
+
+	*(strm->counter) += size;
+	return 0;
+}
+
+static int counter_flush(ostream_t *base)
+{
+	counter_ostream_t *strm = (counter_ostream_t *)base;
+
+	return ostream_flush(strm->wrapped);
+}
+
+static const char *counter_get_filename(ostream_t *base)
+{
+	counter_ostream_t *strm = (counter_ostream_t *)base;
+
+	return ostream_get_filename(strm->wrapped);
+}
+
+static void counter_destroy(sqfs_object_t *base)
+{
+	counter_ostream_t *strm = (counter_ostream_t *)base;
+
+	sqfs_destroy(strm->wrapped);
+	free(strm);
+}
+
+static ostream_t *counter_create(ostream_t *wrapped, sqfs_u64 *counter)
+{
+	counter_ostream_t *strm = calloc(1, sizeof(*strm));
+	ostream_t *base = (ostream_t *)strm;
+
+	if (strm == NULL) {
+		perror("creating output byte counter");
+		sqfs_destroy(wrapped);
+		return NULL;
+	}
+
+	strm->wrapped = wrapped;
+	strm->counter = counter;
+
+	base->append = counter_append;
+	base->append_sparse = counter_append_sparse;
+	base->flush = counter_flush;
+	base->get_filename = counter_get_filename;
+	((sqfs_object_t *)base)->destroy = counter_destroy;
+	return base;
+}
+
+static int write_escaped(const char *str)
+{
+	size_t len;
+
+	while (*str != '\0') {
+		len = strcspn(str, "\\\n");
+
+		if (len > 0 && ostream_append(index_out, str, len))
+			return -1;
+
+		str += len;
+
+		if (*str == '\\' || *str == '\n') {
+			if (ostream_append(index_out, *str == '\\' ?
+					   "\\\\" : "\\n", 2)) {
+				return -1;
+			}
+
+			++str;
+		}
+	}
+
+	return 0;
+}
+
+ostream_t *index_create(ostream_t *raw)
+{
+	index_out = ostream_open_file(index_file, OSTREAM_OPEN_OVERWRITE);
+	if (index_out == NULL) {
+		sqfs_destroy(raw);
+		return NULL;
+	}
+
+	raw = counter_create(raw, &out_offset);
+	if (raw == NULL)
+		return NULL;
+
+	if (compressor > 0) {
+		raw = ostream_compressor_create_parallel(raw, compressor,
+							 num_jobs);
+		if (raw == NULL)
+			return NULL;
+
+		comp_strm = raw;
+	}
+
+	return counter_create(raw, &tar_offset);
+}
+
+int index_begin_entry(void)
+{
+	if (index_out == NULL)
+		return 0;
+
+	if (comp_strm != NULL &&
+	    (tar_offset - frame_tar_offset) >= INDEX_FRAME_SIZE) {
+		if (ostream_compressor_end_frame(comp_strm))
+			return -1;
+
+		frame_tar_offset = tar_offset;
+		frame_out_offset = out_offset;
+	}
+
+	/* without compression, any position is a valid starting point */
+	if (comp_strm == NULL) {
+		frame_tar_offset = tar_offset;
+		frame_out_offset = out_offset;
+	}
+
+	header_offset = tar_offset;
+	return 0;
+}
+
+int index_add_entry(const char *name, sqfs_u64 size)
+{
+	if (index_out == NULL)
+		return 0;
+
+	if (ostream_printf(index_out, PRI_U64 " " PRI_U64 " " PRI_U64 " "
+			   PRI_U64 " " PRI_U64 " ", frame_out_offset,
+			   frame_tar_offset, header_offset,
+			   tar_offset, size) < 0) {
+		return -1;
+	}
+
+	if (write_escaped(name))
+		return -1;
+
+	return ostream_append(index_out, "\n", 1);
+}
+
+int index_finish(void)
+{
+	if (index_out == NULL)
+		return 0;
+
+	return ostream_flush(index_out);
+}
+
+void index_destroy(void)
+{
+	sqfs_destroy(index_out);
+	index_out = NULL;
+}
@@ -6,6 +6,10 @@
  */
 #include "sqfs2tar.h"
 
+enum {
+	IO_STATS_OPTION = 1,
+};
+
 static struct option long_opts[] = {
 	{ "compressor", required_argument, NULL, 'c' },
 	{ "subdir", required_argument, NULL, 'd' },
@@ -14,12 +18,16 @@ static struct option long_opts[] = {
 	{ "no-skip", no_argument, NULL, 's' },
 	{ "no-xattr", no_argument, NULL, 'X' },
 	{ "no-hard-links", no_argument, NULL, 'L' },
+	{ "num-jobs", required_argument, NULL, 'j' },
+	{ "prefetch", required_argument, NULL, 'P' },
+	{ "index", required_argument, NULL, 'I' },
+	{ "io-stats", no_argument, NULL, IO_STATS_OPTION },
 	{ "help", no_argument, NULL, 'h' },
 	{ "version", no_argument, NULL, 'V' },
 	{ NULL, 0, NULL, 0 },
 };
 
-static const char *short_opts = "c:d:kr:sXLhV";
+static const char *short_opts = "c:d:kr:sXLj:P:I:hV";
 
 static const char *usagestr =
 "Usage: sqfs2tar [OPTIONS...] <sqfsfile>\n"
@@ -31,6 +39,18 @@ static const char *usagestr =
 "\n"
 "  --compressor, -c <name>   If set, stream compress the resulting tarball.\n"
 "                            By default, the tarball is uncompressed.\n"
+"  --num-jobs, -j <count>    Number of threads to use for compressing the\n"
+"                            tarball. Defaults to 1.\n"
+"  --prefetch, -P <count>    Number of threads that uncompress file data\n"
+"                            ahead of the tar writer. Defaults to 0, i.e.\n"
+"                            file data is uncompressed on the fly.\n"
+"  --index, -I <file>        Write an index to the given file that maps each\n"
+"                            archive member to its header and data offset\n"
+"                            and to the offset of the compressor frame that\n"
+"                            contains it.\n"
+"  --io-stats                Print statistics about all reads from the\n"
+"                            image to stderr when done, including request\n"
+"                            sizes, latencies and seek distances.\n"
 "\n"
 "  --subdir, -d <dir>        Unpack the given sub directory instead of the\n"
 "                            filesystem root. Can be specified more than\n"
@@ -74,6 +94,10 @@ char **subdirs = NULL;
 size_t num_subdirs = 0;
 static size_t max_subdirs = 0;
 int compressor = 0;
+size_t num_jobs = 1;
+size_t num_prefetch = 0;
+const char *index_file = NULL;
+bool io_stats = false;
 
 const char *filename = NULL;
 
@@ -83,6 +107,8 @@ void process_args(int argc, char **argv)
 	const char *name;
 	int i, ret;
 	char **new;
+	long jobs, prefetch;
+	char *end;
 
 	for (;;) {
 		i = getopt_long(argc, argv, short_opts, long_opts, NULL);
@@ -160,6 +186,30 @@ void process_args(int argc, char **argv)
 		case 'L':
 			no_links = true;
 			break;
+		case 'j':
+			jobs = strtol(optarg, &end, 0);
+			if (end == optarg || *end != '\0' || jobs < 1) {
+				fprintf(stderr, "Invalid number of jobs '%s'.\n",
+					optarg);
+				goto fail_arg;
+			}
+			num_jobs = jobs;
+			break;
+		case 'P':
+			prefetch = strtol(optarg, &end, 0);
+			if (end == optarg || *end != '\0' || prefetch < 0) {
+				fprintf(stderr, "Invalid number of prefetch "
+					"threads '%s'.\n", optarg);
+				goto fail_arg;
+			}
+			num_prefetch = prefetch;
+			break;
+		case 'I':
+			index_file = optarg;
+			break;
+		case IO_STATS_OPTION:
+			io_stats = true;
+			break;
 		case 'h':
 			fputs(usagestr, stdout);
 
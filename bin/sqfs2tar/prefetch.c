@@ -0,0 +1,388 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * prefetch.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "sqfs2tar.h"
+
+/* upper bound for the uncompressed data waiting to be written */
+#define MAX_WINDOW (64 * 1024 * 1024)
+
+/* pieces of small files that are batched into a single job */
+#define MAX_JOB_ITEMS (64)
+
+#define ITEM_FRAGMENT (0xFFFFFFFF)
+
+typedef struct {
+	const sqfs_tree_node_t *node;
+	sqfs_u32 index;
+	bool sparse;
+	int status;
+
+	size_t size;
+	sqfs_u8 *data;
+} pf_item_t;
+
+typedef struct {
+	size_t count;
+	size_t bytes;
+	pf_item_t items[MAX_JOB_ITEMS];
+} pf_job_t;
+
+/*
+  Every worker uses a copy of the image file, since not all sqfs_file_t
+  implementations can handle concurrent reads through the same handle.
+ */
+typedef struct {
+	sqfs_file_t *file;
+	sqfs_compressor_t *cmp;
+	sqfs_data_reader_t *data;
+} pf_worker_t;
+
+struct prefetch_t {
+	thread_pool_t *pool;
+	pf_worker_t *workers;
+	size_t num_workers;
+
+	/* position of the next item to submit, in tar output order */
+	const sqfs_tree_node_t *cursor;
+	size_t cursor_item;
+	size_t in_flight;
+
+	/* the job the writer is currently taking items from */
+	pf_job_t *current;
+	size_t current_item;
+};
+
+static bool is_file(const sqfs_tree_node_t *n)
+{
+	return n->inode->base.type == SQFS_INODE_FILE ||
+	       n->inode->base.type == SQFS_INODE_EXT_FILE;
+}
+
+/* data blocks, followed by the fragment if there is a tail end */
+static size_t item_count(const sqfs_tree_node_t *n)
+{
+	size_t count = sqfs_inode_get_file_block_count(n->inode);
+	sqfs_u64 filesz;
+
+	sqfs_inode_get_file_size(n->inode, &filesz);
+
+	if (filesz > (sqfs_u64)count * super.block_size)
+		count += 1;
+
+	return count;
+}
+
+/* the same pre-order walk that write_tree_dfs does */
+static const sqfs_tree_node_t *next_node(const sqfs_tree_node_t *n)
+{
+	if (n->children != NULL)
+		return n->children;
+
+	while (n != NULL && n->next == NULL)
+		n = n->parent;
+
+	return n == NULL ? NULL : n->next;
+}
+
+static void job_add_item(prefetch_t *pf, pf_job_t *job)
+{
+	const sqfs_tree_node_t *n = pf->cursor;
+	pf_item_t *it = job->items + job->count++;
+	sqfs_u64 filesz, offset;
+
+	sqfs_inode_get_file_size(n->inode, &filesz);
+
+	offset = (sqfs_u64)pf->cursor_item * super.block_size;
+	filesz -= offset;
+
+	it->node = n;
+	it->size = filesz < super.block_size ? filesz : super.block_size;
+
+	if (pf->cursor_item < sqfs_inode_get_file_block_count(n->inode)) {
+		it->index = pf->cursor_item;
+		it->sparse = SQFS_IS_SPARSE_BLOCK(n->inode->extra[it->index]);
+	} else {
+		it->index = ITEM_FRAGMENT;
+	}
+
+	if (!it->sparse)
+		job->bytes += it->size;
+
+	pf->cursor_item += 1;
+}
+
+/*
+  Full blocks get a job of their own, small files and sparse blocks are
+  grouped, so a worker that uncompresses a fragment block can hand out
+  the tail ends of several files that are stored in it.
+ */
+static pf_job_t *next_job(prefetch_t *pf)
+{
+	pf_job_t *job = NULL;
+
+	while (pf->cursor != NULL) {
+		if (!is_file(pf->cursor) ||
+		    pf->cursor_item >= item_count(pf->cursor)) {
+			pf->cursor = next_node(pf->cursor);
+			pf->cursor_item = 0;
+			continue;
+		}
+
+		if (job == NULL) {
+			job = calloc(1, sizeof(*job));
+			if (job == NULL)
+				return NULL;
+		}
+
+		job_add_item(pf, job);
+
+		if (job->count == MAX_JOB_ITEMS ||
+		    job->bytes >= super.block_size) {
+			break;
+		}
+	}
+
+	return job;
+}
+
+static void job_free(pf_job_t *job)
+{
+	size_t i;
+
+	if (job != NULL) {
+		for (i = 0; i < job->count; ++i)
+			free(job->items[i].data);
+	}
+
+	free(job);
+}
+
+static int prefetch_worker(void *user, void *ptr)
+{
+	sqfs_data_reader_t *data = ((pf_worker_t *)user)->data;
+	const sqfs_inode_generic_t *inode;
+	pf_job_t *job = ptr;
+	pf_item_t *it;
+	size_t i;
+
+	for (i = 0; i < job->count; ++i) {
+		it = job->items + i;
+		inode = it->node->inode;
+
+		if (it->sparse)
+			continue;
+
+		if (it->index == ITEM_FRAGMENT) {
+			it->status = sqfs_data_reader_get_fragment(data, inode,
+								   &it->size,
+								   &it->data);
+		} else {
+			it->status = sqfs_data_reader_get_block(data, inode,
+								it->index,
+								&it->size,
+								&it->data);
+		}
+	}
+
+	return 0;
+}
+
+static int fill_pipeline(prefetch_t *pf)
+{
+	pf_job_t *job;
+
+	while (pf->cursor != NULL && pf->in_flight < MAX_WINDOW) {
+		job = next_job(pf);
+		if (job == NULL) {
+			if (pf->cursor == NULL)
+				break;
+
+			perror("allocating file data prefetch job");
+			return -1;
+		}
+
+		if (pf->pool->submit(pf->pool, job) != 0) {
+			fputs("Error submitting file data prefetch job\n",
+			      stderr);
+			job_free(job);
+			return -1;
+		}
+
+		pf->in_flight += job->bytes;
+	}
+
+	return 0;
+}
+
+static pf_item_t *next_item(prefetch_t *pf)
+{
+	while (pf->current == NULL ||
+	       pf->current_item >= pf->current->count) {
+		if (pf->current != NULL) {
+			pf->in_flight -= pf->current->bytes;
+			job_free(pf->current);
+		}
+
+		pf->current_item = 0;
+		pf->current = NULL;
+
+		if (fill_pipeline(pf))
+			return NULL;
+
+		pf->current = pf->pool->dequeue(pf->pool);
+		if (pf->current == NULL) {
+			fputs("Internal error: file data prefetch pipeline "
+			      "ran dry\n", stderr);
+			return NULL;
+		}
+	}
+
+	return pf->current->items + pf->current_item++;
+}
+
+int prefetch_dump(prefetch_t *pf, const char *name,
+		  const sqfs_tree_node_t *n, ostream_t *fp)
+{
+	size_t i, count = item_count(n);
+	pf_item_t *it;
+	int ret;
+
+	for (i = 0; i < count; ++i) {
+		/* drop data of files that were skipped or hard linked */
+		do {
+			it = next_item(pf);
+			if (it == NULL)
+				return -1;
+		} while (it->node != n);
+
+		if (it->status != 0) {
+			sqfs_perror(name, it->index == ITEM_FRAGMENT ?
+				    "reading fragment block" :
+				    "reading data block", it->status);
+			return -1;
+		}
+
+		if (it->sparse) {
+			ret = ostream_append_sparse(fp, it->size);
+		} else {
+			ret = ostream_append(fp, it->data, it->size);
+		}
+
+		free(it->data);
+		it->data = NULL;
+
+		if (ret)
+			return -1;
+	}
+
+	return 0;
+}
+
+prefetch_t *prefetch_create(const sqfs_tree_node_t *root, size_t num_workers)
+{
+	sqfs_compressor_config_t cfg;
+	pf_worker_t *w;
+	prefetch_t *pf;
+	size_t i;
+	int ret;
+
+	pf = calloc(1, sizeof(*pf));
+	if (pf == NULL)
+		goto fail_errno;
+
+	pf->pool = thread_pool_create(num_workers, prefetch_worker);
+	if (pf->pool == NULL) {
+		fputs("Error creating file data prefetch thread pool\n",
+		      stderr);
+		goto fail;
+	}
+
+	pf->num_workers = pf->pool->get_worker_count(pf->pool);
+	pf->workers = calloc(pf->num_workers, sizeof(pf->workers[0]));
+	if (pf->workers == NULL)
+		goto fail_errno;
+
+	sqfs_compressor_config_init(&cfg, super.compression_id,
+				    super.block_size,
+				    SQFS_COMP_FLAG_UNCOMPRESS);
+
+	for (i = 0; i < pf->num_workers; ++i) {
+		w = pf->workers + i;
+
+		w->file = sqfs_copy(file);
+		if (w->file == NULL) {
+			perror("duplicating squashfs image handle");
+			goto fail;
+		}
+
+		ret = sqfs_compressor_create(&cfg, &w->cmp);
+#ifdef WITH_LZO
+		if (super.compression_id == SQFS_COMP_LZO && ret != 0)
+			ret = lzo_compressor_create(&cfg, &w->cmp);
+#endif
+		if (ret != 0) {
+			sqfs_perror(filename, "creating compressor", ret);
+			goto fail;
+		}
+
+		w->data = sqfs_data_reader_create(w->file, super.block_size,
+						  w->cmp, 0);
+		if (w->data == NULL) {
+			sqfs_perror(filename, "creating data reader",
+				    SQFS_ERROR_ALLOC);
+			goto fail;
+		}
+
+		ret = sqfs_data_reader_load_fragment_table(w->data, &super);
+		if (ret) {
+			sqfs_perror(filename, "loading fragment table", ret);
+			goto fail;
+		}
+
+		pf->pool->set_worker_ptr(pf->pool, i, w);
+	}
+
+	pf->cursor = root;
+	return pf;
+fail_errno:
+	perror("creating file data prefetcher");
+fail:
+	prefetch_destroy(pf);
+	return NULL;
+}
+
+void prefetch_destroy(prefetch_t *pf)
+{
+	pf_job_t *job;
+	size_t i;
+
+	if (pf == NULL)
+		return;
+
+	if (pf->pool != NULL) {
+		while ((job = pf->pool->dequeue(pf->pool)) != NULL)
+			job_free(job);
+
+		pf->pool->destroy(pf->pool);
+	}
+
+	if (pf->workers != NULL) {
+		for (i = 0; i < pf->num_workers; ++i) {
+			if (pf->workers[i].data != NULL)
+				sqfs_destroy(pf->workers[i].data);
+
+			if (pf->workers[i].cmp != NULL)
+				sqfs_destroy(pf->workers[i].cmp);
+
+			if (pf->workers[i].file != NULL)
+				sqfs_destroy(pf->workers[i].file);
+		}
+	}
+
+	job_free(pf->current);
+	free(pf->workers);
+	free(pf);
+}
@@ -10,8 +10,8 @@ sqfs_xattr_reader_t *xr;
 sqfs_data_reader_t *data;
 sqfs_super_t super;
 ostream_t *out_file = NULL;
-
-static sqfs_file_t *file;
+int img_fd = -1;
+sqfs_file_t *file;
 
 char *assemble_tar_path(char *name, bool is_dir)
 {
@@ -123,8 +123,14 @@ int main(int argc, char **argv)
 		goto out_dirs;
 	}
 
-	if (compressor > 0) {
-		out_file = ostream_compressor_create(out_file, compressor);
+	if (index_file != NULL) {
+		out_file = index_create(out_file);
+		if (out_file == NULL)
+			goto out_ostrm;
+	} else if (compressor > 0) {
+		out_file = ostream_compressor_create_parallel(out_file,
+							      compressor,
+							      num_jobs);
 		if (out_file == NULL)
 			goto out_dirs;
 	}
@@ -135,12 +141,20 @@ int main(int argc, char **argv)
 		goto out_ostrm;
 	}
 
+	if (io_stats && io_stats_wrap(&file))
+		goto out_fd;
+
 	ret = sqfs_super_read(&super, file);
 	if (ret) {
 		sqfs_perror(filename, "reading super block", ret);
 		goto out_fd;
 	}
 
+#ifndef _WIN32
+	/* optional, for copying uncompressed blocks without a buffer */
+	img_fd = open(filename, O_RDONLY);
+#endif
+
 	sqfs_compressor_config_init(&cfg, super.compression_id,
 				    super.block_size,
 				    SQFS_COMP_FLAG_UNCOMPRESS);
@@ -246,6 +260,9 @@ int main(int argc, char **argv)
 	if (ostream_flush(out_file))
 		goto out;
 
+	if (index_finish())
+		goto out;
+
 	status = EXIT_SUCCESS;
 out:
 	if (root != NULL)
@@ -262,9 +279,13 @@ out_id:
 out_cmp:
 	sqfs_destroy(cmp);
 out_fd:
+	if (img_fd >= 0)
+		close(img_fd);
+	io_stats_print(file, filename);
 	sqfs_destroy(file);
 out_ostrm:
 	sqfs_destroy(out_file);
+	index_destroy();
 out_dirs:
 	for (i = 0; i < num_subdirs; ++i)
 		free(subdirs[i]);
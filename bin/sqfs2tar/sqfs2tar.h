@@ -10,6 +10,7 @@
 #include "config.h"
 #include "common.h"
 #include "tar.h"
+#include "threadpool.h"
 
 #include <getopt.h>
 #include <string.h>
@@ -29,6 +30,10 @@ extern char *root_becomes;
 extern char **subdirs;
 extern size_t num_subdirs;
 extern int compressor;
+extern size_t num_jobs;
+extern size_t num_prefetch;
+extern const char *index_file;
+extern bool io_stats;
 
 extern const char *filename;
 
@@ -38,7 +43,9 @@ void process_args(int argc, char **argv);
 extern sqfs_xattr_reader_t *xr;
 extern sqfs_data_reader_t *data;
 extern sqfs_super_t super;
+extern sqfs_file_t *file;
 extern ostream_t *out_file;
+extern int img_fd;
 
 char *assemble_tar_path(char *name, bool is_dir);
 
@@ -49,4 +56,25 @@ int get_xattrs(const char *name, const sqfs_inode_generic_t *inode,
 /* write_tree.c */
 int write_tree(const sqfs_tree_node_t *n);
 
+/* prefetch.c */
+typedef struct prefetch_t prefetch_t;
+
+prefetch_t *prefetch_create(const sqfs_tree_node_t *root, size_t num_workers);
+
+int prefetch_dump(prefetch_t *pf, const char *name,
+		  const sqfs_tree_node_t *n, ostream_t *fp);
+
+void prefetch_destroy(prefetch_t *pf);
+
+/* index.c */
+ostream_t *index_create(ostream_t *raw);
+
+int index_begin_entry(void);
+
+int index_add_entry(const char *name, sqfs_u64 size);
+
+int index_finish(void);
+
+void index_destroy(void);
+
 #endif /* SQFS2TAR_H */
@@ -8,6 +8,7 @@
 
 static sqfs_hard_link_t *links = NULL;
 static unsigned int record_counter;
+static prefetch_t *prefetch = NULL;
 
 static sqfs_hard_link_t *find_hard_link(const char *name, sqfs_u32 inum)
 {
@@ -76,13 +77,27 @@ static int write_tree_dfs(const sqfs_tree_node_t *n)
 
 		lnk = find_hard_link(name, n->inode->base.inode_number);
 		if (lnk != NULL) {
-			ret = write_hard_link(out_file, &sb, name, lnk->target,
-					      record_counter++);
+			ret = index_begin_entry();
+
+			if (ret == 0) {
+				ret = write_hard_link(out_file, &sb, name,
+						      lnk->target,
+						      record_counter++);
+			}
+
+			if (ret == 0)
+				ret = index_add_entry(name, 0);
+
 			free(name);
 			return ret;
 		}
 	}
 
+	if (index_begin_entry()) {
+		free(name);
+		return -1;
+	}
+
 	if (!no_xattr) {
 		if (get_xattrs(name, n->inode, &xattr)) {
 			free(name);
@@ -103,9 +118,21 @@ static int write_tree_dfs(const sqfs_tree_node_t *n)
 		return -1;
 	}
 
+	if (index_add_entry(name, S_ISREG(sb.st_mode) ? sb.st_size : 0)) {
+		free(name);
+		return -1;
+	}
+
 	if (S_ISREG(sb.st_mode)) {
-		if (sqfs_data_reader_dump(name, data, n->inode, out_file,
-					  super.block_size)) {
+		if (prefetch != NULL) {
+			ret = prefetch_dump(prefetch, name, n, out_file);
+		} else {
+			ret = sqfs_data_reader_dump(name, data, n->inode,
+						    out_file, super.block_size,
+						    img_fd);
+		}
+
+		if (ret) {
 			free(name);
 			return -1;
 		}
@@ -152,7 +179,16 @@ int write_tree(const sqfs_tree_node_t *n)
 		}
 	}
 
+	if (num_prefetch > 0) {
+		prefetch = prefetch_create(n, num_prefetch);
+		if (prefetch == NULL)
+			goto out_links;
+	}
+
 	status = write_tree_dfs(n);
+
+	prefetch_destroy(prefetch);
+	prefetch = NULL;
 out_links:
 	while (links != NULL) {
 		lnk = links;
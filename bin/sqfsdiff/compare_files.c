@@ -9,60 +9,315 @@
 static unsigned char old_buf[MAX_WINDOW_SIZE];
 static unsigned char new_buf[MAX_WINDOW_SIZE];
 
-static int read_blob(const char *prefix, const char *path,
-		     sqfs_data_reader_t *rd, const sqfs_inode_generic_t *inode,
-		     void *buffer, sqfs_u64 offset, size_t size)
+/* used for comparing on the main thread */
+static content_cmp_t main_cmp;
+static bool main_cmp_ready = false;
+
+static int read_blob(const content_src_t *src, const char *path,
+		     const sqfs_inode_generic_t *inode,
+		     sqfs_u64 offset, size_t size)
 {
 	ssize_t ret;
 
-	ret = sqfs_data_reader_read(rd, inode, offset, buffer, size);
+	ret = sqfs_data_reader_read(src->data, inode, offset,
+				    src->buffer, size);
 	ret = (ret < 0 || (size_t)ret < size) ? -1 : 0;
 
 	if (ret) {
 		fprintf(stderr, "Failed to read %s from %s\n",
-			path, prefix);
+			path, src->image);
 		return -1;
 	}
 
 	return 0;
 }
 
-int compare_files(sqfsdiff_t *sd, const sqfs_inode_generic_t *old,
-		  const sqfs_inode_generic_t *new, const char *path)
+static int read_raw(const content_src_t *src, const char *path,
+		    sqfs_u64 offset, size_t size)
 {
-	sqfs_u64 offset, diff, oldsz, newsz;
-	int status = 0, ret;
+	int ret = src->file->read_at(src->file, offset, src->buffer, size);
 
-	sqfs_inode_get_file_size(old, &oldsz);
-	sqfs_inode_get_file_size(new, &newsz);
+	if (ret) {
+		fprintf(stderr, "Failed to read %s from %s\n",
+			path, src->image);
+		return -1;
+	}
 
-	if (oldsz != newsz)
-		goto out_different;
+	return 0;
+}
 
-	if (sd->compare_flags & COMPARE_NO_CONTENTS)
+static int compare_unpacked(content_cmp_t *cmp,
+			    const sqfs_inode_generic_t *old,
+			    const sqfs_inode_generic_t *new, const char *path,
+			    size_t index)
+{
+	size_t old_size, new_size;
+	sqfs_u8 *old_blk, *new_blk;
+	int ret;
+
+	ret = sqfs_data_reader_get_block(cmp->old.data, old, index,
+					 &old_size, &old_blk);
+	if (ret) {
+		fprintf(stderr, "Failed to read %s from %s\n",
+			path, cmp->old.image);
+		return -1;
+	}
+
+	ret = sqfs_data_reader_get_block(cmp->new.data, new, index,
+					 &new_size, &new_blk);
+	if (ret) {
+		fprintf(stderr, "Failed to read %s from %s\n",
+			path, cmp->new.image);
+		free(old_blk);
+		return -1;
+	}
+
+	ret = (old_size != new_size ||
+	       memcmp(old_blk, new_blk, old_size) != 0) ? 1 : 0;
+
+	free(old_blk);
+	free(new_blk);
+	return ret;
+}
+
+static sqfs_u32 get_frag_index(const sqfs_inode_generic_t *inode,
+				size_t block_size, sqfs_u32 *offset)
+{
+	sqfs_u32 frag_idx;
+	sqfs_u64 size;
+
+	sqfs_inode_get_frag_location(inode, &frag_idx, offset);
+	sqfs_inode_get_file_size(inode, &size);
+
+	if ((size % block_size) == 0 || *offset >= block_size)
+		return 0xFFFFFFFF;
+
+	return frag_idx;
+}
+
+static int compare_frag_blocks(content_cmp_t *cmp, sqfs_u32 old_idx,
+			       sqfs_u32 new_idx, bool *equal)
+{
+	sqfs_fragment_t old_ent, new_ent;
+	sqfs_u32 size;
+	int ret;
+
+	if (old_idx == cmp->last_old_frag && new_idx == cmp->last_new_frag) {
+		*equal = cmp->last_frag_equal;
 		return 0;
+	}
+
+	ret = sqfs_frag_table_lookup(cmp->old.frag_tbl, old_idx, &old_ent);
+	if (ret) {
+		sqfs_perror(cmp->old.image, "looking up fragment", ret);
+		return -1;
+	}
+
+	ret = sqfs_frag_table_lookup(cmp->new.frag_tbl, new_idx, &new_ent);
+	if (ret) {
+		sqfs_perror(cmp->new.image, "looking up fragment", ret);
+		return -1;
+	}
+
+	size = SQFS_ON_DISK_BLOCK_SIZE(old_ent.size);
+	*equal = false;
+
+	if (old_ent.size == new_ent.size && size > 0 &&
+	    size <= cmp->block_size) {
+		if (read_raw(&cmp->old, "fragment block",
+			     old_ent.start_offset, size)) {
+			return -1;
+		}
+
+		if (read_raw(&cmp->new, "fragment block",
+			     new_ent.start_offset, size)) {
+			return -1;
+		}
+
+		*equal = memcmp(cmp->old.buffer, cmp->new.buffer, size) == 0;
+	}
+
+	cmp->last_old_frag = old_idx;
+	cmp->last_new_frag = new_idx;
+	cmp->last_frag_equal = *equal;
+	return 0;
+}
+
+/*
+  With the same compressor and block size on both sides, blocks with the
+  same on-disk size and the same raw bytes hold the same data. Only blocks
+  that differ in their stored form have to be uncompressed and compared.
+  The same goes for the tail ends in fragment blocks. Returns the number
+  of bytes that were found to be identical in *done.
+ */
+static int compare_blocks(content_cmp_t *cmp, const sqfs_inode_generic_t *old,
+			  const sqfs_inode_generic_t *new, const char *path,
+			  sqfs_u64 *done)
+{
+	sqfs_u32 old_idx, new_idx, old_frag_off, new_frag_off;
+	sqfs_u64 old_off, new_off, filesz;
+	sqfs_u32 old_sz, new_sz;
+	size_t i, count;
+	bool equal;
+	int ret;
+
+	sqfs_inode_get_file_size(old, &filesz);
+	sqfs_inode_get_file_block_start(old, &old_off);
+	sqfs_inode_get_file_block_start(new, &new_off);
 
-	for (offset = 0; offset < oldsz; offset += diff) {
-		diff = oldsz - offset;
+	count = sqfs_inode_get_file_block_count(old);
+	if (sqfs_inode_get_file_block_count(new) < count)
+		count = sqfs_inode_get_file_block_count(new);
+
+	for (i = 0; i < count; ++i) {
+		old_sz = old->extra[i];
+		new_sz = new->extra[i];
+
+		if (SQFS_ON_DISK_BLOCK_SIZE(old_sz) > cmp->block_size) {
+			/* broken, let the data reader complain about it */
+			ret = 1;
+		} else if (old_sz == new_sz) {
+			if (SQFS_IS_SPARSE_BLOCK(old_sz))
+				continue;
+
+			if (read_raw(&cmp->old, path, old_off,
+				     SQFS_ON_DISK_BLOCK_SIZE(old_sz))) {
+				return -1;
+			}
+
+			if (read_raw(&cmp->new, path, new_off,
+				     SQFS_ON_DISK_BLOCK_SIZE(new_sz))) {
+				return -1;
+			}
+
+			ret = memcmp(cmp->old.buffer, cmp->new.buffer,
+				     SQFS_ON_DISK_BLOCK_SIZE(old_sz)) != 0;
+		} else {
+			ret = 1;
+		}
+
+		if (ret)
+			ret = compare_unpacked(cmp, old, new, path, i);
+
+		if (ret)
+			return ret;
+
+		old_off += SQFS_ON_DISK_BLOCK_SIZE(old_sz);
+		new_off += SQFS_ON_DISK_BLOCK_SIZE(new_sz);
+	}
+
+	*done = (sqfs_u64)count * cmp->block_size;
+	if (*done >= filesz) {
+		*done = filesz;
+		return 0;
+	}
+
+	/* the tail ends are at the same spot of identical fragment blocks */
+	if (count != sqfs_inode_get_file_block_count(old) ||
+	    count != sqfs_inode_get_file_block_count(new)) {
+		return 0;
+	}
+
+	old_idx = get_frag_index(old, cmp->block_size, &old_frag_off);
+	new_idx = get_frag_index(new, cmp->block_size, &new_frag_off);
+
+	if (old_idx == 0xFFFFFFFF || new_idx == 0xFFFFFFFF ||
+	    old_frag_off != new_frag_off) {
+		return 0;
+	}
+
+	if (compare_frag_blocks(cmp, old_idx, new_idx, &equal))
+		return -1;
+
+	if (equal)
+		*done = filesz;
+
+	return 0;
+}
+
+void content_cmp_init(content_cmp_t *cmp, const sqfsdiff_t *sd)
+{
+	memset(cmp, 0, sizeof(*cmp));
+
+	cmp->old.image = sd->old_path;
+	cmp->old.file = sd->sqfs_old.file;
+	cmp->old.data = sd->sqfs_old.data;
+	cmp->old.frag_tbl = sd->sqfs_old.frag_tbl;
+
+	cmp->new.image = sd->new_path;
+	cmp->new.file = sd->sqfs_new.file;
+	cmp->new.data = sd->sqfs_new.data;
+	cmp->new.frag_tbl = sd->sqfs_new.frag_tbl;
+
+	cmp->block_size = sd->sqfs_old.super.block_size;
+	cmp->raw_blocks = sd->raw_blocks;
+	cmp->last_old_frag = 0xFFFFFFFF;
+	cmp->last_new_frag = 0xFFFFFFFF;
+}
+
+int compare_contents(content_cmp_t *cmp, const sqfs_inode_generic_t *old,
+		     const sqfs_inode_generic_t *new, const char *path)
+{
+	sqfs_u64 offset = 0, diff, filesz;
+	int ret;
+
+	sqfs_inode_get_file_size(old, &filesz);
+
+	if (cmp->raw_blocks) {
+		ret = compare_blocks(cmp, old, new, path, &offset);
+		if (ret != 0)
+			return ret;
+	}
+
+	for (; offset < filesz; offset += diff) {
+		diff = filesz - offset;
 
 		if (diff > MAX_WINDOW_SIZE)
 			diff = MAX_WINDOW_SIZE;
 
-		ret = read_blob(sd->old_path, path,
-				sd->sqfs_old.data, old, old_buf, offset, diff);
-		if (ret)
+		if (read_blob(&cmp->old, path, old, offset, diff))
 			return -1;
 
-		ret = read_blob(sd->new_path, path,
-				sd->sqfs_new.data, new, new_buf, offset, diff);
-		if (ret)
+		if (read_blob(&cmp->new, path, new, offset, diff))
 			return -1;
 
-		if (memcmp(old_buf, new_buf, diff) != 0)
-			goto out_different;
+		if (memcmp(cmp->old.buffer, cmp->new.buffer, diff) != 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+int compare_files(sqfsdiff_t *sd, const sqfs_inode_generic_t *old,
+		  const sqfs_inode_generic_t *new, const char *path)
+{
+	sqfs_u64 oldsz, newsz;
+	int ret;
+
+	sqfs_inode_get_file_size(old, &oldsz);
+	sqfs_inode_get_file_size(new, &newsz);
+
+	if (oldsz != newsz)
+		goto out_different;
+
+	if (sd->compare_flags & COMPARE_NO_CONTENTS)
+		return 0;
+
+	if (sd->pool != NULL) {
+		ret = cmp_pool_result(sd->pool, old, new);
+	} else {
+		if (!main_cmp_ready) {
+			content_cmp_init(&main_cmp, sd);
+			main_cmp.old.buffer = old_buf;
+			main_cmp.new.buffer = new_buf;
+			main_cmp_ready = true;
+		}
+
+		ret = compare_contents(&main_cmp, old, new, path);
 	}
 
-	return status;
+	if (ret <= 0)
+		return ret;
 out_different:
 	if (sd->compare_flags & COMPARE_EXTRACT_FILES) {
 		if (extract_files(sd, old, new, path))
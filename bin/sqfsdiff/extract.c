@@ -28,7 +28,7 @@ static int extract(sqfs_data_reader_t *data, const sqfs_inode_generic_t *inode,
 		return -1;
 	}
 
-	if (sqfs_data_reader_dump(path, data, inode, fp, block_size)) {
+	if (sqfs_data_reader_dump(path, data, inode, fp, block_size, -1)) {
 		sqfs_destroy(fp);
 		return -1;
 	}
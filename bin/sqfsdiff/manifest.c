@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * manifest.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "sqfsdiff.h"
+
+/* print omitted entries the same way as compare_dir_entries does */
+static const char *omitted_path(const manifest_entry_t *ent)
+{
+	const char *path = ent->path;
+
+	while (*path == '/')
+		++path;
+
+	return path;
+}
+
+static int compare_entry(sqfsdiff_t *sd, const manifest_entry_t *a,
+			 const manifest_entry_t *b)
+{
+	const char *path = a->path;
+	int status = 0;
+
+	if ((a->mode & S_IFMT) != (b->mode & S_IFMT)) {
+		fprintf(stdout, "%s has a different type\n", path);
+		return 1;
+	}
+
+	if (!(sd->compare_flags & COMPARE_NO_PERM)) {
+		if ((a->mode & ~S_IFMT) != (b->mode & ~S_IFMT)) {
+			fprintf(stdout, "%s has different permissions\n",
+				path);
+			status = 1;
+		}
+	}
+
+	if (!(sd->compare_flags & COMPARE_NO_OWNER)) {
+		if (a->uid != b->uid || a->gid != b->gid) {
+			fprintf(stdout, "%s has different ownership\n", path);
+			status = 1;
+		}
+	}
+
+	if (sd->compare_flags & COMPARE_TIMESTAMP) {
+		if (a->mtime != b->mtime) {
+			fprintf(stdout, "%s has a different timestamp\n", path);
+			status = 1;
+		}
+	}
+
+	switch (a->mode & S_IFMT) {
+	case S_IFCHR:
+	case S_IFBLK:
+		if (a->devno != b->devno) {
+			fprintf(stdout, "%s has different device number\n",
+				path);
+			status = 1;
+		}
+		break;
+	case S_IFLNK:
+		if (strcmp(a->target, b->target) != 0) {
+			fprintf(stdout, "%s has a different link target\n",
+				path);
+			status = 1;
+		}
+		break;
+	case S_IFREG:
+		if (a->size != b->size ||
+		    (!(sd->compare_flags & COMPARE_NO_CONTENTS) &&
+		     memcmp(a->hash, b->hash, sizeof(a->hash)) != 0)) {
+			fprintf(stdout, "regular file %s differs\n", path);
+			status = 1;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return status;
+}
+
+static int compare_lists(sqfsdiff_t *sd, const manifest_t *old,
+			 const manifest_t *new)
+{
+	size_t i = 0, j = 0;
+	int ret, status = 0;
+
+	while (i < old->count || j < new->count) {
+		if (i < old->count && j < new->count) {
+			ret = strcmp(old->entries[i].path,
+				     new->entries[j].path);
+		} else {
+			ret = i < old->count ? -1 : 1;
+		}
+
+		if (ret < 0) {
+			fprintf(stdout, "< %s\n",
+				omitted_path(old->entries + i++));
+			status = 1;
+		} else if (ret > 0) {
+			fprintf(stdout, "> %s\n",
+				omitted_path(new->entries + j++));
+			status = 1;
+		} else {
+			if (compare_entry(sd, old->entries + i,
+					  new->entries + j)) {
+				status = 1;
+			}
+
+			++i;
+			++j;
+		}
+	}
+
+	return status;
+}
+
+int compare_manifest(sqfsdiff_t *sd)
+{
+	manifest_t *old, *new;
+	istream_t *in;
+	int ret;
+
+	in = istream_open_file(sd->manifest_path);
+	if (in == NULL)
+		return -1;
+
+	old = manifest_read(in);
+	sqfs_destroy(in);
+
+	if (old == NULL)
+		return -1;
+
+	new = manifest_from_tree(sd->new_path, sd->sqfs_new.file,
+				 sd->sqfs_new.cmp, &sd->sqfs_new.super,
+				 sd->sqfs_new.root, sd->num_jobs);
+	if (new == NULL) {
+		manifest_destroy(old);
+		return -1;
+	}
+
+	manifest_sort(old);
+	manifest_sort(new);
+
+	ret = compare_lists(sd, old, new);
+
+	manifest_destroy(new);
+	manifest_destroy(old);
+	return ret;
+}
@@ -6,9 +6,14 @@
  */
 #include "sqfsdiff.h"
 
+enum {
+	IO_STATS_OPTION = 1,
+};
+
 static struct option long_opts[] = {
 	{ "old", required_argument, NULL, 'a' },
 	{ "new", required_argument, NULL, 'b' },
+	{ "manifest", required_argument, NULL, 'm' },
 	{ "no-owner", no_argument, NULL, 'O' },
 	{ "no-permissions", no_argument, NULL, 'P' },
 	{ "no-contents", no_argument, NULL, 'C' },
@@ -16,15 +21,19 @@ static struct option long_opts[] = {
 	{ "inode-num", no_argument, NULL, 'I' },
 	{ "super", no_argument, NULL, 'S' },
 	{ "extract", required_argument, NULL, 'e' },
+	{ "num-jobs", required_argument, NULL, 'j' },
+	{ "table-stats", no_argument, NULL, 't' },
+	{ "io-stats", no_argument, NULL, IO_STATS_OPTION },
 	{ "help", no_argument, NULL, 'h' },
 	{ "version", no_argument, NULL, 'V' },
 	{ NULL, 0, NULL, 0 },
 };
 
-static const char *short_opts = "a:b:OPCTISe:hV";
+static const char *short_opts = "a:b:m:OPCTISe:j:thV";
 
 static const char *usagestr =
 "Usage: sqfsdiff [OPTIONS...] --old,-a <first> --new,-b <second>\n"
+"       sqfsdiff [OPTIONS...] --manifest,-m <file> --new,-b <second>\n"
 "\n"
 "Compare two squashfs images. In contrast to doing a direct diff of the\n"
 "images, this actually parses the filesystems and generates a more\n"
@@ -43,6 +52,10 @@ static const char *usagestr =
 "\n"
 "  --old, -a <first>           The first of the two filesystems to compare.\n"
 "  --new, -b <second>          The second of the two filesystems to compare.\n"
+"  --manifest, -m <file>       Instead of a first filesystem, compare against\n"
+"                              a manifest created by rdsquashfs --manifest.\n"
+"                              Only contents, permissions, ownership and\n"
+"                              timestamps can be compared this way.\n"
 "\n"
 "  --no-contents, -C           Do not compare file contents.\n"
 "  --no-owner, -O              Do not compare file owners.\n"
@@ -56,6 +69,15 @@ static const char *usagestr =
 "                              directory. Contents of the first filesystem\n"
 "                              end up in a subdirectory 'old' and of the\n"
 "                              second filesystem in a subdirectory 'new'.\n"
+"  --num-jobs, -j <count>      Number of threads to use for comparing file\n"
+"                              contents. Defaults to 1.\n"
+"  --table-stats, -t           Print the number of reads, the amount of data\n"
+"                              read and the time spent on reading and\n"
+"                              decompressing each table while loading the\n"
+"                              images to stderr.\n"
+"  --io-stats                  Print statistics about all reads from the\n"
+"                              images to stderr when done, including\n"
+"                              request sizes, latencies and seek distances.\n"
 "\n"
 "  --help, -h                  Print help text and exit.\n"
 "  --version, -V               Print version information and exit.\n"
@@ -63,8 +85,11 @@ static const char *usagestr =
 
 void process_options(sqfsdiff_t *sd, int argc, char **argv)
 {
+	long num_jobs;
 	int i;
 
+	sd->num_jobs = 1;
+
 	for (;;) {
 		i = getopt_long(argc, argv, short_opts, long_opts, NULL);
 		if (i == -1)
@@ -77,6 +102,9 @@ void process_options(sqfsdiff_t *sd, int argc, char **argv)
 		case 'b':
 			sd->new_path = optarg;
 			break;
+		case 'm':
+			sd->manifest_path = optarg;
+			break;
 		case 'O':
 			sd->compare_flags |= COMPARE_NO_OWNER;
 			break;
@@ -99,6 +127,16 @@ void process_options(sqfsdiff_t *sd, int argc, char **argv)
 			sd->compare_flags |= COMPARE_EXTRACT_FILES;
 			sd->extract_dir = optarg;
 			break;
+		case 'j':
+			num_jobs = strtol(optarg, NULL, 0);
+			sd->num_jobs = num_jobs < 1 ? 1 : num_jobs;
+			break;
+		case 't':
+			sd->table_stats = true;
+			break;
+		case IO_STATS_OPTION:
+			sd->io_stats = true;
+			break;
 		case 'h':
 			fputs(usagestr, stdout);
 			exit(0);
@@ -110,7 +148,20 @@ void process_options(sqfsdiff_t *sd, int argc, char **argv)
 		}
 	}
 
-	if (sd->old_path == NULL) {
+	if (sd->manifest_path != NULL) {
+		if (sd->old_path != NULL) {
+			fputs("A manifest cannot be used together with a "
+			      "first filesystem\n", stderr);
+			goto fail_arg;
+		}
+
+		if (sd->compare_super || sd->extract_dir != NULL ||
+		    (sd->compare_flags & COMPARE_INODE_NUM)) {
+			fputs("Super blocks, inode numbers and extraction "
+			      "are not supported with a manifest\n", stderr);
+			goto fail_arg;
+		}
+	} else if (sd->old_path == NULL) {
 		fputs("Missing arguments: first filesystem\n", stderr);
 		goto fail_arg;
 	}
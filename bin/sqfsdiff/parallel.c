@@ -0,0 +1,287 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * parallel.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "sqfsdiff.h"
+
+typedef struct {
+	const sqfs_inode_generic_t *old;
+	const sqfs_inode_generic_t *new;
+	char *path;
+	int result;
+} cmp_job_t;
+
+struct cmp_pool_t {
+	thread_pool_t *pool;
+	content_cmp_t *workers;
+	size_t num_workers;
+
+	cmp_job_t *jobs;
+	size_t num_jobs;
+	size_t max_jobs;
+};
+
+static bool is_file(const sqfs_tree_node_t *n)
+{
+	return n->inode->base.type == SQFS_INODE_FILE ||
+	       n->inode->base.type == SQFS_INODE_EXT_FILE;
+}
+
+static bool is_dir(const sqfs_tree_node_t *n)
+{
+	return n->inode->base.type == SQFS_INODE_DIR ||
+	       n->inode->base.type == SQFS_INODE_EXT_DIR;
+}
+
+static int add_job(cmp_pool_t *cp, const sqfs_tree_node_t *a,
+		   const sqfs_tree_node_t *b)
+{
+	sqfs_u64 old_size, new_size;
+	size_t new_max;
+	cmp_job_t *new;
+
+	sqfs_inode_get_file_size(a->inode, &old_size);
+	sqfs_inode_get_file_size(b->inode, &new_size);
+
+	if (old_size != new_size)
+		return 0;
+
+	if (cp->num_jobs == cp->max_jobs) {
+		new_max = cp->max_jobs ? cp->max_jobs * 2 : 128;
+
+		new = realloc(cp->jobs, new_max * sizeof(cp->jobs[0]));
+		if (new == NULL)
+			goto fail_errno;
+
+		cp->jobs = new;
+		cp->max_jobs = new_max;
+	}
+
+	new = cp->jobs + cp->num_jobs;
+	memset(new, 0, sizeof(*new));
+
+	new->old = a->inode;
+	new->new = b->inode;
+	new->path = sqfs_tree_node_get_path(a);
+	if (new->path == NULL)
+		goto fail_errno;
+
+	cp->num_jobs += 1;
+	return 0;
+fail_errno:
+	perror("collecting files to compare");
+	return -1;
+}
+
+/*
+  Visits the same pairs of files, in the same order, as node_compare
+  and compare_dir_entries would.
+ */
+static int collect_jobs(cmp_pool_t *cp, const sqfs_tree_node_t *a,
+			const sqfs_tree_node_t *b)
+{
+	const sqfs_tree_node_t *ait, *bit;
+	int ret;
+
+	if (is_file(a) && is_file(b))
+		return add_job(cp, a, b);
+
+	if (!is_dir(a) || !is_dir(b))
+		return 0;
+
+	ait = a->children;
+	bit = b->children;
+
+	while (ait != NULL && bit != NULL) {
+		ret = strcmp((const char *)ait->name, (const char *)bit->name);
+
+		if (ret < 0) {
+			ait = ait->next;
+		} else if (ret > 0) {
+			bit = bit->next;
+		} else {
+			if (collect_jobs(cp, ait, bit))
+				return -1;
+
+			ait = ait->next;
+			bit = bit->next;
+		}
+	}
+
+	return 0;
+}
+
+static int cmp_worker(void *user, void *ptr)
+{
+	cmp_job_t *job = ptr;
+
+	job->result = compare_contents(user, job->old, job->new, job->path);
+	return 0;
+}
+
+static int init_source(content_src_t *src, const sqfs_state_t *state)
+{
+	int ret;
+
+	/* don't let cleanup_source touch the objects shared with sqfsdiff_t */
+	src->data = NULL;
+	src->frag_tbl = NULL;
+
+	src->file = sqfs_copy(state->file);
+	if (src->file == NULL) {
+		perror(src->image);
+		return -1;
+	}
+
+	src->frag_tbl = sqfs_copy(state->frag_tbl);
+	src->buffer = malloc(MAX_WINDOW_SIZE);
+
+	if (src->frag_tbl == NULL || src->buffer == NULL) {
+		fprintf(stderr, "%s: creating worker data buffers: %s\n",
+			src->image, strerror(errno));
+		return -1;
+	}
+
+	src->cmp = sqfs_copy(state->cmp);
+	if (src->cmp == NULL) {
+		sqfs_perror(src->image, "creating compressor",
+			    SQFS_ERROR_ALLOC);
+		return -1;
+	}
+
+	src->data = sqfs_data_reader_create(src->file, state->super.block_size,
+					    src->cmp, 0);
+	if (src->data == NULL) {
+		sqfs_perror(src->image, "creating data reader",
+			    SQFS_ERROR_ALLOC);
+		return -1;
+	}
+
+	ret = sqfs_data_reader_load_fragment_table(src->data, &state->super);
+	if (ret) {
+		sqfs_perror(src->image, "loading fragment table", ret);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void cleanup_source(content_src_t *src)
+{
+	if (src->data != NULL)
+		sqfs_destroy(src->data);
+
+	if (src->cmp != NULL)
+		sqfs_destroy(src->cmp);
+
+	if (src->frag_tbl != NULL)
+		sqfs_destroy(src->frag_tbl);
+
+	if (src->file != NULL)
+		sqfs_destroy(src->file);
+
+	free(src->buffer);
+}
+
+cmp_pool_t *cmp_pool_create(sqfsdiff_t *sd)
+{
+	content_cmp_t *w;
+	cmp_pool_t *cp;
+	size_t i;
+
+	cp = calloc(1, sizeof(*cp));
+	if (cp == NULL) {
+		perror("creating file comparison thread pool");
+		return NULL;
+	}
+
+	if (collect_jobs(cp, sd->sqfs_old.root, sd->sqfs_new.root))
+		goto fail;
+
+	cp->pool = thread_pool_create(sd->num_jobs, cmp_worker);
+	if (cp->pool == NULL) {
+		fputs("Error creating file comparison thread pool\n", stderr);
+		goto fail;
+	}
+
+	cp->num_workers = cp->pool->get_worker_count(cp->pool);
+	cp->workers = calloc(cp->num_workers, sizeof(cp->workers[0]));
+	if (cp->workers == NULL) {
+		perror("creating file comparison thread pool");
+		goto fail;
+	}
+
+	for (i = 0; i < cp->num_workers; ++i) {
+		w = cp->workers + i;
+		content_cmp_init(w, sd);
+
+		if (init_source(&w->old, &sd->sqfs_old))
+			goto fail;
+
+		if (init_source(&w->new, &sd->sqfs_new))
+			goto fail;
+
+		cp->pool->set_worker_ptr(cp->pool, i, w);
+	}
+
+	for (i = 0; i < cp->num_jobs; ++i) {
+		if (cp->pool->submit(cp->pool, cp->jobs + i) != 0) {
+			fputs("Error submitting file comparison job\n",
+			      stderr);
+			goto fail;
+		}
+	}
+
+	return cp;
+fail:
+	cmp_pool_destroy(cp);
+	return NULL;
+}
+
+int cmp_pool_result(cmp_pool_t *cp, const sqfs_inode_generic_t *old,
+		    const sqfs_inode_generic_t *new)
+{
+	cmp_job_t *job;
+
+	if (cp->pool->get_status(cp->pool) != 0) {
+		fputs("Error in file comparison thread pool\n", stderr);
+		return -1;
+	}
+
+	job = cp->pool->dequeue(cp->pool);
+
+	if (job == NULL || job->old != old || job->new != new) {
+		fputs("Internal error: file comparison results are out "
+		      "of order\n", stderr);
+		return -1;
+	}
+
+	return job->result;
+}
+
+void cmp_pool_destroy(cmp_pool_t *cp)
+{
+	size_t i;
+
+	if (cp == NULL)
+		return;
+
+	if (cp->pool != NULL)
+		cp->pool->destroy(cp->pool);
+
+	if (cp->workers != NULL) {
+		for (i = 0; i < cp->num_workers; ++i) {
+			cleanup_source(&cp->workers[i].old);
+			cleanup_source(&cp->workers[i].new);
+		}
+	}
+
+	for (i = 0; i < cp->num_jobs; ++i)
+		free(cp->jobs[i].path);
+
+	free(cp->jobs);
+	free(cp->workers);
+	free(cp);
+}
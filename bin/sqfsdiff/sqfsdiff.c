@@ -6,22 +6,39 @@
  */
 #include "sqfsdiff.h"
 
-static int open_sfqs(sqfs_state_t *state, const char *path)
+static int open_sfqs(const sqfsdiff_t *sd, sqfs_state_t *state,
+		     const char *path)
 {
 	int ret;
 
+	if (sd->table_stats) {
+		state->ts = table_stats_create();
+		if (state->ts == NULL)
+			return -1;
+	}
+
 	state->file = sqfs_open_file(path, SQFS_FILE_OPEN_READ_ONLY);
 	if (state->file == NULL) {
 		perror(path);
-		return -1;
+		goto fail_ts;
 	}
 
+	if (sd->io_stats && io_stats_wrap(&state->file))
+		goto fail_file;
+
+	if (table_stats_wrap_file(state->ts, &state->file))
+		goto fail_file;
+
+	table_stats_begin(state->ts);
+
 	ret = sqfs_super_read(&state->super, state->file);
 	if (ret) {
 		sqfs_perror(path, "reading super block", ret);
 		goto fail_file;
 	}
 
+	table_stats_end(state->ts, "super block");
+
 	sqfs_compressor_config_init(&state->cfg, state->super.compression_id,
 				    state->super.block_size,
 				    SQFS_COMP_FLAG_UNCOMPRESS);
@@ -38,9 +55,16 @@ static int open_sfqs(sqfs_state_t *state, const char *path)
 		goto fail_file;
 	}
 
+	if (table_stats_wrap_compressor(state->ts, &state->cmp))
+		goto fail_cmp;
+
 	if (state->super.flags & SQFS_FLAG_COMPRESSOR_OPTIONS) {
+		table_stats_begin(state->ts);
+
 		ret = state->cmp->read_options(state->cmp, state->file);
 
+		table_stats_end(state->ts, "compressor options");
+
 		if (ret == 0) {
 			state->cmp->get_configuration(state->cmp,
 						      &state->options);
@@ -59,6 +83,8 @@ static int open_sfqs(sqfs_state_t *state, const char *path)
 		goto fail_cmp;
 	}
 
+	table_stats_begin(state->ts);
+
 	ret = sqfs_id_table_read(state->idtbl, state->file,
 				 &state->super, state->cmp);
 	if (ret) {
@@ -66,6 +92,8 @@ static int open_sfqs(sqfs_state_t *state, const char *path)
 		goto fail_id;
 	}
 
+	table_stats_end(state->ts, "ID table");
+
 	state->dr = sqfs_dir_reader_create(&state->super, state->cmp,
 					   state->file, 0);
 	if (state->dr == NULL) {
@@ -74,6 +102,8 @@ static int open_sfqs(sqfs_state_t *state, const char *path)
 		goto fail_id;
 	}
 
+	table_stats_begin(state->ts);
+
 	ret = sqfs_dir_reader_get_full_hierarchy(state->dr, state->idtbl,
 						 NULL, 0, &state->root);
 	if (ret) {
@@ -81,6 +111,8 @@ static int open_sfqs(sqfs_state_t *state, const char *path)
 		goto fail_dr;
 	}
 
+	table_stats_end(state->ts, "directory tree");
+
 	state->data = sqfs_data_reader_create(state->file,
 					      state->super.block_size,
 					      state->cmp, 0);
@@ -89,13 +121,34 @@ static int open_sfqs(sqfs_state_t *state, const char *path)
 		goto fail_tree;
 	}
 
+	/* the data reader and the raw copy each load the fragment table */
+	table_stats_begin(state->ts);
+
 	ret = sqfs_data_reader_load_fragment_table(state->data, &state->super);
 	if (ret) {
 		sqfs_perror(path, "loading fragment table", ret);
 		goto fail_data;
 	}
 
+	/* a copy of our own, for comparing raw fragment blocks */
+	state->frag_tbl = sqfs_frag_table_create(0);
+	if (state->frag_tbl == NULL) {
+		sqfs_perror(path, "creating fragment table", SQFS_ERROR_ALLOC);
+		goto fail_data;
+	}
+
+	ret = sqfs_frag_table_read(state->frag_tbl, state->file,
+				   &state->super, state->cmp);
+	if (ret) {
+		sqfs_perror(path, "loading fragment table", ret);
+		goto fail_frag;
+	}
+
+	table_stats_end(state->ts, "fragment table");
+	table_stats_print(state->ts, path);
 	return 0;
+fail_frag:
+	sqfs_destroy(state->frag_tbl);
 fail_data:
 	sqfs_destroy(state->data);
 fail_tree:
@@ -108,17 +161,22 @@ fail_cmp:
 	sqfs_destroy(state->cmp);
 fail_file:
 	sqfs_destroy(state->file);
+fail_ts:
+	table_stats_destroy(state->ts);
 	return -1;
 }
 
-static void close_sfqs(sqfs_state_t *state)
+static void close_sfqs(sqfs_state_t *state, const char *path)
 {
+	sqfs_destroy(state->frag_tbl);
 	sqfs_destroy(state->data);
 	sqfs_dir_tree_destroy(state->root);
 	sqfs_destroy(state->dr);
 	sqfs_destroy(state->idtbl);
 	sqfs_destroy(state->cmp);
+	io_stats_print(state->file, path);
 	sqfs_destroy(state->file);
+	table_stats_destroy(state->ts);
 }
 
 int main(int argc, char **argv)
@@ -134,14 +192,36 @@ int main(int argc, char **argv)
 			return 2;
 	}
 
-	if (open_sfqs(&sd.sqfs_old, sd.old_path))
+	if (sd.manifest_path != NULL) {
+		if (open_sfqs(&sd, &sd.sqfs_new, sd.new_path))
+			return 2;
+
+		ret = compare_manifest(&sd);
+		close_sfqs(&sd.sqfs_new, sd.new_path);
+		return ret < 0 ? 2 : ret;
+	}
+
+	if (open_sfqs(&sd, &sd.sqfs_old, sd.old_path))
 		return 2;
 
-	if (open_sfqs(&sd.sqfs_new, sd.new_path)) {
+	if (open_sfqs(&sd, &sd.sqfs_new, sd.new_path)) {
 		status = 2;
 		goto out_sqfs_old;
 	}
 
+	sd.raw_blocks = sd.sqfs_old.super.compression_id ==
+			sd.sqfs_new.super.compression_id &&
+			sd.sqfs_old.super.block_size ==
+			sd.sqfs_new.super.block_size;
+
+	if (sd.num_jobs > 1 && !(sd.compare_flags & COMPARE_NO_CONTENTS)) {
+		sd.pool = cmp_pool_create(&sd);
+		if (sd.pool == NULL) {
+			ret = -1;
+			goto out;
+		}
+	}
+
 	if (sd.extract_dir != NULL) {
 		if (chdir(sd.extract_dir)) {
 			perror(sd.extract_dir);
@@ -168,8 +248,9 @@ out:
 	} else {
 		status = 0;
 	}
-	close_sfqs(&sd.sqfs_new);
+	cmp_pool_destroy(sd.pool);
+	close_sfqs(&sd.sqfs_new, sd.new_path);
 out_sqfs_old:
-	close_sfqs(&sd.sqfs_old);
+	close_sfqs(&sd.sqfs_old, sd.old_path);
 	return status;
 }
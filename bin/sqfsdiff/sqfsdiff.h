@@ -11,6 +11,10 @@
 #include "common.h"
 #include "fstree.h"
 
+#include "sqfs/frag_table.h"
+#include "threadpool.h"
+#include "manifest.h"
+
 #include <stdlib.h>
 #include <getopt.h>
 #include <string.h>
@@ -27,19 +31,58 @@ typedef struct {
 	sqfs_dir_reader_t *dr;
 	sqfs_tree_node_t *root;
 	sqfs_data_reader_t *data;
+	sqfs_frag_table_t *frag_tbl;
+	table_stats_t *ts;
 
 	sqfs_compressor_config_t options;
 	bool have_options;
 } sqfs_state_t;
 
+/* one side of a file content comparison */
+typedef struct {
+	const char *image;
+	sqfs_file_t *file;
+	sqfs_compressor_t *cmp;
+	sqfs_data_reader_t *data;
+	sqfs_frag_table_t *frag_tbl;
+	sqfs_u8 *buffer;
+} content_src_t;
+
+/* everything a thread needs to compare file contents on its own */
+typedef struct {
+	content_src_t old;
+	content_src_t new;
+	size_t block_size;
+
+	/* same compressor and block size, data blocks can be compared raw */
+	bool raw_blocks;
+
+	/* the outcome of the last raw fragment block comparison */
+	sqfs_u32 last_old_frag;
+	sqfs_u32 last_new_frag;
+	bool last_frag_equal;
+} content_cmp_t;
+
+typedef struct cmp_pool_t cmp_pool_t;
+
 typedef struct {
 	const char *old_path;
 	const char *new_path;
+	const char *manifest_path;
 	int compare_flags;
 	sqfs_state_t sqfs_old;
 	sqfs_state_t sqfs_new;
 	bool compare_super;
+	bool table_stats;
+	bool io_stats;
 	const char *extract_dir;
+	size_t num_jobs;
+
+	/* same compressor and block size, data blocks can be compared raw */
+	bool raw_blocks;
+
+	/* if comparing file contents on multiple threads */
+	cmp_pool_t *pool;
 } sqfsdiff_t;
 
 enum {
@@ -59,6 +102,27 @@ char *node_path(const sqfs_tree_node_t *n);
 int compare_files(sqfsdiff_t *sd, const sqfs_inode_generic_t *old,
 		  const sqfs_inode_generic_t *new, const char *path);
 
+void content_cmp_init(content_cmp_t *cmp, const sqfsdiff_t *sd);
+
+/*
+  Compare the contents of two files of the same size. Returns 0 if they
+  are equal, 1 if they differ, -1 on failure.
+ */
+int compare_contents(content_cmp_t *cmp, const sqfs_inode_generic_t *old,
+		     const sqfs_inode_generic_t *new, const char *path);
+
+/*
+  Collects all pairs of files that the tree walk will compare the contents
+  of and starts comparing them in the background. Results are picked up
+  in the same order as the tree walk encounters the files.
+ */
+cmp_pool_t *cmp_pool_create(sqfsdiff_t *sd);
+
+int cmp_pool_result(cmp_pool_t *pool, const sqfs_inode_generic_t *old,
+		    const sqfs_inode_generic_t *new);
+
+void cmp_pool_destroy(cmp_pool_t *pool);
+
 int node_compare(sqfsdiff_t *sd, sqfs_tree_node_t *a, sqfs_tree_node_t *b);
 
 int compare_super_blocks(const sqfs_super_t *a, const sqfs_super_t *b);
@@ -67,6 +131,12 @@ int extract_files(sqfsdiff_t *sd, const sqfs_inode_generic_t *old,
 		  const sqfs_inode_generic_t *new,
 		  const char *path);
 
+/*
+  Compare the new image against a manifest of the old one, instead
+  of the old image itself.
+ */
+int compare_manifest(sqfsdiff_t *sd);
+
 void process_options(sqfsdiff_t *sd, int argc, char **argv);
 
 #endif /* DIFFTOOL_H */
@@ -0,0 +1,587 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * index.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "tar2sqfs.h"
+
+#include <sys/stat.h>
+
+#define INDEX_MAGIC "T2SQIDX"
+#define INDEX_VERSION (1)
+
+/* the tar reader does not accept names or PAX records larger than this */
+#define INDEX_MAX_STRING (65536)
+
+enum {
+	INDEX_RECORD_ENTRY = 'E',
+	INDEX_RECORD_END = 'Z',
+};
+
+enum {
+	INDEX_FLAG_UNKNOWN = 0x01,
+	INDEX_FLAG_HARD_LINK = 0x02,
+	INDEX_FLAG_NAME = 0x04,
+	INDEX_FLAG_TARGET = 0x08,
+	INDEX_FLAG_SPARSE = 0x10,
+};
+
+typedef struct {
+	char magic[8];
+	sqfs_u32 version;
+	sqfs_u32 pad0;
+	sqfs_u64 input_size;
+	sqfs_s64 input_mtime;
+} index_header_t;
+
+typedef struct {
+	sqfs_u8 type;
+	sqfs_u8 flags;
+	sqfs_u16 mode;
+	sqfs_u32 pad0;
+	sqfs_u64 data_offset;
+	sqfs_u64 actual_size;
+	sqfs_u64 record_size;
+	sqfs_u64 uid;
+	sqfs_u64 gid;
+	sqfs_u64 devno;
+	sqfs_s64 mtime;
+} index_entry_t;
+
+/*
+  Keeps track of the position in the (uncompressed) tar stream. The buffer
+  of the wrapped stream is used directly, so nothing is copied.
+ */
+typedef struct {
+	istream_t base;
+
+	istream_t *wrapped;
+	sqfs_u64 buffer_start;
+} counter_istream_t;
+
+static const char *index_path = NULL;
+static istream_t *index_in = NULL;
+static ostream_t *index_out = NULL;
+static counter_istream_t *counter = NULL;
+
+static sqfs_u64 get_position(void)
+{
+	return counter->buffer_start + ((istream_t *)counter)->buffer_offset;
+}
+
+static int counter_precache(istream_t *base)
+{
+	counter_istream_t *strm = (counter_istream_t *)base;
+	istream_t *wrapped = strm->wrapped;
+
+	/* istream_precache already dropped the consumed data for us */
+	strm->buffer_start += wrapped->buffer_used - base->buffer_used;
+	wrapped->buffer_used = base->buffer_used;
+	wrapped->buffer_offset = 0;
+
+	if (istream_precache(wrapped))
+		return -1;
+
+	base->buffer = wrapped->buffer;
+	base->buffer_used = wrapped->buffer_used;
+	base->eof = wrapped->eof;
+	return 0;
+}
+
+static int counter_skip(istream_t *base, sqfs_u64 size)
+{
+	counter_istream_t *strm = (counter_istream_t *)base;
+	istream_t *wrapped = strm->wrapped;
+
+	strm->buffer_start += wrapped->buffer_used + size;
+	wrapped->buffer_used = 0;
+	wrapped->buffer_offset = 0;
+
+	return istream_skip(wrapped, size);
+}
+
+static sqfs_s32 counter_read_direct(istream_t *base, void *data, size_t size)
+{
+	counter_istream_t *strm = (counter_istream_t *)base;
+	istream_t *wrapped = strm->wrapped;
+	sqfs_s32 ret;
+
+	strm->buffer_start += wrapped->buffer_used;
+	wrapped->buffer_used = 0;
+	wrapped->buffer_offset = 0;
+
+	ret = istream_read(wrapped, data, size);
+	if (ret > 0)
+		strm->buffer_start += ret;
+
+	return ret;
+}
+
+static const char *counter_get_filename(istream_t *base)
+{
+	counter_istream_t *strm = (counter_istream_t *)base;
+
+	return istream_get_filename(strm->wrapped);
+}
+
+static void counter_destroy(sqfs_object_t *base)
+{
+	counter_istream_t *strm = (counter_istream_t *)base;
+
+	sqfs_destroy(strm->wrapped);
+	free(strm);
+}
+
+static int get_input_stat(sqfs_u64 *size, sqfs_s64 *mtime)
+{
+	struct stat sb;
+
+	*size = 0;
+	*mtime = 0;
+
+	if (fstat(fileno(stdin), &sb) != 0) {
+		perror("stdin");
+		return -1;
+	}
+
+	/* a pipe can't be identified, trust the user on that */
+	if (S_ISREG(sb.st_mode)) {
+		*size = sb.st_size;
+		*mtime = sb.st_mtime;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+static int write_u32(sqfs_u32 value)
+{
+	value = htole32(value);
+	return ostream_append(index_out, &value, sizeof(value));
+}
+
+static int write_string(const char *str, size_t len)
+{
+	if (write_u32(len))
+		return -1;
+
+	return ostream_append(index_out, str, len);
+}
+
+static int write_entry(const tar_header_decoded_t *hdr, sqfs_u64 offset)
+{
+	const sparse_map_t *sparse;
+	const tar_xattr_t *xattr;
+	sqfs_u64 pair[2];
+	index_entry_t ent;
+	sqfs_u32 count;
+
+	memset(&ent, 0, sizeof(ent));
+	ent.type = INDEX_RECORD_ENTRY;
+	ent.mode = htole16(hdr->mode);
+	ent.data_offset = htole64(offset);
+	ent.actual_size = htole64(hdr->actual_size);
+	ent.record_size = htole64(hdr->record_size);
+	ent.uid = htole64(hdr->uid);
+	ent.gid = htole64(hdr->gid);
+	ent.devno = htole64(hdr->devno);
+	ent.mtime = htole64(hdr->mtime);
+
+	if (hdr->unknown_record)
+		ent.flags |= INDEX_FLAG_UNKNOWN;
+	if (hdr->is_hard_link)
+		ent.flags |= INDEX_FLAG_HARD_LINK;
+	if (hdr->name != NULL)
+		ent.flags |= INDEX_FLAG_NAME;
+	if (hdr->link_target != NULL)
+		ent.flags |= INDEX_FLAG_TARGET;
+	if (hdr->sparse != NULL)
+		ent.flags |= INDEX_FLAG_SPARSE;
+
+	if (ostream_append(index_out, &ent, sizeof(ent)))
+		return -1;
+
+	if (hdr->name != NULL && write_string(hdr->name, strlen(hdr->name)))
+		return -1;
+
+	if (hdr->link_target != NULL &&
+	    write_string(hdr->link_target, strlen(hdr->link_target))) {
+		return -1;
+	}
+
+	count = 0;
+	for (sparse = hdr->sparse; sparse != NULL; sparse = sparse->next)
+		++count;
+
+	if (write_u32(count))
+		return -1;
+
+	for (sparse = hdr->sparse; sparse != NULL; sparse = sparse->next) {
+		pair[0] = htole64(sparse->offset);
+		pair[1] = htole64(sparse->count);
+
+		if (ostream_append(index_out, pair, sizeof(pair)))
+			return -1;
+	}
+
+	count = 0;
+	for (xattr = hdr->xattr; xattr != NULL; xattr = xattr->next)
+		++count;
+
+	if (write_u32(count))
+		return -1;
+
+	for (xattr = hdr->xattr; xattr != NULL; xattr = xattr->next) {
+		if (write_string(xattr->key, strlen(xattr->key)))
+			return -1;
+
+		if (write_string((const char *)xattr->value,
+				 xattr->value_len)) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*****************************************************************************/
+
+static int read_data(void *data, size_t size)
+{
+	sqfs_s32 ret = istream_read(index_in, data, size);
+
+	if (ret < 0)
+		return -1;
+
+	if ((size_t)ret < size) {
+		fprintf(stderr, "%s: index is truncated.\n", index_path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int read_u32(sqfs_u32 *out)
+{
+	if (read_data(out, sizeof(*out)))
+		return -1;
+
+	*out = le32toh(*out);
+	return 0;
+}
+
+static void *read_string(size_t extra, size_t *len_out)
+{
+	sqfs_u32 len;
+	char *str;
+
+	if (read_u32(&len))
+		return NULL;
+
+	if (len > INDEX_MAX_STRING) {
+		fprintf(stderr, "%s: index entry is too long.\n", index_path);
+		return NULL;
+	}
+
+	str = calloc(1, extra + len + 1);
+	if (str == NULL) {
+		perror(index_path);
+		return NULL;
+	}
+
+	if (read_data(str + extra, len)) {
+		free(str);
+		return NULL;
+	}
+
+	*len_out = len;
+	return str;
+}
+
+static int read_xattr(tar_xattr_t **out)
+{
+	size_t keylen, valuelen;
+	tar_xattr_t *xattr;
+	char *value;
+
+	xattr = read_string(offsetof(tar_xattr_t, data), &keylen);
+	if (xattr == NULL)
+		return -1;
+
+	value = read_string(0, &valuelen);
+	if (value == NULL) {
+		free(xattr);
+		return -1;
+	}
+
+	/* same layout that the tar reader uses, so it can be freed as usual */
+	*out = realloc(xattr, sizeof(*xattr) + keylen + 1 + valuelen + 1);
+	if (*out == NULL) {
+		perror(index_path);
+		free(xattr);
+		free(value);
+		return -1;
+	}
+
+	xattr = *out;
+	xattr->key = xattr->data;
+	xattr->value = (sqfs_u8 *)xattr->data + keylen + 1;
+	xattr->value_len = valuelen;
+	memcpy(xattr->value, value, valuelen + 1);
+	free(value);
+	return 0;
+}
+
+static int read_entry(tar_header_decoded_t *hdr, sqfs_u64 *offset)
+{
+	sparse_map_t **sparse_tail = &hdr->sparse;
+	tar_xattr_t **xattr_tail = &hdr->xattr;
+	sqfs_u32 i, count;
+	index_entry_t ent;
+	sqfs_u64 pair[2];
+	size_t len;
+
+	memset(hdr, 0, sizeof(*hdr));
+
+	if (read_data(&ent.type, 1))
+		return -1;
+
+	if (ent.type == INDEX_RECORD_END)
+		return 1;
+
+	if (ent.type != INDEX_RECORD_ENTRY)
+		goto fail_corrupt;
+
+	if (read_data((char *)&ent + 1, sizeof(ent) - 1))
+		return -1;
+
+	*offset = le64toh(ent.data_offset);
+	hdr->mode = le16toh(ent.mode);
+	hdr->actual_size = le64toh(ent.actual_size);
+	hdr->record_size = le64toh(ent.record_size);
+	hdr->uid = le64toh(ent.uid);
+	hdr->gid = le64toh(ent.gid);
+	hdr->devno = le64toh(ent.devno);
+	hdr->mtime = le64toh(ent.mtime);
+	hdr->unknown_record = (ent.flags & INDEX_FLAG_UNKNOWN) != 0;
+	hdr->is_hard_link = (ent.flags & INDEX_FLAG_HARD_LINK) != 0;
+
+	if (ent.flags & INDEX_FLAG_NAME) {
+		hdr->name = read_string(0, &len);
+		if (hdr->name == NULL)
+			goto fail;
+	}
+
+	if (ent.flags & INDEX_FLAG_TARGET) {
+		hdr->link_target = read_string(0, &len);
+		if (hdr->link_target == NULL)
+			goto fail;
+	}
+
+	if (read_u32(&count))
+		goto fail;
+
+	if (((ent.flags & INDEX_FLAG_SPARSE) != 0) != (count > 0))
+		goto fail_corrupt;
+
+	for (i = 0; i < count; ++i) {
+		if (read_data(pair, sizeof(pair)))
+			goto fail;
+
+		*sparse_tail = calloc(1, sizeof(**sparse_tail));
+		if (*sparse_tail == NULL) {
+			perror(index_path);
+			goto fail;
+		}
+
+		(*sparse_tail)->offset = le64toh(pair[0]);
+		(*sparse_tail)->count = le64toh(pair[1]);
+		sparse_tail = &(*sparse_tail)->next;
+	}
+
+	if (read_u32(&count))
+		goto fail;
+
+	for (i = 0; i < count; ++i) {
+		if (read_xattr(xattr_tail))
+			goto fail;
+
+		xattr_tail = &(*xattr_tail)->next;
+	}
+
+	return 0;
+fail_corrupt:
+	fprintf(stderr, "%s: index is corrupted.\n", index_path);
+fail:
+	clear_header(hdr);
+	return -1;
+}
+
+/*****************************************************************************/
+
+static int index_load(void)
+{
+	sqfs_u64 input_size;
+	sqfs_s64 input_mtime;
+	index_header_t hdr;
+
+	index_in = istream_open_file(index_path);
+	if (index_in == NULL)
+		return -1;
+
+	if (read_data(&hdr, sizeof(hdr)))
+		return -1;
+
+	if (memcmp(hdr.magic, INDEX_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    le32toh(hdr.version) != INDEX_VERSION) {
+		fprintf(stderr, "%s: not a tar2sqfs index.\n", index_path);
+		return -1;
+	}
+
+	if (get_input_stat(&input_size, &input_mtime))
+		return -1;
+
+	if (input_size != 0 && hdr.input_size != 0 &&
+	    (le64toh(hdr.input_size) != input_size ||
+	     (sqfs_s64)le64toh(hdr.input_mtime) != input_mtime)) {
+		fprintf(stderr, "%s: index was created for a different "
+			"input file.\n", index_path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int index_create(void)
+{
+	index_header_t hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.version = htole32(INDEX_VERSION);
+
+	if (get_input_stat(&hdr.input_size, &hdr.input_mtime))
+		return -1;
+
+	hdr.input_size = htole64(hdr.input_size);
+	hdr.input_mtime = htole64(hdr.input_mtime);
+
+	index_out = ostream_open_file(index_path, 0);
+	if (index_out == NULL)
+		return -1;
+
+	return ostream_append(index_out, &hdr, sizeof(hdr));
+}
+
+istream_t *index_init(const char *path, istream_t *input)
+{
+	istream_t *base;
+	struct stat sb;
+
+	index_path = path;
+
+	if (stat(path, &sb) == 0) {
+		if (index_load())
+			goto fail;
+	} else {
+		if (index_create())
+			goto fail;
+	}
+
+	counter = calloc(1, sizeof(*counter));
+	if (counter == NULL) {
+		perror("creating tar input position counter");
+		goto fail;
+	}
+
+	base = (istream_t *)counter;
+	counter->wrapped = input;
+	base->buffer = input->buffer;
+	base->buffer_used = input->buffer_used;
+	base->buffer_offset = input->buffer_offset;
+	base->eof = input->eof;
+	base->precache = counter_precache;
+	base->get_filename = counter_get_filename;
+	((sqfs_object_t *)base)->destroy = counter_destroy;
+
+	if (input->skip != NULL)
+		base->skip = counter_skip;
+
+	if (input->read_direct != NULL)
+		base->read_direct = counter_read_direct;
+
+	return base;
+fail:
+	sqfs_destroy(input);
+	return NULL;
+}
+
+int index_read_header(istream_t *input, tar_header_decoded_t *hdr,
+		      tar_arena_t *arena)
+{
+	sqfs_u64 offset, pos;
+	int ret;
+
+	if (index_in != NULL) {
+		ret = read_entry(hdr, &offset);
+		if (ret != 0)
+			return ret;
+
+		pos = get_position();
+
+		if (offset < pos) {
+			fprintf(stderr, "%s: index is corrupted.\n",
+				index_path);
+			clear_header(hdr);
+			return -1;
+		}
+
+		if (istream_skip(input, offset - pos)) {
+			clear_header(hdr);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	ret = read_header_arena(input, hdr, arena);
+	if (ret != 0 || index_out == NULL)
+		return ret;
+
+	if (write_entry(hdr, get_position())) {
+		clear_header(hdr);
+		return -1;
+	}
+
+	return 0;
+}
+
+int index_finish(void)
+{
+	sqfs_u8 end = INDEX_RECORD_END;
+
+	if (index_out == NULL)
+		return 0;
+
+	if (ostream_append(index_out, &end, 1))
+		return -1;
+
+	return ostream_flush(index_out);
+}
+
+void index_cleanup(int status)
+{
+	if (index_out != NULL) {
+		sqfs_destroy(index_out);
+
+		/* never leave a partial index around */
+		if (status != EXIT_SUCCESS)
+			remove(index_path);
+	}
+
+	sqfs_destroy(index_in);
+	index_out = NULL;
+	index_in = NULL;
+}
@@ -6,6 +6,10 @@
  */
 #include "tar2sqfs.h"
 
+enum {
+	IO_STATS_OPTION = 1,
+};
+
 static struct option long_opts[] = {
 	{ "root-becomes", required_argument, NULL, 'r' },
 	{ "compressor", required_argument, NULL, 'c' },
@@ -21,14 +25,16 @@ static struct option long_opts[] = {
 	{ "exportable", no_argument, NULL, 'e' },
 	{ "no-symlink-retarget", no_argument, NULL, 'S' },
 	{ "no-tail-packing", no_argument, NULL, 'T' },
+	{ "index", required_argument, NULL, 'I' },
 	{ "force", no_argument, NULL, 'f' },
+	{ "io-stats", no_argument, NULL, IO_STATS_OPTION },
 	{ "quiet", no_argument, NULL, 'q' },
 	{ "help", no_argument, NULL, 'h' },
 	{ "version", no_argument, NULL, 'V' },
 	{ NULL, 0, NULL, 0 },
 };
 
-static const char *short_opts = "r:c:b:B:d:X:j:Q:sxekfqSThV";
+static const char *short_opts = "r:c:b:B:d:X:j:Q:I:sxekfqSThV";
 
 static const char *usagestr =
 "Usage: tar2sqfs [OPTIONS...] <sqfsfile>\n"
@@ -79,7 +85,16 @@ static const char *usagestr =
 "  --exportable, -e            Generate an export table for NFS support.\n"
 "  --no-tail-packing, -T       Do not perform tail end packing on files that\n"
 "                              are larger than block size.\n"
+"  --index, -I <file>          Speed up repeated conversions of the same\n"
+"                              tarball. If the file does not exist, the\n"
+"                              decoded tar headers are stored in it. If it\n"
+"                              exists, the headers are taken from it and\n"
+"                              the input is seeked to the file data\n"
+"                              instead of parsing it.\n"
 "  --force, -f                 Overwrite the output file if it exists.\n"
+"  --io-stats                  Print statistics about all reads and writes\n"
+"                              on the image to stderr when done, including\n"
+"                              request sizes, latencies and seek distances.\n"
 "  --quiet, -q                 Do not print out progress reports.\n"
 "  --help, -h                  Print help text and exit.\n"
 "  --version, -V               Print version information and exit.\n"
@@ -91,6 +106,7 @@ bool no_tail_pack = false;
 bool no_symlink_retarget = false;
 sqfs_writer_cfg_t cfg;
 char *root_becomes = NULL;
+const char *index_file = NULL;
 
 static void input_compressor_print_available(void)
 {
@@ -208,12 +224,18 @@ void process_args(int argc, char **argv)
 		case 'e':
 			cfg.exportable = true;
 			break;
+		case 'I':
+			index_file = optarg;
+			break;
 		case 'f':
 			cfg.outmode |= SQFS_FILE_OPEN_OVERWRITE;
 			break;
 		case 'q':
 			cfg.quiet = true;
 			break;
+		case IO_STATS_OPTION:
+			cfg.io_stats = true;
+			break;
 		case 'h':
 			printf(usagestr, SQFS_DEFAULT_BLOCK_SIZE,
 			       SQFS_DEVBLK_SIZE);
@@ -6,6 +6,55 @@
  */
 #include "tar2sqfs.h"
 
+/*
+  File data is read straight into the data blocks of the block processor,
+  instead of going through the stream buffer if the input supports it.
+ */
+static int append_data(istream_t *input_file, sqfs_block_processor_t *proc,
+		       const char *name, sqfs_u64 size, bool sparse)
+{
+	sqfs_s32 ret;
+	size_t diff;
+	void *ptr;
+	int err;
+
+	while (size > 0) {
+		err = sqfs_block_processor_get_buffer(proc, &ptr, &diff);
+		if (err)
+			goto fail_proc;
+
+		if ((sqfs_u64)diff > size)
+			diff = size;
+
+		if (sparse) {
+			memset(ptr, 0, diff);
+		} else {
+			ret = istream_read(input_file, ptr, diff);
+			if (ret < 0)
+				return -1;
+
+			if (ret == 0) {
+				fprintf(stderr, "%s: unexpected end-of-file\n",
+					name);
+				return -1;
+			}
+
+			diff = ret;
+		}
+
+		err = sqfs_block_processor_commit(proc, diff);
+		if (err)
+			goto fail_proc;
+
+		size -= diff;
+	}
+
+	return 0;
+fail_proc:
+	sqfs_perror(name, NULL, err);
+	return -1;
+}
+
 static int write_file(istream_t *input_file, sqfs_writer_t *sqfs,
 		      const tar_header_decoded_t *hdr,
 		      file_info_t *fi, sqfs_u64 filesize)
@@ -14,16 +63,16 @@ static int write_file(istream_t *input_file, sqfs_writer_t *sqfs,
 	int flags = 0, ret = 0;
 	sqfs_u64 offset, diff;
 	bool sparse_region;
-	ostream_t *out;
 
 	if (no_tail_pack && filesize > cfg.block_size)
 		flags |= SQFS_BLK_DONT_FRAGMENT;
 
-	out = data_writer_ostream_create(hdr->name, sqfs->data, &fi->inode,
-					 flags);
-
-	if (out == NULL)
+	ret = sqfs_block_processor_begin_file(sqfs->data, &fi->inode,
+					      NULL, flags);
+	if (ret) {
+		sqfs_perror(hdr->name, NULL, ret);
 		return -1;
+	}
 
 	list = hdr->sparse;
 
@@ -48,31 +97,19 @@ static int write_file(istream_t *input_file, sqfs_writer_t *sqfs,
 			diff = filesize - offset;
 		}
 
-		if (diff > 0x7FFFFFFFUL)
-			diff = 0x7FFFFFFFUL;
-
-		if (sparse_region) {
-			ret = ostream_append_sparse(out, diff);
-		} else {
-			ret = ostream_append_from_istream(out, input_file,
-							  diff);
-
-			if (ret == 0) {
-				fprintf(stderr, "%s: unexpected end-of-file\n",
-					hdr->name);
-				ret = -1;
-			} else if (ret > 0) {
-				diff = ret;
-				ret = 0;
-			}
-		}
-
-		if (ret < 0)
+		ret = append_data(input_file, sqfs->data, hdr->name, diff,
+				  sparse_region);
+		if (ret)
 			break;
 	}
 
-	ostream_flush(out);
-	sqfs_destroy(out);
+	if (ret == 0) {
+		ret = sqfs_block_processor_end_file(sqfs->data);
+		if (ret) {
+			sqfs_perror(hdr->name, NULL, ret);
+			ret = -1;
+		}
+	}
 
 	if (ret)
 		return -1;
@@ -209,6 +246,7 @@ int process_tarball(istream_t *input_file, sqfs_writer_t *sqfs)
 	bool skip, is_root, is_prefixed;
 	tar_header_decoded_t hdr;
 	sqfs_u64 offset, count;
+	tar_arena_t *arena;
 	sparse_map_t *m;
 	size_t rootlen;
 	char *target;
@@ -216,12 +254,16 @@ int process_tarball(istream_t *input_file, sqfs_writer_t *sqfs)
 
 	rootlen = root_becomes == NULL ? 0 : strlen(root_becomes);
 
+	arena = tar_arena_create();
+	if (arena == NULL)
+		return -1;
+
 	for (;;) {
-		ret = read_header(input_file, &hdr);
+		ret = index_read_header(input_file, &hdr, arena);
 		if (ret > 0)
 			break;
 		if (ret < 0)
-			return -1;
+			goto fail_arena;
 
 		if (hdr.mtime < 0)
 			hdr.mtime = 0;
@@ -339,8 +381,11 @@ int process_tarball(istream_t *input_file, sqfs_writer_t *sqfs)
 		clear_header(&hdr);
 	}
 
+	tar_arena_destroy(arena);
 	return 0;
 fail:
 	clear_header(&hdr);
+fail_arena:
+	tar_arena_destroy(arena);
 	return -1;
 }
@@ -32,10 +32,28 @@ static int tar_probe(const sqfs_u8 *data, size_t size)
 	return 0;
 }
 
+static unsigned int percent(sqfs_u64 part, sqfs_u64 total)
+{
+	return total == 0 ? 0 : (unsigned int)((100 * part) / total);
+}
+
+static void print_pipeline_stats(istream_t *strm)
+{
+	istream_readahead_stats_t stats;
+
+	istream_readahead_get_stats(strm, &stats);
+
+	printf("Input decompression thread busy: %u%%\n",
+	       percent(stats.busy_us, stats.total_us));
+	printf("Packer waiting for input: %u%%\n",
+	       percent(stats.wait_us, stats.total_us));
+	fputc('\n', stdout);
+}
+
 int main(int argc, char **argv)
 {
 	int status = EXIT_FAILURE;
-	istream_t *input_file = NULL;
+	istream_t *input_file = NULL, *readahead = NULL;
 	sqfs_writer_t sqfs;
 	int ret;
 
@@ -58,7 +76,22 @@ int main(int argc, char **argv)
 			goto out_if;
 		}
 
-		input_file = istream_compressor_create(input_file, ret);
+		input_file = istream_compressor_create_parallel(input_file, ret,
+								 cfg.num_jobs);
+		if (input_file == NULL)
+			return EXIT_FAILURE;
+
+		input_file = istream_readahead_create(input_file,
+						      READAHEAD_BUFFERS);
+		if (input_file == NULL)
+			return EXIT_FAILURE;
+
+		/* the index may wrap it further, the stats are in this one */
+		readahead = input_file;
+	}
+
+	if (index_file != NULL) {
+		input_file = index_init(index_file, input_file);
 		if (input_file == NULL)
 			return EXIT_FAILURE;
 	}
@@ -70,16 +103,23 @@ int main(int argc, char **argv)
 	if (process_tarball(input_file, &sqfs))
 		goto out;
 
+	if (index_finish())
+		goto out;
+
 	if (fstree_post_process(&sqfs.fs))
 		goto out;
 
 	if (sqfs_writer_finish(&sqfs, &cfg))
 		goto out;
 
+	if (readahead != NULL && !cfg.quiet)
+		print_pipeline_stats(readahead);
+
 	status = EXIT_SUCCESS;
 out:
 	sqfs_writer_cleanup(&sqfs, status);
 out_if:
 	sqfs_destroy(input_file);
+	index_cleanup(status);
 	return status;
 }
@@ -11,6 +11,7 @@
 #include "common.h"
 #include "compat.h"
 #include "tar.h"
+#include "util.h"
 
 #include <stdlib.h>
 #include <getopt.h>
@@ -18,6 +19,12 @@
 #include <stdio.h>
 #include <errno.h>
 
+/*
+  Number of buffers that the input decompression thread can fill ahead of
+  the tar parser.
+ */
+#define READAHEAD_BUFFERS (4)
+
 /* options.c */
 extern bool dont_skip;
 extern bool keep_time;
@@ -25,10 +32,21 @@ extern bool no_tail_pack;
 extern bool no_symlink_retarget;
 extern sqfs_writer_cfg_t cfg;
 extern char *root_becomes;
+extern const char *index_file;
 
 void process_args(int argc, char **argv);
 
 /* process_tarball.c */
 int process_tarball(istream_t *input_file, sqfs_writer_t *sqfs);
 
+/* index.c */
+istream_t *index_init(const char *path, istream_t *input);
+
+int index_read_header(istream_t *input, tar_header_decoded_t *hdr,
+		      tar_arena_t *arena);
+
+int index_finish(void);
+
+void index_cleanup(int status);
+
 #endif /* TAR2SQFS_H */
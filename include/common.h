@@ -37,14 +37,24 @@ int inode_stat(const sqfs_tree_node_t *node, struct stat *sb);
 
 char *sqfs_tree_node_get_path(const sqfs_tree_node_t *node);
 
+/*
+  Write the contents of a file to an output stream. If img_fd is a file
+  descriptor of the image and the stream supports it, uncompressed blocks
+  are copied over by the kernel instead of being read by the data reader.
+  Pass -1 to always go through the data reader.
+ */
 int sqfs_data_reader_dump(const char *name, sqfs_data_reader_t *data,
 			  const sqfs_inode_generic_t *inode,
-			  ostream_t *fp, size_t block_size);
+			  ostream_t *fp, size_t block_size, int img_fd);
 
 int write_data_from_file(const char *filename, sqfs_block_processor_t *data,
 			 sqfs_inode_generic_t **inode,
 			 sqfs_file_t *file, int flags);
 
+int write_data_from_memory(const char *filename, sqfs_block_processor_t *data,
+			   sqfs_inode_generic_t **inode, const void *buffer,
+			   size_t size, int flags);
+
 void sqfs_perror(const char *file, const char *action, int error_code);
 
 int sqfs_tree_find_hard_links(const sqfs_tree_node_t *root,
@@ -80,4 +90,42 @@ ostream_t *data_writer_ostream_create(const char *filename,
 				      sqfs_inode_generic_t **inode,
 				      int flags);
 
+/*
+  Breaks down the time and I/O spent on loading the tables of an image. The
+  image file and the compressor are replaced with instrumented versions and
+  every step between table_stats_begin and table_stats_end is recorded as
+  one row. All functions do nothing if the table_stats_t pointer is NULL.
+
+  The stats object must outlive the instrumented compressor. On failure, the
+  wrap functions print an error message and leave the object unchanged.
+ */
+typedef struct table_stats_t table_stats_t;
+
+table_stats_t *table_stats_create(void);
+
+void table_stats_destroy(table_stats_t *ts);
+
+int table_stats_wrap_file(table_stats_t *ts, sqfs_file_t **file);
+
+int table_stats_wrap_compressor(table_stats_t *ts, sqfs_compressor_t **cmp);
+
+void table_stats_begin(table_stats_t *ts);
+
+void table_stats_end(table_stats_t *ts, const char *name);
+
+void table_stats_print(const table_stats_t *ts, const char *filename);
+
+/*
+  Replace a file with one that counts the I/O done through it, for the
+  --io-stats option of the tools. Prints an error message on failure and
+  leaves the file unchanged.
+ */
+int io_stats_wrap(sqfs_file_t **file);
+
+/*
+  Print the I/O counters and histograms of a file created by io_stats_wrap
+  to stderr. Does nothing for other files.
+ */
+void io_stats_print(const sqfs_file_t *file, const char *filename);
+
 #endif /* COMMON_H */
@@ -30,6 +30,19 @@ typedef struct ostream_t {
 
 	int (*append_sparse)(struct ostream_t *strm, size_t size);
 
+	/*
+	  Optional. Append a range of a regular file, given by a file
+	  descriptor, without reading it into a user space buffer first.
+	 */
+	int (*append_from_fd)(struct ostream_t *strm, int fd,
+			      sqfs_u64 offset, sqfs_u64 size);
+
+	/*
+	  Optional. Reserve disk space for the given number of bytes that
+	  are about to be appended.
+	 */
+	int (*preallocate)(struct ostream_t *strm, sqfs_u64 size);
+
 	int (*flush)(struct ostream_t *strm);
 
 	const char *(*get_filename)(struct ostream_t *strm);
@@ -51,11 +64,60 @@ typedef struct istream_t {
 
 	sqfs_u8 *buffer;
 
+	/*
+	  Append data at buffer + buffer_used, up to the size of the stream's
+	  own buffer. The buffer pointer itself must be honoured, since the
+	  read ahead stream points it at memory of its own.
+	 */
 	int (*precache)(struct istream_t *strm);
 
+	/*
+	  Optional. Skip over data that has not been buffered yet without
+	  reading it, e.g. by seeking. Called with an empty buffer.
+	 */
+	int (*skip)(struct istream_t *strm, sqfs_u64 size);
+
+	/*
+	  Optional. Read data that has not been buffered yet directly into
+	  the destination, bypassing the stream buffer. Called with an empty
+	  buffer. Returns the number of bytes read, which is only less than
+	  requested at the end of the stream, or -1 on failure.
+	 */
+	sqfs_s32 (*read_direct)(struct istream_t *strm, void *data,
+				size_t size);
+
 	const char *(*get_filename)(struct istream_t *strm);
 } istream_t;
 
+/**
+ * @struct istream_readahead_stats_t
+ *
+ * @brief Runtime statistics of a read ahead stream.
+ */
+typedef struct {
+	/**
+	 * @brief Time in micro seconds the producer thread spent reading
+	 *        and uncompressing data.
+	 */
+	sqfs_u64 busy_us;
+
+	/**
+	 * @brief Time in micro seconds the reader spent waiting for the
+	 *        producer thread to deliver data.
+	 */
+	sqfs_u64 wait_us;
+
+	/**
+	 * @brief Time in micro seconds since the stream was created.
+	 */
+	sqfs_u64 total_us;
+
+	/**
+	 * @brief Number of bytes handed to the reader.
+	 */
+	sqfs_u64 bytes_read;
+} istream_readahead_stats_t;
+
 
 enum {
 	OSTREAM_OPEN_OVERWRITE = 0x01,
@@ -83,8 +145,13 @@ enum {
 
 	FSTREAM_COMPRESSOR_BZIP2 = 4,
 
+	/**
+	 * @brief LZ4 frame format, as written by the lz4 command line tool.
+	 */
+	FSTREAM_COMPRESSOR_LZ4 = 5,
+
 	FSTREAM_COMPRESSOR_MIN = 1,
-	FSTREAM_COMPRESSOR_MAX = 4,
+	FSTREAM_COMPRESSOR_MAX = 5,
 };
 
 #ifdef __cplusplus
@@ -161,6 +228,47 @@ SQFS_INTERNAL istream_t *istream_open_stdin(void);
 SQFS_INTERNAL ostream_t *ostream_compressor_create(ostream_t *strm,
 						   int comp_id);
 
+/**
+ * @brief Create an output stream that compresses data on multiple threads.
+ *
+ * @memberof ostream_t
+ *
+ * This works like @ref ostream_compressor_create, but uses the given number
+ * of compressor threads. xz and zstd use the multi threaded encoders of the
+ * respective libraries, if available. gzip compresses chunks of data into
+ * separate gzip members in parallel and concatenates them. Other formats
+ * ignore the number of jobs.
+ *
+ * @param strm A pointer to another stream that should be wrapped.
+ * @param comp_id An identifier describing the compressor to use.
+ * @param num_jobs The number of compressor threads to use.
+ *
+ * @return A pointer to an output stream on success, NULL on failure.
+ */
+SQFS_INTERNAL ostream_t *ostream_compressor_create_parallel(ostream_t *strm,
+							    int comp_id,
+							    size_t num_jobs);
+
+/**
+ * @brief Finish the current frame of a compressor stream.
+ *
+ * @memberof ostream_t
+ *
+ * Compresses all data appended so far and terminates the frame, member or
+ * stream of the underlying format, so that everything appended afterwards
+ * goes into a new one that can be uncompressed independently, starting
+ * from the position in the wrapped stream at which this function returned.
+ *
+ * Calling this function if no data was appended since the last frame
+ * ended is a no-op.
+ *
+ * @param strm A pointer to a stream returned by
+ *             @ref ostream_compressor_create.
+ *
+ * @return Zero on success, -1 on failure.
+ */
+SQFS_INTERNAL int ostream_compressor_end_frame(ostream_t *strm);
+
 /**
  * @brief Create an input stream that transparently uncompresses data.
  *
@@ -182,6 +290,73 @@ SQFS_INTERNAL ostream_t *ostream_compressor_create(ostream_t *strm,
 SQFS_INTERNAL istream_t *istream_compressor_create(istream_t *strm,
 						   int comp_id);
 
+/**
+ * @brief Create an input stream that uncompresses data on a thread pool.
+ *
+ * @memberof istream_t
+ *
+ * This works like @ref istream_compressor_create, but for formats where the
+ * compressed data consists of independently decodable frames (zstd) or
+ * members (gzip), e.g. produced by parallel compression tools or by simply
+ * concatenating compressed files, the input is split up at frame
+ * boundaries and the pieces are uncompressed on a pool of worker threads.
+ * The uncompressed data is delivered in order.
+ *
+ * Very large frames are uncompressed serially, so a stream that consists
+ * of a single frame is processed just like with the serial decompressor.
+ * The same happens to pieces that uncompress to more than a few megabytes,
+ * so highly compressible input does not pile up in memory.
+ *
+ * For formats that do not support this, the function falls back to
+ * @ref istream_compressor_create.
+ *
+ * @param strm A pointer to another stream that should be wrapped.
+ * @param comp_id An identifier describing the compressor to use.
+ * @param num_jobs The number of worker threads to use.
+ *
+ * @return A pointer to an input stream on success, NULL on failure.
+ */
+SQFS_INTERNAL istream_t *istream_compressor_create_parallel(istream_t *strm,
+							    int comp_id,
+							    size_t num_jobs);
+
+/**
+ * @brief Create an input stream that reads ahead on a background thread.
+ *
+ * @memberof istream_t
+ *
+ * This function creates an input stream that wraps another input stream.
+ * A producer thread fills a ring of buffers from the wrapped stream, e.g.
+ * uncompressing data, while the thread that reads from the returned stream
+ * is busy processing earlier buffers. The wrapped stream writes directly
+ * into the ring buffers, the reader gets a pointer into them.
+ *
+ * The wrapped stream must not be used by anything else afterwards. The new
+ * stream takes ownership of the wrapped stream and destroys it when it is
+ * destroyed itself. If this function fails, the wrapped stream is also
+ * destroyed.
+ *
+ * @param strm A pointer to another stream that should be wrapped.
+ * @param num_buffers The number of buffers to keep in flight.
+ *
+ * @return A pointer to an input stream on success, NULL on failure.
+ */
+SQFS_INTERNAL istream_t *istream_readahead_create(istream_t *strm,
+						  size_t num_buffers);
+
+/**
+ * @brief Get runtime statistics from a read ahead stream.
+ *
+ * @memberof istream_t
+ *
+ * @param strm A pointer to a stream created by
+ *             @ref istream_readahead_create.
+ * @param stats Returns the statistics.
+ */
+SQFS_INTERNAL void
+istream_readahead_get_stats(istream_t *strm,
+			    istream_readahead_stats_t *stats);
+
 /**
  * @brief Probe the buffered data in an istream to check if it is compressed.
  *
@@ -231,6 +406,43 @@ SQFS_INTERNAL int ostream_append(ostream_t *strm, const void *data,
  */
 SQFS_INTERNAL int ostream_append_sparse(ostream_t *strm, size_t size);
 
+/**
+ * @brief Append a range of a regular file to an output stream.
+ *
+ * @memberof ostream_t
+ *
+ * Only output streams that have an append_from_fd implementation support
+ * this. The data is moved between the files by the kernel, e.g. using
+ * copy_file_range, which can also share the extents on file systems that
+ * support reflinks.
+ *
+ * @param strm A pointer to an output stream.
+ * @param fd A file descriptor of a regular file to copy from.
+ * @param offset The absolute position in the file to start copying from.
+ * @param size The number of bytes to copy.
+ *
+ * @return Zero on success, -1 on failure.
+ */
+SQFS_INTERNAL int ostream_append_from_fd(ostream_t *strm, int fd,
+					 sqfs_u64 offset, sqfs_u64 size);
+
+/**
+ * @brief Reserve space for data that is about to be appended.
+ *
+ * @memberof ostream_t
+ *
+ * This is only a hint, e.g. for allocating the space of a file in one
+ * piece up front. If the underlying implementation does not support it,
+ * nothing happens. Holes that are created through
+ * @ref ostream_append_sparse afterwards are removed from the reservation.
+ *
+ * @param strm A pointer to an output stream.
+ * @param size The number of bytes that follow.
+ *
+ * @return Zero on success, -1 on failure, e.g. if the disk is full.
+ */
+SQFS_INTERNAL int ostream_preallocate(ostream_t *strm, sqfs_u64 size);
+
 /**
  * @brief Process all pending, buffered data and flush it to disk.
  *
@@ -300,6 +512,32 @@ SQFS_INTERNAL int ostream_printf(ostream_t *strm, const char *fmt, ...)
 SQFS_INTERNAL int istream_get_line(istream_t *strm, char **out,
 				   size_t *line_num, int flags);
 
+/**
+ * @brief Read a line of text from an input stream into a reusable buffer
+ *
+ * @memberof istream_t
+ *
+ * This works exactly like @ref istream_get_line, except that the line is
+ * stored in a caller provided buffer that is grown using realloc as needed,
+ * similar to the POSIX getline function. When reading lots of lines, this
+ * avoids allocating and freeing memory for every single one.
+ *
+ * The buffer is owned by the caller and must be freed by the caller when it
+ * is no longer needed, even if the function fails.
+ *
+ * @param strm A pointer to an input stream.
+ * @param buffer A pointer to a buffer pointer, initially NULL.
+ * @param size A pointer to the buffer capacity, initially 0.
+ * @param line_num This is incremented if lines are skipped.
+ * @param flags A combination of flags controling the functions behaviour.
+ *
+ * @return Zero on success, a negative value on error, a positive value if
+ *         end-of-file was reached without reading any data.
+ */
+SQFS_INTERNAL int istream_get_line_buffered(istream_t *strm, char **buffer,
+					    size_t *size, size_t *line_num,
+					    int flags);
+
 /**
  * @brief Read data from an input stream
  *
@@ -345,6 +583,10 @@ SQFS_INTERNAL const char *istream_get_filename(istream_t *strm);
  *
  * @memberof istream_t
  *
+ * Data that is already buffered is simply dropped. For the rest, streams
+ * that support it (e.g. regular files) seek forward instead of reading and
+ * discarding the data.
+ *
  * @param strm A pointer to an input stream.
  * @param size The number of bytes to seek forward.
  *
@@ -67,7 +67,6 @@ struct file_info_t {
 	/* used by sort file processing */
 	sqfs_s64 priority;
 	int flags;
-	bool already_matched;
 };
 
 /* Additional meta data stored in a tree_node_t for directories */
@@ -75,6 +74,10 @@ struct dir_info_t {
 	/* Linked list head for children in the directory */
 	tree_node_t *children;
 
+	/* Last entry in the children list. Used for quickly appending
+	   entries that are added in sorted order. */
+	tree_node_t *last_child;
+
 	/* Set to true for implicitly generated directories.  */
 	bool created_implicitly;
 
@@ -182,6 +185,15 @@ tree_node_t *fstree_mknode(tree_node_t *parent, const char *name,
 tree_node_t *fstree_add_generic(fstree_t *fs, const char *path,
 				const struct stat *sb, const char *extra);
 
+/*
+  Same as fstree_add_generic, but the path is interpreted as relative to the
+  given directory node instead of the tree root. This can be used to speed up
+  adding lots of entries to the same directory.
+*/
+tree_node_t *fstree_add_generic_at(fstree_t *fs, tree_node_t *root,
+				   const char *path, const struct stat *sb,
+				   const char *extra);
+
 /*
   Parses the file format accepted by gensquashfs and produce a file system
   tree from it. File input paths are interpreted as relative to the current
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * manifest.h
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include "config.h"
+
+#include "sqfs/compressor.h"
+#include "sqfs/dir_reader.h"
+#include "sqfs/super.h"
+#include "sqfs/io.h"
+
+#include "fstream.h"
+#include "util.h"
+
+/*
+  A manifest lists every entry of a filesystem tree with its meta data and,
+  for regular files, the size and SHA-256 of the contents. Comparing an
+  image against a stored manifest tells what changed, without needing the
+  old image anymore.
+ */
+typedef struct {
+	char *path;
+
+	/* symlink target, NULL for all other types */
+	char *target;
+
+	/* permission bits and S_IFMT type */
+	sqfs_u16 mode;
+	sqfs_u32 uid;
+	sqfs_u32 gid;
+	sqfs_u32 mtime;
+
+	/* device number of block and character devices */
+	sqfs_u32 devno;
+
+	/* size and content hash of regular files */
+	sqfs_u64 size;
+	sqfs_u8 hash[SHA256_DIGEST_SIZE];
+} manifest_entry_t;
+
+typedef struct {
+	manifest_entry_t *entries;
+	size_t count;
+} manifest_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  Create a manifest from a tree read from an image. The file contents are
+  hashed on num_jobs threads, each using a copy of the given file and
+  compressor. Entries are stored in the pre-order of the tree walk.
+ */
+manifest_t *manifest_from_tree(const char *filename, sqfs_file_t *file,
+			       sqfs_compressor_t *cmp,
+			       const sqfs_super_t *super,
+			       const sqfs_tree_node_t *root, size_t num_jobs);
+
+int manifest_write(const manifest_t *manifest, ostream_t *out);
+
+manifest_t *manifest_read(istream_t *in);
+
+/* Sort the entries by path, e.g. to merge two manifests in one pass */
+void manifest_sort(manifest_t *manifest);
+
+void manifest_destroy(manifest_t *manifest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MANIFEST_H */
@@ -54,6 +54,7 @@ typedef struct {
 	bool exportable;
 	bool no_xattr;
 	bool quiet;
+	bool io_stats;
 } sqfs_writer_cfg_t;
 
 #ifdef __cplusplus
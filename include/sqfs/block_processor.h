@@ -108,6 +108,22 @@ struct sqfs_block_processor_stats_t {
 	 * eliminated by deduplication.
 	 */
 	sqfs_u64 actual_frag_count;
+
+	/**
+	 * @brief Total number of pre-encoded data blocks submitted through
+	 *        @ref sqfs_block_processor_append_raw.
+	 *
+	 * These are also included in the data block count.
+	 */
+	sqfs_u64 raw_block_count;
+
+	/**
+	 * @brief Total number of uncompressed bytes that the pre-encoded
+	 *        blocks represent.
+	 *
+	 * These are also included in the number of input bytes read.
+	 */
+	sqfs_u64 raw_bytes_read;
 };
 
 /**
@@ -290,6 +306,76 @@ SQFS_API int sqfs_block_processor_begin_file(sqfs_block_processor_t *proc,
 SQFS_API int sqfs_block_processor_append(sqfs_block_processor_t *proc,
 					 const void *data, size_t size);
 
+/**
+ * @brief Get a pointer to the unused space of the current data block.
+ *
+ * @memberof sqfs_block_processor_t
+ *
+ * This is an alternative to @ref sqfs_block_processor_append that allows
+ * writing file data directly into the block buffer, e.g. by reading it from
+ * a file or uncompressing it there, instead of copying it out of a separate
+ * buffer. After filling the space, @ref sqfs_block_processor_commit must be
+ * called to append the data to the current file.
+ *
+ * If the current block is full, or there is none yet, a new one is started,
+ * so the returned size is never zero.
+ *
+ * @param proc A pointer to a data writer object.
+ * @param data Returns a pointer to the unused space in the current block.
+ * @param size Returns the number of bytes available at that location.
+ *
+ * @return Zero on success, an @ref SQFS_ERROR value on failure.
+ */
+SQFS_API int sqfs_block_processor_get_buffer(sqfs_block_processor_t *proc,
+					     void **data, size_t *size);
+
+/**
+ * @brief Append data that was written into the current data block.
+ *
+ * @memberof sqfs_block_processor_t
+ *
+ * The counter part to @ref sqfs_block_processor_get_buffer. The given number
+ * of bytes, starting at the pointer returned by it, are appended to the
+ * current file. If this fills up the block, it is submitted for processing
+ * and the pointer is no longer valid.
+ *
+ * @param proc A pointer to a data writer object.
+ * @param size The number of bytes that were written, at most the size
+ *             returned by @ref sqfs_block_processor_get_buffer.
+ *
+ * @return Zero on success, an @ref SQFS_ERROR value on failure.
+ */
+SQFS_API int sqfs_block_processor_commit(sqfs_block_processor_t *proc,
+					 size_t size);
+
+/**
+ * @brief Append an already encoded data block to the current file.
+ *
+ * @memberof sqfs_block_processor_t
+ *
+ * This can be used to copy data blocks from an existing image without
+ * decompressing and recompressing them. The block is passed down to
+ * the block writer as-is, but still takes part in block deduplication.
+ *
+ * Raw blocks must be appended before any data is added to the file
+ * through @ref sqfs_block_processor_append, or after full blocks only.
+ * Only the last raw block of a file may be shorter than the block size.
+ * Sparse blocks cannot be represented this way and have to be appended
+ * as zero bytes instead.
+ *
+ * @param proc A pointer to a data writer object.
+ * @param data A pointer to the encoded block data.
+ * @param disk_size The on-disk size field of the block, as stored in a
+ *                  file inode, i.e. with the uncompressed flag set if the
+ *                  data is stored uncompressed.
+ * @param size The number of uncompressed bytes the block represents.
+ *
+ * @return Zero on success, an @ref SQFS_ERROR value on failure.
+ */
+SQFS_API int sqfs_block_processor_append_raw(sqfs_block_processor_t *proc,
+					     const void *data,
+					     sqfs_u32 disk_size, size_t size);
+
 /**
  * @brief Stop writing the current file and flush everything that is
  *        buffered internally.
@@ -144,6 +144,116 @@ struct sqfs_file_t {
 	int (*truncate)(sqfs_file_t *file, sqfs_u64 size);
 };
 
+/**
+ * @brief The number of buckets in the histograms of a
+ *        @ref sqfs_file_stats_t
+ *
+ * Bucket 0 counts values of 0, bucket i > 0 counts values in the range
+ * [2^(i-1), 2^i - 1]. Values that are larger are counted in the last bucket.
+ */
+#define SQFS_FILE_STATS_HIST_SIZE (40)
+
+/**
+ * @struct sqfs_file_stats_t
+ *
+ * @brief Counters collected by a file created through
+ *        @ref sqfs_file_stats_create
+ */
+struct sqfs_file_stats_t {
+	/**
+	 * @brief Holds the size of the structure.
+	 *
+	 * If a later version of libsquashfs expands this structure, the value
+	 * of this field can be used to check at runtime whether the newer
+	 * fields are avaialable or not.
+	 */
+	size_t size;
+
+	/**
+	 * @brief Total number of read_at calls forwarded to the wrapped file.
+	 */
+	sqfs_u64 read_calls;
+
+	/**
+	 * @brief Total number of bytes requested through read_at.
+	 */
+	sqfs_u64 bytes_read;
+
+	/**
+	 * @brief Total time spent in read_at calls, in microseconds.
+	 */
+	sqfs_u64 read_time_us;
+
+	/**
+	 * @brief Total number of write_at calls forwarded to the wrapped file.
+	 */
+	sqfs_u64 write_calls;
+
+	/**
+	 * @brief Total number of bytes passed to write_at.
+	 */
+	sqfs_u64 bytes_written;
+
+	/**
+	 * @brief Total time spent in write_at calls, in microseconds.
+	 */
+	sqfs_u64 write_time_us;
+
+	/**
+	 * @brief Number of reads that started exactly where the previous
+	 *        one ended.
+	 */
+	sqfs_u64 read_seq_calls;
+
+	/**
+	 * @brief Number of reads that started before the end of the previous
+	 *        one, i.e. that required seeking backwards.
+	 */
+	sqfs_u64 read_back_calls;
+
+	/**
+	 * @brief Number of distinct bytes of the file that were read.
+	 *
+	 * Together with bytes_read, this shows how much data was read more
+	 * than once. If memory for keeping track of the ranges read so far
+	 * runs out, the reads are counted as distinct.
+	 */
+	sqfs_u64 read_unique_bytes;
+
+	/**
+	 * @brief Number of writes that started exactly where the previous
+	 *        one ended.
+	 */
+	sqfs_u64 write_seq_calls;
+
+	/**
+	 * @brief Histogram of read sizes in bytes.
+	 */
+	sqfs_u64 read_size_hist[SQFS_FILE_STATS_HIST_SIZE];
+
+	/**
+	 * @brief Histogram of read latencies in microseconds.
+	 */
+	sqfs_u64 read_time_hist[SQFS_FILE_STATS_HIST_SIZE];
+
+	/**
+	 * @brief Histogram of the distance in bytes between the end of the
+	 *        previous read and the start of the next one, for reads that
+	 *        are not sequential.
+	 */
+	sqfs_u64 read_seek_hist[SQFS_FILE_STATS_HIST_SIZE];
+
+	/**
+	 * @brief Histogram of write sizes in bytes.
+	 */
+	sqfs_u64 write_size_hist[SQFS_FILE_STATS_HIST_SIZE];
+
+	/**
+	 * @brief Histogram of write latencies in microseconds.
+	 */
+	sqfs_u64 write_time_hist[SQFS_FILE_STATS_HIST_SIZE];
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -167,6 +277,45 @@ extern "C" {
  */
 SQFS_API sqfs_file_t *sqfs_open_file(const char *filename, sqfs_u32 flags);
 
+/**
+ * @brief Create a file that counts the I/O done through it
+ *
+ * The returned file forwards all calls to the wrapped file and keeps track
+ * of the number of reads and writes, the number of bytes transferred and
+ * the time spent doing so, as well as histograms of the request sizes,
+ * latencies and seek distances. The counters can be retrieved at any point
+ * using @ref sqfs_file_stats_get.
+ *
+ * The wrapped file is owned by the returned object and destroyed along with
+ * it. Copying the returned object creates a wrapper around a copy of the
+ * underlying file with its own set of counters, starting at zero. When the
+ * copy is destroyed, its counters are added to the file it was copied from,
+ * so the copies handed to worker threads show up in the total. The original
+ * must therefore outlive all copies, and the copies must not be destroyed
+ * while the original is accessed concurrently.
+ *
+ * The counters are updated without any locking, so a single object must not
+ * be accessed concurrently.
+ *
+ * @param wrapped A pointer to the file to forward calls to.
+ *
+ * @return A pointer to a file object on success, NULL on allocation failure.
+ *         If creating the wrapper fails, the wrapped file is not destroyed.
+ */
+SQFS_API sqfs_file_t *sqfs_file_stats_create(sqfs_file_t *wrapped);
+
+/**
+ * @brief Get the I/O counters of a file created through
+ *        @ref sqfs_file_stats_create
+ *
+ * @param file A pointer to a file object.
+ *
+ * @return A pointer to a @ref sqfs_file_stats_t structure, or NULL if the
+ *         file was not created by @ref sqfs_file_stats_create.
+ */
+SQFS_API const sqfs_file_stats_t
+*sqfs_file_stats_get(const sqfs_file_t *file);
+
 #ifdef __cplusplus
 }
 #endif
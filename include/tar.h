@@ -77,6 +77,12 @@ typedef struct tar_xattr_t {
 	char data[];
 } tar_xattr_t;
 
+/*
+  A growing buffer that a header can be decoded into, instead of
+  allocating every string and list node of it separately.
+ */
+typedef struct tar_arena_t tar_arena_t;
+
 typedef struct {
 	char *name;
 	char *link_target;
@@ -92,6 +98,9 @@ typedef struct {
 	sqfs_u64 gid;
 	sqfs_u64 devno;
 	sqfs_s64 mtime;
+
+	/* if not NULL, everything above was allocated from this arena */
+	tar_arena_t *arena;
 } tar_header_decoded_t;
 
 #define TAR_TYPE_FILE '0'
@@ -139,6 +148,19 @@ int skip_entry(istream_t *fp, sqfs_u64 size);
 
 int read_header(istream_t *fp, tar_header_decoded_t *out);
 
+/*
+  Same as read_header, but all memory for the decoded header is taken from
+  the given arena. The arena is reset when reading the next header, or when
+  calling clear_header on the decoded header, which invalidates all data
+  that was previously decoded into it.
+ */
+int read_header_arena(istream_t *fp, tar_header_decoded_t *out,
+		      tar_arena_t *arena);
+
+tar_arena_t *tar_arena_create(void);
+
+void tar_arena_destroy(tar_arena_t *arena);
+
 void free_xattr_list(tar_xattr_t *list);
 
 void clear_header(tar_header_decoded_t *hdr);
@@ -13,6 +13,21 @@
 
 #include <stddef.h>
 
+typedef struct {
+	sqfs_u64 total_len;
+	sqfs_u32 v1, v2, v3, v4;
+	sqfs_u8 mem[16];
+	size_t memsize;
+} xxh32_state_t;
+
+#define SHA256_DIGEST_SIZE (32)
+
+typedef struct {
+	sqfs_u64 total_len;
+	sqfs_u32 h[8];
+	sqfs_u8 mem[64];
+} sha256_state_t;
+
 /*
   Helper for allocating data structures with flexible array members.
 
@@ -30,9 +45,42 @@ void *alloc_array(size_t item_size, size_t nmemb);
 
 SQFS_INTERNAL sqfs_u32 xxh32(const void *input, const size_t len);
 
+/*
+  Incremental hashing for data that arrives in pieces. The result is
+  compatible with the reference xxHash implementation, which the above
+  function is not. Only use the latter for hashes that never leave memory.
+ */
+SQFS_INTERNAL void xxh32_reset(xxh32_state_t *state);
+
+SQFS_INTERNAL void xxh32_update(xxh32_state_t *state, const void *input,
+				size_t len);
+
+SQFS_INTERNAL sqfs_u32 xxh32_digest(const xxh32_state_t *state);
+
+/* One shot version of the incremental interface */
+SQFS_INTERNAL sqfs_u32 xxh32_ref(const void *input, size_t len);
+
+/*
+  Incremental SHA-256, for content hashes that are stored or compared
+  outside the program, where a collision must not be possible in practice.
+ */
+SQFS_INTERNAL void sha256_reset(sha256_state_t *state);
+
+SQFS_INTERNAL void sha256_update(sha256_state_t *state, const void *input,
+				 size_t len);
+
+SQFS_INTERNAL void sha256_digest(sha256_state_t *state,
+				 sqfs_u8 digest[SHA256_DIGEST_SIZE]);
+
 /*
   Returns true if the given region of memory is filled with zero-bytes only.
  */
 SQFS_INTERNAL bool is_memory_zero(const void *blob, size_t size);
 
+/*
+  Returns a monotonic time stamp in micro seconds. Only useful for
+  measuring durations, the absolute value is meaningless.
+ */
+SQFS_INTERNAL sqfs_u64 get_time_us(void);
+
 #endif /* SQFS_UTIL_H */
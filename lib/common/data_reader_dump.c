@@ -11,20 +11,58 @@
 #include <stdio.h>
 #include <errno.h>
 
+/* blocks that are stored as-is and can be copied over from the image */
+static bool is_raw_block(sqfs_u32 size, size_t diff)
+{
+	return !SQFS_IS_SPARSE_BLOCK(size) && !SQFS_IS_BLOCK_COMPRESSED(size) &&
+	       SQFS_ON_DISK_BLOCK_SIZE(size) == diff;
+}
+
 int sqfs_data_reader_dump(const char *name, sqfs_data_reader_t *data,
 			  const sqfs_inode_generic_t *inode,
-			  ostream_t *fp, size_t block_size)
+			  ostream_t *fp, size_t block_size, int img_fd)
 {
-	size_t i, diff, chunk_size;
-	sqfs_u64 filesz;
+	size_t i, diff, chunk_size, count;
+	sqfs_u64 filesz, offset, run_start, run_size;
 	sqfs_u8 *chunk;
 	int err;
 
 	sqfs_inode_get_file_size(inode, &filesz);
+	sqfs_inode_get_file_block_start(inode, &offset);
+	count = sqfs_inode_get_file_block_count(inode);
 
-	for (i = 0; i < sqfs_inode_get_file_block_count(inode); ++i) {
+	for (i = 0; i < count; ++i) {
 		diff = (filesz < block_size) ? filesz : block_size;
 
+		if (img_fd >= 0 && fp->append_from_fd != NULL &&
+		    is_raw_block(inode->extra[i], diff)) {
+			run_start = offset;
+			run_size = 0;
+
+			for (;;) {
+				offset += diff;
+				run_size += diff;
+				filesz -= diff;
+
+				if ((i + 1) >= count)
+					break;
+
+				diff = (filesz < block_size) ?
+					filesz : block_size;
+
+				if (!is_raw_block(inode->extra[i + 1], diff))
+					break;
+
+				++i;
+			}
+
+			if (ostream_append_from_fd(fp, img_fd, run_start,
+						   run_size)) {
+				return -1;
+			}
+			continue;
+		}
+
 		if (SQFS_IS_SPARSE_BLOCK(inode->extra[i])) {
 			if (ostream_append_sparse(fp, diff))
 				return -1;
@@ -43,6 +81,7 @@ int sqfs_data_reader_dump(const char *name, sqfs_data_reader_t *data,
 				return -1;
 		}
 
+		offset += SQFS_ON_DISK_BLOCK_SIZE(inode->extra[i]);
 		filesz -= diff;
 	}
 
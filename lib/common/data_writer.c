@@ -52,3 +52,32 @@ int write_data_from_file(const char *filename, sqfs_block_processor_t *data,
 
 	return 0;
 }
+
+int write_data_from_memory(const char *filename, sqfs_block_processor_t *data,
+			   sqfs_inode_generic_t **inode, const void *buffer,
+			   size_t size, int flags)
+{
+	int ret;
+
+	ret = sqfs_block_processor_begin_file(data, inode, NULL, flags);
+	if (ret) {
+		sqfs_perror(filename, "beginning file data blocks", ret);
+		return -1;
+	}
+
+	if (size > 0) {
+		ret = sqfs_block_processor_append(data, buffer, size);
+		if (ret) {
+			sqfs_perror(filename, "packing file data", ret);
+			return -1;
+		}
+	}
+
+	ret = sqfs_block_processor_end_file(data);
+	if (ret) {
+		sqfs_perror(filename, "finishing file data", ret);
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * io_stats.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "config.h"
+#include "common.h"
+
+#include <string.h>
+#include <stdio.h>
+
+static sqfs_u64 bucket_min(size_t i)
+{
+	return i == 0 ? 0 : ((sqfs_u64)1 << (i - 1));
+}
+
+static sqfs_u64 bucket_max(size_t i)
+{
+	return i == 0 ? 0 : (((sqfs_u64)1 << i) - 1);
+}
+
+/* upper bound of the bucket that contains the given percentile */
+static sqfs_u64 percentile(const sqfs_u64 *hist, sqfs_u64 total,
+			   unsigned int pct)
+{
+	sqfs_u64 sum = 0;
+	size_t i;
+
+	for (i = 0; i < SQFS_FILE_STATS_HIST_SIZE; ++i) {
+		sum += hist[i];
+
+		if (sum * 100 >= total * pct)
+			break;
+	}
+
+	if (i >= SQFS_FILE_STATS_HIST_SIZE)
+		i = SQFS_FILE_STATS_HIST_SIZE - 1;
+
+	return bucket_max(i);
+}
+
+static void print_hist(const char *title, const sqfs_u64 *hist)
+{
+	char lo[32], hi[32], count[32];
+	sqfs_u64 total = 0;
+	size_t i;
+
+	for (i = 0; i < SQFS_FILE_STATS_HIST_SIZE; ++i)
+		total += hist[i];
+
+	if (total == 0)
+		return;
+
+	fprintf(stderr, "%s:\n", title);
+
+	for (i = 0; i < SQFS_FILE_STATS_HIST_SIZE; ++i) {
+		if (hist[i] == 0)
+			continue;
+
+		sprintf(lo, PRI_U64, bucket_min(i));
+		sprintf(count, PRI_U64, hist[i]);
+
+		if (i == SQFS_FILE_STATS_HIST_SIZE - 1) {
+			strcpy(hi, "- ...");
+		} else if (bucket_max(i) > bucket_min(i)) {
+			sprintf(hi, "- " PRI_U64, bucket_max(i));
+		} else {
+			hi[0] = '\0';
+		}
+
+		fprintf(stderr, "    %12s %-14s %10s (%u%%)\n", lo, hi, count,
+			(unsigned int)((hist[i] * 100) / total));
+	}
+}
+
+static void print_latency(const sqfs_u64 *hist, sqfs_u64 calls,
+			  sqfs_u64 time_us)
+{
+	fprintf(stderr, "Time: " PRI_U64 "us, p50 <= " PRI_U64 "us, "
+		"p90 <= " PRI_U64 "us, p99 <= " PRI_U64 "us\n", time_us,
+		percentile(hist, calls, 50), percentile(hist, calls, 90),
+		percentile(hist, calls, 99));
+}
+
+int io_stats_wrap(sqfs_file_t **file)
+{
+	sqfs_file_t *wrapped = sqfs_file_stats_create(*file);
+
+	if (wrapped == NULL) {
+		perror("creating I/O counter");
+		return -1;
+	}
+
+	*file = wrapped;
+	return 0;
+}
+
+void io_stats_print(const sqfs_file_t *file, const char *filename)
+{
+	const sqfs_file_stats_t *stats = sqfs_file_stats_get(file);
+	char size[32], unique[32];
+	sqfs_u64 amp;
+
+	if (stats == NULL)
+		return;
+
+	fprintf(stderr, "I/O statistics for %s:\n", filename);
+
+	if (stats->read_calls > 0) {
+		print_size(stats->bytes_read, size, false);
+		print_size(stats->read_unique_bytes, unique, false);
+
+		fprintf(stderr, "Reads: " PRI_U64 ", " PRI_U64 " sequential, "
+			PRI_U64 " backwards\n", stats->read_calls,
+			stats->read_seq_calls, stats->read_back_calls);
+
+		fprintf(stderr, "Bytes read: %s, %s distinct", size, unique);
+
+		if (stats->read_unique_bytes > 0) {
+			amp = (stats->bytes_read * 100) /
+				stats->read_unique_bytes;
+
+			fprintf(stderr, ", amplification %u.%02u",
+				(unsigned int)(amp / 100),
+				(unsigned int)(amp % 100));
+		}
+
+		fputc('\n', stderr);
+
+		print_latency(stats->read_time_hist, stats->read_calls,
+			      stats->read_time_us);
+		print_hist("Read sizes (bytes)", stats->read_size_hist);
+		print_hist("Read latencies (us)", stats->read_time_hist);
+		print_hist("Seek distances (bytes)", stats->read_seek_hist);
+	}
+
+	if (stats->write_calls > 0) {
+		print_size(stats->bytes_written, size, false);
+
+		fprintf(stderr, "Writes: " PRI_U64 ", " PRI_U64 " sequential\n",
+			stats->write_calls, stats->write_seq_calls);
+		fprintf(stderr, "Bytes written: %s\n", size);
+
+		print_latency(stats->write_time_hist, stats->write_calls,
+			      stats->write_time_us);
+		print_hist("Write sizes (bytes)", stats->write_size_hist);
+		print_hist("Write latencies (us)", stats->write_time_hist);
+	}
+}
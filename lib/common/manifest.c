@@ -0,0 +1,650 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * manifest.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "common.h"
+#include "manifest.h"
+#include "threadpool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <errno.h>
+
+/* amount of file data a hashing job reads at once */
+#define HASH_WINDOW (1024 * 1024)
+
+#define MAX_FIELDS (9)
+
+typedef struct {
+	const sqfs_inode_generic_t *inode;
+	manifest_entry_t *ent;
+	int status;
+} hash_job_t;
+
+typedef struct {
+	sqfs_file_t *file;
+	sqfs_compressor_t *cmp;
+	sqfs_data_reader_t *data;
+	sqfs_u8 *buffer;
+} hash_worker_t;
+
+static const struct {
+	const char *name;
+	sqfs_u16 type;
+} types[] = {
+	{ "dir", S_IFDIR },
+	{ "file", S_IFREG },
+	{ "slink", S_IFLNK },
+	{ "nod", S_IFCHR },
+	{ "nod", S_IFBLK },
+	{ "pipe", S_IFIFO },
+	{ "sock", S_IFSOCK },
+};
+
+/*****************************************************************************/
+
+static int hash_worker(void *user, void *ptr)
+{
+	hash_worker_t *w = user;
+	hash_job_t *job = ptr;
+	sqfs_u64 offset, size;
+	sha256_state_t state;
+	sqfs_s32 ret;
+
+	sha256_reset(&state);
+	size = job->ent->size;
+
+	for (offset = 0; offset < size; offset += ret) {
+		ret = sqfs_data_reader_read(w->data, job->inode, offset,
+					    w->buffer, HASH_WINDOW);
+		if (ret <= 0) {
+			job->status = ret < 0 ? ret : SQFS_ERROR_OUT_OF_BOUNDS;
+			return 0;
+		}
+
+		sha256_update(&state, w->buffer, ret);
+	}
+
+	sha256_digest(&state, job->ent->hash);
+	return 0;
+}
+
+static void destroy_workers(hash_worker_t *workers, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; ++i) {
+		if (workers[i].data != NULL)
+			sqfs_destroy(workers[i].data);
+
+		if (workers[i].cmp != NULL)
+			sqfs_destroy(workers[i].cmp);
+
+		if (workers[i].file != NULL)
+			sqfs_destroy(workers[i].file);
+
+		free(workers[i].buffer);
+	}
+
+	free(workers);
+}
+
+static int init_worker(hash_worker_t *w, const char *filename,
+		       sqfs_file_t *file, sqfs_compressor_t *cmp,
+		       const sqfs_super_t *super)
+{
+	int ret;
+
+	w->file = sqfs_copy(file);
+	if (w->file == NULL) {
+		perror(filename);
+		return -1;
+	}
+
+	w->cmp = sqfs_copy(cmp);
+	w->buffer = malloc(HASH_WINDOW);
+
+	if (w->cmp == NULL || w->buffer == NULL) {
+		sqfs_perror(filename, "creating hashing thread",
+			    SQFS_ERROR_ALLOC);
+		return -1;
+	}
+
+	w->data = sqfs_data_reader_create(w->file, super->block_size,
+					  w->cmp, 0);
+	if (w->data == NULL) {
+		sqfs_perror(filename, "creating data reader",
+			    SQFS_ERROR_ALLOC);
+		return -1;
+	}
+
+	ret = sqfs_data_reader_load_fragment_table(w->data, super);
+	if (ret) {
+		sqfs_perror(filename, "loading fragment table", ret);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int hash_files(const char *filename, sqfs_file_t *file,
+		      sqfs_compressor_t *cmp, const sqfs_super_t *super,
+		      hash_job_t *jobs, size_t num_files, size_t num_jobs)
+{
+	hash_worker_t *workers = NULL;
+	size_t i, num_workers = 0;
+	thread_pool_t *pool;
+	hash_job_t *job;
+	int status = -1;
+
+	pool = thread_pool_create(num_jobs, hash_worker);
+	if (pool == NULL) {
+		fputs("Error creating file hashing thread pool\n", stderr);
+		return -1;
+	}
+
+	num_workers = pool->get_worker_count(pool);
+	workers = calloc(num_workers, sizeof(workers[0]));
+	if (workers == NULL) {
+		perror("creating file hashing thread pool");
+		goto out;
+	}
+
+	for (i = 0; i < num_workers; ++i) {
+		if (init_worker(workers + i, filename, file, cmp, super))
+			goto out;
+
+		pool->set_worker_ptr(pool, i, workers + i);
+	}
+
+	for (i = 0; i < num_files; ++i) {
+		if (pool->submit(pool, jobs + i) != 0) {
+			fputs("Error submitting file hashing job\n", stderr);
+			goto out;
+		}
+	}
+
+	for (i = 0; i < num_files; ++i) {
+		job = pool->dequeue(pool);
+
+		if (job->status != 0) {
+			sqfs_perror(job->ent->path, "reading file data",
+				    job->status);
+			goto out;
+		}
+	}
+
+	status = 0;
+out:
+	pool->destroy(pool);
+	if (workers != NULL)
+		destroy_workers(workers, num_workers);
+	return status;
+}
+
+/*****************************************************************************/
+
+static size_t count_nodes(const sqfs_tree_node_t *n)
+{
+	size_t count = 1;
+
+	for (n = n->children; n != NULL; n = n->next)
+		count += count_nodes(n);
+
+	return count;
+}
+
+static int fill_entries(manifest_t *m, hash_job_t *jobs, size_t *num_files,
+			const sqfs_tree_node_t *n)
+{
+	manifest_entry_t *ent = m->entries + m->count;
+	const sqfs_inode_generic_t *inode = n->inode;
+
+	ent->path = sqfs_tree_node_get_path(n);
+	if (ent->path == NULL) {
+		perror("constructing absolute file path");
+		return -1;
+	}
+
+	m->count += 1;
+
+	ent->mode = inode->base.mode;
+	ent->uid = n->uid;
+	ent->gid = n->gid;
+	ent->mtime = inode->base.mod_time;
+
+	switch (inode->base.type) {
+	case SQFS_INODE_FILE:
+	case SQFS_INODE_EXT_FILE:
+		sqfs_inode_get_file_size(inode, &ent->size);
+
+		jobs[*num_files].inode = inode;
+		jobs[*num_files].ent = ent;
+		*num_files += 1;
+		break;
+	case SQFS_INODE_SLINK:
+	case SQFS_INODE_EXT_SLINK:
+		ent->target = strdup((const char *)inode->extra);
+		if (ent->target == NULL) {
+			perror(ent->path);
+			return -1;
+		}
+		break;
+	case SQFS_INODE_BDEV:
+	case SQFS_INODE_CDEV:
+		ent->devno = inode->data.dev.devno;
+		break;
+	case SQFS_INODE_EXT_BDEV:
+	case SQFS_INODE_EXT_CDEV:
+		ent->devno = inode->data.dev_ext.devno;
+		break;
+	default:
+		break;
+	}
+
+	for (n = n->children; n != NULL; n = n->next) {
+		if (fill_entries(m, jobs, num_files, n))
+			return -1;
+	}
+
+	return 0;
+}
+
+manifest_t *manifest_from_tree(const char *filename, sqfs_file_t *file,
+			       sqfs_compressor_t *cmp,
+			       const sqfs_super_t *super,
+			       const sqfs_tree_node_t *root, size_t num_jobs)
+{
+	size_t num_files = 0, count = count_nodes(root);
+	hash_job_t *jobs = NULL;
+	manifest_t *m;
+
+	m = calloc(1, sizeof(*m));
+	if (m == NULL)
+		goto fail_errno;
+
+	m->entries = alloc_array(sizeof(m->entries[0]), count);
+	jobs = alloc_array(sizeof(jobs[0]), count);
+
+	if (m->entries == NULL || jobs == NULL)
+		goto fail_errno;
+
+	if (fill_entries(m, jobs, &num_files, root))
+		goto fail;
+
+	if (hash_files(filename, file, cmp, super, jobs, num_files, num_jobs))
+		goto fail;
+
+	free(jobs);
+	return m;
+fail_errno:
+	perror("creating manifest");
+fail:
+	free(jobs);
+	manifest_destroy(m);
+	return NULL;
+}
+
+/*****************************************************************************/
+
+static const char *type_name(sqfs_u16 mode)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(types) / sizeof(types[0]); ++i) {
+		if (types[i].type == (mode & S_IFMT))
+			return types[i].name;
+	}
+
+	return NULL;
+}
+
+/* white space, control characters and back slashes are written in octal */
+static int write_escaped(ostream_t *out, const char *str)
+{
+	char buffer[8];
+	size_t len;
+
+	while (*str != '\0') {
+		for (len = 0; str[len] != '\0'; ++len) {
+			if ((unsigned char)str[len] <= 0x20 ||
+			    str[len] == 0x7F || str[len] == '\\') {
+				break;
+			}
+		}
+
+		if (len > 0 && ostream_append(out, str, len))
+			return -1;
+
+		str += len;
+
+		if (*str != '\0') {
+			sprintf(buffer, "\\%03o", (unsigned int)
+				(unsigned char)*(str++));
+
+			if (ostream_append(out, buffer, 4))
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int write_entry(const manifest_entry_t *ent, ostream_t *out)
+{
+	const char *type = type_name(ent->mode);
+	char hex[SHA256_DIGEST_SIZE * 2 + 1];
+	size_t i;
+
+	if (type == NULL)
+		return 0;
+
+	if (ostream_printf(out, "%s ", type) < 0)
+		return -1;
+
+	if (write_escaped(out, ent->path))
+		return -1;
+
+	if (ostream_printf(out, " 0%o %u %u %u",
+			   (unsigned int)(ent->mode & ~S_IFMT),
+			   (unsigned int)ent->uid, (unsigned int)ent->gid,
+			   (unsigned int)ent->mtime) < 0) {
+		return -1;
+	}
+
+	switch (ent->mode & S_IFMT) {
+	case S_IFREG:
+		for (i = 0; i < SHA256_DIGEST_SIZE; ++i)
+			sprintf(hex + i * 2, "%02x", ent->hash[i]);
+
+		if (ostream_printf(out, " " PRI_U64 " %s", ent->size, hex) < 0)
+			return -1;
+		break;
+	case S_IFLNK:
+		if (ostream_append(out, " ", 1))
+			return -1;
+
+		if (write_escaped(out, ent->target))
+			return -1;
+		break;
+	case S_IFCHR:
+	case S_IFBLK:
+		if (ostream_printf(out, " %c %u %u",
+				   S_ISCHR(ent->mode) ? 'c' : 'b',
+				   major(ent->devno), minor(ent->devno)) < 0) {
+			return -1;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return ostream_append(out, "\n", 1);
+}
+
+int manifest_write(const manifest_t *manifest, ostream_t *out)
+{
+	size_t i;
+
+	for (i = 0; i < manifest->count; ++i) {
+		if (write_entry(manifest->entries + i, out))
+			return -1;
+	}
+
+	return ostream_flush(out);
+}
+
+/*****************************************************************************/
+
+static int unescape(char *str)
+{
+	char *dst = str;
+	int i, value;
+
+	while (*str != '\0') {
+		if (*str != '\\') {
+			*(dst++) = *(str++);
+			continue;
+		}
+
+		++str;
+		value = 0;
+
+		for (i = 0; i < 3; ++i) {
+			if (str[i] < '0' || str[i] > '7')
+				return -1;
+
+			value = value * 8 + (str[i] - '0');
+		}
+
+		if (value == 0 || value > 0xFF)
+			return -1;
+
+		*(dst++) = value;
+		str += 3;
+	}
+
+	*dst = '\0';
+	return 0;
+}
+
+static int parse_u32(const char *str, int base, sqfs_u32 *out)
+{
+	unsigned long value;
+	char *end;
+
+	errno = 0;
+	value = strtoul(str, &end, base);
+
+	if (errno != 0 || end == str || *end != '\0' || value > 0xFFFFFFFFUL)
+		return -1;
+
+	*out = value;
+	return 0;
+}
+
+static int parse_hash(const char *str, sqfs_u8 *out)
+{
+	unsigned int value;
+	size_t i;
+
+	if (strlen(str) != SHA256_DIGEST_SIZE * 2)
+		return -1;
+
+	for (i = 0; i < SHA256_DIGEST_SIZE; ++i) {
+		if (!isxdigit((unsigned char)str[i * 2]) ||
+		    !isxdigit((unsigned char)str[i * 2 + 1]))
+			return -1;
+
+		sscanf(str + i * 2, "%2x", &value);
+		out[i] = value;
+	}
+
+	return 0;
+}
+
+static int parse_line(manifest_entry_t *ent, char *line)
+{
+	sqfs_u32 mode, major_num, minor_num;
+	char *field[MAX_FIELDS];
+	size_t i, count = 0;
+	unsigned long long size;
+	char *end;
+
+	for (;;) {
+		while (*line == ' ')
+			++line;
+
+		if (*line == '\0')
+			break;
+
+		if (count == MAX_FIELDS)
+			return -1;
+
+		field[count++] = line;
+
+		while (*line != ' ' && *line != '\0')
+			++line;
+
+		if (*line == ' ')
+			*(line++) = '\0';
+	}
+
+	if (count < 6)
+		return -1;
+
+	for (i = 0; i < sizeof(types) / sizeof(types[0]); ++i) {
+		if (strcmp(field[0], types[i].name) == 0)
+			break;
+	}
+
+	if (i == sizeof(types) / sizeof(types[0]))
+		return -1;
+
+	ent->mode = types[i].type;
+
+	if (unescape(field[1]))
+		return -1;
+
+	ent->path = strdup(field[1]);
+	if (ent->path == NULL)
+		return -1;
+
+	if (parse_u32(field[2], 8, &mode) || mode > 07777 ||
+	    parse_u32(field[3], 10, &ent->uid) ||
+	    parse_u32(field[4], 10, &ent->gid) ||
+	    parse_u32(field[5], 10, &ent->mtime)) {
+		return -1;
+	}
+
+	ent->mode |= mode;
+
+	switch (ent->mode & S_IFMT) {
+	case S_IFREG:
+		if (count != 8 || !isdigit((unsigned char)field[6][0]))
+			return -1;
+
+		errno = 0;
+		size = strtoull(field[6], &end, 10);
+		if (errno != 0 || *end != '\0')
+			return -1;
+
+		ent->size = size;
+		return parse_hash(field[7], ent->hash);
+	case S_IFLNK:
+		if (count != 7 || unescape(field[6]))
+			return -1;
+
+		ent->target = strdup(field[6]);
+		return ent->target == NULL ? -1 : 0;
+	case S_IFCHR:
+		if (count != 9 || strlen(field[6]) != 1)
+			return -1;
+
+		if (field[6][0] == 'b') {
+			ent->mode = (ent->mode & ~S_IFMT) | S_IFBLK;
+		} else if (field[6][0] != 'c') {
+			return -1;
+		}
+
+		if (parse_u32(field[7], 10, &major_num) ||
+		    parse_u32(field[8], 10, &minor_num)) {
+			return -1;
+		}
+
+		ent->devno = makedev(major_num, minor_num);
+		return 0;
+	default:
+		return count == 6 ? 0 : -1;
+	}
+}
+
+manifest_t *manifest_read(istream_t *in)
+{
+	size_t line_num = 1, size = 0, max = 0;
+	manifest_entry_t *new;
+	char *line = NULL;
+	manifest_t *m;
+	int ret;
+
+	m = calloc(1, sizeof(*m));
+	if (m == NULL)
+		goto fail_errno;
+
+	for (;; ++line_num) {
+		ret = istream_get_line_buffered(in, &line, &size, &line_num,
+						ISTREAM_LINE_LTRIM |
+						ISTREAM_LINE_RTRIM |
+						ISTREAM_LINE_SKIP_EMPTY);
+		if (ret < 0)
+			goto fail;
+		if (ret > 0)
+			break;
+
+		if (line[0] == '#')
+			continue;
+
+		if (m->count == max) {
+			max = max ? max * 2 : 128;
+
+			new = realloc(m->entries, max * sizeof(m->entries[0]));
+			if (new == NULL)
+				goto fail_errno;
+
+			m->entries = new;
+		}
+
+		new = m->entries + m->count++;
+		memset(new, 0, sizeof(*new));
+
+		if (parse_line(new, line)) {
+			fprintf(stderr, "%s: " PRI_SZ ": malformed manifest "
+				"entry.\n", istream_get_filename(in),
+				line_num);
+			goto fail;
+		}
+	}
+
+	free(line);
+	return m;
+fail_errno:
+	perror(istream_get_filename(in));
+fail:
+	free(line);
+	manifest_destroy(m);
+	return NULL;
+}
+
+/*****************************************************************************/
+
+static int compare_entries(const void *lhs, const void *rhs)
+{
+	return strcmp(((const manifest_entry_t *)lhs)->path,
+		      ((const manifest_entry_t *)rhs)->path);
+}
+
+void manifest_sort(manifest_t *manifest)
+{
+	qsort(manifest->entries, manifest->count, sizeof(manifest->entries[0]),
+	      compare_entries);
+}
+
+void manifest_destroy(manifest_t *manifest)
+{
+	size_t i;
+
+	if (manifest == NULL)
+		return;
+
+	for (i = 0; i < manifest->count; ++i) {
+		free(manifest->entries[i].path);
+		free(manifest->entries[i].target);
+	}
+
+	free(manifest->entries);
+	free(manifest);
+}
@@ -0,0 +1,248 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * table_stats.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "config.h"
+#include "common.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define MAX_ROWS (16)
+
+typedef struct {
+	const char *name;
+	sqfs_u64 read_calls;
+	sqfs_u64 bytes_read;
+	sqfs_u64 read_time_us;
+	sqfs_u64 cmp_time_us;
+	sqfs_u64 total_time_us;
+} table_stats_row_t;
+
+struct table_stats_t {
+	const sqfs_file_t *file;
+	sqfs_u64 cmp_time_us;
+
+	/* snapshot taken by table_stats_begin */
+	sqfs_file_stats_t start;
+	sqfs_u64 start_cmp_time_us;
+	sqfs_u64 start_time_us;
+
+	table_stats_row_t rows[MAX_ROWS];
+	size_t num_rows;
+};
+
+typedef struct {
+	sqfs_compressor_t base;
+
+	sqfs_compressor_t *wrapped;
+	sqfs_u64 *time_us;
+} timed_compressor_t;
+
+static void timed_get_configuration(const sqfs_compressor_t *base,
+				    sqfs_compressor_config_t *cfg)
+{
+	const timed_compressor_t *cmp = (const timed_compressor_t *)base;
+
+	cmp->wrapped->get_configuration(cmp->wrapped, cfg);
+}
+
+static int timed_write_options(sqfs_compressor_t *base, sqfs_file_t *file)
+{
+	timed_compressor_t *cmp = (timed_compressor_t *)base;
+
+	return cmp->wrapped->write_options(cmp->wrapped, file);
+}
+
+static int timed_read_options(sqfs_compressor_t *base, sqfs_file_t *file)
+{
+	timed_compressor_t *cmp = (timed_compressor_t *)base;
+
+	return cmp->wrapped->read_options(cmp->wrapped, file);
+}
+
+static sqfs_s32 timed_do_block(sqfs_compressor_t *base, const sqfs_u8 *in,
+			       sqfs_u32 size, sqfs_u8 *out, sqfs_u32 outsize)
+{
+	timed_compressor_t *cmp = (timed_compressor_t *)base;
+	sqfs_u64 start = get_time_us();
+	sqfs_s32 ret;
+
+	ret = cmp->wrapped->do_block(cmp->wrapped, in, size, out, outsize);
+
+	*(cmp->time_us) += get_time_us() - start;
+	return ret;
+}
+
+/* copies are handed to worker threads, those are not timed */
+static sqfs_object_t *timed_copy(const sqfs_object_t *base)
+{
+	const timed_compressor_t *cmp = (const timed_compressor_t *)base;
+
+	return sqfs_copy(cmp->wrapped);
+}
+
+static void timed_destroy(sqfs_object_t *base)
+{
+	timed_compressor_t *cmp = (timed_compressor_t *)base;
+
+	sqfs_destroy(cmp->wrapped);
+	free(cmp);
+}
+
+table_stats_t *table_stats_create(void)
+{
+	table_stats_t *ts = calloc(1, sizeof(*ts));
+
+	if (ts == NULL)
+		perror("creating table load statistics");
+
+	return ts;
+}
+
+void table_stats_destroy(table_stats_t *ts)
+{
+	free(ts);
+}
+
+int table_stats_wrap_file(table_stats_t *ts, sqfs_file_t **file)
+{
+	sqfs_file_t *wrapped;
+
+	if (ts == NULL)
+		return 0;
+
+	/* already counted for --io-stats */
+	if (sqfs_file_stats_get(*file) != NULL) {
+		ts->file = *file;
+		return 0;
+	}
+
+	wrapped = sqfs_file_stats_create(*file);
+	if (wrapped == NULL) {
+		perror("creating I/O counter");
+		return -1;
+	}
+
+	ts->file = wrapped;
+	*file = wrapped;
+	return 0;
+}
+
+int table_stats_wrap_compressor(table_stats_t *ts, sqfs_compressor_t **cmp)
+{
+	timed_compressor_t *timed;
+	sqfs_compressor_t *base;
+
+	if (ts == NULL)
+		return 0;
+
+	timed = calloc(1, sizeof(*timed));
+	base = (sqfs_compressor_t *)timed;
+
+	if (timed == NULL) {
+		perror("creating decompression timer");
+		return -1;
+	}
+
+	timed->wrapped = *cmp;
+	timed->time_us = &ts->cmp_time_us;
+
+	base->get_configuration = timed_get_configuration;
+	base->write_options = timed_write_options;
+	base->read_options = timed_read_options;
+	base->do_block = timed_do_block;
+	((sqfs_object_t *)base)->copy = timed_copy;
+	((sqfs_object_t *)base)->destroy = timed_destroy;
+
+	*cmp = base;
+	return 0;
+}
+
+void table_stats_begin(table_stats_t *ts)
+{
+	const sqfs_file_stats_t *fs;
+
+	if (ts == NULL)
+		return;
+
+	fs = ts->file == NULL ? NULL : sqfs_file_stats_get(ts->file);
+
+	if (fs != NULL) {
+		ts->start = *fs;
+	} else {
+		memset(&ts->start, 0, sizeof(ts->start));
+	}
+
+	ts->start_cmp_time_us = ts->cmp_time_us;
+	ts->start_time_us = get_time_us();
+}
+
+void table_stats_end(table_stats_t *ts, const char *name)
+{
+	const sqfs_file_stats_t *fs;
+	table_stats_row_t *row;
+
+	if (ts == NULL || ts->num_rows >= MAX_ROWS)
+		return;
+
+	row = ts->rows + ts->num_rows++;
+	row->name = name;
+	row->total_time_us = get_time_us() - ts->start_time_us;
+	row->cmp_time_us = ts->cmp_time_us - ts->start_cmp_time_us;
+
+	fs = ts->file == NULL ? NULL : sqfs_file_stats_get(ts->file);
+
+	if (fs != NULL) {
+		row->read_calls = fs->read_calls - ts->start.read_calls;
+		row->bytes_read = fs->bytes_read - ts->start.bytes_read;
+		row->read_time_us = fs->read_time_us - ts->start.read_time_us;
+	}
+}
+
+/* PRI_U64 already contains the '%', so the numbers are aligned as strings */
+static void print_row(const table_stats_row_t *row)
+{
+	char num[5][32];
+
+	sprintf(num[0], PRI_U64, row->read_calls);
+	sprintf(num[1], PRI_U64, row->bytes_read);
+	sprintf(num[2], PRI_U64, row->read_time_us);
+	sprintf(num[3], PRI_U64, row->cmp_time_us);
+	sprintf(num[4], PRI_U64, row->total_time_us);
+
+	fprintf(stderr, "%-20s %8s %12s %10s %12s %10s\n", row->name,
+		num[0], num[1], num[2], num[3], num[4]);
+}
+
+void table_stats_print(const table_stats_t *ts, const char *filename)
+{
+	table_stats_row_t total;
+	size_t i;
+
+	if (ts == NULL)
+		return;
+
+	memset(&total, 0, sizeof(total));
+	total.name = "total";
+
+	fprintf(stderr, "Table load statistics for %s:\n", filename);
+	fprintf(stderr, "%-20s %8s %12s %10s %12s %10s\n", "table", "reads",
+		"bytes", "read (us)", "decomp (us)", "total (us)");
+
+	for (i = 0; i < ts->num_rows; ++i) {
+		print_row(ts->rows + i);
+
+		total.read_calls += ts->rows[i].read_calls;
+		total.bytes_read += ts->rows[i].bytes_read;
+		total.read_time_us += ts->rows[i].read_time_us;
+		total.cmp_time_us += ts->rows[i].cmp_time_us;
+		total.total_time_us += ts->rows[i].total_time_us;
+	}
+
+	print_row(&total);
+}
@@ -48,6 +48,15 @@ static void print_statistics(const sqfs_super_t *super,
 
 	printf("Sparse blocks omitted: " PRI_U64 "\n",
 	       proc_stats->sparse_block_count);
+
+	if (proc_stats->raw_block_count > 0) {
+		print_size(proc_stats->raw_bytes_read, read_sz, false);
+
+		printf("Data blocks copied without recompression: " PRI_U64
+		       "\n", proc_stats->raw_block_count);
+		printf("Data bytes copied without recompression: %s\n",
+		       read_sz);
+	}
 	fputc('\n', stdout);
 
 	printf("Fragments actually written: " PRI_U64 "\n",
@@ -172,5 +181,6 @@ int sqfs_writer_finish(sqfs_writer_t *sqfs, const sqfs_writer_cfg_t *cfg)
 	if (!cfg->quiet)
 		print_statistics(&sqfs->super, sqfs->data, sqfs->blkwr);
 
+	io_stats_print(sqfs->outfile, cfg->filename);
 	return 0;
 }
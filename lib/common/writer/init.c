@@ -58,6 +58,9 @@ int sqfs_writer_init(sqfs_writer_t *sqfs, const sqfs_writer_cfg_t *wrcfg)
 		return -1;
 	}
 
+	if (wrcfg->io_stats && io_stats_wrap(&sqfs->outfile))
+		goto fail_file;
+
 	if (fstree_init(&sqfs->fs, wrcfg->fs_defaults))
 		goto fail_file;
 
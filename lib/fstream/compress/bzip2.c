@@ -50,8 +50,11 @@ static int flush_inbuf(ostream_comp_t *base, bool finish)
 		if (base->wrapped->append(base->wrapped, base->outbuf, have))
 			return -1;
 
-		if (ret == BZ_STREAM_END || ret == BZ_OUTBUFF_FULL ||
-		    bzip2->strm.avail_in == 0) {
+		if (ret == BZ_STREAM_END)
+			break;
+
+		if (!finish && (ret == BZ_OUTBUFF_FULL ||
+				bzip2->strm.avail_in == 0)) {
 			break;
 		}
 	}
@@ -65,6 +68,22 @@ static int flush_inbuf(ostream_comp_t *base, bool finish)
 	return 0;
 }
 
+static int reset(ostream_comp_t *base)
+{
+	ostream_bzip2_t *bzip2 = (ostream_bzip2_t *)base;
+
+	BZ2_bzCompressEnd(&bzip2->strm);
+	memset(&bzip2->strm, 0, sizeof(bzip2->strm));
+
+	if (BZ2_bzCompressInit(&bzip2->strm, 9, 0, 30) != BZ_OK) {
+		fprintf(stderr, "%s: error initializing bzip2 compressor.\n",
+			base->wrapped->get_filename(base->wrapped));
+		return -1;
+	}
+
+	return 0;
+}
+
 static void cleanup(ostream_comp_t *base)
 {
 	ostream_bzip2_t *bzip2 = (ostream_bzip2_t *)base;
@@ -91,6 +110,7 @@ ostream_comp_t *ostream_bzip2_create(const char *filename)
 	}
 
 	base->flush_inbuf = flush_inbuf;
+	base->reset = reset;
 	base->cleanup = cleanup;
 	return base;
 }
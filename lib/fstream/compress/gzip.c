@@ -6,12 +6,34 @@
  */
 #include "../internal.h"
 
+#include "threadpool.h"
+
 #include <zlib.h>
 
+/* amount of data compressed into one member in multi threaded mode */
+#define MEMBER_SIZE (4 * BUFSZ)
+
+typedef struct {
+	sqfs_u8 *data;
+	size_t size;
+
+	sqfs_u8 *compressed;
+	size_t comp_size;
+	int status;
+} gzip_job_t;
+
 typedef struct {
 	ostream_comp_t base;
 
 	z_stream strm;
+
+	/* multi threaded mode */
+	thread_pool_t *pool;
+	z_stream *workers;
+	size_t num_workers;
+	size_t max_jobs;
+	size_t in_flight;
+	gzip_job_t *current;
 } ostream_gzip_t;
 
 static int flush_inbuf(ostream_comp_t *base, bool finish)
@@ -57,14 +79,187 @@ static int flush_inbuf(ostream_comp_t *base, bool finish)
 	return 0;
 }
 
+static int reset(ostream_comp_t *base)
+{
+	ostream_gzip_t *gzip = (ostream_gzip_t *)base;
+
+	if (deflateReset(&gzip->strm) != Z_OK) {
+		fprintf(stderr, "%s: internal error in gzip compressor.\n",
+			base->wrapped->get_filename(base->wrapped));
+		return -1;
+	}
+
+	return 0;
+}
+
+static void job_destroy(gzip_job_t *job)
+{
+	if (job != NULL) {
+		free(job->data);
+		free(job->compressed);
+		free(job);
+	}
+}
+
+/*
+  Every job is compressed into a complete, independent gzip member. The
+  members are simply concatenated, which gzip compatible decompressors
+  handle the same way as a single member.
+*/
+static int compress_job(void *user, void *ptr)
+{
+	z_stream *strm = user;
+	gzip_job_t *job = ptr;
+	uLong bound;
+	int ret;
+
+	job->status = -1;
+
+	if (deflateReset(strm) != Z_OK)
+		return 0;
+
+	bound = deflateBound(strm, job->size);
+
+	job->compressed = malloc(bound);
+	if (job->compressed == NULL)
+		return 0;
+
+	strm->next_in = job->data;
+	strm->avail_in = job->size;
+	strm->next_out = job->compressed;
+	strm->avail_out = bound;
+
+	ret = deflate(strm, Z_FINISH);
+	if (ret != Z_STREAM_END)
+		return 0;
+
+	job->comp_size = bound - strm->avail_out;
+	job->status = 0;
+	return 0;
+}
+
+static int write_job(ostream_comp_t *base)
+{
+	ostream_gzip_t *gzip = (ostream_gzip_t *)base;
+	gzip_job_t *job;
+	int ret;
+
+	job = gzip->pool->dequeue(gzip->pool);
+	if (job == NULL || job->status != 0) {
+		fprintf(stderr, "%s: internal error in gzip compressor.\n",
+			base->wrapped->get_filename(base->wrapped));
+		job_destroy(job);
+		return -1;
+	}
+
+	gzip->in_flight -= 1;
+
+	ret = base->wrapped->append(base->wrapped, job->compressed,
+				    job->comp_size);
+	job_destroy(job);
+	return ret;
+}
+
+static int flush_inbuf_mt(ostream_comp_t *base, bool finish)
+{
+	ostream_gzip_t *gzip = (ostream_gzip_t *)base;
+	gzip_job_t *job = gzip->current;
+
+	if (job == NULL) {
+		job = calloc(1, sizeof(*job));
+		if (job == NULL)
+			goto fail_errno;
+
+		job->data = malloc(MEMBER_SIZE);
+		if (job->data == NULL)
+			goto fail_errno;
+
+		gzip->current = job;
+	}
+
+	memcpy(job->data + job->size, base->inbuf, base->inbuf_used);
+	job->size += base->inbuf_used;
+	base->inbuf_used = 0;
+
+	if ((MEMBER_SIZE - job->size) < BUFSZ || finish) {
+		if (gzip->in_flight >= gzip->max_jobs) {
+			if (write_job(base))
+				return -1;
+		}
+
+		if (gzip->pool->submit(gzip->pool, job)) {
+			fprintf(stderr, "%s: internal error in gzip "
+				"compressor.\n",
+				base->wrapped->get_filename(base->wrapped));
+			return -1;
+		}
+
+		gzip->current = NULL;
+		gzip->in_flight += 1;
+	}
+
+	while (finish && gzip->in_flight > 0) {
+		if (write_job(base))
+			return -1;
+	}
+
+	return 0;
+fail_errno:
+	fprintf(stderr, "%s: %s.\n",
+		base->wrapped->get_filename(base->wrapped), strerror(errno));
+	return -1;
+}
+
 static void cleanup(ostream_comp_t *base)
 {
 	ostream_gzip_t *gzip = (ostream_gzip_t *)base;
+	size_t i;
+
+	if (gzip->pool != NULL) {
+		while (gzip->in_flight > 0) {
+			job_destroy(gzip->pool->dequeue(gzip->pool));
+			gzip->in_flight -= 1;
+		}
 
+		gzip->pool->destroy(gzip->pool);
+	}
+
+	for (i = 0; i < gzip->num_workers; ++i)
+		deflateEnd(gzip->workers + i);
+
+	job_destroy(gzip->current);
+	free(gzip->workers);
 	deflateEnd(&gzip->strm);
 }
 
-ostream_comp_t *ostream_gzip_create(const char *filename)
+static int init_mt(ostream_gzip_t *gzip, size_t num_jobs)
+{
+	size_t i;
+
+	gzip->pool = thread_pool_create(num_jobs, compress_job);
+	if (gzip->pool == NULL)
+		return -1;
+
+	gzip->max_jobs = 2 * num_jobs;
+
+	gzip->workers = calloc(num_jobs, sizeof(gzip->workers[0]));
+	if (gzip->workers == NULL)
+		return -1;
+
+	for (i = 0; i < num_jobs; ++i) {
+		if (deflateInit2(gzip->workers + i, 9, Z_DEFLATED, 16 + 15, 8,
+				 Z_DEFAULT_STRATEGY) != Z_OK) {
+			return -1;
+		}
+
+		gzip->num_workers += 1;
+		gzip->pool->set_worker_ptr(gzip->pool, i, gzip->workers + i);
+	}
+
+	return 0;
+}
+
+ostream_comp_t *ostream_gzip_create(const char *filename, size_t num_jobs)
 {
 	ostream_gzip_t *gzip = calloc(1, sizeof(*gzip));
 	ostream_comp_t *base = (ostream_comp_t *)gzip;
@@ -87,6 +282,21 @@ ostream_comp_t *ostream_gzip_create(const char *filename)
 	}
 
 	base->flush_inbuf = flush_inbuf;
+	base->reset = reset;
 	base->cleanup = cleanup;
+
+	if (num_jobs > 1) {
+		if (init_mt(gzip, num_jobs)) {
+			fprintf(stderr, "%s: error creating gzip compressor "
+				"threads.\n", filename);
+			cleanup(base);
+			free(gzip);
+			return NULL;
+		}
+
+		base->flush_inbuf = flush_inbuf_mt;
+		base->reset = NULL;
+	}
+
 	return base;
 }
@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * lz4.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "../internal.h"
+#include "util.h"
+
+#include <lz4.h>
+
+/*
+  Writes the LZ4 frame format. Every input buffer is compressed into an
+  independent block of at most 256KiB, so the frame header can declare
+  that block size and a reader does not need to keep any history around.
+ */
+#define LZ4_FRAME_MAGIC (0x184D2204)
+
+#define LZ4_FLG_VERSION (0x40)
+#define LZ4_FLG_BLOCK_INDEP (0x20)
+#define LZ4_FLG_CONTENT_CHKSUM (0x04)
+
+#define LZ4_BD_256K (5 << 4)
+
+#define LZ4_BLOCK_UNCOMPRESSED (0x80000000)
+
+typedef struct {
+	ostream_comp_t base;
+
+	bool header_written;
+	xxh32_state_t chksum;
+} ostream_lz4_t;
+
+static int write_le32(ostream_comp_t *base, sqfs_u32 value)
+{
+	value = htole32(value);
+
+	return base->wrapped->append(base->wrapped, &value, sizeof(value));
+}
+
+static int write_header(ostream_comp_t *base)
+{
+	sqfs_u8 header[7];
+	sqfs_u32 magic = htole32(LZ4_FRAME_MAGIC);
+
+	memcpy(header, &magic, sizeof(magic));
+	header[4] = LZ4_FLG_VERSION | LZ4_FLG_BLOCK_INDEP |
+		    LZ4_FLG_CONTENT_CHKSUM;
+	header[5] = LZ4_BD_256K;
+	header[6] = (xxh32_ref(header + 4, 2) >> 8) & 0xFF;
+
+	return base->wrapped->append(base->wrapped, header, sizeof(header));
+}
+
+static int flush_inbuf(ostream_comp_t *base, bool finish)
+{
+	ostream_lz4_t *lz4 = (ostream_lz4_t *)base;
+	int ret;
+
+	if (!lz4->header_written) {
+		if (write_header(base))
+			return -1;
+
+		lz4->header_written = true;
+	}
+
+	if (base->inbuf_used > 0) {
+		xxh32_update(&lz4->chksum, base->inbuf, base->inbuf_used);
+
+		/* if it does not get smaller, store it as is */
+		ret = LZ4_compress_default((const char *)base->inbuf,
+					   (char *)base->outbuf,
+					   base->inbuf_used,
+					   base->inbuf_used - 1);
+
+		if (ret > 0) {
+			if (write_le32(base, ret))
+				return -1;
+
+			if (base->wrapped->append(base->wrapped,
+						  base->outbuf, ret)) {
+				return -1;
+			}
+		} else {
+			if (write_le32(base, base->inbuf_used |
+				       LZ4_BLOCK_UNCOMPRESSED)) {
+				return -1;
+			}
+
+			if (base->wrapped->append(base->wrapped, base->inbuf,
+						  base->inbuf_used)) {
+				return -1;
+			}
+		}
+
+		base->inbuf_used = 0;
+	}
+
+	if (finish) {
+		if (write_le32(base, 0))
+			return -1;
+
+		if (write_le32(base, xxh32_digest(&lz4->chksum)))
+			return -1;
+
+		lz4->header_written = false;
+		xxh32_reset(&lz4->chksum);
+	}
+
+	return 0;
+}
+
+static void cleanup(ostream_comp_t *base)
+{
+	(void)base;
+}
+
+ostream_comp_t *ostream_lz4_create(const char *filename)
+{
+	ostream_lz4_t *lz4 = calloc(1, sizeof(*lz4));
+	ostream_comp_t *base = (ostream_comp_t *)lz4;
+
+	if (lz4 == NULL) {
+		fprintf(stderr, "%s: creating lz4 compressor: %s.\n",
+			filename, strerror(errno));
+		return NULL;
+	}
+
+	xxh32_reset(&lz4->chksum);
+
+	base->flush_inbuf = flush_inbuf;
+	base->cleanup = cleanup;
+	return base;
+}
@@ -32,14 +32,25 @@ static int comp_append(ostream_t *strm, const void *data, size_t size)
 	return 0;
 }
 
+int ostream_compressor_end_frame(ostream_t *strm)
+{
+	ostream_comp_t *comp = (ostream_comp_t *)strm;
+
+	if (comp->inbuf_used == 0)
+		return 0;
+
+	if (comp->flush_inbuf(comp, true))
+		return -1;
+
+	return comp->reset == NULL ? 0 : comp->reset(comp);
+}
+
 static int comp_flush(ostream_t *strm)
 {
 	ostream_comp_t *comp = (ostream_comp_t *)strm;
 
-	if (comp->inbuf_used > 0) {
-		if (comp->flush_inbuf(comp, true))
-			return -1;
-	}
+	if (ostream_compressor_end_frame(strm))
+		return -1;
 
 	return comp->wrapped->flush(comp->wrapped);
 }
@@ -60,7 +71,8 @@ static void comp_destroy(sqfs_object_t *obj)
 	free(comp);
 }
 
-ostream_t *ostream_compressor_create(ostream_t *strm, int comp_id)
+ostream_t *ostream_compressor_create_parallel(ostream_t *strm, int comp_id,
+					      size_t num_jobs)
 {
 	ostream_comp_t *comp = NULL;
 	sqfs_object_t *obj;
@@ -69,22 +81,30 @@ ostream_t *ostream_compressor_create(ostream_t *strm, int comp_id)
 	switch (comp_id) {
 	case FSTREAM_COMPRESSOR_GZIP:
 #ifdef WITH_GZIP
-		comp = ostream_gzip_create(strm->get_filename(strm));
+		comp = ostream_gzip_create(strm->get_filename(strm),
+					   num_jobs);
 #endif
 		break;
 	case FSTREAM_COMPRESSOR_XZ:
 #ifdef WITH_XZ
-		comp = ostream_xz_create(strm->get_filename(strm));
+		comp = ostream_xz_create(strm->get_filename(strm),
+					   num_jobs);
 #endif
 		break;
 	case FSTREAM_COMPRESSOR_ZSTD:
 #if defined(WITH_ZSTD) && defined(HAVE_ZSTD_STREAM)
-		comp = ostream_zstd_create(strm->get_filename(strm));
+		comp = ostream_zstd_create(strm->get_filename(strm),
+					   num_jobs);
 #endif
 		break;
 	case FSTREAM_COMPRESSOR_BZIP2:
 #ifdef WITH_BZIP2
 		comp = ostream_bzip2_create(strm->get_filename(strm));
+#endif
+		break;
+	case FSTREAM_COMPRESSOR_LZ4:
+#ifdef WITH_LZ4
+		comp = ostream_lz4_create(strm->get_filename(strm));
 #endif
 		break;
 	default:
@@ -106,3 +126,8 @@ ostream_t *ostream_compressor_create(ostream_t *strm, int comp_id)
 	obj->destroy = comp_destroy;
 	return base;
 }
+
+ostream_t *ostream_compressor_create(ostream_t *strm, int comp_id)
+{
+	return ostream_compressor_create_parallel(strm, comp_id, 1);
+}
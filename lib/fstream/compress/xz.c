@@ -12,6 +12,7 @@ typedef struct {
 	ostream_comp_t base;
 
 	lzma_stream strm;
+	size_t num_jobs;
 } ostream_xz_t;
 
 static int flush_inbuf(ostream_comp_t *base, bool finish)
@@ -23,6 +24,10 @@ static int flush_inbuf(ostream_comp_t *base, bool finish)
 	xz->strm.next_in = base->inbuf;
 	xz->strm.avail_in = base->inbuf_used;
 
+	/*
+	  The multi threaded encoder may return with input left over, or
+	  before it is done finishing, while there is still output space.
+	*/
 	do {
 		xz->strm.next_out = base->outbuf;
 		xz->strm.avail_out = BUFSZ;
@@ -40,12 +45,53 @@ static int flush_inbuf(ostream_comp_t *base, bool finish)
 
 		if (base->wrapped->append(base->wrapped, base->outbuf, have))
 			return -1;
-	} while (xz->strm.avail_out == 0);
+	} while (xz->strm.avail_out == 0 || xz->strm.avail_in > 0 ||
+		 (finish && ret_xz != LZMA_STREAM_END));
 
 	base->inbuf_used = 0;
 	return 0;
 }
 
+static int init_encoder(ostream_xz_t *xz)
+{
+	lzma_ret ret_xz;
+#ifdef HAVE_LZMA_STREAM_ENCODER_MT
+	lzma_mt mt;
+
+	if (xz->num_jobs > 1) {
+		memset(&mt, 0, sizeof(mt));
+		mt.threads = xz->num_jobs;
+		mt.preset = LZMA_PRESET_DEFAULT;
+		mt.check = LZMA_CHECK_CRC64;
+
+		ret_xz = lzma_stream_encoder_mt(&xz->strm, &mt);
+	} else {
+		ret_xz = lzma_easy_encoder(&xz->strm, LZMA_PRESET_DEFAULT,
+					   LZMA_CHECK_CRC64);
+	}
+#else
+	ret_xz = lzma_easy_encoder(&xz->strm, LZMA_PRESET_DEFAULT,
+				   LZMA_CHECK_CRC64);
+#endif
+	return ret_xz == LZMA_OK ? 0 : -1;
+}
+
+static int reset(ostream_comp_t *base)
+{
+	ostream_xz_t *xz = (ostream_xz_t *)base;
+
+	lzma_end(&xz->strm);
+	memset(&xz->strm, 0, sizeof(xz->strm));
+
+	if (init_encoder(xz)) {
+		fprintf(stderr, "%s: error initializing XZ compressor\n",
+			base->wrapped->get_filename(base->wrapped));
+		return -1;
+	}
+
+	return 0;
+}
+
 static void cleanup(ostream_comp_t *base)
 {
 	ostream_xz_t *xz = (ostream_xz_t *)base;
@@ -53,11 +99,10 @@ static void cleanup(ostream_comp_t *base)
 	lzma_end(&xz->strm);
 }
 
-ostream_comp_t *ostream_xz_create(const char *filename)
+ostream_comp_t *ostream_xz_create(const char *filename, size_t num_jobs)
 {
 	ostream_xz_t *xz = calloc(1, sizeof(*xz));
 	ostream_comp_t *base = (ostream_comp_t *)xz;
-	lzma_ret ret_xz;
 
 	if (xz == NULL) {
 		fprintf(stderr, "%s: creating xz wrapper: %s.\n",
@@ -65,9 +110,9 @@ ostream_comp_t *ostream_xz_create(const char *filename)
 		return NULL;
 	}
 
-	ret_xz = lzma_easy_encoder(&xz->strm, LZMA_PRESET_DEFAULT,
-				   LZMA_CHECK_CRC64);
-	if (ret_xz != LZMA_OK) {
+	xz->num_jobs = num_jobs;
+
+	if (init_encoder(xz)) {
 		fprintf(stderr, "%s: error initializing XZ compressor\n",
 			filename);
 		free(xz);
@@ -75,6 +120,7 @@ ostream_comp_t *ostream_xz_create(const char *filename)
 	}
 
 	base->flush_inbuf = flush_inbuf;
+	base->reset = reset;
 	base->cleanup = cleanup;
 	return base;
 }
@@ -68,7 +68,7 @@ static void cleanup(ostream_comp_t *base)
 	ZSTD_freeCStream(zstd->strm);
 }
 
-ostream_comp_t *ostream_zstd_create(const char *filename)
+ostream_comp_t *ostream_zstd_create(const char *filename, size_t num_jobs)
 {
 	ostream_zstd_t *zstd = calloc(1, sizeof(*zstd));
 	ostream_comp_t *base = (ostream_comp_t *)zstd;
@@ -87,6 +87,12 @@ ostream_comp_t *ostream_zstd_create(const char *filename)
 		return NULL;
 	}
 
+	/* fails if libzstd was built without thread support, that's fine */
+	if (num_jobs > 1) {
+		ZSTD_CCtx_setParameter(zstd->strm, ZSTD_c_nbWorkers,
+				       (int)num_jobs);
+	}
+
 	base->flush_inbuf = flush_inbuf;
 	base->cleanup = cleanup;
 	return base;
@@ -38,63 +38,78 @@ static size_t trim(char *buffer, int flags)
 	return strlen(buffer);
 }
 
-int istream_get_line(istream_t *strm, char **out,
-		     size_t *line_num, int flags)
+int istream_get_line_buffered(istream_t *strm, char **buffer, size_t *size,
+			      size_t *line_num, int flags)
 {
-	char *line = NULL, *new;
-	size_t i, line_len = 0;
+	size_t i, avail, new_size, line_len = 0;
+	const sqfs_u8 *ptr, *end;
 	bool have_line = false;
-
-	*out = NULL;
+	char *new;
 
 	for (;;) {
-		if (istream_precache(strm))
-			return -1;
+		/* only touch the stream if the buffer is used up */
+		if (strm->buffer_offset >= strm->buffer_used) {
+			if (istream_precache(strm))
+				return -1;
+		}
 
 		if (strm->buffer_used == 0) {
 			if (line_len == 0)
-				goto out_eof;
+				return 1;
 
-			line_len = trim(line, flags);
+			line_len = trim(*buffer, flags);
 
 			if (line_len == 0 &&
 			    (flags & ISTREAM_LINE_SKIP_EMPTY)) {
-				goto out_eof;
+				return 1;
 			}
 			break;
 		}
 
-		for (i = 0; i < strm->buffer_used; ++i) {
-			if (strm->buffer[i] == '\n')
-				break;
-		}
+		ptr = strm->buffer + strm->buffer_offset;
+		avail = strm->buffer_used - strm->buffer_offset;
 
-		if (i < strm->buffer_used) {
+		end = memchr(ptr, '\n', avail);
+
+		if (end != NULL) {
+			i = end - ptr;
 			have_line = true;
-			strm->buffer_offset = i + 1;
+			strm->buffer_offset += i + 1;
 
-			if (i > 0 && strm->buffer[i - 1] == '\r')
+			if (i > 0 && ptr[i - 1] == '\r')
 				--i;
 		} else {
-			strm->buffer_offset = i;
+			i = avail;
+			strm->buffer_offset += i;
 		}
 
-		new = realloc(line, line_len + i + 1);
-		if (new == NULL)
+		if (SZ_ADD_OV(line_len, i, &new_size) ||
+		    SZ_ADD_OV(new_size, 1, &new_size)) {
+			errno = EOVERFLOW;
 			goto fail_errno;
+		}
+
+		if (new_size > *size) {
+			if (new_size < 2 * (*size))
+				new_size = 2 * (*size);
+
+			new = realloc(*buffer, new_size);
+			if (new == NULL)
+				goto fail_errno;
+
+			*buffer = new;
+			*size = new_size;
+		}
 
-		line = new;
-		memcpy(line + line_len, strm->buffer, i);
+		memcpy((*buffer) + line_len, ptr, i);
 		line_len += i;
-		line[line_len] = '\0';
+		(*buffer)[line_len] = '\0';
 
 		if (have_line) {
-			line_len = trim(line, flags);
+			line_len = trim(*buffer, flags);
 
 			if (line_len == 0 &&
 			    (flags & ISTREAM_LINE_SKIP_EMPTY)) {
-				free(line);
-				line = NULL;
 				have_line = false;
 				*line_num += 1;
 				continue;
@@ -103,16 +118,26 @@ int istream_get_line(istream_t *strm, char **out,
 		}
 	}
 
-	*out = line;
 	return 0;
 fail_errno:
 	fprintf(stderr, "%s: " PRI_SZ ": %s.\n", strm->get_filename(strm),
 		*line_num, strerror(errno));
-	free(line);
-	*out = NULL;
 	return -1;
-out_eof:
-	free(line);
+}
+
+int istream_get_line(istream_t *strm, char **out,
+		     size_t *line_num, int flags)
+{
+	size_t size = 0;
+	int ret;
+
 	*out = NULL;
-	return 1;
+
+	ret = istream_get_line_buffered(strm, out, &size, line_num, flags);
+	if (ret != 0) {
+		free(*out);
+		*out = NULL;
+	}
+
+	return ret;
 }
@@ -35,6 +35,9 @@ typedef struct ostream_comp_t {
 
 	int (*flush_inbuf)(struct ostream_comp_t *ostrm, bool finish);
 
+	/* optional, prepares the compressor for a new frame after finishing */
+	int (*reset)(struct ostream_comp_t *ostrm);
+
 	void (*cleanup)(struct ostream_comp_t *ostrm);
 } ostream_comp_t;
 
@@ -50,18 +53,58 @@ typedef struct istream_comp_t {
 	void (*cleanup)(struct istream_comp_t *strm);
 } istream_comp_t;
 
+/*
+  Hooks used by the parallel decompressor for formats that consist of
+  independently decodable frames (zstd) or members (gzip).
+ */
+typedef struct {
+	/* allocate a decoder for one frame at a time, NULL on failure */
+	void *(*create)(void);
+
+	void (*destroy)(void *dec);
+
+	/* prepare the decoder for the next frame */
+	int (*reset)(void *dec);
+
+	/*
+	  Decode as much as possible, advancing the buffer pointers.
+	  Returns a negative value on failure, a positive value if the end
+	  of the frame has been reached and zero otherwise. Errors are not
+	  reported; the caller decides whether to print them.
+	 */
+	int (*decode)(void *dec, sqfs_u8 **in, size_t *in_left,
+		      sqfs_u8 **out, size_t *out_left);
+
+	/* check if a new frame starts at the given location */
+	bool (*is_frame_start)(const sqfs_u8 *data, size_t size);
+
+	/*
+	  Find the first offset at or after start where a frame (probably)
+	  begins. Returns 0 if there is none in the buffer.
+	 */
+	size_t (*find_split)(const sqfs_u8 *data, size_t size, size_t start);
+
+	/* data after the last frame is ignored instead of an error */
+	bool ignore_trailing;
+} istream_par_format_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-SQFS_INTERNAL ostream_comp_t *ostream_gzip_create(const char *filename);
+SQFS_INTERNAL ostream_comp_t *ostream_gzip_create(const char *filename,
+						  size_t num_jobs);
 
-SQFS_INTERNAL ostream_comp_t *ostream_xz_create(const char *filename);
+SQFS_INTERNAL ostream_comp_t *ostream_xz_create(const char *filename,
+						  size_t num_jobs);
 
-SQFS_INTERNAL ostream_comp_t *ostream_zstd_create(const char *filename);
+SQFS_INTERNAL ostream_comp_t *ostream_zstd_create(const char *filename,
+						  size_t num_jobs);
 
 SQFS_INTERNAL ostream_comp_t *ostream_bzip2_create(const char *filename);
 
+SQFS_INTERNAL ostream_comp_t *ostream_lz4_create(const char *filename);
+
 SQFS_INTERNAL istream_comp_t *istream_gzip_create(const char *filename);
 
 SQFS_INTERNAL istream_comp_t *istream_xz_create(const char *filename);
@@ -70,6 +113,12 @@ SQFS_INTERNAL istream_comp_t *istream_zstd_create(const char *filename);
 
 SQFS_INTERNAL istream_comp_t *istream_bzip2_create(const char *filename);
 
+SQFS_INTERNAL istream_comp_t *istream_lz4_create(const char *filename);
+
+SQFS_INTERNAL const istream_par_format_t *istream_gzip_par_format(void);
+
+SQFS_INTERNAL const istream_par_format_t *istream_zstd_par_format(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -6,16 +6,34 @@
  */
 #include "internal.h"
 
+/*
+  Reads at least this large bypass the stream buffer if it is empty and the
+  stream supports it, smaller ones are still served from the buffer.
+ */
+#define DIRECT_READ_MIN (4096)
 
 sqfs_s32 istream_read(istream_t *strm, void *data, size_t size)
 {
-	sqfs_s32 total = 0;
+	sqfs_s32 total = 0, ret;
 	size_t diff;
 
 	if (size > 0x7FFFFFFF)
 		size = 0x7FFFFFFF;
 
 	while (size > 0) {
+		if (strm->buffer_offset >= strm->buffer_used &&
+		    strm->read_direct != NULL && size >= DIRECT_READ_MIN) {
+			strm->buffer_offset = 0;
+			strm->buffer_used = 0;
+
+			ret = strm->read_direct(strm, data, size);
+			if (ret < 0)
+				return -1;
+
+			total += ret;
+			break;
+		}
+
 		if (strm->buffer_offset >= strm->buffer_used) {
 			if (istream_precache(strm))
 				return -1;
@@ -69,6 +87,12 @@ int istream_skip(istream_t *strm, sqfs_u64 size)
 
 	while (size > 0) {
 		if (strm->buffer_offset >= strm->buffer_used) {
+			if (strm->skip != NULL) {
+				strm->buffer_offset = 0;
+				strm->buffer_used = 0;
+				return strm->skip(strm, size);
+			}
+
 			if (istream_precache(strm))
 				return -1;
 
@@ -40,6 +40,20 @@ int ostream_append_sparse(ostream_t *strm, size_t size)
 	return strm->append_sparse(strm, size);
 }
 
+int ostream_append_from_fd(ostream_t *strm, int fd, sqfs_u64 offset,
+			   sqfs_u64 size)
+{
+	return strm->append_from_fd(strm, fd, offset, size);
+}
+
+int ostream_preallocate(ostream_t *strm, sqfs_u64 size)
+{
+	if (strm->preallocate == NULL)
+		return 0;
+
+	return strm->preallocate(strm, size);
+}
+
 int ostream_flush(ostream_t *strm)
 {
 	return strm->flush(strm);
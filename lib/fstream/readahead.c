@@ -0,0 +1,301 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * readahead.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "internal.h"
+#include "threadpool.h"
+#include "util.h"
+
+/*
+  Each slot has room for one buffer worth of data that was not consumed
+  yet from the previous slot, followed by one buffer filled by the
+  wrapped stream.
+ */
+typedef struct {
+	size_t used;
+	sqfs_u64 busy_us;
+	bool eof;
+	int status;
+
+	sqfs_u8 data[2 * BUFSZ];
+} ra_slot_t;
+
+typedef struct {
+	/* only touched by the producer */
+	istream_t *wrapped;
+	bool eof;
+} ra_producer_t;
+
+typedef struct {
+	istream_t base;
+
+	ra_producer_t producer;
+	thread_pool_t *pool;
+
+	/* the slot that currently backs the stream buffer */
+	ra_slot_t *current;
+
+	/* a slot that has only partially been appended to the buffer */
+	ra_slot_t *next;
+	size_t next_offset;
+
+	istream_readahead_stats_t stats;
+	sqfs_u64 start_us;
+} istream_readahead_t;
+
+static int fill_slot(void *user, void *ptr)
+{
+	ra_producer_t *prod = user;
+	istream_t *wrapped = prod->wrapped;
+	ra_slot_t *slot = ptr;
+	sqfs_u64 start = get_time_us();
+	sqfs_u8 *old_buffer;
+	size_t used;
+	int ret = 0;
+
+	slot->used = 0;
+
+	if (prod->eof) {
+		slot->eof = true;
+		return 0;
+	}
+
+	/*
+	  Anything that is left over from probing the wrapped stream is
+	  copied out first. After that, the wrapped stream is told to put
+	  its data directly into the slot.
+	*/
+	if (wrapped->buffer_offset < wrapped->buffer_used) {
+		slot->used = wrapped->buffer_used - wrapped->buffer_offset;
+
+		memcpy(slot->data + BUFSZ,
+		       wrapped->buffer + wrapped->buffer_offset, slot->used);
+	}
+
+	old_buffer = wrapped->buffer;
+	wrapped->buffer = slot->data + BUFSZ;
+	wrapped->buffer_used = slot->used;
+	wrapped->buffer_offset = 0;
+
+	while (wrapped->buffer_used < BUFSZ && !wrapped->eof) {
+		used = wrapped->buffer_used;
+
+		ret = wrapped->precache(wrapped);
+		if (ret != 0 || wrapped->buffer_used == used)
+			break;
+	}
+
+	slot->used = wrapped->buffer_used;
+
+	if (ret != 0 || wrapped->eof || slot->used < BUFSZ)
+		prod->eof = true;
+
+	wrapped->buffer = old_buffer;
+	wrapped->buffer_used = 0;
+	wrapped->buffer_offset = 0;
+
+	slot->status = ret;
+	slot->eof = prod->eof;
+	slot->busy_us = get_time_us() - start;
+	return 0;
+}
+
+static int next_slot(istream_readahead_t *ra)
+{
+	istream_t *strm = (istream_t *)ra;
+	sqfs_u64 start = get_time_us();
+	ra_slot_t *slot;
+
+	slot = ra->pool->dequeue(ra->pool);
+	ra->stats.wait_us += get_time_us() - start;
+
+	if (slot == NULL) {
+		fprintf(stderr, "%s: internal error in read ahead buffer.\n",
+			strm->get_filename(strm));
+		return -1;
+	}
+
+	ra->stats.busy_us += slot->busy_us;
+	ra->stats.bytes_read += slot->used;
+
+	if (slot->status != 0) {
+		free(slot);
+		return -1;
+	}
+
+	ra->next = slot;
+	ra->next_offset = 0;
+	return 0;
+}
+
+static int recycle_slot(istream_readahead_t *ra, ra_slot_t *slot)
+{
+	istream_t *strm = (istream_t *)ra;
+
+	if (ra->pool->submit(ra->pool, slot) != 0) {
+		fprintf(stderr, "%s: internal error in read ahead buffer.\n",
+			strm->get_filename(strm));
+		free(slot);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+  Normally, the next slot becomes the stream buffer and only the data that
+  was not consumed yet is copied in front of it. If there is more of that
+  than fits, the new data is appended to the current slot piece by piece
+  instead, so every call makes progress unless the buffer is full.
+*/
+static int ra_precache(istream_t *strm)
+{
+	istream_readahead_t *ra = (istream_readahead_t *)strm;
+	size_t leftover = strm->buffer_used;
+	ra_slot_t *slot, *old;
+	size_t avail, diff;
+
+	for (;;) {
+		if (ra->next == NULL && next_slot(ra))
+			return -1;
+
+		slot = ra->next;
+		avail = slot->used - ra->next_offset;
+
+		if (avail > 0 || slot->eof)
+			break;
+
+		ra->next = NULL;
+		if (recycle_slot(ra, slot))
+			return -1;
+	}
+
+	if (leftover > BUFSZ + ra->next_offset) {
+		memmove(ra->current->data, strm->buffer, leftover);
+		strm->buffer = ra->current->data;
+		strm->buffer_offset = 0;
+
+		diff = sizeof(ra->current->data) - leftover;
+		if (diff > avail)
+			diff = avail;
+
+		memcpy(strm->buffer + leftover,
+		       slot->data + BUFSZ + ra->next_offset, diff);
+
+		strm->buffer_used += diff;
+		ra->next_offset += diff;
+
+		if (slot->eof && ra->next_offset == slot->used)
+			strm->eof = true;
+		return 0;
+	}
+
+	memcpy(slot->data + BUFSZ + ra->next_offset - leftover,
+	       strm->buffer, leftover);
+
+	old = ra->current;
+	ra->current = slot;
+	ra->next = NULL;
+
+	strm->buffer = slot->data + BUFSZ + ra->next_offset - leftover;
+	strm->buffer_used = leftover + avail;
+	strm->buffer_offset = 0;
+
+	if (slot->eof) {
+		strm->eof = true;
+		free(old);
+		return 0;
+	}
+
+	return old == NULL ? 0 : recycle_slot(ra, old);
+}
+
+static const char *ra_get_filename(istream_t *strm)
+{
+	istream_readahead_t *ra = (istream_readahead_t *)strm;
+
+	return ra->producer.wrapped->get_filename(ra->producer.wrapped);
+}
+
+static void ra_destroy(sqfs_object_t *obj)
+{
+	istream_readahead_t *ra = (istream_readahead_t *)obj;
+	ra_slot_t *slot;
+
+	while ((slot = ra->pool->dequeue(ra->pool)) != NULL)
+		free(slot);
+
+	ra->pool->destroy(ra->pool);
+	sqfs_destroy(ra->producer.wrapped);
+	free(ra->current);
+	free(ra->next);
+	free(ra);
+}
+
+istream_t *istream_readahead_create(istream_t *strm, size_t num_buffers)
+{
+	istream_readahead_t *ra = calloc(1, sizeof(*ra));
+	sqfs_object_t *obj = (sqfs_object_t *)ra;
+	istream_t *base = (istream_t *)ra;
+	ra_slot_t *slot;
+	size_t i;
+
+	if (ra == NULL)
+		goto fail_errno;
+
+	ra->producer.wrapped = strm;
+
+	ra->pool = thread_pool_create(1, fill_slot);
+	if (ra->pool == NULL)
+		goto fail_errno;
+
+	ra->pool->set_worker_ptr(ra->pool, 0, &ra->producer);
+
+	if (num_buffers < 2)
+		num_buffers = 2;
+
+	for (i = 0; i < num_buffers; ++i) {
+		slot = calloc(1, sizeof(*slot));
+		if (slot == NULL)
+			goto fail_errno;
+
+		if (ra->pool->submit(ra->pool, slot) != 0) {
+			free(slot);
+			goto fail_pool;
+		}
+	}
+
+	ra->start_us = get_time_us();
+
+	base->precache = ra_precache;
+	base->get_filename = ra_get_filename;
+	obj->destroy = ra_destroy;
+	return base;
+fail_errno:
+	fprintf(stderr, "%s: creating read ahead buffer: %s.\n",
+		strm->get_filename(strm), strerror(errno));
+	goto fail;
+fail_pool:
+	fprintf(stderr, "%s: internal error creating read ahead buffer.\n",
+		strm->get_filename(strm));
+fail:
+	if (ra != NULL && ra->pool != NULL) {
+		while ((slot = ra->pool->dequeue(ra->pool)) != NULL)
+			free(slot);
+		ra->pool->destroy(ra->pool);
+	}
+	free(ra);
+	sqfs_destroy(strm);
+	return NULL;
+}
+
+void istream_readahead_get_stats(istream_t *strm,
+				 istream_readahead_stats_t *stats)
+{
+	istream_readahead_t *ra = (istream_readahead_t *)strm;
+
+	*stats = ra->stats;
+	stats->total_us = get_time_us() - ra->start_us;
+}
@@ -56,9 +56,17 @@ static int precache(istream_t *base)
 		if (ret == Z_BUF_ERROR)
 			break;
 
+		/* concatenated members are uncompressed like a single one */
 		if (ret == Z_STREAM_END) {
-			base->eof = true;
-			break;
+			if (istream_precache(wrapped))
+				return -1;
+
+			if (wrapped->buffer_used == 0) {
+				base->eof = true;
+				break;
+			}
+
+			ret = inflateReset(&gzip->strm);
 		}
 
 		if (ret != Z_OK) {
@@ -104,3 +112,122 @@ istream_comp_t *istream_gzip_create(const char *filename)
 	base->cleanup = cleanup;
 	return base;
 }
+
+static void *par_create(void)
+{
+	z_stream *strm = calloc(1, sizeof(*strm));
+
+	if (strm == NULL)
+		return NULL;
+
+	if (inflateInit2(strm, 16 + 15) != Z_OK) {
+		free(strm);
+		return NULL;
+	}
+
+	return strm;
+}
+
+static void par_destroy(void *dec)
+{
+	inflateEnd(dec);
+	free(dec);
+}
+
+static int par_reset(void *dec)
+{
+	return inflateReset(dec) == Z_OK ? 0 : -1;
+}
+
+static int par_decode(void *dec, sqfs_u8 **in, size_t *in_left,
+		      sqfs_u8 **out, size_t *out_left)
+{
+	z_stream *strm = dec;
+	uInt avail_in, avail_out;
+	int ret;
+
+	avail_in = ~((uInt)0U);
+	avail_out = ~((uInt)0U);
+
+	if ((size_t)avail_in > *in_left)
+		avail_in = (uInt)*in_left;
+
+	if ((size_t)avail_out > *out_left)
+		avail_out = (uInt)*out_left;
+
+	strm->next_in = *in;
+	strm->avail_in = avail_in;
+	strm->next_out = *out;
+	strm->avail_out = avail_out;
+
+	ret = inflate(strm, Z_NO_FLUSH);
+
+	*in += avail_in - strm->avail_in;
+	*in_left -= avail_in - strm->avail_in;
+	*out += avail_out - strm->avail_out;
+	*out_left -= avail_out - strm->avail_out;
+
+	if (ret == Z_STREAM_END)
+		return 1;
+
+	return (ret == Z_OK || ret == Z_BUF_ERROR) ? 0 : -1;
+}
+
+static bool par_is_frame_start(const sqfs_u8 *data, size_t size)
+{
+	/* magic, deflate method, no reserved flags, sane XFL & OS fields */
+	if (size < 10 || data[0] != 0x1F || data[1] != 0x8B || data[2] != 0x08)
+		return false;
+
+	if (data[3] & 0xE0)
+		return false;
+
+	if (data[8] != 0 && data[8] != 2 && data[8] != 4)
+		return false;
+
+	return data[9] <= 13 || data[9] == 255;
+}
+
+/*
+  A gzip member does not record its compressed size, so there is no way to
+  find the next one without inflating. Instead, look for something that
+  looks like a member header. If the guess turns out to be wrong, the
+  parallel decompressor notices that the previous member does not end there
+  and falls back to decoding that stretch serially.
+ */
+static size_t par_find_split(const sqfs_u8 *data, size_t size, size_t start)
+{
+	const sqfs_u8 *ptr;
+
+	while (start < size) {
+		ptr = memchr(data + start, 0x1F, size - start);
+		if (ptr == NULL)
+			break;
+
+		start = ptr - data;
+		if (size - start < 10)
+			break;
+
+		if (par_is_frame_start(ptr, size - start))
+			return start;
+
+		++start;
+	}
+
+	return 0;
+}
+
+static const istream_par_format_t par_format = {
+	.create = par_create,
+	.destroy = par_destroy,
+	.reset = par_reset,
+	.decode = par_decode,
+	.is_frame_start = par_is_frame_start,
+	.find_split = par_find_split,
+	.ignore_trailing = true,
+};
+
+const istream_par_format_t *istream_gzip_par_format(void)
+{
+	return &par_format;
+}
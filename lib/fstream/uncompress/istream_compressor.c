@@ -47,6 +47,11 @@ istream_t *istream_compressor_create(istream_t *strm, int comp_id)
 	case FSTREAM_COMPRESSOR_BZIP2:
 #ifdef WITH_BZIP2
 		comp = istream_bzip2_create(strm->get_filename(strm));
+#endif
+		break;
+	case FSTREAM_COMPRESSOR_LZ4:
+#ifdef WITH_LZ4
+		comp = istream_lz4_create(strm->get_filename(strm));
 #endif
 		break;
 	default:
@@ -0,0 +1,408 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * lz4.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "../internal.h"
+#include "util.h"
+
+#include <lz4.h>
+
+#define LZ4_FRAME_MAGIC (0x184D2204)
+#define LZ4_SKIPPABLE_MAGIC (0x184D2A50)
+#define LZ4_SKIPPABLE_MASK (0xFFFFFFF0)
+
+#define LZ4_FLG_VERSION_MASK (0xC0)
+#define LZ4_FLG_VERSION (0x40)
+#define LZ4_FLG_BLOCK_INDEP (0x20)
+#define LZ4_FLG_BLOCK_CHKSUM (0x10)
+#define LZ4_FLG_CONTENT_SIZE (0x08)
+#define LZ4_FLG_CONTENT_CHKSUM (0x04)
+#define LZ4_FLG_RESERVED (0x02)
+#define LZ4_FLG_DICT_ID (0x01)
+
+#define LZ4_BD_RESERVED (0x8F)
+
+#define LZ4_BLOCK_UNCOMPRESSED (0x80000000)
+
+/* how far back a match in a linked block can reach */
+#define LZ4_HISTORY_SIZE (65536)
+
+typedef struct {
+	istream_comp_t base;
+
+	bool in_frame;
+	sqfs_u8 flags;
+	size_t block_max;
+	xxh32_state_t chksum;
+
+	/*
+	  Compressed blocks are copied to 'in' only if they are not in the
+	  wrapped buffer in one piece. Blocks that can't be decoded directly
+	  into the stream buffer are decoded to 'out' instead, which is
+	  prefixed with the history needed by linked blocks.
+	 */
+	size_t alloc_size;
+	sqfs_u8 *in;
+	sqfs_u8 *out;
+
+	size_t history;
+	size_t out_offset;
+	size_t out_used;
+} istream_lz4_t;
+
+static const char *get_filename(istream_lz4_t *lz4)
+{
+	istream_t *wrapped = ((istream_comp_t *)lz4)->wrapped;
+
+	return wrapped->get_filename(wrapped);
+}
+
+static int read_data(istream_lz4_t *lz4, void *data, size_t size)
+{
+	istream_t *wrapped = ((istream_comp_t *)lz4)->wrapped;
+	sqfs_s32 ret;
+
+	ret = istream_read(wrapped, data, size);
+	if (ret < 0)
+		return -1;
+
+	if ((size_t)ret < size) {
+		fprintf(stderr, "%s: unexpected end-of-file in compressed "
+			"data.\n", get_filename(lz4));
+		return -1;
+	}
+
+	return 0;
+}
+
+static int read_le32(istream_lz4_t *lz4, sqfs_u32 *out)
+{
+	sqfs_u32 value;
+
+	if (read_data(lz4, &value, sizeof(value)))
+		return -1;
+
+	*out = le32toh(value);
+	return 0;
+}
+
+/* avoid copying blocks that are available in the wrapped buffer anyway */
+static const sqfs_u8 *get_block(istream_lz4_t *lz4, size_t size)
+{
+	istream_t *wrapped = ((istream_comp_t *)lz4)->wrapped;
+	const sqfs_u8 *ptr;
+
+	if ((wrapped->buffer_used - wrapped->buffer_offset) >= size) {
+		ptr = wrapped->buffer + wrapped->buffer_offset;
+		wrapped->buffer_offset += size;
+		return ptr;
+	}
+
+	if (read_data(lz4, lz4->in, size))
+		return NULL;
+
+	return lz4->in;
+}
+
+static int grow_buffers(istream_lz4_t *lz4)
+{
+	sqfs_u8 *new;
+
+	if (lz4->block_max <= lz4->alloc_size)
+		return 0;
+
+	/* room for the optional block checksum */
+	new = realloc(lz4->in, lz4->block_max + 4);
+	if (new == NULL)
+		goto fail;
+	lz4->in = new;
+
+	new = realloc(lz4->out, LZ4_HISTORY_SIZE + lz4->block_max);
+	if (new == NULL)
+		goto fail;
+	lz4->out = new;
+
+	lz4->alloc_size = lz4->block_max;
+	return 0;
+fail:
+	fprintf(stderr, "%s: allocating lz4 block buffer: %s.\n",
+		get_filename(lz4), strerror(errno));
+	return -1;
+}
+
+/*
+  Returns a negative value on failure, a positive value if the end of the
+  input was reached and zero if a frame header was read.
+ */
+static int read_frame_header(istream_lz4_t *lz4)
+{
+	istream_t *wrapped = ((istream_comp_t *)lz4)->wrapped;
+	sqfs_u8 desc[1 + 1 + 8 + 1];
+	sqfs_u32 magic, skip;
+	size_t size;
+
+	for (;;) {
+		if (istream_precache(wrapped))
+			return -1;
+
+		if (wrapped->buffer_used == 0)
+			return 1;
+
+		if (read_le32(lz4, &magic))
+			return -1;
+
+		if ((magic & LZ4_SKIPPABLE_MASK) != LZ4_SKIPPABLE_MAGIC)
+			break;
+
+		if (read_le32(lz4, &skip))
+			return -1;
+
+		if (istream_skip(wrapped, skip))
+			return -1;
+	}
+
+	if (magic != LZ4_FRAME_MAGIC) {
+		fprintf(stderr, "%s: trailing garbage after compressed data.\n",
+			get_filename(lz4));
+		return -1;
+	}
+
+	if (read_data(lz4, desc, 2))
+		return -1;
+
+	if ((desc[0] & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION ||
+	    (desc[0] & LZ4_FLG_RESERVED) || (desc[1] & LZ4_BD_RESERVED) ||
+	    (desc[1] >> 4) < 4) {
+		fprintf(stderr, "%s: unsupported lz4 frame header.\n",
+			get_filename(lz4));
+		return -1;
+	}
+
+	if (desc[0] & LZ4_FLG_DICT_ID) {
+		fprintf(stderr, "%s: lz4 frames that need a dictionary are "
+			"not supported.\n", get_filename(lz4));
+		return -1;
+	}
+
+	size = 2;
+
+	if (desc[0] & LZ4_FLG_CONTENT_SIZE)
+		size += 8;
+
+	if (read_data(lz4, desc + 2, size - 2 + 1))
+		return -1;
+
+	if (desc[size] != ((xxh32_ref(desc, size) >> 8) & 0xFF)) {
+		fprintf(stderr, "%s: lz4 frame header checksum mismatch.\n",
+			get_filename(lz4));
+		return -1;
+	}
+
+	lz4->flags = desc[0];
+	lz4->block_max = 1 << (2 * (desc[1] >> 4) + 8);
+	lz4->in_frame = true;
+	lz4->history = 0;
+	lz4->out_offset = 0;
+	lz4->out_used = 0;
+	xxh32_reset(&lz4->chksum);
+
+	return grow_buffers(lz4);
+}
+
+static int read_frame_end(istream_lz4_t *lz4)
+{
+	sqfs_u32 chksum;
+
+	lz4->in_frame = false;
+
+	if (!(lz4->flags & LZ4_FLG_CONTENT_CHKSUM))
+		return 0;
+
+	if (read_le32(lz4, &chksum))
+		return -1;
+
+	if (chksum != xxh32_digest(&lz4->chksum)) {
+		fprintf(stderr, "%s: lz4 content checksum mismatch.\n",
+			get_filename(lz4));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* keep the tail of what was decoded so far in front of the out buffer */
+static void update_history(istream_lz4_t *lz4)
+{
+	size_t keep = lz4->history + lz4->out_used;
+	sqfs_u8 *end = lz4->out + LZ4_HISTORY_SIZE + lz4->out_used;
+
+	if (keep > LZ4_HISTORY_SIZE)
+		keep = LZ4_HISTORY_SIZE;
+
+	memmove(lz4->out + LZ4_HISTORY_SIZE - keep, end - keep, keep);
+	lz4->history = keep;
+	lz4->out_offset = 0;
+	lz4->out_used = 0;
+}
+
+/*
+  Decodes the next block either directly into the stream buffer or into
+  the out buffer. Returns a negative value on failure, a positive value if
+  the end of the input was reached.
+ */
+static int read_block(istream_lz4_t *lz4)
+{
+	istream_t *base = (istream_t *)lz4;
+	sqfs_u32 size, chksum;
+	const sqfs_u8 *data;
+	sqfs_u8 *dst;
+	size_t extra;
+	int ret;
+
+	for (;;) {
+		if (!lz4->in_frame) {
+			ret = read_frame_header(lz4);
+			if (ret != 0)
+				return ret;
+		}
+
+		if (read_le32(lz4, &size))
+			return -1;
+
+		if (size != 0)
+			break;
+
+		if (read_frame_end(lz4))
+			return -1;
+	}
+
+	extra = (lz4->flags & LZ4_FLG_BLOCK_CHKSUM) ? 4 : 0;
+
+	if ((size & ~LZ4_BLOCK_UNCOMPRESSED) > lz4->block_max) {
+		fprintf(stderr, "%s: lz4 block exceeds maximum size.\n",
+			get_filename(lz4));
+		return -1;
+	}
+
+	data = get_block(lz4, (size & ~LZ4_BLOCK_UNCOMPRESSED) + extra);
+	if (data == NULL)
+		return -1;
+
+	if (extra > 0) {
+		memcpy(&chksum, data + (size & ~LZ4_BLOCK_UNCOMPRESSED),
+		       sizeof(chksum));
+
+		if (le32toh(chksum) != xxh32_ref(data, size &
+					     ~LZ4_BLOCK_UNCOMPRESSED)) {
+			fprintf(stderr, "%s: lz4 block checksum mismatch.\n",
+				get_filename(lz4));
+			return -1;
+		}
+	}
+
+	if ((lz4->flags & LZ4_FLG_BLOCK_INDEP) &&
+	    (BUFSZ - base->buffer_used) >= lz4->block_max) {
+		dst = base->buffer + base->buffer_used;
+	} else {
+		if (lz4->flags & LZ4_FLG_BLOCK_INDEP) {
+			lz4->out_offset = 0;
+			lz4->out_used = 0;
+		} else {
+			update_history(lz4);
+		}
+
+		dst = lz4->out + LZ4_HISTORY_SIZE;
+	}
+
+	if (size & LZ4_BLOCK_UNCOMPRESSED) {
+		ret = size & ~LZ4_BLOCK_UNCOMPRESSED;
+		memcpy(dst, data, ret);
+	} else if (lz4->flags & LZ4_FLG_BLOCK_INDEP) {
+		ret = LZ4_decompress_safe((const char *)data, (char *)dst,
+					  size, lz4->block_max);
+	} else {
+		ret = LZ4_decompress_safe_usingDict((const char *)data,
+						    (char *)dst, size,
+						    lz4->block_max,
+						    (const char *)dst -
+						    lz4->history,
+						    lz4->history);
+	}
+
+	if (ret < 0) {
+		fprintf(stderr, "%s: data corruption in lz4 block.\n",
+			get_filename(lz4));
+		return -1;
+	}
+
+	if (lz4->flags & LZ4_FLG_CONTENT_CHKSUM)
+		xxh32_update(&lz4->chksum, dst, ret);
+
+	if (dst == base->buffer + base->buffer_used) {
+		base->buffer_used += ret;
+	} else {
+		lz4->out_used = ret;
+	}
+
+	return 0;
+}
+
+static int precache(istream_t *base)
+{
+	istream_lz4_t *lz4 = (istream_lz4_t *)base;
+	size_t diff;
+	int ret;
+
+	while (base->buffer_used < BUFSZ) {
+		if (lz4->out_offset < lz4->out_used) {
+			diff = lz4->out_used - lz4->out_offset;
+			if (diff > (BUFSZ - base->buffer_used))
+				diff = BUFSZ - base->buffer_used;
+
+			memcpy(base->buffer + base->buffer_used,
+			       lz4->out + LZ4_HISTORY_SIZE + lz4->out_offset,
+			       diff);
+
+			base->buffer_used += diff;
+			lz4->out_offset += diff;
+			continue;
+		}
+
+		ret = read_block(lz4);
+		if (ret < 0)
+			return -1;
+
+		if (ret > 0) {
+			base->eof = true;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static void cleanup(istream_comp_t *base)
+{
+	istream_lz4_t *lz4 = (istream_lz4_t *)base;
+
+	free(lz4->in);
+	free(lz4->out);
+}
+
+istream_comp_t *istream_lz4_create(const char *filename)
+{
+	istream_lz4_t *lz4 = calloc(1, sizeof(*lz4));
+	istream_comp_t *base = (istream_comp_t *)lz4;
+
+	if (lz4 == NULL) {
+		fprintf(stderr, "%s: creating lz4 decompressor: %s.\n",
+			filename, strerror(errno));
+		return NULL;
+	}
+
+	((istream_t *)base)->precache = precache;
+	base->cleanup = cleanup;
+	return base;
+}
@@ -0,0 +1,644 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * parallel.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "../internal.h"
+#include "threadpool.h"
+
+/* try to hand at least this much compressed data to a worker at once */
+#define CHUNK_SIZE (1024 * 1024)
+
+/* frames larger than this are decoded serially */
+#define MAX_CHUNK_SIZE (16 * 1024 * 1024)
+
+/*
+  A worker gives up on a chunk that uncompresses to more than this and the
+  chunk is decoded serially instead, so a small, highly compressible chunk
+  cannot blow up memory usage. With chunks of at least CHUNK_SIZE, only data
+  that compresses better than 16:1 takes the serial path.
+ */
+#define MAX_JOB_OUTPUT (16 * 1024 * 1024)
+
+/*
+  Number of jobs kept in flight per worker thread. Every job holds at most
+  MAX_CHUNK_SIZE bytes of input and MAX_JOB_OUTPUT bytes of output, so this
+  also bounds the memory used by the pipeline.
+ */
+#define JOBS_PER_WORKER (2)
+
+typedef struct {
+	sqfs_u8 *input;
+	size_t in_size;
+
+	sqfs_u8 *output;
+	size_t out_size;
+	size_t out_offset;
+
+	int status;
+	bool trailing;
+} par_job_t;
+
+typedef struct {
+	const istream_par_format_t *fmt;
+	void *dec;
+} par_worker_t;
+
+typedef struct {
+	istream_t base;
+
+	istream_t *wrapped;
+	const istream_par_format_t *fmt;
+	thread_pool_t *pool;
+	par_worker_t *workers;
+	size_t num_workers;
+	size_t max_jobs;
+
+	/* compressed data read from the wrapped stream, not submitted yet */
+	sqfs_u8 *pending;
+	size_t pending_size;
+	size_t pending_offset;
+	size_t pending_max;
+	size_t scanned;
+	bool input_eof;
+
+	size_t in_flight;
+	size_t in_flight_bytes;
+	par_job_t *current;
+
+	/* decoder for frames that cannot be processed in parallel */
+	void *serial_dec;
+	bool serial;
+	bool done;
+
+	sqfs_u8 buffer[BUFSZ];
+} istream_par_t;
+
+static void job_destroy(par_job_t *job)
+{
+	if (job != NULL) {
+		free(job->input);
+		free(job->output);
+		free(job);
+	}
+}
+
+static int grow_output(par_job_t *job)
+{
+	size_t new_sz = job->out_size * 2;
+	sqfs_u8 *new;
+
+	if (new_sz < BUFSZ)
+		new_sz = BUFSZ;
+
+	if (new_sz > MAX_JOB_OUTPUT)
+		new_sz = MAX_JOB_OUTPUT;
+
+	if (new_sz <= job->out_size)
+		return -1;
+
+	new = realloc(job->output, new_sz);
+	if (new == NULL)
+		return -1;
+
+	job->output = new;
+	job->out_size = new_sz;
+	return 0;
+}
+
+static int decode_job(void *user, void *ptr)
+{
+	size_t in_left, out_left, out_used = 0;
+	par_worker_t *worker = user;
+	par_job_t *job = ptr;
+	sqfs_u8 *in;
+	sqfs_u8 *out;
+	int ret;
+
+	in = job->input;
+	in_left = job->in_size;
+	job->status = -1;
+
+	while (in_left > 0) {
+		if (worker->fmt->reset(worker->dec))
+			goto fail;
+
+		do {
+			if (out_used == job->out_size && grow_output(job))
+				goto fail;
+
+			out = job->output + out_used;
+			out_left = job->out_size - out_used;
+
+			ret = worker->fmt->decode(worker->dec, &in, &in_left,
+						  &out, &out_left);
+
+			out_used = job->out_size - out_left;
+			if (ret < 0)
+				goto fail;
+
+			/* needs more input than we have */
+			if (ret == 0 && in_left == 0 && out_left > 0)
+				goto fail;
+		} while (ret == 0);
+
+		if (in_left > 0 &&
+		    !worker->fmt->is_frame_start(in, in_left)) {
+			job->trailing = true;
+			break;
+		}
+	}
+
+	job->out_size = out_used;
+	job->status = 0;
+	return 0;
+fail:
+	/* the main thread only needs the input to decode it serially */
+	free(job->output);
+	job->output = NULL;
+	job->out_size = 0;
+	return 0;
+}
+
+static int read_input(istream_par_t *par)
+{
+	istream_t *wrapped = par->wrapped;
+	size_t avail, new_max;
+	sqfs_u8 *new;
+
+	if (par->pending_offset > 0) {
+		memmove(par->pending, par->pending + par->pending_offset,
+			par->pending_size - par->pending_offset);
+
+		par->pending_size -= par->pending_offset;
+		par->pending_offset = 0;
+	}
+
+	if (istream_precache(wrapped))
+		return -1;
+
+	avail = wrapped->buffer_used - wrapped->buffer_offset;
+	if (avail == 0) {
+		par->input_eof = true;
+		return 0;
+	}
+
+	if (avail > par->pending_max - par->pending_size) {
+		new_max = par->pending_size + avail;
+
+		new = realloc(par->pending, new_max);
+		if (new == NULL) {
+			perror(wrapped->get_filename(wrapped));
+			return -1;
+		}
+
+		par->pending = new;
+		par->pending_max = new_max;
+	}
+
+	memcpy(par->pending + par->pending_size,
+	       wrapped->buffer + wrapped->buffer_offset, avail);
+
+	par->pending_size += avail;
+	wrapped->buffer_offset = wrapped->buffer_used;
+
+	if (wrapped->eof)
+		par->input_eof = true;
+	return 0;
+}
+
+/*
+  Cut the next chunk off the pending input. Returns 0 and sets the job to
+  NULL if there is no more input, or if the next frame is too large and has
+  to be decoded serially.
+ */
+static int next_job(istream_par_t *par, par_job_t **out)
+{
+	size_t avail, split, start;
+	par_job_t *job;
+
+	*out = NULL;
+
+	for (;;) {
+		avail = par->pending_size - par->pending_offset;
+		split = 0;
+
+		if (avail >= CHUNK_SIZE) {
+			start = par->scanned > CHUNK_SIZE ?
+				par->scanned : CHUNK_SIZE;
+
+			split = par->fmt->find_split(par->pending +
+						     par->pending_offset,
+						     avail, start);
+
+			par->scanned = avail > 16 ? (avail - 16) : 0;
+		}
+
+		if (split == 0 && avail < MAX_CHUNK_SIZE && par->input_eof) {
+			if (avail == 0)
+				return 0;
+			split = avail;
+		}
+
+		if (split > 0) {
+			par->scanned = 0;
+			break;
+		}
+
+		/*
+		  Nothing found past the minimum chunk size. Unless this is
+		  one huge frame, settle for a smaller chunk. There are no
+		  further boundaries up to the scanned offset, so that can be
+		  kept for the next chunk.
+		*/
+		if (avail >= MAX_CHUNK_SIZE) {
+			split = par->fmt->find_split(par->pending +
+						     par->pending_offset,
+						     avail, 1);
+			if (split > 0) {
+				par->scanned = par->scanned > split ?
+					(par->scanned - split) : 0;
+				break;
+			}
+
+			par->serial = true;
+			return par->fmt->reset(par->serial_dec);
+		}
+
+		if (read_input(par))
+			return -1;
+	}
+
+	job = calloc(1, sizeof(*job));
+	if (job == NULL)
+		goto fail_errno;
+
+	job->input = malloc(split);
+	if (job->input == NULL)
+		goto fail_errno;
+
+	memcpy(job->input, par->pending + par->pending_offset, split);
+	job->in_size = split;
+
+	par->pending_offset += split;
+	*out = job;
+	return 0;
+fail_errno:
+	perror(par->wrapped->get_filename(par->wrapped));
+	job_destroy(job);
+	return -1;
+}
+
+static int fill_pipeline(istream_par_t *par)
+{
+	par_job_t *job;
+
+	while (!par->serial && par->in_flight < par->max_jobs) {
+		if (next_job(par, &job))
+			return -1;
+
+		if (job == NULL)
+			break;
+
+		if (par->pool->submit(par->pool, job)) {
+			fprintf(stderr, "%s: internal error in parallel "
+				"decompressor.\n",
+				par->wrapped->get_filename(par->wrapped));
+			job_destroy(job);
+			return -1;
+		}
+
+		par->in_flight += 1;
+		par->in_flight_bytes += job->in_size;
+	}
+
+	return 0;
+}
+
+/*
+  A worker could not decode a chunk. Either the data is broken, it
+  uncompresses to more than MAX_JOB_OUTPUT or, for gzip, a guessed member
+  boundary was wrong. Every chunk after it started at the
+  same wrong guess, so they are all put back in front of the pending input
+  and the whole stretch is decoded serially.
+ */
+static int rewind_to_serial(istream_par_t *par, par_job_t *failed)
+{
+	size_t pos, size;
+	par_job_t *job;
+	sqfs_u8 *new;
+
+	size = par->pending_size - par->pending_offset;
+	size += failed->in_size + par->in_flight_bytes;
+
+	new = malloc(size);
+	if (new == NULL) {
+		perror(par->wrapped->get_filename(par->wrapped));
+		return -1;
+	}
+
+	memcpy(new, failed->input, failed->in_size);
+	pos = failed->in_size;
+
+	while (par->in_flight > 0) {
+		job = par->pool->dequeue(par->pool);
+		if (job == NULL)
+			break;
+
+		memcpy(new + pos, job->input, job->in_size);
+		pos += job->in_size;
+
+		par->in_flight -= 1;
+		par->in_flight_bytes -= job->in_size;
+		job_destroy(job);
+	}
+
+	memcpy(new + pos, par->pending + par->pending_offset,
+	       par->pending_size - par->pending_offset);
+	pos += par->pending_size - par->pending_offset;
+
+	free(par->pending);
+	par->pending = new;
+	par->pending_size = pos;
+	par->pending_offset = 0;
+	par->pending_max = size;
+	par->scanned = 0;
+
+	par->serial = true;
+	return par->fmt->reset(par->serial_dec);
+}
+
+static int decode_serial(istream_par_t *par)
+{
+	istream_t *strm = (istream_t *)par;
+	size_t in_left, out_left;
+	sqfs_u8 *in;
+	sqfs_u8 *out;
+	int ret;
+
+	while (strm->buffer_used < BUFSZ) {
+		if (par->pending_offset >= par->pending_size) {
+			if (par->input_eof) {
+				fprintf(stderr, "%s: unexpected end-of-file "
+					"in compressed data.\n",
+					par->wrapped->get_filename(par->wrapped));
+				return -1;
+			}
+
+			par->pending_offset = 0;
+			par->pending_size = 0;
+
+			if (read_input(par))
+				return -1;
+			continue;
+		}
+
+		in = par->pending + par->pending_offset;
+		in_left = par->pending_size - par->pending_offset;
+		out = strm->buffer + strm->buffer_used;
+		out_left = BUFSZ - strm->buffer_used;
+
+		ret = par->fmt->decode(par->serial_dec, &in, &in_left,
+				       &out, &out_left);
+
+		par->pending_offset = par->pending_size - in_left;
+		strm->buffer_used = BUFSZ - out_left;
+
+		if (ret < 0) {
+			fprintf(stderr, "%s: error in decompressor.\n",
+				par->wrapped->get_filename(par->wrapped));
+			return -1;
+		}
+
+		if (ret > 0) {
+			par->serial = false;
+			break;
+		}
+	}
+
+	if (par->serial)
+		return 0;
+
+	/* make sure the rest is actually another frame */
+	while (par->pending_size - par->pending_offset < 16 &&
+	       !par->input_eof) {
+		if (read_input(par))
+			return -1;
+	}
+
+	if (par->pending_offset < par->pending_size &&
+	    !par->fmt->is_frame_start(par->pending + par->pending_offset,
+				      par->pending_size - par->pending_offset)) {
+		if (!par->fmt->ignore_trailing) {
+			fprintf(stderr, "%s: trailing garbage after "
+				"compressed data.\n",
+				par->wrapped->get_filename(par->wrapped));
+			return -1;
+		}
+
+		par->done = true;
+	}
+
+	return 0;
+}
+
+static int par_precache(istream_t *strm)
+{
+	istream_par_t *par = (istream_par_t *)strm;
+	par_job_t *job;
+	size_t diff;
+
+	while (strm->buffer_used < BUFSZ) {
+		job = par->current;
+
+		if (job != NULL) {
+			diff = job->out_size - job->out_offset;
+			if (diff > BUFSZ - strm->buffer_used)
+				diff = BUFSZ - strm->buffer_used;
+
+			memcpy(strm->buffer + strm->buffer_used,
+			       job->output + job->out_offset, diff);
+			strm->buffer_used += diff;
+			job->out_offset += diff;
+
+			if (job->out_offset >= job->out_size) {
+				if (job->trailing) {
+					if (!par->fmt->ignore_trailing) {
+						fprintf(stderr, "%s: trailing "
+							"garbage after "
+							"compressed data.\n",
+							strm->get_filename(strm));
+						return -1;
+					}
+					par->done = true;
+				}
+				job_destroy(job);
+				par->current = NULL;
+			}
+			continue;
+		}
+
+		if (par->done)
+			break;
+
+		/* chunks submitted before switching modes come first */
+		if (par->serial && par->in_flight == 0) {
+			if (decode_serial(par))
+				return -1;
+			continue;
+		}
+
+		if (fill_pipeline(par))
+			return -1;
+
+		if (par->in_flight == 0) {
+			if (!par->serial)
+				par->done = true;
+			continue;
+		}
+
+		job = par->pool->dequeue(par->pool);
+		if (job == NULL) {
+			fprintf(stderr, "%s: internal error in parallel "
+				"decompressor.\n", strm->get_filename(strm));
+			return -1;
+		}
+
+		par->in_flight -= 1;
+		par->in_flight_bytes -= job->in_size;
+
+		if (job->status != 0) {
+			if (rewind_to_serial(par, job)) {
+				job_destroy(job);
+				return -1;
+			}
+			job_destroy(job);
+			continue;
+		}
+
+		par->current = job;
+	}
+
+	if (par->done && par->current == NULL)
+		strm->eof = true;
+
+	return 0;
+}
+
+static const char *par_get_filename(istream_t *strm)
+{
+	istream_par_t *par = (istream_par_t *)strm;
+
+	return par->wrapped->get_filename(par->wrapped);
+}
+
+static void par_destroy(sqfs_object_t *obj)
+{
+	istream_par_t *par = (istream_par_t *)obj;
+	size_t i;
+
+	if (par->pool != NULL) {
+		while (par->in_flight > 0) {
+			job_destroy(par->pool->dequeue(par->pool));
+			par->in_flight -= 1;
+		}
+
+		par->pool->destroy(par->pool);
+	}
+
+	for (i = 0; i < par->num_workers; ++i) {
+		if (par->workers[i].dec != NULL)
+			par->fmt->destroy(par->workers[i].dec);
+	}
+
+	if (par->serial_dec != NULL)
+		par->fmt->destroy(par->serial_dec);
+
+	job_destroy(par->current);
+	sqfs_destroy(par->wrapped);
+	free(par->workers);
+	free(par->pending);
+	free(par);
+}
+
+istream_t *istream_compressor_create_parallel(istream_t *strm, int comp_id,
+					      size_t num_jobs)
+{
+	const istream_par_format_t *fmt = NULL;
+	istream_par_t *par;
+	size_t i;
+
+	switch (comp_id) {
+	case FSTREAM_COMPRESSOR_GZIP:
+#ifdef WITH_GZIP
+		fmt = istream_gzip_par_format();
+#endif
+		break;
+	case FSTREAM_COMPRESSOR_ZSTD:
+#if defined(WITH_ZSTD) && defined(HAVE_ZSTD_STREAM)
+		fmt = istream_zstd_par_format();
+#endif
+		break;
+	default:
+		break;
+	}
+
+	if (fmt == NULL)
+		return istream_compressor_create(strm, comp_id);
+
+	par = calloc(1, sizeof(*par));
+	if (par == NULL)
+		goto fail_errno;
+
+	par->wrapped = strm;
+	par->fmt = fmt;
+	if (num_jobs > 1) {
+		par->pool = thread_pool_create(num_jobs, decode_job);
+	} else {
+		par->pool = thread_pool_create_serial(decode_job);
+	}
+
+	if (par->pool == NULL)
+		goto fail_errno;
+
+	par->num_workers = par->pool->get_worker_count(par->pool);
+	par->max_jobs = par->num_workers * JOBS_PER_WORKER;
+
+	par->workers = calloc(par->num_workers, sizeof(par->workers[0]));
+	if (par->workers == NULL)
+		goto fail_errno;
+
+	for (i = 0; i < par->num_workers; ++i) {
+		par->workers[i].fmt = fmt;
+		par->workers[i].dec = fmt->create();
+		if (par->workers[i].dec == NULL)
+			goto fail_dec;
+
+		par->pool->set_worker_ptr(par->pool, i, par->workers + i);
+	}
+
+	par->serial_dec = fmt->create();
+	if (par->serial_dec == NULL)
+		goto fail_dec;
+
+	((istream_t *)par)->buffer = par->buffer;
+	((istream_t *)par)->precache = par_precache;
+	((istream_t *)par)->get_filename = par_get_filename;
+	((sqfs_object_t *)par)->destroy = par_destroy;
+	return (istream_t *)par;
+fail_errno:
+	fprintf(stderr, "%s: creating parallel decompressor: %s.\n",
+		strm->get_filename(strm), strerror(errno));
+	goto fail;
+fail_dec:
+	fprintf(stderr, "%s: error creating decoder.\n",
+		strm->get_filename(strm));
+fail:
+	if (par != NULL) {
+		par_destroy((sqfs_object_t *)par);
+	} else {
+		sqfs_destroy(strm);
+	}
+	return NULL;
+}
@@ -32,7 +32,7 @@ static int precache(istream_t *base)
 	in.src = wrapped->buffer;
 	in.size = wrapped->buffer_used;
 
-	out.dst = ((istream_comp_t *)base)->uncompressed + base->buffer_used;
+	out.dst = base->buffer + base->buffer_used;
 	out.size = BUFSZ - base->buffer_used;
 
 	ret = ZSTD_decompressStream(zstd->strm, &out, &in);
@@ -78,4 +78,98 @@ istream_comp_t *istream_zstd_create(const char *filename)
 	base->cleanup = cleanup;
 	return base;
 }
+
+static void *par_create(void)
+{
+	return ZSTD_createDStream();
+}
+
+static void par_destroy(void *dec)
+{
+	ZSTD_freeDStream(dec);
+}
+
+static int par_reset(void *dec)
+{
+	return ZSTD_isError(ZSTD_initDStream(dec)) ? -1 : 0;
+}
+
+static int par_decode(void *dec, sqfs_u8 **in, size_t *in_left,
+		      sqfs_u8 **out, size_t *out_left)
+{
+	ZSTD_outBuffer outbuf;
+	ZSTD_inBuffer inbuf;
+	size_t ret;
+
+	inbuf.src = *in;
+	inbuf.size = *in_left;
+	inbuf.pos = 0;
+
+	outbuf.dst = *out;
+	outbuf.size = *out_left;
+	outbuf.pos = 0;
+
+	ret = ZSTD_decompressStream(dec, &outbuf, &inbuf);
+
+	*in += inbuf.pos;
+	*in_left -= inbuf.pos;
+	*out += outbuf.pos;
+	*out_left -= outbuf.pos;
+
+	if (ZSTD_isError(ret))
+		return -1;
+
+	return ret == 0 ? 1 : 0;
+}
+
+static bool par_is_frame_start(const sqfs_u8 *data, size_t size)
+{
+	sqfs_u32 magic;
+
+	if (size < 4)
+		return false;
+
+	magic = data[0] | (data[1] << 8) | (data[2] << 16) |
+		((sqfs_u32)data[3] << 24);
+
+	return magic == ZSTD_MAGICNUMBER ||
+		(magic & 0xFFFFFFF0) == 0x184D2A50;
+}
+
+/*
+  Frames can be skipped over by walking the block headers, so the split
+  points found here are exact.
+ */
+static size_t par_find_split(const sqfs_u8 *data, size_t size, size_t start)
+{
+	size_t offset = 0, ret;
+
+	while (offset < size) {
+		ret = ZSTD_findFrameCompressedSize(data + offset,
+						   size - offset);
+		if (ZSTD_isError(ret))
+			break;
+
+		offset += ret;
+		if (offset >= start)
+			return offset;
+	}
+
+	return 0;
+}
+
+static const istream_par_format_t par_format = {
+	.create = par_create,
+	.destroy = par_destroy,
+	.reset = par_reset,
+	.decode = par_decode,
+	.is_frame_start = par_is_frame_start,
+	.find_split = par_find_split,
+	.ignore_trailing = false,
+};
+
+const istream_par_format_t *istream_zstd_par_format(void)
+{
+	return &par_format;
+}
 #endif /* HAVE_ZSTD_STREAM */
@@ -45,6 +45,60 @@ static int file_precache(istream_t *strm)
 	return 0;
 }
 
+static sqfs_s32 file_read_direct(istream_t *strm, void *data, size_t size)
+{
+	file_istream_t *file = (file_istream_t *)strm;
+	sqfs_s32 total = 0;
+	ssize_t ret;
+
+	while (size > 0 && !file->eof) {
+		ret = read(file->fd, data, size);
+
+		if (ret == 0) {
+			file->eof = true;
+			break;
+		}
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			perror(file->path);
+			return -1;
+		}
+
+		data = (char *)data + ret;
+		size -= ret;
+		total += ret;
+	}
+
+	return total;
+}
+
+static int file_skip(istream_t *strm, sqfs_u64 size)
+{
+	file_istream_t *file = (file_istream_t *)strm;
+	struct stat sb;
+	off_t pos;
+
+	pos = lseek(file->fd, 0, SEEK_CUR);
+	if (pos == (off_t)-1 || fstat(file->fd, &sb) != 0)
+		goto fail_errno;
+
+	if (pos > sb.st_size || size > (sqfs_u64)(sb.st_size - pos)) {
+		fprintf(stderr, "%s: unexpected end-of-file\n", file->path);
+		return -1;
+	}
+
+	if (lseek(file->fd, size, SEEK_CUR) == (off_t)-1)
+		goto fail_errno;
+
+	return 0;
+fail_errno:
+	perror(file->path);
+	return -1;
+}
+
 static const char *file_get_filename(istream_t *strm)
 {
 	file_istream_t *file = (file_istream_t *)strm;
@@ -52,6 +106,15 @@ static const char *file_get_filename(istream_t *strm)
 	return file->path;
 }
 
+/* pipes and devices are always read, even if lseek happens to work */
+static void file_init_skip(file_istream_t *file)
+{
+	struct stat sb;
+
+	if (fstat(file->fd, &sb) == 0 && S_ISREG(sb.st_mode))
+		((istream_t *)file)->skip = file_skip;
+}
+
 static void file_destroy(sqfs_object_t *obj)
 {
 	file_istream_t *file = (file_istream_t *)obj;
@@ -88,8 +151,10 @@ istream_t *istream_open_file(const char *path)
 
 	strm->buffer = file->buffer;
 	strm->precache = file_precache;
+	strm->read_direct = file_read_direct;
 	strm->get_filename = file_get_filename;
 	obj->destroy = file_destroy;
+	file_init_skip(file);
 	return strm;
 fail_path:
 	free(file->path);
@@ -114,8 +179,10 @@ istream_t *istream_open_stdin(void)
 	file->fd = STDIN_FILENO;
 	strm->buffer = file->buffer;
 	strm->precache = file_precache;
+	strm->read_direct = file_read_direct;
 	strm->get_filename = file_get_filename;
 	obj->destroy = file_destroy;
+	file_init_skip(file);
 	return strm;
 fail:
 	perror("creating file wrapper for stdin");
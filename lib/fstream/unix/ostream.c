@@ -11,10 +11,51 @@ typedef struct {
 	char *path;
 	int fd;
 
+	/* cleared once the kernel refuses to copy between two files */
+	bool try_copy_range;
+	bool try_splice;
+
+	/*
+	  Set for regular files we created, where data is written to
+	  explicit offsets instead of moving the file position around.
+	 */
+	bool positional;
+
+	/* holes have to be punched out of the preallocated space */
+	bool preallocated;
+
 	off_t sparse_count;
 	off_t size;
 } file_ostream_t;
 
+/* upper bound for a single kernel side copy request */
+#define MAX_COPY_CHUNK (0x40000000)
+
+static int skip_sparse(file_ostream_t *file)
+{
+	if (file->sparse_count == 0)
+		return 0;
+
+#if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_PUNCH_HOLE)
+	if (file->preallocated &&
+	    fallocate(file->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+		      file->size - file->sparse_count,
+		      file->sparse_count) != 0) {
+		/* not fatal, the space simply stays allocated */
+		if (errno != EOPNOTSUPP && errno != ENOSYS)
+			return -1;
+	}
+#endif
+
+	if (!file->positional &&
+	    lseek(file->fd, file->sparse_count, SEEK_CUR) == (off_t)-1) {
+		return -1;
+	}
+
+	file->sparse_count = 0;
+	return 0;
+}
+
 static int file_append(ostream_t *strm, const void *data, size_t size)
 {
 	file_ostream_t *file = (file_ostream_t *)strm;
@@ -23,15 +64,15 @@ static int file_append(ostream_t *strm, const void *data, size_t size)
 	if (size == 0)
 		return 0;
 
-	if (file->sparse_count > 0) {
-		if (lseek(file->fd, file->sparse_count, SEEK_CUR) == (off_t)-1)
-			goto fail_errno;
-
-		file->sparse_count = 0;
-	}
+	if (skip_sparse(file))
+		goto fail_errno;
 
 	while (size > 0) {
-		ret = write(file->fd, data, size);
+		if (file->positional) {
+			ret = pwrite(file->fd, data, size, file->size);
+		} else {
+			ret = write(file->fd, data, size);
+		}
 
 		if (ret == 0) {
 			fprintf(stderr, "%s: truncated data write.\n",
@@ -56,6 +97,127 @@ fail_errno:
 	return -1;
 }
 
+#if defined(HAVE_COPY_FILE_RANGE) || defined(HAVE_SPLICE)
+/*
+  Returns a positive value if the kernel cannot copy between the two
+  files. Whatever is left of the range, e.g. after hitting the end of
+  the input file, is handled by the pread fallback.
+ */
+static int kernel_copy(file_ostream_t *file, int fd, sqfs_u64 *offset,
+		       sqfs_u64 *size, bool use_splice)
+{
+	ssize_t ret;
+	loff_t off;
+	size_t diff;
+
+	while (*size > 0) {
+		diff = *size < MAX_COPY_CHUNK ? *size : MAX_COPY_CHUNK;
+		off = *offset;
+
+#ifdef HAVE_SPLICE
+		if (use_splice) {
+			ret = splice(fd, &off, file->fd, NULL, diff, 0);
+		} else
+#endif
+		{
+#ifdef HAVE_COPY_FILE_RANGE
+			loff_t out_off = file->size;
+
+			ret = copy_file_range(fd, &off, file->fd,
+					      file->positional ?
+					      &out_off : NULL, diff, 0);
+#else
+			errno = ENOSYS;
+			ret = -1;
+#endif
+		}
+
+		if (ret == 0)
+			break;
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if (errno == EXDEV || errno == EINVAL ||
+			    errno == ENOSYS || errno == EOPNOTSUPP ||
+			    errno == EBADF) {
+				return 1;
+			}
+
+			perror(file->path);
+			return -1;
+		}
+
+		file->size += ret;
+		*offset += ret;
+		*size -= ret;
+	}
+
+	return 0;
+}
+#endif
+
+static int file_append_from_fd(ostream_t *strm, int fd, sqfs_u64 offset,
+			       sqfs_u64 size)
+{
+	file_ostream_t *file = (file_ostream_t *)strm;
+	sqfs_u8 buffer[65536];
+	size_t diff;
+	ssize_t ret;
+
+	if (skip_sparse(file)) {
+		perror(file->path);
+		return -1;
+	}
+
+#if defined(HAVE_COPY_FILE_RANGE) || defined(HAVE_SPLICE)
+	if (file->try_copy_range) {
+		ret = kernel_copy(file, fd, &offset, &size, false);
+		if (ret < 0)
+			return -1;
+		if (ret > 0)
+			file->try_copy_range = false;
+	}
+
+	if (size > 0 && file->try_splice && !file->positional) {
+		ret = kernel_copy(file, fd, &offset, &size, true);
+		if (ret < 0)
+			return -1;
+		if (ret > 0)
+			file->try_splice = false;
+	}
+#endif
+
+	while (size > 0) {
+		diff = size < sizeof(buffer) ? size : sizeof(buffer);
+
+		ret = pread(fd, buffer, diff, offset);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			fprintf(stderr, "%s: reading input data: %s.\n",
+				file->path, strerror(errno));
+			return -1;
+		}
+
+		if (ret == 0) {
+			fprintf(stderr, "%s: input data is truncated.\n",
+				file->path);
+			return -1;
+		}
+
+		if (file_append(strm, buffer, ret))
+			return -1;
+
+		offset += ret;
+		size -= ret;
+	}
+
+	return 0;
+}
+
 static int file_append_sparse(ostream_t *strm, size_t size)
 {
 	file_ostream_t *file = (file_ostream_t *)strm;
@@ -65,11 +227,39 @@ static int file_append_sparse(ostream_t *strm, size_t size)
 	return 0;
 }
 
+#ifdef HAVE_FALLOCATE
+static int file_preallocate(ostream_t *strm, sqfs_u64 size)
+{
+	file_ostream_t *file = (file_ostream_t *)strm;
+
+	if (size == 0)
+		return 0;
+
+	/*
+	  This also extends the file, since some file systems ignore
+	  requests to punch holes past the end of a file.
+	 */
+	if (fallocate(file->fd, 0, file->size, size) != 0) {
+		if (errno == EOPNOTSUPP || errno == ENOSYS)
+			return 0;
+
+		perror(file->path);
+		return -1;
+	}
+
+	file->preallocated = true;
+	return 0;
+}
+#endif
+
 static int file_flush(ostream_t *strm)
 {
 	file_ostream_t *file = (file_ostream_t *)strm;
 
-	if (file->sparse_count > 0) {
+	if (file->sparse_count > 0 || file->preallocated) {
+		if (skip_sparse(file))
+			goto fail;
+
 		if (ftruncate(file->fd, file->size) != 0)
 			goto fail;
 	}
@@ -135,7 +325,15 @@ ostream_t *ostream_open_file(const char *path, int flags)
 	if (flags & OSTREAM_OPEN_SPARSE)
 		strm->append_sparse = file_append_sparse;
 
+#ifdef HAVE_FALLOCATE
+	strm->preallocate = file_preallocate;
+#endif
+	file->try_copy_range = true;
+	file->try_splice = true;
+	file->positional = true;
+
 	strm->append = file_append;
+	strm->append_from_fd = file_append_from_fd;
 	strm->flush = file_flush;
 	strm->get_filename = file_get_filename;
 	obj->destroy = file_destroy;
@@ -161,7 +359,11 @@ ostream_t *ostream_open_stdout(void)
 		goto fail;
 
 	file->fd = STDOUT_FILENO;
+	file->try_copy_range = true;
+	file->try_splice = true;
+
 	strm->append = file_append;
+	strm->append_from_fd = file_append_from_fd;
 	strm->flush = file_flush;
 	strm->get_filename = file_get_filename;
 	obj->destroy = file_destroy;
@@ -45,6 +45,34 @@ static int file_precache(istream_t *strm)
 	return 0;
 }
 
+static sqfs_s32 file_read_direct(istream_t *strm, void *data, size_t size)
+{
+	file_istream_t *file = (file_istream_t *)strm;
+	DWORD actual;
+	sqfs_s32 total = 0;
+	HANDLE hnd;
+
+	hnd = file->path == NULL ? GetStdHandle(STD_INPUT_HANDLE) : file->hnd;
+
+	while (size > 0 && !strm->eof) {
+		if (!ReadFile(hnd, data, (DWORD)size, &actual, NULL)) {
+			w32_perror(file->path == NULL ? "stdin" : file->path);
+			return -1;
+		}
+
+		if (actual == 0) {
+			strm->eof = true;
+			break;
+		}
+
+		data = (char *)data + actual;
+		size -= actual;
+		total += actual;
+	}
+
+	return total;
+}
+
 static const char *file_get_filename(istream_t *strm)
 {
 	file_istream_t *file = (file_istream_t *)strm;
@@ -98,6 +126,7 @@ istream_t *istream_open_file(const char *path)
 
 	strm->buffer = file->buffer;
 	strm->precache = file_precache;
+	strm->read_direct = file_read_direct;
 	strm->get_filename = file_get_filename;
 	obj->destroy = file_destroy;
 	return strm;
@@ -122,6 +151,7 @@ istream_t *istream_open_stdin(void)
 
 	strm->buffer = file->buffer;
 	strm->precache = file_precache;
+	strm->read_direct = file_read_direct;
 	strm->get_filename = file_get_filename;
 	obj->destroy = file_destroy;
 	return strm;
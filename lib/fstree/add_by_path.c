@@ -6,34 +6,33 @@
  */
 #include "config.h"
 
-#include "fstree.h"
+#include "internal.h"
 
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
 
-tree_node_t *fstree_add_generic(fstree_t *fs, const char *path,
-				const struct stat *sb, const char *extra)
+tree_node_t *fstree_add_generic_at(fstree_t *fs, tree_node_t *root,
+				   const char *path, const struct stat *sb,
+				   const char *extra)
 {
 	tree_node_t *child, *parent;
 	const char *name;
 
 	if (*path == '\0') {
-		child = fs->root;
+		child = root;
 		assert(child != NULL);
 		goto out;
 	}
 
-	parent = fstree_get_node_by_path(fs, fs->root, path, true, true);
+	parent = fstree_get_node_by_path(fs, root, path, true, true);
 	if (parent == NULL)
 		return NULL;
 
 	name = strrchr(path, '/');
 	name = (name == NULL ? path : (name + 1));
 
-	child = parent->data.dir.children;
-	while (child != NULL && strcmp(child->name, name) != 0)
-		child = child->next;
+	child = fstree_find_child(parent, name, strlen(name));
 out:
 	if (child != NULL) {
 		if (!S_ISDIR(child->mode) || !S_ISDIR(sb->st_mode) ||
@@ -52,3 +51,9 @@ out:
 
 	return fstree_mknode(parent, name, strlen(name), extra, sb);
 }
+
+tree_node_t *fstree_add_generic(fstree_t *fs, const char *path,
+				const struct stat *sb, const char *extra)
+{
+	return fstree_add_generic_at(fs, fs->root, path, sb, extra);
+}
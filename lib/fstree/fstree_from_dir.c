@@ -264,7 +264,7 @@ fail:
 #else
 static void discard_node(tree_node_t *root, tree_node_t *n)
 {
-	tree_node_t *it;
+	tree_node_t *it = NULL;
 
 	if (n == root->data.dir.children) {
 		root->data.dir.children = n->next;
@@ -278,6 +278,9 @@ static void discard_node(tree_node_t *root, tree_node_t *n)
 			it->next = n->next;
 	}
 
+	if (root->data.dir.last_child == n)
+		root->data.dir.last_child = it;
+
 	free(n);
 }
 
@@ -16,6 +16,24 @@
 #include <errno.h>
 #include <ctype.h>
 
+typedef struct {
+	fstree_t *fs;
+	const char *filename;
+	const char *basepath;
+	size_t line_num;
+
+	/*
+	  Generated listings typically have lots of consecutive entries in
+	  the same directory. We remember the last parent directory node and
+	  its path, so we don't have to walk the tree from the root for
+	  every single line.
+	 */
+	tree_node_t *parent;
+	char *parent_path;
+	size_t parent_path_len;
+	size_t parent_path_size;
+} parser_t;
+
 struct glob_context {
 	const char *filename;
 	size_t line_num;
@@ -51,25 +69,62 @@ static const struct {
 	{ "-nonrecursive", 0, DIR_SCAN_NO_RECURSION },
 };
 
-static int add_generic(fstree_t *fs, const char *filename, size_t line_num,
-		       const char *path, struct stat *sb,
-		       const char *basepath, unsigned int glob_flags,
-		       const char *extra)
+static tree_node_t *get_parent(parser_t *p, const char *path,
+			       const char **name)
+{
+	const char *sep = strrchr(path, '/');
+	size_t len = (sep == NULL) ? 0 : (size_t)(sep - path);
+	tree_node_t *parent;
+	char *new;
+
+	*name = (sep == NULL) ? path : (sep + 1);
+
+	if (p->parent != NULL && p->parent_path_len == len &&
+	    strncmp(p->parent_path, path, len) == 0) {
+		return p->parent;
+	}
+
+	parent = fstree_get_node_by_path(p->fs, p->fs->root, path,
+					 true, true);
+	if (parent == NULL)
+		return NULL;
+
+	if (len >= p->parent_path_size) {
+		new = realloc(p->parent_path, len + 1);
+		if (new == NULL)
+			return NULL;
+
+		p->parent_path = new;
+		p->parent_path_size = len + 1;
+	}
+
+	memcpy(p->parent_path, path, len);
+	p->parent_path[len] = '\0';
+	p->parent_path_len = len;
+	p->parent = parent;
+	return parent;
+}
+
+static int add_generic(parser_t *p, const char *path, struct stat *sb,
+		       unsigned int glob_flags, const char *extra)
 {
-	(void)basepath;
+	tree_node_t *parent;
+	const char *name;
 	(void)glob_flags;
 
-	if (fstree_add_generic(fs, path, sb, extra) == NULL) {
+	parent = get_parent(p, path, &name);
+
+	if (parent == NULL ||
+	    fstree_add_generic_at(p->fs, parent, name, sb, extra) == NULL) {
 		fprintf(stderr, "%s: " PRI_SZ ": %s: %s\n",
-			filename, line_num, path, strerror(errno));
+			p->filename, p->line_num, path, strerror(errno));
 		return -1;
 	}
 
 	return 0;
 }
 
-static int add_device(fstree_t *fs, const char *filename, size_t line_num,
-		      const char *path, struct stat *sb, const char *basepath,
+static int add_device(parser_t *p, const char *path, struct stat *sb,
 		      unsigned int glob_flags, const char *extra)
 {
 	unsigned int maj, min;
@@ -78,7 +133,7 @@ static int add_device(fstree_t *fs, const char *filename, size_t line_num,
 	if (sscanf(extra, "%c %u %u", &c, &maj, &min) != 3) {
 		fprintf(stderr, "%s: " PRI_SZ ": "
 			"expected '<c|b> major minor'\n",
-			filename, line_num);
+			p->filename, p->line_num);
 		return -1;
 	}
 
@@ -88,38 +143,32 @@ static int add_device(fstree_t *fs, const char *filename, size_t line_num,
 		sb->st_mode |= S_IFBLK;
 	} else {
 		fprintf(stderr, "%s: " PRI_SZ ": unknown device type '%c'\n",
-			filename, line_num, c);
+			p->filename, p->line_num, c);
 		return -1;
 	}
 
 	sb->st_rdev = makedev(maj, min);
-	return add_generic(fs, filename, line_num, path, sb, basepath,
-			   glob_flags, NULL);
+	return add_generic(p, path, sb, glob_flags, NULL);
 }
 
-static int add_file(fstree_t *fs, const char *filename, size_t line_num,
-		    const char *path, struct stat *basic, const char *basepath,
+static int add_file(parser_t *p, const char *path, struct stat *basic,
 		    unsigned int glob_flags, const char *extra)
 {
 	if (extra == NULL || *extra == '\0')
 		extra = path;
 
-	return add_generic(fs, filename, line_num, path, basic,
-			   basepath, glob_flags, extra);
+	return add_generic(p, path, basic, glob_flags, extra);
 }
 
-static int add_hard_link(fstree_t *fs, const char *filename, size_t line_num,
-			 const char *path, struct stat *basic,
-			 const char *basepath, unsigned int glob_flags,
-			 const char *extra)
+static int add_hard_link(parser_t *p, const char *path, struct stat *basic,
+			 unsigned int glob_flags, const char *extra)
 {
-	(void)basepath;
 	(void)glob_flags;
 	(void)basic;
 
-	if (fstree_add_hard_link(fs, path, extra) == NULL) {
+	if (fstree_add_hard_link(p->fs, path, extra) == NULL) {
 		fprintf(stderr, "%s: " PRI_SZ ": %s\n",
-			filename, line_num, strerror(errno));
+			p->filename, p->line_num, strerror(errno));
 		return -1;
 	}
 	return 0;
@@ -205,11 +254,11 @@ static void quote_remove(char *str)
 	*(dst++) = '\0';
 }
 
-static int glob_files(fstree_t *fs, const char *filename, size_t line_num,
-		      const char *path, struct stat *basic,
-		      const char *basepath, unsigned int glob_flags,
-		      const char *extra)
+static int glob_files(parser_t *p, const char *path, struct stat *basic,
+		      unsigned int glob_flags, const char *extra)
 {
+	const char *basepath = p->basepath;
+	fstree_t *fs = p->fs;
 	unsigned int scan_flags = 0, all_flags;
 	struct glob_context ctx;
 	bool first_clear_flag;
@@ -218,8 +267,8 @@ static int glob_files(fstree_t *fs, const char *filename, size_t line_num,
 	int ret;
 
 	memset(&ctx, 0, sizeof(ctx));
-	ctx.filename = filename;
-	ctx.line_num = line_num;
+	ctx.filename = p->filename;
+	ctx.line_num = p->line_num;
 	ctx.basic = basic;
 	ctx.glob_flags = glob_flags;
 
@@ -227,7 +276,7 @@ static int glob_files(fstree_t *fs, const char *filename, size_t line_num,
 	root = fstree_get_node_by_path(fs, fs->root, path, true, false);
 	if (root == NULL) {
 		fprintf(stderr, "%s: " PRI_SZ ": %s: %s\n",
-			filename, line_num, path, strerror(errno));
+			p->filename, p->line_num, path, strerror(errno));
 		return -1;
 	}
 
@@ -310,7 +359,7 @@ static int glob_files(fstree_t *fs, const char *filename, size_t line_num,
 			}
 
 			fprintf(stderr, "%s: " PRI_SZ ": unknown option.\n",
-				filename, line_num);
+				p->filename, p->line_num);
 			free(ctx.name_pattern);
 			return -1;
 		} else {
@@ -347,10 +396,8 @@ static const struct callback_t {
 	bool need_extra;
 	bool is_glob;
 	bool allow_root;
-	int (*callback)(fstree_t *fs, const char *filename, size_t line_num,
-			const char *path, struct stat *sb,
-			const char *basepath, unsigned int glob_flags,
-			const char *extra);
+	int (*callback)(parser_t *p, const char *path, struct stat *sb,
+			unsigned int glob_flags, const char *extra);
 } file_list_hooks[] = {
 	{ "dir", S_IFDIR, false, false, true, add_generic },
 	{ "slink", S_IFLNK, true, false, false, add_generic },
@@ -430,10 +477,10 @@ static char *read_str(char *str, char **out)
 	return str;
 }
 
-static int handle_line(fstree_t *fs, const char *filename,
-		       size_t line_num, char *line,
-		       const char *basepath)
+static int handle_line(parser_t *p, char *line)
 {
+	const char *filename = p->filename;
+	size_t line_num = p->line_num;
 	const char *extra = NULL, *msg = NULL;
 	const struct callback_t *cb = NULL;
 	unsigned int glob_flags = 0;
@@ -506,13 +553,12 @@ static int handle_line(fstree_t *fs, const char *filename,
 
 	/* forward to callback */
 	memset(&sb, 0, sizeof(sb));
-	sb.st_mtime = fs->defaults.st_mtime;
+	sb.st_mtime = p->fs->defaults.st_mtime;
 	sb.st_mode = mode | cb->mode;
 	sb.st_uid = uid;
 	sb.st_gid = gid;
 
-	return cb->callback(fs, filename, line_num, path,
-			    &sb, basepath, glob_flags, extra);
+	return cb->callback(p, path, &sb, glob_flags, extra);
 fail_root:
 	fprintf(stderr, "%s: " PRI_SZ ": cannot use / as argument for %s.\n",
 		filename, line_num, cb->keyword);
@@ -542,36 +588,38 @@ out_desc:
 
 int fstree_from_file_stream(fstree_t *fs, istream_t *fp, const char *basepath)
 {
-	const char *filename;
-	size_t line_num = 1;
-	char *line;
+	size_t line_size = 0;
+	char *line = NULL;
+	parser_t p;
 	int ret;
 
-	filename = istream_get_filename(fp);
+	memset(&p, 0, sizeof(p));
+	p.fs = fs;
+	p.basepath = basepath;
+	p.filename = istream_get_filename(fp);
+	p.line_num = 1;
 
 	for (;;) {
-		ret = istream_get_line(fp, &line, &line_num,
-				       ISTREAM_LINE_LTRIM | ISTREAM_LINE_SKIP_EMPTY);
-		if (ret < 0)
-			return -1;
-		if (ret > 0)
+		ret = istream_get_line_buffered(fp, &line, &line_size,
+						&p.line_num,
+						ISTREAM_LINE_LTRIM |
+						ISTREAM_LINE_SKIP_EMPTY);
+		if (ret != 0)
 			break;
 
 		if (line[0] != '#') {
-			if (handle_line(fs, filename, line_num,
-					line, basepath)) {
-				goto fail_line;
+			if (handle_line(&p, line)) {
+				ret = -1;
+				break;
 			}
 		}
 
-		free(line);
-		++line_num;
+		++p.line_num;
 	}
 
-	return 0;
-fail_line:
+	free(p.parent_path);
 	free(line);
-	return -1;
+	return ret < 0 ? -1 : 0;
 }
 
 int fstree_from_file(fstree_t *fs, const char *filename, const char *basepath)
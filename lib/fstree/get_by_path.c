@@ -6,26 +6,11 @@
  */
 #include "config.h"
 
-#include "fstree.h"
+#include "internal.h"
 
 #include <string.h>
 #include <errno.h>
 
-static tree_node_t *child_by_name(tree_node_t *root, const char *name,
-				  size_t len)
-{
-	tree_node_t *n = root->data.dir.children;
-
-	while (n != NULL) {
-		if (strncmp(n->name, name, len) == 0 && n->name[len] == '\0')
-			break;
-
-		n = n->next;
-	}
-
-	return n;
-}
-
 tree_node_t *fstree_get_node_by_path(fstree_t *fs, tree_node_t *root,
 				     const char *path, bool create_implicitly,
 				     bool stop_at_parent)
@@ -53,7 +38,7 @@ tree_node_t *fstree_get_node_by_path(fstree_t *fs, tree_node_t *root,
 			len = end - path;
 		}
 
-		n = child_by_name(root, path, len);
+		n = fstree_find_child(root, path, len);
 
 		if (n == NULL) {
 			if (!create_implicitly) {
@@ -19,4 +19,13 @@ sqfs_u32 get_source_date_epoch(void);
 
 void fstree_insert_sorted(tree_node_t *root, tree_node_t *n);
 
+/*
+  Find a child node by name. The name doesn't have to be null terminated,
+  a length has to be specified.
+
+  Returns NULL if no such child exists.
+ */
+tree_node_t *fstree_find_child(tree_node_t *root, const char *name,
+			       size_t len);
+
 #endif /* FSTREE_INTERNAL_H */
@@ -16,6 +16,12 @@ void fstree_insert_sorted(tree_node_t *root, tree_node_t *n)
 {
 	tree_node_t *it = root->data.dir.children, *prev = NULL;
 
+	if (root->data.dir.last_child != NULL &&
+	    strcmp(root->data.dir.last_child->name, n->name) < 0) {
+		prev = root->data.dir.last_child;
+		it = NULL;
+	}
+
 	while (it != NULL && strcmp(it->name, n->name) < 0) {
 		prev = it;
 		it = it->next;
@@ -29,6 +35,31 @@ void fstree_insert_sorted(tree_node_t *root, tree_node_t *n)
 	} else {
 		prev->next = n;
 	}
+
+	if (it == NULL)
+		root->data.dir.last_child = n;
+}
+
+tree_node_t *fstree_find_child(tree_node_t *root, const char *name,
+			       size_t len)
+{
+	tree_node_t *n = root->data.dir.last_child;
+	int ret;
+
+	/* names past the last, sorted entry can't be in the list */
+	if (n != NULL) {
+		ret = strncmp(n->name, name, len);
+
+		if (ret < 0 || (ret == 0 && n->name[len] == '\0'))
+			return ret == 0 ? n : NULL;
+	}
+
+	for (n = root->data.dir.children; n != NULL; n = n->next) {
+		if (strncmp(n->name, name, len) == 0 && n->name[len] == '\0')
+			break;
+	}
+
+	return n;
 }
 
 tree_node_t *fstree_mknode(tree_node_t *parent, const char *name,
@@ -88,14 +119,13 @@ tree_node_t *fstree_mknode(tree_node_t *parent, const char *name,
 	}
 
 	if (parent != NULL) {
-		fstree_insert_sorted(parent, n);
-
 		if (parent->link_count == 0x0FFFF) {
 			free(n);
 			errno = EMLINK;
 			return NULL;
 		}
 
+		fstree_insert_sorted(parent, n);
 		parent->link_count++;
 	}
 
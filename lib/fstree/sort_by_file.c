@@ -8,6 +8,9 @@
 
 #include "fstree.h"
 #include "compat.h"
+#include "hash_table.h"
+#include "array.h"
+#include "util.h"
 
 #include "sqfs/block.h"
 
@@ -208,69 +211,78 @@ fail_flag:
 	return -1;
 }
 
-static void sort_file_list(fstree_t *fs)
-{
-	file_info_t *out = NULL, *out_last = NULL;
+typedef struct {
+	char *pattern;
+	size_t line_num;
+	sqfs_s64 priority;
+	int flags;
+	bool do_glob;
+	bool path_glob;
+	bool have_match;
 
-	while (fs->files != NULL) {
-		sqfs_s64 lowest = fs->files->priority;
-		file_info_t *it, *prev;
+	/* length of the leading part of a glob pattern without wild cards */
+	size_t prefix_len;
+} sort_rule_t;
 
-		for (it = fs->files; it != NULL; it = it->next) {
-			if (it->priority < lowest)
-				lowest = it->priority;
-		}
+/*
+  Glob rules are grouped by the directory part of their literal prefix, so
+  for a given path, only the groups for each of its parent directories have
+  to be looked at. The rule list of a group is in sort file order.
+ */
+typedef struct {
+	char *dir;
+	array_t rules;
+} glob_group_t;
+
+typedef struct {
+	array_t rules;
+	struct hash_table *literals;
+	struct hash_table *globs;
+} sort_matcher_t;
+
+static sqfs_u32 str_hash(const char *str)
+{
+	return xxh32(str, strlen(str));
+}
 
-		it = fs->files;
-		prev = NULL;
+static bool key_equals_function(void *user, const void *a, const void *b)
+{
+	(void)user;
+	return strcmp(a, b) == 0;
+}
 
-		while (it != NULL) {
-			if (it->priority != lowest) {
-				prev = it;
-				it = it->next;
-				continue;
-			}
+static void free_glob_group(struct hash_entry *ent)
+{
+	glob_group_t *grp = ent->data;
 
-			if (prev == NULL) {
-				fs->files = it->next;
-			} else {
-				prev->next = it->next;
-			}
+	array_cleanup(&grp->rules);
+	free(grp->dir);
+	free(grp);
+}
 
-			if (out == NULL) {
-				out = it;
-			} else {
-				out_last->next = it;
-			}
+static void sort_matcher_cleanup(sort_matcher_t *m)
+{
+	sort_rule_t *rules = m->rules.data;
+	size_t i;
 
-			out_last = it;
-			it = it->next;
-			out_last->next = NULL;
-		}
-	}
+	hash_table_destroy(m->globs, free_glob_group);
+	hash_table_destroy(m->literals, NULL);
+
+	for (i = 0; i < m->rules.used; ++i)
+		free(rules[i].pattern);
 
-	fs->files = out;
+	array_cleanup(&m->rules);
 }
 
-int fstree_sort_files(fstree_t *fs, istream_t *sortfile)
+static int read_rules(sort_matcher_t *m, istream_t *sortfile)
 {
-	const char *filename;
+	const char *filename = istream_get_filename(sortfile);
 	size_t line_num = 1;
-	file_info_t *it;
-
-	for (it = fs->files; it != NULL; it = it->next) {
-		it->priority = 0;
-		it->flags = 0;
-		it->already_matched = false;
-	}
-
-	filename = istream_get_filename(sortfile);
+	sort_rule_t rule;
 
 	for (;;) {
-		bool do_glob, path_glob, have_match;
 		char *line = NULL;
-		sqfs_s64 priority;
-		int ret, flags;
+		int ret;
 
 		ret = istream_get_line(sortfile, &line, &line_num,
 				       ISTREAM_LINE_LTRIM |
@@ -278,89 +290,319 @@ int fstree_sort_files(fstree_t *fs, istream_t *sortfile)
 				       ISTREAM_LINE_SKIP_EMPTY);
 		if (ret != 0) {
 			free(line);
-			if (ret < 0)
-				return -1;
-			break;
+			return ret < 0 ? -1 : 0;
 		}
 
 		if (line[0] == '#') {
 			free(line);
+			++line_num;
 			continue;
 		}
 
-		if (decode_priority(filename, line_num, line, &priority)) {
-			free(line);
-			return -1;
+		memset(&rule, 0, sizeof(rule));
+		rule.pattern = line;
+		rule.line_num = line_num;
+
+		if (decode_priority(filename, line_num, line, &rule.priority))
+			goto fail;
+
+		if (decode_flags(filename, line_num, &rule.do_glob,
+				 &rule.path_glob, &rule.flags, line)) {
+			goto fail;
 		}
 
-		if (decode_flags(filename, line_num, &do_glob, &path_glob,
-				 &flags, line)) {
-			free(line);
+		if (decode_filename(filename, line_num, line))
+			goto fail;
+
+		if (rule.do_glob)
+			rule.prefix_len = strcspn(line, "*?[\\");
+
+		if (array_append(&m->rules, &rule)) {
+			fprintf(stderr, "%s: " PRI_SZ ": out-of-memory\n",
+				filename, line_num);
+			goto fail;
+		}
+
+		++line_num;
+		continue;
+	fail:
+		free(line);
+		return -1;
+	}
+}
+
+static int add_glob_rule(sort_matcher_t *m, sort_rule_t *rule)
+{
+	glob_group_t *grp;
+	struct hash_entry *ent;
+	size_t dir_len = rule->prefix_len;
+	sqfs_u32 hash;
+	char *dir;
+
+	while (dir_len > 0 && rule->pattern[dir_len - 1] != '/')
+		--dir_len;
+
+	dir = strndup(rule->pattern, dir_len);
+	if (dir == NULL)
+		return -1;
+
+	hash = str_hash(dir);
+	ent = hash_table_search_pre_hashed(m->globs, hash, dir);
+
+	if (ent != NULL) {
+		free(dir);
+		grp = ent->data;
+	} else {
+		grp = calloc(1, sizeof(*grp));
+		if (grp == NULL) {
+			free(dir);
 			return -1;
 		}
 
-		if (decode_filename(filename, line_num, line)) {
-			free(line);
+		grp->dir = dir;
+
+		if (array_init(&grp->rules, sizeof(sort_rule_t *), 0) ||
+		    hash_table_insert_pre_hashed(m->globs, hash,
+						 grp->dir, grp) == NULL) {
+			free(grp->dir);
+			free(grp);
 			return -1;
 		}
+	}
 
-		have_match = false;
+	return array_append(&grp->rules, &rule);
+}
 
-		for (it = fs->files; it != NULL; it = it->next) {
-			tree_node_t *node;
-			char *path;
+static int sort_matcher_init(sort_matcher_t *m, istream_t *sortfile)
+{
+	struct hash_entry *ent;
+	sort_rule_t *rules;
+	size_t i;
+	sqfs_u32 hash;
 
-			if (it->already_matched)
-				continue;
+	memset(m, 0, sizeof(*m));
 
-			node = container_of(it, tree_node_t, data.file);
-			path = fstree_get_path(node);
-			if (path == NULL) {
-				fprintf(stderr, "%s: " PRI_SZ ": out-of-memory\n",
-					filename, line_num);
-				free(line);
-				return -1;
-			}
+	if (array_init(&m->rules, sizeof(sort_rule_t), 0))
+		goto fail_oom;
 
-			if (canonicalize_name(path)) {
-				fprintf(stderr,
-					"%s: " PRI_SZ ": [BUG] error "
-					"reconstructing node path\n",
-					filename, line_num);
-				free(line);
-				return -1;
-			}
+	m->literals = hash_table_create(NULL, key_equals_function);
+	m->globs = hash_table_create(NULL, key_equals_function);
+	if (m->literals == NULL || m->globs == NULL)
+		goto fail_oom;
 
-			if (do_glob) {
-				ret = fnmatch(line, path,
-					      path_glob ? FNM_PATHNAME : 0);
+	if (read_rules(m, sortfile))
+		goto fail;
 
-			} else {
-				ret = strcmp(path, line);
-			}
+	rules = m->rules.data;
 
-			free(path);
+	for (i = 0; i < m->rules.used; ++i) {
+		if (rules[i].do_glob) {
+			if (add_glob_rule(m, rules + i))
+				goto fail_oom;
+			continue;
+		}
 
-			if (ret == 0) {
-				have_match = true;
-				it->flags = flags;
-				it->priority = priority;
-				it->already_matched = true;
+		/* the first rule for a literal path wins, like for globs */
+		hash = str_hash(rules[i].pattern);
+		ent = hash_table_search_pre_hashed(m->literals, hash,
+						   rules[i].pattern);
+		if (ent != NULL)
+			continue;
 
-				if (!do_glob)
-					break;
-			}
+		if (hash_table_insert_pre_hashed(m->literals, hash,
+						 rules[i].pattern,
+						 rules + i) == NULL) {
+			goto fail_oom;
 		}
+	}
 
-		if (!have_match) {
-			fprintf(stderr, "WARNING: %s: " PRI_SZ ": no match "
-				"for '%s'.\n",
-				filename, line_num, line);
+	return 0;
+fail_oom:
+	fprintf(stderr, "%s: out-of-memory\n", istream_get_filename(sortfile));
+fail:
+	sort_matcher_cleanup(m);
+	return -1;
+}
+
+static sort_rule_t *match_glob_group(const glob_group_t *grp,
+				     const char *path, sort_rule_t *best)
+{
+	sort_rule_t **list = grp->rules.data;
+	size_t i;
+	int ret;
+
+	for (i = 0; i < grp->rules.used; ++i) {
+		sort_rule_t *rule = list[i];
+
+		if (best != NULL && rule >= best)
+			break;
+
+		if (strncmp(path, rule->pattern, rule->prefix_len) != 0)
+			continue;
+
+		ret = fnmatch(rule->pattern, path,
+			      rule->path_glob ? FNM_PATHNAME : 0);
+		if (ret == 0)
+			return rule;
+	}
+
+	return best;
+}
+
+static glob_group_t *find_glob_group(sort_matcher_t *m, const char *dir)
+{
+	struct hash_entry *ent;
+
+	ent = hash_table_search_pre_hashed(m->globs, str_hash(dir), dir);
+
+	return (ent == NULL) ? NULL : ent->data;
+}
+
+/*
+  Find the first rule in sort file order that matches the given path. The
+  path buffer is temporarily cut off after each slash to look up the glob
+  groups for each of its parent directories.
+ */
+static sort_rule_t *find_rule(sort_matcher_t *m, char *path)
+{
+	struct hash_entry *ent;
+	glob_group_t *grp;
+	sort_rule_t *best;
+	size_t i;
+	char c;
+
+	ent = hash_table_search_pre_hashed(m->literals, str_hash(path), path);
+	best = (ent == NULL) ? NULL : ent->data;
+
+	if (m->globs->entries == 0)
+		return best;
+
+	grp = find_glob_group(m, "");
+	if (grp != NULL)
+		best = match_glob_group(grp, path, best);
+
+	for (i = 0; path[i] != '\0'; ++i) {
+		if (path[i] != '/')
+			continue;
+
+		c = path[i + 1];
+		path[i + 1] = '\0';
+		grp = find_glob_group(m, path);
+		path[i + 1] = c;
+
+		if (grp != NULL)
+			best = match_glob_group(grp, path, best);
+	}
+
+	return best;
+}
+
+static file_info_t *merge_lists(file_info_t *a, file_info_t *b)
+{
+	file_info_t *out = NULL, *out_last = NULL, *it;
+
+	while (a != NULL || b != NULL) {
+		if (b == NULL || (a != NULL && a->priority <= b->priority)) {
+			it = a;
+			a = a->next;
+		} else {
+			it = b;
+			b = b->next;
 		}
 
-		free(line);
+		if (out == NULL) {
+			out = it;
+		} else {
+			out_last->next = it;
+		}
+
+		out_last = it;
 	}
 
-	sort_file_list(fs);
+	if (out_last != NULL)
+		out_last->next = NULL;
+
+	return out;
+}
+
+/* stable merge sort of the file list by priority */
+static file_info_t *sort_file_list(file_info_t *list, size_t count)
+{
+	file_info_t *half, *prev;
+	size_t i;
+
+	if (count < 2)
+		return list;
+
+	prev = list;
+	for (i = 1; i < count / 2; ++i)
+		prev = prev->next;
+
+	half = prev->next;
+	prev->next = NULL;
+
+	list = sort_file_list(list, count / 2);
+	half = sort_file_list(half, count - count / 2);
+
+	return merge_lists(list, half);
+}
+
+int fstree_sort_files(fstree_t *fs, istream_t *sortfile)
+{
+	const char *filename = istream_get_filename(sortfile);
+	sort_rule_t *rules, *rule;
+	sort_matcher_t matcher;
+	size_t i, count = 0;
+	file_info_t *it;
+
+	if (sort_matcher_init(&matcher, sortfile))
+		return -1;
+
+	for (it = fs->files; it != NULL; it = it->next) {
+		tree_node_t *node = container_of(it, tree_node_t, data.file);
+		char *path;
+
+		it->priority = 0;
+		it->flags = 0;
+		++count;
+
+		path = fstree_get_path(node);
+		if (path == NULL) {
+			fprintf(stderr, "%s: out-of-memory\n", filename);
+			goto fail;
+		}
+
+		if (canonicalize_name(path)) {
+			fprintf(stderr, "%s: [BUG] error reconstructing "
+				"node path\n", filename);
+			free(path);
+			goto fail;
+		}
+
+		rule = find_rule(&matcher, path);
+		free(path);
+
+		if (rule != NULL) {
+			rule->have_match = true;
+			it->flags = rule->flags;
+			it->priority = rule->priority;
+		}
+	}
+
+	rules = matcher.rules.data;
+
+	for (i = 0; i < matcher.rules.used; ++i) {
+		if (rules[i].have_match)
+			continue;
+
+		fprintf(stderr, "WARNING: %s: " PRI_SZ ": no match for '%s'.\n",
+			filename, rules[i].line_num, rules[i].pattern);
+	}
+
+	fs->files = sort_file_list(fs->files, count);
+	sort_matcher_cleanup(&matcher);
 	return 0;
+fail:
+	sort_matcher_cleanup(&matcher);
+	return -1;
 }
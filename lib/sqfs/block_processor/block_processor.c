@@ -16,6 +16,12 @@ static int process_block(void *userptr, void *workitem)
 	if (block->size == 0)
 		return 0;
 
+	if (block->flags & BLK_FLAG_RAW_BLOCK) {
+		if (!(block->flags & SQFS_BLK_DONT_HASH))
+			block->checksum = xxh32(block->data, block->size);
+		return 0;
+	}
+
 	if (!(block->flags & SQFS_BLK_IGNORE_SPARSE) &&
 	    is_memory_zero(block->data, block->size)) {
 		block->flags |= SQFS_BLK_IS_SPARSE;
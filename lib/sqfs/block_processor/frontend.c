@@ -108,69 +108,138 @@ int sqfs_block_processor_begin_file(sqfs_block_processor_t *proc,
 	return 0;
 }
 
-int sqfs_block_processor_append(sqfs_block_processor_t *proc, const void *data,
-				size_t size)
+int sqfs_block_processor_get_buffer(sqfs_block_processor_t *proc,
+				    void **data, size_t *size)
 {
 	sqfs_block_t *new;
-	sqfs_u64 filesize;
-	size_t diff;
 	int err;
 
 	if (!proc->begin_called)
 		return SQFS_ERROR_SEQUENCE;
 
+	if (proc->blk_current == NULL) {
+		err = get_new_block(proc, &new);
+		if (err != 0)
+			return err;
+
+		proc->blk_current = new;
+		proc->blk_current->flags = proc->blk_flags;
+		proc->blk_current->inode = proc->inode;
+		proc->blk_current->user = proc->user;
+		proc->blk_current->index = proc->blk_index++;
+		proc->blk_flags &= ~SQFS_BLK_FIRST_BLOCK;
+	}
+
+	*data = proc->blk_current->data + proc->blk_current->size;
+	*size = proc->max_block_size - proc->blk_current->size;
+	return 0;
+}
+
+int sqfs_block_processor_commit(sqfs_block_processor_t *proc, size_t size)
+{
+	sqfs_u64 filesize;
+	int err;
+
+	if (!proc->begin_called || proc->blk_current == NULL)
+		return SQFS_ERROR_SEQUENCE;
+
+	if (size > (proc->max_block_size - proc->blk_current->size))
+		return SQFS_ERROR_OVERFLOW;
+
 	if (proc->inode != NULL) {
 		sqfs_inode_get_file_size(*(proc->inode), &filesize);
 		sqfs_inode_set_file_size(*(proc->inode), filesize + size);
 	}
 
-	while (size > 0) {
-		if (proc->blk_current == NULL) {
-			err = get_new_block(proc, &new);
-			if (err != 0)
-				return err;
+	proc->blk_current->size += size;
+	proc->stats.input_bytes_read += size;
 
-			proc->blk_current = new;
-			proc->blk_current->flags = proc->blk_flags;
-			proc->blk_current->inode = proc->inode;
-			proc->blk_current->user = proc->user;
-			proc->blk_current->index = proc->blk_index++;
-			proc->blk_flags &= ~SQFS_BLK_FIRST_BLOCK;
-		}
+	if (proc->blk_current->size == proc->max_block_size) {
+		err = enqueue_block(proc, proc->blk_current);
+		proc->blk_current = NULL;
 
-		diff = proc->max_block_size - proc->blk_current->size;
+		if (err)
+			return err;
+	}
 
-		if (diff == 0) {
-			err = enqueue_block(proc, proc->blk_current);
-			proc->blk_current = NULL;
+	return 0;
+}
 
-			if (err)
-				return err;
-			continue;
-		}
+int sqfs_block_processor_append(sqfs_block_processor_t *proc, const void *data,
+				size_t size)
+{
+	size_t diff;
+	void *dst;
+	int err;
+
+	if (!proc->begin_called)
+		return SQFS_ERROR_SEQUENCE;
+
+	while (size > 0) {
+		err = sqfs_block_processor_get_buffer(proc, &dst, &diff);
+		if (err != 0)
+			return err;
 
 		if (diff > size)
 			diff = size;
 
-		memcpy(proc->blk_current->data + proc->blk_current->size,
-		       data, diff);
+		memcpy(dst, data, diff);
+
+		err = sqfs_block_processor_commit(proc, diff);
+		if (err != 0)
+			return err;
 
 		size -= diff;
-		proc->blk_current->size += diff;
 		data = (const char *)data + diff;
-
-		proc->stats.input_bytes_read += diff;
 	}
 
-	if (proc->blk_current->size == proc->max_block_size) {
-		err = enqueue_block(proc, proc->blk_current);
-		proc->blk_current = NULL;
+	return 0;
+}
 
-		if (err)
-			return err;
+int sqfs_block_processor_append_raw(sqfs_block_processor_t *proc,
+				    const void *data, sqfs_u32 disk_size,
+				    size_t size)
+{
+	size_t raw_size = SQFS_ON_DISK_BLOCK_SIZE(disk_size);
+	sqfs_u64 filesize;
+	sqfs_block_t *blk;
+	int err;
+
+	if (!proc->begin_called || proc->blk_current != NULL)
+		return SQFS_ERROR_SEQUENCE;
+
+	if (raw_size == 0 || size == 0)
+		return SQFS_ERROR_ARG_INVALID;
+
+	if (raw_size > proc->max_block_size || size > proc->max_block_size)
+		return SQFS_ERROR_OVERFLOW;
+
+	err = get_new_block(proc, &blk);
+	if (err != 0)
+		return err;
+
+	blk->flags = proc->blk_flags | BLK_FLAG_RAW_BLOCK;
+	blk->inode = proc->inode;
+	blk->user = proc->user;
+	blk->index = proc->blk_index++;
+	blk->size = raw_size;
+	memcpy(blk->data, data, raw_size);
+
+	if (SQFS_IS_BLOCK_COMPRESSED(disk_size))
+		blk->flags |= SQFS_BLK_IS_COMPRESSED;
+
+	proc->blk_flags &= ~SQFS_BLK_FIRST_BLOCK;
+
+	if (proc->inode != NULL) {
+		sqfs_inode_get_file_size(*(proc->inode), &filesize);
+		sqfs_inode_set_file_size(*(proc->inode), filesize + size);
 	}
 
-	return 0;
+	proc->stats.input_bytes_read += size;
+	proc->stats.raw_bytes_read += size;
+	proc->stats.raw_block_count += 1;
+
+	return enqueue_block(proc, blk);
 }
 
 int sqfs_block_processor_end_file(sqfs_block_processor_t *proc)
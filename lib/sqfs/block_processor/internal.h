@@ -35,7 +35,8 @@ typedef struct {
 
 enum {
 	BLK_FLAG_MANUAL_SUBMISSION = 0x10000000,
-	BLK_FLAG_INTERNAL = 0x10000000,
+	BLK_FLAG_RAW_BLOCK = 0x20000000,
+	BLK_FLAG_INTERNAL = 0x30000000,
 };
 
 typedef struct sqfs_block_t {
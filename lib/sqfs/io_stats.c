@@ -0,0 +1,264 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/*
+ * io_stats.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#define SQFS_BUILDING_DLL
+#include "config.h"
+
+#include "sqfs/io.h"
+#include "array.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	sqfs_u64 start;
+	sqfs_u64 end;
+} io_range_t;
+
+typedef struct sqfs_file_counter_t {
+	sqfs_file_t base;
+
+	sqfs_file_t *wrapped;
+	sqfs_file_stats_t stats;
+
+	/*
+	  The file that all others were copied from, directly or indirectly.
+	  Copies add their stats to it when they are destroyed.
+	 */
+	struct sqfs_file_counter_t *root;
+
+	sqfs_u64 read_end;
+	sqfs_u64 write_end;
+
+	/* sorted, non-overlapping, non-adjacent ranges read so far */
+	array_t ranges;
+} sqfs_file_counter_t;
+
+static void hist_add(sqfs_u64 *hist, sqfs_u64 value)
+{
+	size_t i = 0;
+
+	while (value > 0 && i < (SQFS_FILE_STATS_HIST_SIZE - 1)) {
+		value >>= 1;
+		++i;
+	}
+
+	hist[i] += 1;
+}
+
+static void add_range(sqfs_file_counter_t *file, sqfs_u64 start, sqfs_u64 end)
+{
+	io_range_t *r = file->ranges.data, new = { start, end };
+	size_t lo = 0, hi = file->ranges.used, mid;
+	sqfs_u64 covered = 0;
+
+	/* first range that ends at or after the start of the new one */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+
+		if (r[mid].end < start) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	for (hi = lo; hi < file->ranges.used && r[hi].start <= end; ++hi) {
+		if (r[hi].start < new.start)
+			new.start = r[hi].start;
+		if (r[hi].end > new.end)
+			new.end = r[hi].end;
+
+		covered += r[hi].end - r[hi].start;
+	}
+
+	if (hi > lo) {
+		r[lo] = new;
+		memmove(r + lo + 1, r + hi,
+			(file->ranges.used - hi) * sizeof(r[0]));
+		file->ranges.used -= hi - lo - 1;
+	} else {
+		if (array_append(&file->ranges, &new) != 0) {
+			file->stats.read_unique_bytes += end - start;
+			return;
+		}
+
+		r = file->ranges.data;
+		memmove(r + lo + 1, r + lo,
+			(file->ranges.used - 1 - lo) * sizeof(r[0]));
+		r[lo] = new;
+	}
+
+	file->stats.read_unique_bytes += (new.end - new.start) - covered;
+}
+
+static int counter_read_at(sqfs_file_t *base, sqfs_u64 offset,
+			   void *buffer, size_t size)
+{
+	sqfs_file_counter_t *file = (sqfs_file_counter_t *)base;
+	sqfs_u64 start = get_time_us(), diff;
+	int ret;
+
+	ret = file->wrapped->read_at(file->wrapped, offset, buffer, size);
+
+	diff = get_time_us() - start;
+	file->stats.read_time_us += diff;
+	file->stats.read_calls += 1;
+	file->stats.bytes_read += size;
+	hist_add(file->stats.read_time_hist, diff);
+	hist_add(file->stats.read_size_hist, size);
+
+	if (offset == file->read_end) {
+		file->stats.read_seq_calls += 1;
+	} else if (offset < file->read_end) {
+		file->stats.read_back_calls += 1;
+		hist_add(file->stats.read_seek_hist, file->read_end - offset);
+	} else {
+		hist_add(file->stats.read_seek_hist, offset - file->read_end);
+	}
+
+	file->read_end = offset + size;
+
+	if (ret == 0 && size > 0)
+		add_range(file, offset, offset + size);
+
+	return ret;
+}
+
+static int counter_write_at(sqfs_file_t *base, sqfs_u64 offset,
+			    const void *buffer, size_t size)
+{
+	sqfs_file_counter_t *file = (sqfs_file_counter_t *)base;
+	sqfs_u64 start = get_time_us(), diff;
+	int ret;
+
+	ret = file->wrapped->write_at(file->wrapped, offset, buffer, size);
+
+	diff = get_time_us() - start;
+	file->stats.write_time_us += diff;
+	file->stats.write_calls += 1;
+	file->stats.bytes_written += size;
+	hist_add(file->stats.write_time_hist, diff);
+	hist_add(file->stats.write_size_hist, size);
+
+	if (offset == file->write_end)
+		file->stats.write_seq_calls += 1;
+
+	file->write_end = offset + size;
+	return ret;
+}
+
+static sqfs_u64 counter_get_size(const sqfs_file_t *base)
+{
+	const sqfs_file_counter_t *file = (const sqfs_file_counter_t *)base;
+
+	return file->wrapped->get_size(file->wrapped);
+}
+
+static int counter_truncate(sqfs_file_t *base, sqfs_u64 size)
+{
+	sqfs_file_counter_t *file = (sqfs_file_counter_t *)base;
+
+	return file->wrapped->truncate(file->wrapped, size);
+}
+
+static void merge_stats(sqfs_file_counter_t *dst,
+			const sqfs_file_counter_t *src)
+{
+	const io_range_t *r = src->ranges.data;
+	size_t i;
+
+	dst->stats.read_calls += src->stats.read_calls;
+	dst->stats.bytes_read += src->stats.bytes_read;
+	dst->stats.read_time_us += src->stats.read_time_us;
+	dst->stats.write_calls += src->stats.write_calls;
+	dst->stats.bytes_written += src->stats.bytes_written;
+	dst->stats.write_time_us += src->stats.write_time_us;
+	dst->stats.read_seq_calls += src->stats.read_seq_calls;
+	dst->stats.read_back_calls += src->stats.read_back_calls;
+	dst->stats.write_seq_calls += src->stats.write_seq_calls;
+
+	for (i = 0; i < SQFS_FILE_STATS_HIST_SIZE; ++i) {
+		dst->stats.read_size_hist[i] += src->stats.read_size_hist[i];
+		dst->stats.read_time_hist[i] += src->stats.read_time_hist[i];
+		dst->stats.read_seek_hist[i] += src->stats.read_seek_hist[i];
+		dst->stats.write_size_hist[i] += src->stats.write_size_hist[i];
+		dst->stats.write_time_hist[i] += src->stats.write_time_hist[i];
+	}
+
+	/* ranges that both have read only count once */
+	for (i = 0; i < src->ranges.used; ++i)
+		add_range(dst, r[i].start, r[i].end);
+}
+
+static void counter_destroy(sqfs_object_t *base)
+{
+	sqfs_file_counter_t *file = (sqfs_file_counter_t *)base;
+
+	if (file->root != file)
+		merge_stats(file->root, file);
+
+	array_cleanup(&file->ranges);
+	sqfs_destroy(file->wrapped);
+	free(file);
+}
+
+static sqfs_object_t *counter_copy(const sqfs_object_t *base)
+{
+	const sqfs_file_counter_t *file = (const sqfs_file_counter_t *)base;
+	sqfs_file_counter_t *copy;
+	sqfs_file_t *wrapped;
+
+	wrapped = sqfs_copy(file->wrapped);
+	if (wrapped == NULL)
+		return NULL;
+
+	copy = (sqfs_file_counter_t *)sqfs_file_stats_create(wrapped);
+	if (copy == NULL) {
+		sqfs_destroy(wrapped);
+		return NULL;
+	}
+
+	copy->root = file->root;
+	return (sqfs_object_t *)copy;
+}
+
+sqfs_file_t *sqfs_file_stats_create(sqfs_file_t *wrapped)
+{
+	sqfs_file_counter_t *file = calloc(1, sizeof(*file));
+	sqfs_file_t *base = (sqfs_file_t *)file;
+
+	if (file == NULL)
+		return NULL;
+
+	if (array_init(&file->ranges, sizeof(io_range_t), 0)) {
+		free(file);
+		return NULL;
+	}
+
+	file->wrapped = wrapped;
+	file->root = file;
+	file->stats.size = sizeof(file->stats);
+
+	base->read_at = counter_read_at;
+	base->write_at = counter_write_at;
+	base->get_size = counter_get_size;
+	base->truncate = counter_truncate;
+	((sqfs_object_t *)base)->copy = counter_copy;
+	((sqfs_object_t *)base)->destroy = counter_destroy;
+	return base;
+}
+
+const sqfs_file_stats_t *sqfs_file_stats_get(const sqfs_file_t *base)
+{
+	const sqfs_file_counter_t *file = (const sqfs_file_counter_t *)base;
+
+	if (base->read_at != counter_read_at)
+		return NULL;
+
+	return &file->stats;
+}
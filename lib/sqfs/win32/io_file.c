@@ -11,6 +11,7 @@
 #include "sqfs/error.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -67,7 +68,7 @@ static int stdio_read_at(sqfs_file_t *base, sqfs_u64 offset,
 {
 	sqfs_file_stdio_t *file = (sqfs_file_stdio_t *)base;
 	DWORD actually_read;
-	LARGE_INTEGER pos;
+	OVERLAPPED ov;
 
 	if (offset >= file->size)
 		return SQFS_ERROR_OUT_OF_BOUNDS;
@@ -78,16 +79,24 @@ static int stdio_read_at(sqfs_file_t *base, sqfs_u64 offset,
 	if ((offset + size - 1) >= file->size)
 		return SQFS_ERROR_OUT_OF_BOUNDS;
 
-	pos.QuadPart = offset;
-
-	if (!SetFilePointerEx(file->fd, pos, NULL, FILE_BEGIN))
-		return SQFS_ERROR_IO;
-
+	/*
+	  Pass the position with every read instead of moving the file
+	  pointer, which duplicated handles share, so copies of a file can
+	  be read from concurrently.
+	 */
 	while (size > 0) {
-		if (!ReadFile(file->fd, buffer, size, &actually_read, NULL))
+		memset(&ov, 0, sizeof(ov));
+		ov.Offset = offset & 0xFFFFFFFF;
+		ov.OffsetHigh = offset >> 32;
+
+		if (!ReadFile(file->fd, buffer, size, &actually_read, &ov))
 			return SQFS_ERROR_IO;
 
+		if (actually_read == 0)
+			return SQFS_ERROR_OUT_OF_BOUNDS;
+
 		size -= actually_read;
+		offset += actually_read;
 		buffer = (char *)buffer + actually_read;
 	}
 
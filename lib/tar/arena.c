@@ -0,0 +1,145 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * arena.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "config.h"
+
+#include "internal.h"
+
+#define ARENA_MIN_CHUNK (4096)
+#define ARENA_ALIGN (sizeof(sqfs_u64))
+
+#define ALIGN_UP(x) (((x) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+#define CHUNK_DATA(chunk) ((sqfs_u8 *)(chunk) + ALIGN_UP(sizeof(arena_chunk_t)))
+
+typedef struct arena_chunk_t {
+	struct arena_chunk_t *next;
+	size_t size;
+	size_t used;
+} arena_chunk_t;
+
+/*
+  New chunks are at least twice as large as the previous one and are added
+  to the front of the list. A reset only keeps the first, largest chunk, so
+  after a few headers the arena settles on a single buffer that can hold an
+  entire header and is reused for every following one.
+ */
+struct tar_arena_t {
+	arena_chunk_t *chunks;
+};
+
+tar_arena_t *tar_arena_create(void)
+{
+	tar_arena_t *arena = calloc(1, sizeof(*arena));
+
+	if (arena == NULL)
+		perror("creating tar header arena");
+
+	return arena;
+}
+
+void tar_arena_destroy(tar_arena_t *arena)
+{
+	arena_chunk_t *chunk;
+
+	if (arena == NULL)
+		return;
+
+	while (arena->chunks != NULL) {
+		chunk = arena->chunks;
+		arena->chunks = chunk->next;
+		free(chunk);
+	}
+
+	free(arena);
+}
+
+void tar_arena_reset(tar_arena_t *arena)
+{
+	arena_chunk_t *chunk;
+
+	if (arena->chunks == NULL)
+		return;
+
+	while (arena->chunks->next != NULL) {
+		chunk = arena->chunks->next;
+		arena->chunks->next = chunk->next;
+		free(chunk);
+	}
+
+	arena->chunks->used = 0;
+}
+
+static void *arena_alloc(tar_arena_t *arena, size_t size)
+{
+	arena_chunk_t *chunk = arena->chunks;
+	size_t alloc;
+	void *ptr;
+
+	if (size > ((size_t)-1 / 2))
+		goto fail_ov;
+
+	size = ALIGN_UP(size);
+
+	if (chunk == NULL || (chunk->size - chunk->used) < size) {
+		alloc = (chunk == NULL) ? ARENA_MIN_CHUNK : 2 * chunk->size;
+		if (alloc < size)
+			alloc = size;
+
+		chunk = malloc(ALIGN_UP(sizeof(*chunk)) + alloc);
+		if (chunk == NULL)
+			return NULL;
+
+		chunk->next = arena->chunks;
+		chunk->size = alloc;
+		chunk->used = 0;
+		arena->chunks = chunk;
+	}
+
+	ptr = CHUNK_DATA(chunk) + chunk->used;
+	chunk->used += size;
+	return ptr;
+fail_ov:
+	errno = EOVERFLOW;
+	return NULL;
+}
+
+void *hdr_alloc(tar_header_decoded_t *hdr, size_t size)
+{
+	void *ptr;
+
+	if (hdr->arena == NULL)
+		return calloc(1, size);
+
+	ptr = arena_alloc(hdr->arena, size);
+	if (ptr != NULL)
+		memset(ptr, 0, size);
+
+	return ptr;
+}
+
+char *hdr_strndup(tar_header_decoded_t *hdr, const char *str, size_t max)
+{
+	size_t len = strnlen(str, max);
+	char *copy = hdr_alloc(hdr, len + 1);
+
+	if (copy != NULL)
+		memcpy(copy, str, len);
+
+	return copy;
+}
+
+void hdr_free(tar_header_decoded_t *hdr, void *ptr)
+{
+	if (hdr->arena == NULL)
+		free(ptr);
+}
+
+void hdr_free_sparse(tar_header_decoded_t *hdr, sparse_map_t *list)
+{
+	if (hdr->arena == NULL)
+		free_sparse_list(list);
+}
@@ -32,9 +32,17 @@ void free_xattr_list(tar_xattr_t *list)
 
 void clear_header(tar_header_decoded_t *hdr)
 {
-	free_xattr_list(hdr->xattr);
-	free_sparse_list(hdr->sparse);
-	free(hdr->name);
-	free(hdr->link_target);
+	tar_arena_t *arena = hdr->arena;
+
+	if (arena != NULL) {
+		tar_arena_reset(arena);
+	} else {
+		free_xattr_list(hdr->xattr);
+		free_sparse_list(hdr->sparse);
+		free(hdr->name);
+		free(hdr->link_target);
+	}
+
 	memset(hdr, 0, sizeof(*hdr));
+	hdr->arena = arena;
 }
@@ -16,6 +16,7 @@
 #include <limits.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <errno.h>
 
 enum {
 	PAX_SIZE = 0x001,
@@ -57,19 +58,36 @@ void update_checksum(tar_header_t *hdr);
 
 bool is_checksum_valid(const tar_header_t *hdr);
 
-sparse_map_t *read_sparse_map(const char *line);
+sparse_map_t *read_sparse_map(const char *line, tar_header_decoded_t *out);
 
-sparse_map_t *read_gnu_old_sparse(istream_t *fp, tar_header_t *hdr);
+sparse_map_t *read_gnu_old_sparse(istream_t *fp, tar_header_t *hdr,
+				  tar_header_decoded_t *out);
 
 sparse_map_t *read_gnu_new_sparse(istream_t *fp, tar_header_decoded_t *out);
 
 void free_sparse_list(sparse_map_t *sparse);
 
+void tar_arena_reset(tar_arena_t *arena);
+
+/*
+  Allocate zero initialized memory for a decoded header, either from the
+  arena of the header if it has one, or from the heap. Memory allocated
+  from an arena is only released when the arena is reset, so the free
+  functions do nothing in that case.
+ */
+void *hdr_alloc(tar_header_decoded_t *hdr, size_t size);
+
+char *hdr_strndup(tar_header_decoded_t *hdr, const char *str, size_t max);
+
+void hdr_free(tar_header_decoded_t *hdr, void *ptr);
+
+void hdr_free_sparse(tar_header_decoded_t *hdr, sparse_map_t *list);
+
 size_t base64_decode(sqfs_u8 *out, const char *in, size_t len);
 
 void urldecode(char *str);
 
-char *record_to_memory(istream_t *fp, size_t size);
+char *record_to_memory(istream_t *fp, size_t size, tar_header_decoded_t *out);
 
 int read_pax_header(istream_t *fp, sqfs_u64 entsize, unsigned int *set_by_pax,
 		    tar_header_decoded_t *out);
@@ -40,14 +40,14 @@ static int pax_rsize(tar_header_decoded_t *out, sqfs_u64 size)
 
 static int pax_path(tar_header_decoded_t *out, char *path)
 {
-	free(out->name);
+	hdr_free(out, out->name);
 	out->name = path;
 	return 0;
 }
 
 static int pax_slink(tar_header_decoded_t *out, char *path)
 {
-	free(out->link_target);
+	hdr_free(out, out->link_target);
 	out->link_target = path;
 	return 0;
 }
@@ -136,13 +136,13 @@ static const struct pax_handler_t *find_handler(const char *key)
 	return NULL;
 }
 
-static tar_xattr_t *mkxattr(const char *key,
+static tar_xattr_t *mkxattr(tar_header_decoded_t *out, const char *key,
 			    const char *value, size_t valuelen)
 {
 	size_t keylen = strlen(key);
 	tar_xattr_t *xattr;
 
-	xattr = calloc(1, sizeof(*xattr) + keylen + 1 + valuelen + 1);
+	xattr = hdr_alloc(out, sizeof(*xattr) + keylen + 1 + valuelen + 1);
 	if (xattr == NULL)
 		return NULL;
 
@@ -180,25 +180,25 @@ static int apply_handler(tar_header_decoded_t *out,
 			return -1;
 		return field->cb.uint(out, uval);
 	case PAX_TYPE_STRING:
-		copy = strdup(value);
+		copy = hdr_strndup(out, value, valuelen);
 		if (copy == NULL) {
 			perror("processing pax header");
 			return -1;
 		}
 		if (field->cb.str(out, copy)) {
-			free(copy);
+			hdr_free(out, copy);
 			return -1;
 		}
 		break;
 	case PAX_TYPE_PREFIXED_XATTR:
-		xattr = mkxattr(key + strlen(field->name) + 1,
+		xattr = mkxattr(out, key + strlen(field->name) + 1,
 				value, valuelen);
 		if (xattr == NULL) {
 			perror("reading pax xattr field");
 			return -1;
 		}
 		if (field->cb.xattr(out, xattr)) {
-			free(xattr);
+			hdr_free(out, xattr);
 			return -1;
 		}
 		break;
@@ -218,7 +218,7 @@ int read_pax_header(istream_t *fp, sqfs_u64 entsize, unsigned int *set_by_pax,
 	const struct pax_handler_t *field;
 	long len;
 
-	buffer = record_to_memory(fp, entsize);
+	buffer = record_to_memory(fp, entsize, out);
 	if (buffer == NULL)
 		return -1;
 
@@ -261,10 +261,10 @@ int read_pax_header(istream_t *fp, sqfs_u64 entsize, unsigned int *set_by_pax,
 
 			*set_by_pax |= field->flag;
 		} else if (!strcmp(key, "GNU.sparse.map")) {
-			free_sparse_list(out->sparse);
+			hdr_free_sparse(out, out->sparse);
 			sparse_last = NULL;
 
-			out->sparse = read_sparse_map(value);
+			out->sparse = read_sparse_map(value, out);
 			if (out->sparse == NULL)
 				goto fail;
 		} else if (!strcmp(key, "GNU.sparse.offset")) {
@@ -273,13 +273,13 @@ int read_pax_header(istream_t *fp, sqfs_u64 entsize, unsigned int *set_by_pax,
 		} else if (!strcmp(key, "GNU.sparse.numbytes")) {
 			if (pax_read_decimal(value, &num_bytes))
 				goto fail;
-			sparse = calloc(1, sizeof(*sparse));
+			sparse = hdr_alloc(out, sizeof(*sparse));
 			if (sparse == NULL)
 				goto fail_errno;
 			sparse->offset = offset;
 			sparse->count = num_bytes;
 			if (sparse_last == NULL) {
-				free_sparse_list(out->sparse);
+				hdr_free_sparse(out, out->sparse);
 				out->sparse = sparse_last = sparse;
 			} else {
 				sparse_last->next = sparse;
@@ -288,7 +288,7 @@ int read_pax_header(istream_t *fp, sqfs_u64 entsize, unsigned int *set_by_pax,
 		}
 	}
 
-	free(buffer);
+	hdr_free(out, buffer);
 	return 0;
 fail_malformed:
 	fputs("Found a malformed PAX header.\n", stderr);
@@ -300,6 +300,6 @@ fail_errno:
 	perror("reading pax header");
 	goto fail;
 fail:
-	free(buffer);
+	hdr_free(out, buffer);
 	return -1;
 }
@@ -48,7 +48,7 @@ static int decode_header(const tar_header_t *hdr, unsigned int set_by_pax,
 			len2 = strnlen(hdr->tail.posix.prefix,
 				       sizeof(hdr->tail.posix.prefix));
 
-			out->name = malloc(len1 + 1 + len2 + 1);
+			out->name = hdr_alloc(out, len1 + 1 + len2 + 1);
 
 			if (out->name != NULL) {
 				memcpy(out->name, hdr->tail.posix.prefix, len2);
@@ -57,7 +57,8 @@ static int decode_header(const tar_header_t *hdr, unsigned int set_by_pax,
 				out->name[len1 + 1 + len2] = '\0';
 			}
 		} else {
-			out->name = strndup(hdr->name, sizeof(hdr->name));
+			out->name = hdr_strndup(out, hdr->name,
+						sizeof(hdr->name));
 		}
 
 		if (out->name == NULL) {
@@ -116,8 +117,8 @@ static int decode_header(const tar_header_t *hdr, unsigned int set_by_pax,
 	if (hdr->typeflag == TAR_TYPE_LINK ||
 	    hdr->typeflag == TAR_TYPE_SLINK) {
 		if (!(set_by_pax & PAX_SLINK_TARGET)) {
-			out->link_target = strndup(hdr->linkname,
-						   sizeof(hdr->linkname));
+			out->link_target = hdr_strndup(out, hdr->linkname,
+						       sizeof(hdr->linkname));
 			if (out->link_target == NULL) {
 				perror("decoding symlink target");
 				return -1;
@@ -159,7 +160,8 @@ static int decode_header(const tar_header_t *hdr, unsigned int set_by_pax,
 	return 0;
 }
 
-int read_header(istream_t *fp, tar_header_decoded_t *out)
+int read_header_arena(istream_t *fp, tar_header_decoded_t *out,
+		      tar_arena_t *arena)
 {
 	unsigned int set_by_pax = 0;
 	bool prev_was_zero = false;
@@ -168,6 +170,10 @@ int read_header(istream_t *fp, tar_header_decoded_t *out)
 	int version, ret;
 
 	memset(out, 0, sizeof(*out));
+	out->arena = arena;
+
+	if (arena != NULL)
+		tar_arena_reset(arena);
 
 	for (;;) {
 		ret = istream_read(fp, &hdr, sizeof(hdr));
@@ -199,8 +205,8 @@ int read_header(istream_t *fp, tar_header_decoded_t *out)
 				goto fail;
 			if (pax_size < 1 || pax_size > TAR_MAX_SYMLINK_LEN)
 				goto fail_slink_len;
-			free(out->link_target);
-			out->link_target = record_to_memory(fp, pax_size);
+			hdr_free(out, out->link_target);
+			out->link_target = record_to_memory(fp, pax_size, out);
 			if (out->link_target == NULL)
 				goto fail;
 			set_by_pax |= PAX_SLINK_TARGET;
@@ -210,8 +216,8 @@ int read_header(istream_t *fp, tar_header_decoded_t *out)
 				goto fail;
 			if (pax_size < 1 || pax_size > TAR_MAX_PATH_LEN)
 				goto fail_path_len;
-			free(out->name);
-			out->name = record_to_memory(fp, pax_size);
+			hdr_free(out, out->name);
+			out->name = record_to_memory(fp, pax_size, out);
 			if (out->name == NULL)
 				goto fail;
 			set_by_pax |= PAX_NAME;
@@ -232,8 +238,8 @@ int read_header(istream_t *fp, tar_header_decoded_t *out)
 				goto fail;
 			continue;
 		case TAR_TYPE_GNU_SPARSE:
-			free_sparse_list(out->sparse);
-			out->sparse = read_gnu_old_sparse(fp, &hdr);
+			hdr_free_sparse(out, out->sparse);
+			out->sparse = read_gnu_old_sparse(fp, &hdr, out);
 			if (out->sparse == NULL)
 				goto fail;
 			if (read_number(hdr.tail.gnu.realsize,
@@ -251,7 +257,7 @@ int read_header(istream_t *fp, tar_header_decoded_t *out)
 		goto fail;
 
 	if (set_by_pax & PAX_SPARSE_GNU_1_X) {
-		free_sparse_list(out->sparse);
+		hdr_free_sparse(out, out->sparse);
 		out->sparse = read_gnu_new_sparse(fp, out);
 		if (out->sparse == NULL)
 			goto fail;
@@ -287,6 +293,11 @@ fail:
 	return -1;
 }
 
+int read_header(istream_t *fp, tar_header_decoded_t *out)
+{
+	return read_header_arena(fp, out, NULL);
+}
+
 int skip_padding(istream_t *fp, sqfs_u64 size)
 {
 	size_t tail = size % 512;
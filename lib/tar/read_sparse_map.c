@@ -8,12 +8,12 @@
 
 #include "internal.h"
 
-sparse_map_t *read_sparse_map(const char *line)
+sparse_map_t *read_sparse_map(const char *line, tar_header_decoded_t *out)
 {
 	sparse_map_t *last = NULL, *list = NULL, *ent = NULL;
 
 	do {
-		ent = calloc(1, sizeof(*ent));
+		ent = hdr_alloc(out, sizeof(*ent));
 		if (ent == NULL)
 			goto fail_errno;
 
@@ -48,7 +48,7 @@ fail_format:
 	fputs("malformed GNU pax sparse file record\n", stderr);
 	goto fail;
 fail:
-	free_sparse_list(list);
-	free(ent);
+	hdr_free_sparse(out, list);
+	hdr_free(out, ent);
 	return NULL;
 }
@@ -82,7 +82,7 @@ sparse_map_t *read_gnu_new_sparse(istream_t *fp, tar_header_decoded_t *out)
 		}
 
 		if ((i & 0x01) == 0) {
-			ent = calloc(1, sizeof(*ent));
+			ent = hdr_alloc(out, sizeof(*ent));
 			if (ent == NULL)
 				goto fail_errno;
 
@@ -107,6 +107,6 @@ fail_format:
 	fputs("Malformed GNU 1.0 style sparse file map.\n", stderr);
 	goto fail;
 fail:
-	free_sparse_list(list);
+	hdr_free_sparse(out, list);
 	return NULL;
 }
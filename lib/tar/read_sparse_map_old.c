@@ -8,7 +8,8 @@
 
 #include "internal.h"
 
-sparse_map_t *read_gnu_old_sparse(istream_t *fp, tar_header_t *hdr)
+sparse_map_t *read_gnu_old_sparse(istream_t *fp, tar_header_t *hdr,
+				  tar_header_decoded_t *out)
 {
 	sparse_map_t *list = NULL, *end = NULL, *node;
 	gnu_sparse_t sph;
@@ -28,7 +29,7 @@ sparse_map_t *read_gnu_old_sparse(istream_t *fp, tar_header_t *hdr)
 			       sizeof(hdr->tail.gnu.sparse[i].numbytes), &sz))
 			goto fail;
 
-		node = calloc(1, sizeof(*node));
+		node = hdr_alloc(out, sizeof(*node));
 		if (node == NULL)
 			goto fail_errno;
 
@@ -71,7 +72,7 @@ sparse_map_t *read_gnu_old_sparse(istream_t *fp, tar_header_t *hdr)
 				       sizeof(sph.sparse[i].numbytes), &sz))
 				goto fail;
 
-			node = calloc(1, sizeof(*node));
+			node = hdr_alloc(out, sizeof(*node));
 			if (node == NULL)
 				goto fail_errno;
 
@@ -92,6 +93,6 @@ fail_errno:
 	perror("parsing GNU sparse header");
 	goto fail;
 fail:
-	free_sparse_list(list);
+	hdr_free_sparse(out, list);
 	return NULL;
 }
@@ -9,9 +9,9 @@
 #include "tar.h"
 #include "internal.h"
 
-char *record_to_memory(istream_t *fp, size_t size)
+char *record_to_memory(istream_t *fp, size_t size, tar_header_decoded_t *out)
 {
-	char *buffer = malloc(size + 1);
+	char *buffer = hdr_alloc(out, size + 1);
 	int ret;
 
 	if (buffer == NULL)
@@ -35,6 +35,6 @@ fail_errno:
 	perror("reading tar record");
 	goto fail;
 fail:
-	free(buffer);
+	hdr_free(out, buffer);
 	return NULL;
 }
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/*
+ * get_time.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "util.h"
+
+#if defined(_WIN32) || defined(__WINDOWS__)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+sqfs_u64 get_time_us(void)
+{
+	LARGE_INTEGER count, freq;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+
+	return ((sqfs_u64)count.QuadPart / freq.QuadPart) * 1000000UL +
+		(((sqfs_u64)count.QuadPart % freq.QuadPart) * 1000000UL) /
+		freq.QuadPart;
+}
+#else
+#include <time.h>
+
+sqfs_u64 get_time_us(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0;
+
+	return (sqfs_u64)ts.tv_sec * 1000000UL + ts.tv_nsec / 1000UL;
+}
+#endif
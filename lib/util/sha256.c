@@ -0,0 +1,144 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/*
+ * sha256.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "config.h"
+#include "util.h"
+
+#include <string.h>
+
+static const sqfs_u32 k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static sqfs_u32 read_be32(const sqfs_u8 *ptr)
+{
+	return ((sqfs_u32)ptr[0] << 24) | ((sqfs_u32)ptr[1] << 16) |
+	       ((sqfs_u32)ptr[2] << 8) | (sqfs_u32)ptr[3];
+}
+
+static void write_be32(sqfs_u8 *ptr, sqfs_u32 value)
+{
+	ptr[0] = (value >> 24) & 0xFF;
+	ptr[1] = (value >> 16) & 0xFF;
+	ptr[2] = (value >> 8) & 0xFF;
+	ptr[3] = value & 0xFF;
+}
+
+static void process_block(sqfs_u32 *h, const sqfs_u8 *block)
+{
+	sqfs_u32 w[64], a, b, c, d, e, f, g, x, t1, t2;
+	size_t i;
+
+	for (i = 0; i < 16; ++i)
+		w[i] = read_be32(block + i * 4);
+
+	for (i = 16; i < 64; ++i) {
+		t1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		t2 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^
+			(w[i - 15] >> 3);
+
+		w[i] = t1 + w[i - 7] + t2 + w[i - 16];
+	}
+
+	a = h[0]; b = h[1]; c = h[2]; d = h[3];
+	e = h[4]; f = h[5]; g = h[6]; x = h[7];
+
+	for (i = 0; i < 64; ++i) {
+		t1 = x + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) +
+			((e & f) ^ (~e & g)) + k[i] + w[i];
+		t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) +
+			((a & b) ^ (a & c) ^ (b & c));
+
+		x = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+	h[4] += e; h[5] += f; h[6] += g; h[7] += x;
+}
+
+void sha256_reset(sha256_state_t *state)
+{
+	static const sqfs_u32 init[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+
+	memset(state, 0, sizeof(*state));
+	memcpy(state->h, init, sizeof(init));
+}
+
+void sha256_update(sha256_state_t *state, const void *input, size_t len)
+{
+	const sqfs_u8 *ptr = input;
+	size_t used = state->total_len % sizeof(state->mem);
+	size_t diff;
+
+	state->total_len += len;
+
+	if (used > 0) {
+		diff = sizeof(state->mem) - used;
+		if (diff > len)
+			diff = len;
+
+		memcpy(state->mem + used, ptr, diff);
+		ptr += diff;
+		len -= diff;
+
+		if ((used + diff) < sizeof(state->mem))
+			return;
+
+		process_block(state->h, state->mem);
+	}
+
+	while (len >= sizeof(state->mem)) {
+		process_block(state->h, ptr);
+		ptr += sizeof(state->mem);
+		len -= sizeof(state->mem);
+	}
+
+	if (len > 0)
+		memcpy(state->mem, ptr, len);
+}
+
+void sha256_digest(sha256_state_t *state, sqfs_u8 digest[SHA256_DIGEST_SIZE])
+{
+	size_t i, used = state->total_len % sizeof(state->mem);
+	sqfs_u64 bits = state->total_len * 8;
+
+	state->mem[used++] = 0x80;
+
+	if (used > (sizeof(state->mem) - 8)) {
+		memset(state->mem + used, 0, sizeof(state->mem) - used);
+		process_block(state->h, state->mem);
+		used = 0;
+	}
+
+	memset(state->mem + used, 0, sizeof(state->mem) - 8 - used);
+	write_be32(state->mem + 56, bits >> 32);
+	write_be32(state->mem + 60, bits & 0xFFFFFFFF);
+	process_block(state->h, state->mem);
+
+	for (i = 0; i < 8; ++i)
+		write_be32(digest + i * 4, state->h[i]);
+}
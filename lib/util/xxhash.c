@@ -62,6 +62,30 @@ static sqfs_u32 XXH_readLE32(const sqfs_u8 *ptr)
 	return le32toh(value);
 }
 
+static sqfs_u32 xxh32_finalize(sqfs_u32 h32, const sqfs_u8 *p, size_t len)
+{
+	const sqfs_u8 *b_end = p + len;
+
+	while (p + 4 <= b_end) {
+		h32 += XXH_readLE32(p) * PRIME32_3;
+		h32 = xxh_rotl32(h32, 17) * PRIME32_4;
+		p += 4;
+	}
+
+	while (p < b_end) {
+		h32 += (*p) * PRIME32_5;
+		h32 = xxh_rotl32(h32, 11) * PRIME32_1;
+		p++;
+	}
+
+	h32 ^= h32 >> 15;
+	h32 *= PRIME32_2;
+	h32 ^= h32 >> 13;
+	h32 *= PRIME32_3;
+	h32 ^= h32 >> 16;
+	return h32;
+}
+
 sqfs_u32 xxh32(const void *input, const size_t len)
 {
 	const sqfs_u8 *p = (const sqfs_u8 *)input;
@@ -90,23 +114,84 @@ sqfs_u32 xxh32(const void *input, const size_t len)
 	}
 
 	h32 += (sqfs_u32)len;
+	return xxh32_finalize(h32, p, b_end - p);
+}
 
-	while (p + 4 <= b_end) {
-		h32 += XXH_readLE32(p) * PRIME32_3;
-		h32 = xxh_rotl32(h32, 17) * PRIME32_4;
-		p += 4;
+/*
+  Unlike xxh32() above, the incremental interface starts the fourth lane at
+  -PRIME32_1 like the reference implementation does, so it can be used to
+  check data that was hashed by other programs.
+ */
+void xxh32_reset(xxh32_state_t *state)
+{
+	memset(state, 0, sizeof(*state));
+	state->v1 = PRIME32_1 + PRIME32_2;
+	state->v2 = PRIME32_2;
+	state->v3 = 0;
+	state->v4 = 0 - PRIME32_1;
+}
+
+void xxh32_update(xxh32_state_t *state, const void *input, size_t len)
+{
+	const sqfs_u8 *p = (const sqfs_u8 *)input;
+	const sqfs_u8 *b_end = p + len;
+	size_t diff;
+
+	state->total_len += len;
+
+	if (state->memsize > 0) {
+		diff = sizeof(state->mem) - state->memsize;
+		if (diff > len)
+			diff = len;
+
+		memcpy(state->mem + state->memsize, p, diff);
+		state->memsize += diff;
+		p += diff;
+
+		if (state->memsize < sizeof(state->mem))
+			return;
+
+		state->v1 = xxh32_round(state->v1, XXH_readLE32(state->mem));
+		state->v2 = xxh32_round(state->v2, XXH_readLE32(state->mem + 4));
+		state->v3 = xxh32_round(state->v3, XXH_readLE32(state->mem + 8));
+		state->v4 = xxh32_round(state->v4, XXH_readLE32(state->mem + 12));
+		state->memsize = 0;
 	}
 
-	while (p < b_end) {
-		h32 += (*p) * PRIME32_5;
-		h32 = xxh_rotl32(h32, 11) * PRIME32_1;
-		p++;
+	while ((size_t)(b_end - p) >= 16) {
+		state->v1 = xxh32_round(state->v1, XXH_readLE32(p     ));
+		state->v2 = xxh32_round(state->v2, XXH_readLE32(p +  4));
+		state->v3 = xxh32_round(state->v3, XXH_readLE32(p +  8));
+		state->v4 = xxh32_round(state->v4, XXH_readLE32(p + 12));
+		p += 16;
 	}
 
-	h32 ^= h32 >> 15;
-	h32 *= PRIME32_2;
-	h32 ^= h32 >> 13;
-	h32 *= PRIME32_3;
-	h32 ^= h32 >> 16;
-	return h32;
+	if (p < b_end) {
+		memcpy(state->mem, p, b_end - p);
+		state->memsize = b_end - p;
+	}
+}
+
+sqfs_u32 xxh32_digest(const xxh32_state_t *state)
+{
+	sqfs_u32 h32;
+
+	if (state->total_len >= 16) {
+		h32 = xxh_rotl32(state->v1, 1) + xxh_rotl32(state->v2, 7) +
+			xxh_rotl32(state->v3, 12) + xxh_rotl32(state->v4, 18);
+	} else {
+		h32 = PRIME32_5;
+	}
+
+	h32 += (sqfs_u32)state->total_len;
+	return xxh32_finalize(h32, state->mem, state->memsize);
+}
+
+sqfs_u32 xxh32_ref(const void *input, size_t len)
+{
+	xxh32_state_t state;
+
+	xxh32_reset(&state);
+	xxh32_update(&state, input, len);
+	return xxh32_digest(&state);
 }
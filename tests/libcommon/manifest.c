@@ -0,0 +1,283 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * manifest.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "config.h"
+
+#include "manifest.h"
+#include "../test.h"
+
+/* small, so that lines span several buffer refills */
+#define MEM_BUFSZ (61)
+
+typedef struct {
+	ostream_t base;
+
+	char *data;
+	size_t size;
+} mem_ostream_t;
+
+typedef struct {
+	istream_t base;
+	const char *data;
+	size_t size;
+	size_t offset;
+
+	sqfs_u8 buffer[MEM_BUFSZ];
+} mem_istream_t;
+
+static const struct {
+	const char *path;
+	const char *target;
+	sqfs_u16 mode;
+	sqfs_u32 uid;
+	sqfs_u32 gid;
+	sqfs_u32 mtime;
+	unsigned int major_num;
+	unsigned int minor_num;
+	sqfs_u64 size;
+	sqfs_u8 hash[6];
+} entries[] = {
+	{ "/", NULL, S_IFDIR | 0755, 0, 0, 1000, 0, 0, 0, { 0 } },
+	{ "/a dir", NULL, S_IFDIR | 01777, 1, 2, 1001, 0, 0, 0, { 0 } },
+	{ "/a dir/tab\tnew\nline", NULL, S_IFREG | 0644, 3, 4, 1002, 0, 0,
+	  123456789, { 0x00, 0x01, 0xAB, 0xCD, 0xEF, 0xFF } },
+	{ "/back\\slash\x7F\x01", NULL, S_IFREG | 04755, 5, 6, 1003, 0, 0,
+	  0, { 0 } },
+	{ "/gr\xC3\xBC\xC3\x9F" "e", NULL, S_IFREG | 0600, 0, 0, 0, 0, 0,
+	  1, { 0x12 } },
+	{ "/link", "some target\\with spaces", S_IFLNK | 0777, 7, 8, 1004,
+	  0, 0, 0, { 0 } },
+	{ "/chr", NULL, S_IFCHR | 0620, 0, 5, 1005, 4, 64, 0, { 0 } },
+	{ "/blk", NULL, S_IFBLK | 0660, 0, 6, 1006, 8, 1, 0, { 0 } },
+	{ "/fifo", NULL, S_IFIFO | 0644, 9, 10, 1007, 0, 0, 0, { 0 } },
+	{ "/sock", NULL, S_IFSOCK | 0777, 11, 12, 4294967295UL, 0, 0, 0,
+	  { 0 } },
+};
+
+static const char *expected_lines[] = {
+	"slink /link 0777 7 8 1004 some\\040target\\134with\\040spaces\n",
+	"file /back\\134slash\\177\\001 04755 5 6 1003 0 "
+	"0000000000000000000000000000000000000000000000000000000000000000\n",
+	"dir /a\\040dir 01777 1 2 1001\n",
+	"nod /chr 0620 0 5 1005 c 4 64\n",
+	"nod /blk 0660 0 6 1006 b 8 1\n",
+};
+
+static int mem_append(ostream_t *base, const void *data, size_t size)
+{
+	mem_ostream_t *strm = (mem_ostream_t *)base;
+
+	strm->data = realloc(strm->data, strm->size + size + 1);
+	TEST_NOT_NULL(strm->data);
+
+	memcpy(strm->data + strm->size, data, size);
+	strm->size += size;
+	strm->data[strm->size] = '\0';
+	return 0;
+}
+
+static int mem_flush(ostream_t *base)
+{
+	(void)base;
+	return 0;
+}
+
+static const char *mem_ostream_get_filename(ostream_t *base)
+{
+	(void)base;
+	return "memory";
+}
+
+static int mem_precache(istream_t *strm)
+{
+	mem_istream_t *mem = (mem_istream_t *)strm;
+	size_t diff = MEM_BUFSZ - strm->buffer_used;
+
+	if (diff > mem->size - mem->offset)
+		diff = mem->size - mem->offset;
+
+	memcpy(strm->buffer + strm->buffer_used, mem->data + mem->offset,
+	       diff);
+
+	strm->buffer_used += diff;
+	mem->offset += diff;
+
+	if (mem->offset == mem->size)
+		strm->eof = true;
+
+	return 0;
+}
+
+static const char *mem_istream_get_filename(istream_t *strm)
+{
+	(void)strm;
+	return "memory";
+}
+
+static void mem_destroy(sqfs_object_t *obj)
+{
+	(void)obj;
+}
+
+static manifest_t *read_text(const char *text)
+{
+	mem_istream_t mem;
+
+	memset(&mem, 0, sizeof(mem));
+	mem.data = text;
+	mem.size = strlen(text);
+
+	((istream_t *)&mem)->buffer = mem.buffer;
+	((istream_t *)&mem)->precache = mem_precache;
+	((istream_t *)&mem)->get_filename = mem_istream_get_filename;
+	((sqfs_object_t *)&mem)->destroy = mem_destroy;
+
+	return manifest_read((istream_t *)&mem);
+}
+
+static manifest_t *create_manifest(void)
+{
+	manifest_entry_t *ent;
+	manifest_t *m;
+	size_t i;
+
+	m = calloc(1, sizeof(*m));
+	TEST_NOT_NULL(m);
+
+	m->count = sizeof(entries) / sizeof(entries[0]);
+	m->entries = calloc(m->count, sizeof(m->entries[0]));
+	TEST_NOT_NULL(m->entries);
+
+	for (i = 0; i < m->count; ++i) {
+		ent = m->entries + i;
+
+		ent->path = strdup(entries[i].path);
+		TEST_NOT_NULL(ent->path);
+
+		if (entries[i].target != NULL) {
+			ent->target = strdup(entries[i].target);
+			TEST_NOT_NULL(ent->target);
+		}
+
+		ent->mode = entries[i].mode;
+		ent->uid = entries[i].uid;
+		ent->gid = entries[i].gid;
+		ent->mtime = entries[i].mtime;
+		ent->devno = makedev(entries[i].major_num,
+				     entries[i].minor_num);
+		ent->size = entries[i].size;
+		memcpy(ent->hash, entries[i].hash, sizeof(entries[i].hash));
+	}
+
+	return m;
+}
+
+static void test_round_trip(void)
+{
+	const manifest_entry_t *a, *b;
+	mem_ostream_t out;
+	manifest_t *m, *in;
+	size_t i;
+
+	in = create_manifest();
+
+	memset(&out, 0, sizeof(out));
+	((ostream_t *)&out)->append = mem_append;
+	((ostream_t *)&out)->flush = mem_flush;
+	((ostream_t *)&out)->get_filename = mem_ostream_get_filename;
+	((sqfs_object_t *)&out)->destroy = mem_destroy;
+
+	TEST_ASSERT(manifest_write(in, (ostream_t *)&out) == 0);
+	TEST_NOT_NULL(out.data);
+
+	/* nothing but the line breaks between entries */
+	for (i = 0; i < out.size; ++i) {
+		TEST_ASSERT((unsigned char)out.data[i] > 0x20 ||
+			    out.data[i] == ' ' || out.data[i] == '\n');
+		TEST_ASSERT(out.data[i] != 0x7F);
+	}
+
+	for (i = 0; i < sizeof(expected_lines) / sizeof(expected_lines[0]);
+	     ++i) {
+		TEST_NOT_NULL(strstr(out.data, expected_lines[i]));
+	}
+
+	m = read_text(out.data);
+	TEST_NOT_NULL(m);
+	TEST_EQUAL_UI(m->count, in->count);
+
+	for (i = 0; i < m->count; ++i) {
+		a = in->entries + i;
+		b = m->entries + i;
+
+		TEST_STR_EQUAL(b->path, a->path);
+		TEST_EQUAL_UI(b->mode, a->mode);
+		TEST_EQUAL_UI(b->uid, a->uid);
+		TEST_EQUAL_UI(b->gid, a->gid);
+		TEST_EQUAL_UI(b->mtime, a->mtime);
+		TEST_EQUAL_UI(b->devno, a->devno);
+		TEST_EQUAL_UI(b->size, a->size);
+		TEST_ASSERT(memcmp(b->hash, a->hash, sizeof(a->hash)) == 0);
+
+		if (a->target == NULL) {
+			TEST_NULL(b->target);
+		} else {
+			TEST_STR_EQUAL(b->target, a->target);
+		}
+	}
+
+	manifest_destroy(in);
+	manifest_destroy(m);
+	free(out.data);
+}
+
+static void test_comments(void)
+{
+	manifest_t *m;
+
+	m = read_text("# a comment\n\n   \n  dir / 0755 0 0 0  \n");
+	TEST_NOT_NULL(m);
+	TEST_EQUAL_UI(m->count, 1);
+	TEST_STR_EQUAL(m->entries[0].path, "/");
+	TEST_EQUAL_UI(m->entries[0].mode, S_IFDIR | 0755);
+	manifest_destroy(m);
+}
+
+static void test_malformed(void)
+{
+	static const char *lines[] = {
+		"dir / 0755 0 0\n",
+		"dir / 0755 0 0 0 extra\n",
+		"dir / 010000 0 0 0\n",
+		"dir / 0755 0 0 4294967296\n",
+		"foo / 0755 0 0 0\n",
+		"dir /\\000 0755 0 0 0\n",
+		"dir /\\400 0755 0 0 0\n",
+		"dir /\\12 0755 0 0 0\n",
+		"file /a 0644 0 0 0 -1 "
+		"0000000000000000000000000000000000000000000000000000000000000000\n",
+		"file /a 0644 0 0 0 1 00\n",
+		"file /a 0644 0 0 0 1 "
+		"000000000000000000000000000000000000000000000000000000000000\xE9\xE9\n",
+		"slink /a 0777 0 0 0\n",
+		"nod /a 0600 0 0 0 x 1 2\n",
+		"nod /a 0600 0 0 0 c 1\n",
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(lines) / sizeof(lines[0]); ++i)
+		TEST_NULL(read_text(lines[i]));
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc; (void)argv;
+
+	test_round_trip();
+	test_comments();
+	test_malformed();
+	return EXIT_SUCCESS;
+}
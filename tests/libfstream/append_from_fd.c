@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * append_from_fd.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "config.h"
+
+#include "fstream.h"
+#include "../test.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define INPUT_SIZE (300007)
+
+static sqfs_u8 byte_at(size_t offset)
+{
+	return ((offset * 13 + offset / 509) / 5) & 0xFF;
+}
+
+static int create_input(char *path)
+{
+	sqfs_u8 buffer[4096];
+	size_t i, j, diff;
+	int fd;
+
+	fd = mkstemp(path);
+	TEST_ASSERT(fd >= 0);
+
+	for (i = 0; i < INPUT_SIZE; i += diff) {
+		diff = INPUT_SIZE - i;
+		if (diff > sizeof(buffer))
+			diff = sizeof(buffer);
+
+		for (j = 0; j < diff; ++j)
+			buffer[j] = byte_at(i + j);
+
+		TEST_EQUAL_I(write(fd, buffer, diff), (int)diff);
+	}
+
+	return fd;
+}
+
+static void check_range(int fd, size_t offset, size_t size)
+{
+	sqfs_u8 buffer[4096];
+	size_t i, diff;
+
+	for (; size > 0; size -= diff) {
+		diff = size < sizeof(buffer) ? size : sizeof(buffer);
+
+		TEST_EQUAL_I(read(fd, buffer, diff), (int)diff);
+
+		for (i = 0; i < diff; ++i)
+			TEST_EQUAL_UI(buffer[i], byte_at(offset + i));
+
+		offset += diff;
+	}
+}
+
+static void run_test(int in_fd, bool prealloc)
+{
+	char out_path[] = "append_from_fd_out.XXXXXX";
+	sqfs_u8 buffer[100];
+	ostream_t *strm;
+	struct stat sb;
+	size_t i;
+	int fd;
+
+	fd = mkstemp(out_path);
+	TEST_ASSERT(fd >= 0);
+	close(fd);
+
+	strm = ostream_open_file(out_path, OSTREAM_OPEN_OVERWRITE |
+				 OSTREAM_OPEN_SPARSE);
+	TEST_NOT_NULL(strm);
+	TEST_ASSERT(strm->append_from_fd != NULL);
+
+	if (prealloc) {
+		TEST_EQUAL_I(ostream_preallocate(strm, 5 + 70000 + 100 +
+						 INPUT_SIZE + 5 + 4096), 0);
+	}
+
+	/* mixed with regular writes and holes, copying from any position */
+	TEST_EQUAL_I(ostream_append(strm, "Hello", 5), 0);
+	TEST_EQUAL_I(ostream_append_from_fd(strm, in_fd, 1000, 70000), 0);
+	TEST_EQUAL_I(ostream_append_sparse(strm, 100), 0);
+	TEST_EQUAL_I(ostream_append_from_fd(strm, in_fd, 0, INPUT_SIZE), 0);
+	TEST_EQUAL_I(ostream_append_from_fd(strm, in_fd, 7, 0), 0);
+	TEST_EQUAL_I(ostream_append(strm, "World", 5), 0);
+	TEST_EQUAL_I(ostream_append_sparse(strm, 4096), 0);
+
+	/* reading past the end of the input fails, after the last 10 bytes */
+	TEST_ASSERT(ostream_append_from_fd(strm, in_fd, INPUT_SIZE - 10,
+					   20) != 0);
+
+	TEST_EQUAL_I(ostream_flush(strm), 0);
+	sqfs_destroy(strm);
+
+	fd = open(out_path, O_RDONLY);
+	TEST_ASSERT(fd >= 0);
+
+	TEST_EQUAL_I(read(fd, buffer, 5), 5);
+	TEST_ASSERT(memcmp(buffer, "Hello", 5) == 0);
+
+	check_range(fd, 1000, 70000);
+
+	TEST_EQUAL_I(read(fd, buffer, 100), 100);
+	for (i = 0; i < 100; ++i)
+		TEST_EQUAL_UI(buffer[i], 0);
+
+	check_range(fd, 0, INPUT_SIZE);
+
+	TEST_EQUAL_I(read(fd, buffer, 5), 5);
+	TEST_ASSERT(memcmp(buffer, "World", 5) == 0);
+
+	TEST_EQUAL_I(read(fd, buffer, 100), 100);
+	for (i = 0; i < 100; ++i)
+		TEST_EQUAL_UI(buffer[i], 0);
+
+	TEST_ASSERT(lseek(fd, 4096 - 100, SEEK_CUR) != (off_t)-1);
+	check_range(fd, INPUT_SIZE - 10, 10);
+
+	TEST_ASSERT(fstat(fd, &sb) == 0);
+	TEST_EQUAL_UI(sb.st_size,
+		      5 + 70000 + 100 + INPUT_SIZE + 5 + 4096 + 10);
+
+	close(fd);
+	unlink(out_path);
+}
+
+int main(int argc, char **argv)
+{
+	char in_path[] = "append_from_fd_in.XXXXXX";
+	int in_fd;
+	(void)argc; (void)argv;
+
+	in_fd = create_input(in_path);
+
+	run_test(in_fd, false);
+	run_test(in_fd, true);
+
+	close(in_fd);
+	unlink(in_path);
+	return EXIT_SUCCESS;
+}
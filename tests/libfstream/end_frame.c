@@ -0,0 +1,173 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * end_frame.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "config.h"
+
+#include "fstream.h"
+#include "../test.h"
+
+#include <unistd.h>
+
+/* spans multiple compressor input buffers */
+#define PART_SIZE (600011)
+
+typedef struct {
+	ostream_t base;
+
+	sqfs_u8 *data;
+	size_t size;
+} mem_ostream_t;
+
+static sqfs_u8 byte_at(size_t offset)
+{
+	return ((offset * 7 + offset / 251) / 3) & 0xFF;
+}
+
+static int mem_append(ostream_t *base, const void *data, size_t size)
+{
+	mem_ostream_t *strm = (mem_ostream_t *)base;
+
+	if (size == 0)
+		return 0;
+
+	strm->data = realloc(strm->data, strm->size + size);
+	TEST_NOT_NULL(strm->data);
+
+	memcpy(strm->data + strm->size, data, size);
+	strm->size += size;
+	return 0;
+}
+
+static int mem_flush(ostream_t *base)
+{
+	(void)base;
+	return 0;
+}
+
+static const char *mem_get_filename(ostream_t *base)
+{
+	(void)base;
+	return "memory";
+}
+
+static void mem_destroy(sqfs_object_t *base)
+{
+	(void)base;
+}
+
+static void append_part(ostream_t *strm, size_t offset)
+{
+	sqfs_u8 buffer[4096];
+	size_t i, j, diff;
+
+	for (i = 0; i < PART_SIZE; i += diff) {
+		diff = PART_SIZE - i;
+		if (diff > sizeof(buffer))
+			diff = sizeof(buffer);
+
+		for (j = 0; j < diff; ++j)
+			buffer[j] = byte_at(offset + i + j);
+
+		TEST_EQUAL_I(ostream_append(strm, buffer, diff), 0);
+	}
+}
+
+static void check_data(const mem_ostream_t *mem, size_t comp_offset,
+		       int comp_id, size_t offset, size_t size)
+{
+	char path[] = "end_frame_test.XXXXXX";
+	sqfs_u8 buffer[4096];
+	istream_t *strm;
+	size_t i, diff;
+	int fd;
+
+	fd = mkstemp(path);
+	TEST_ASSERT(fd >= 0);
+	TEST_EQUAL_I(write(fd, mem->data, mem->size), (int)mem->size);
+	close(fd);
+
+	strm = istream_open_file(path);
+	TEST_NOT_NULL(strm);
+	TEST_EQUAL_I(istream_skip(strm, comp_offset), 0);
+
+	strm = istream_compressor_create(strm, comp_id);
+	TEST_NOT_NULL(strm);
+
+	for (; size > 0; size -= diff) {
+		diff = size < sizeof(buffer) ? size : sizeof(buffer);
+
+		TEST_EQUAL_I(istream_read(strm, buffer, diff), (int)diff);
+
+		for (i = 0; i < diff; ++i)
+			TEST_EQUAL_UI(buffer[i], byte_at(offset + i));
+
+		offset += diff;
+	}
+
+	TEST_EQUAL_I(istream_read(strm, buffer, sizeof(buffer)), 0);
+
+	sqfs_destroy(strm);
+	unlink(path);
+}
+
+static void run_test(int comp_id, size_t num_jobs)
+{
+	mem_ostream_t mem;
+	size_t cut[2];
+	ostream_t *strm;
+
+	memset(&mem, 0, sizeof(mem));
+	((ostream_t *)&mem)->append = mem_append;
+	((ostream_t *)&mem)->flush = mem_flush;
+	((ostream_t *)&mem)->get_filename = mem_get_filename;
+	((sqfs_object_t *)&mem)->destroy = mem_destroy;
+
+	strm = ostream_compressor_create_parallel((ostream_t *)&mem,
+						  comp_id, num_jobs);
+	TEST_NOT_NULL(strm);
+
+	/* ending a frame without data in it does nothing */
+	TEST_EQUAL_I(ostream_compressor_end_frame(strm), 0);
+	TEST_EQUAL_UI(mem.size, 0);
+
+	append_part(strm, 0);
+	TEST_EQUAL_I(ostream_compressor_end_frame(strm), 0);
+	cut[0] = mem.size;
+	TEST_ASSERT(cut[0] > 0);
+
+	TEST_EQUAL_I(ostream_compressor_end_frame(strm), 0);
+	TEST_EQUAL_UI(mem.size, cut[0]);
+
+	append_part(strm, PART_SIZE);
+	TEST_EQUAL_I(ostream_compressor_end_frame(strm), 0);
+	cut[1] = mem.size;
+
+	append_part(strm, 2 * PART_SIZE);
+	TEST_EQUAL_I(ostream_flush(strm), 0);
+	sqfs_destroy(strm);
+
+	check_data(&mem, 0, comp_id, 0, 3 * PART_SIZE);
+	check_data(&mem, cut[0], comp_id, PART_SIZE, 2 * PART_SIZE);
+	check_data(&mem, cut[1], comp_id, 2 * PART_SIZE, PART_SIZE);
+
+	free(mem.data);
+}
+
+int main(int argc, char **argv)
+{
+	int id;
+	(void)argc; (void)argv;
+
+	for (id = FSTREAM_COMPRESSOR_MIN; id <= FSTREAM_COMPRESSOR_MAX; ++id) {
+		if (!fstream_compressor_exists(id))
+			continue;
+
+		run_test(id, 1);
+		run_test(id, 2);
+	}
+
+	return EXIT_SUCCESS;
+}
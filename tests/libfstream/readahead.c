@@ -0,0 +1,309 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * readahead.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "config.h"
+
+#include "fstream.h"
+#include "../test.h"
+
+#define TOTAL_SIZE (1000003)
+#define GEN_BUFSZ (262144)
+
+typedef struct {
+	ostream_t base;
+
+	sqfs_u8 *data;
+	size_t size;
+} mem_ostream_t;
+
+typedef struct {
+	istream_t base;
+	const mem_ostream_t *src;
+	size_t offset;
+
+	sqfs_u8 buffer[GEN_BUFSZ];
+} mem_istream_t;
+
+typedef struct {
+	istream_t base;
+	size_t generated;
+	size_t chunk;
+
+	sqfs_u8 buffer[GEN_BUFSZ];
+} gen_istream_t;
+
+static sqfs_u8 byte_at(size_t offset)
+{
+	return (offset * 7 + offset / 251) & 0xFF;
+}
+
+/* deliberately hand out data in small, uneven chunks */
+static int gen_precache(istream_t *strm)
+{
+	gen_istream_t *gen = (gen_istream_t *)strm;
+	size_t i, diff;
+
+	diff = GEN_BUFSZ - strm->buffer_used;
+	if (diff > gen->chunk)
+		diff = gen->chunk;
+
+	if (diff > TOTAL_SIZE - gen->generated)
+		diff = TOTAL_SIZE - gen->generated;
+
+	for (i = 0; i < diff; ++i)
+		strm->buffer[strm->buffer_used + i] = byte_at(gen->generated + i);
+
+	strm->buffer_used += diff;
+	gen->generated += diff;
+	gen->chunk = (gen->chunk * 3) % 40009 + 1;
+
+	if (gen->generated == TOTAL_SIZE)
+		strm->eof = true;
+
+	return 0;
+}
+
+static const char *gen_get_filename(istream_t *strm)
+{
+	(void)strm;
+	return "generator";
+}
+
+static void gen_destroy(sqfs_object_t *obj)
+{
+	free(obj);
+}
+
+static istream_t *gen_create(void)
+{
+	gen_istream_t *gen = calloc(1, sizeof(*gen));
+	TEST_NOT_NULL(gen);
+
+	gen->chunk = 1000;
+	gen->base.buffer = gen->buffer;
+	gen->base.precache = gen_precache;
+	gen->base.get_filename = gen_get_filename;
+	((sqfs_object_t *)gen)->destroy = gen_destroy;
+	return (istream_t *)gen;
+}
+
+static int mem_append(ostream_t *base, const void *data, size_t size)
+{
+	mem_ostream_t *strm = (mem_ostream_t *)base;
+
+	if (size == 0)
+		return 0;
+
+	strm->data = realloc(strm->data, strm->size + size);
+	TEST_NOT_NULL(strm->data);
+
+	memcpy(strm->data + strm->size, data, size);
+	strm->size += size;
+	return 0;
+}
+
+static int mem_flush(ostream_t *base)
+{
+	(void)base;
+	return 0;
+}
+
+static const char *mem_ostream_get_filename(ostream_t *base)
+{
+	(void)base;
+	return "memory";
+}
+
+static void mem_ostream_destroy(sqfs_object_t *base)
+{
+	(void)base;
+}
+
+/* hands out the compressed data in odd sized pieces */
+static int mem_precache(istream_t *strm)
+{
+	mem_istream_t *mem = (mem_istream_t *)strm;
+	size_t diff = GEN_BUFSZ - strm->buffer_used;
+
+	if (diff > 12345)
+		diff = 12345;
+
+	if (diff > mem->src->size - mem->offset)
+		diff = mem->src->size - mem->offset;
+
+	memcpy(strm->buffer + strm->buffer_used,
+	       mem->src->data + mem->offset, diff);
+
+	strm->buffer_used += diff;
+	mem->offset += diff;
+
+	if (mem->offset == mem->src->size)
+		strm->eof = true;
+
+	return 0;
+}
+
+static const char *mem_istream_get_filename(istream_t *strm)
+{
+	(void)strm;
+	return "memory";
+}
+
+static void mem_istream_destroy(sqfs_object_t *obj)
+{
+	free(obj);
+}
+
+static void check_stream(istream_t *strm, size_t offset)
+{
+	size_t i, size = 1;
+	sqfs_u8 buffer[5000];
+	sqfs_s32 ret;
+
+	for (;;) {
+		ret = istream_read(strm, buffer, size);
+		TEST_ASSERT(ret >= 0);
+
+		if (ret == 0)
+			break;
+
+		for (i = 0; i < (size_t)ret; ++i)
+			TEST_EQUAL_UI(buffer[i], byte_at(offset + i));
+
+		offset += ret;
+		size = (size * 5) % sizeof(buffer) + 1;
+	}
+
+	TEST_EQUAL_UI(offset, TOTAL_SIZE);
+	TEST_EQUAL_I(istream_read(strm, buffer, sizeof(buffer)), 0);
+}
+
+/* keep more unconsumed data around than fits in front of a new buffer */
+static void test_peek(void)
+{
+	istream_t *strm;
+	size_t i, used;
+
+	strm = istream_readahead_create(gen_create(), 3);
+	TEST_NOT_NULL(strm);
+
+	/* without consuming anything, every call adds data until it is full */
+	do {
+		used = strm->buffer_used;
+		TEST_EQUAL_I(istream_precache(strm), 0);
+		TEST_ASSERT(!strm->eof);
+	} while (strm->buffer_used > used);
+
+	TEST_EQUAL_UI(strm->buffer_used, 2 * GEN_BUFSZ);
+
+	for (i = 0; i < strm->buffer_used; ++i)
+		TEST_EQUAL_UI(strm->buffer[i], byte_at(i));
+
+	strm->buffer_offset = 1000;
+	TEST_EQUAL_I(istream_precache(strm), 0);
+	TEST_EQUAL_UI(strm->buffer_offset, 0);
+	TEST_EQUAL_UI(strm->buffer_used, 2 * GEN_BUFSZ);
+	TEST_EQUAL_UI(strm->buffer[0], byte_at(1000));
+
+	check_stream(strm, 1000);
+	sqfs_destroy(strm);
+}
+
+/* the decoders do not all produce their output in the same place */
+static void test_compressed(int comp_id)
+{
+	sqfs_u8 buffer[4096];
+	mem_ostream_t out;
+	mem_istream_t *mem;
+	ostream_t *ostrm;
+	istream_t *strm;
+	size_t i, j, diff;
+
+	memset(&out, 0, sizeof(out));
+	((ostream_t *)&out)->append = mem_append;
+	((ostream_t *)&out)->flush = mem_flush;
+	((ostream_t *)&out)->get_filename = mem_ostream_get_filename;
+	((sqfs_object_t *)&out)->destroy = mem_ostream_destroy;
+
+	ostrm = ostream_compressor_create((ostream_t *)&out, comp_id);
+	TEST_NOT_NULL(ostrm);
+
+	for (i = 0; i < TOTAL_SIZE; i += diff) {
+		diff = TOTAL_SIZE - i;
+		if (diff > sizeof(buffer))
+			diff = sizeof(buffer);
+
+		for (j = 0; j < diff; ++j)
+			buffer[j] = byte_at(i + j);
+
+		TEST_EQUAL_I(ostream_append(ostrm, buffer, diff), 0);
+	}
+
+	TEST_EQUAL_I(ostream_flush(ostrm), 0);
+	sqfs_destroy(ostrm);
+
+	mem = calloc(1, sizeof(*mem));
+	TEST_NOT_NULL(mem);
+
+	mem->src = &out;
+	mem->base.buffer = mem->buffer;
+	mem->base.precache = mem_precache;
+	mem->base.get_filename = mem_istream_get_filename;
+	((sqfs_object_t *)mem)->destroy = mem_istream_destroy;
+
+	strm = istream_compressor_create((istream_t *)mem, comp_id);
+	TEST_NOT_NULL(strm);
+
+	strm = istream_readahead_create(strm, 3);
+	TEST_NOT_NULL(strm);
+
+	check_stream(strm, 0);
+
+	sqfs_destroy(strm);
+	free(out.data);
+}
+
+int main(int argc, char **argv)
+{
+	istream_t *strm;
+	size_t i;
+	int id;
+	(void)argc; (void)argv;
+
+	/* leave some data in the wrapped stream, like a format probe */
+	strm = gen_create();
+	TEST_EQUAL_I(istream_precache(strm), 0);
+	TEST_ASSERT(strm->buffer_used > 10);
+	strm->buffer_offset = 10;
+
+	strm = istream_readahead_create(strm, 3);
+	TEST_NOT_NULL(strm);
+
+	/* peek at the start without consuming everything */
+	TEST_EQUAL_I(istream_precache(strm), 0);
+	TEST_ASSERT(strm->buffer_used > 100);
+
+	for (i = 0; i < 100; ++i)
+		TEST_EQUAL_UI(strm->buffer[i], byte_at(10 + i));
+
+	strm->buffer_offset = 50;
+	TEST_EQUAL_I(istream_precache(strm), 0);
+	TEST_EQUAL_UI(strm->buffer_offset, 0);
+	TEST_EQUAL_UI(strm->buffer[0], byte_at(60));
+
+	/* read the rest in varying sizes */
+	check_stream(strm, 60);
+	sqfs_destroy(strm);
+
+	test_peek();
+
+	for (id = FSTREAM_COMPRESSOR_MIN; id <= FSTREAM_COMPRESSOR_MAX; ++id) {
+		if (fstream_compressor_exists(id))
+			test_compressed(id);
+	}
+
+	return EXIT_SUCCESS;
+}
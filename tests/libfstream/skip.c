@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * skip.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "config.h"
+
+#include "fstream.h"
+#include "../test.h"
+
+#include <unistd.h>
+
+#define FILE_SIZE (1000003)
+
+static sqfs_u8 byte_at(size_t offset)
+{
+	return (offset * 7 + offset / 251) & 0xFF;
+}
+
+static void check_read(istream_t *strm, size_t offset, size_t size)
+{
+	sqfs_u8 buffer[64];
+	size_t i;
+
+	TEST_ASSERT(size <= sizeof(buffer));
+	TEST_EQUAL_I(istream_read(strm, buffer, size), (int)size);
+
+	for (i = 0; i < size; ++i)
+		TEST_EQUAL_UI(buffer[i], byte_at(offset + i));
+}
+
+int main(int argc, char **argv)
+{
+	char path[] = "skip_test.XXXXXX";
+	sqfs_u8 buffer[4096];
+	size_t i, j;
+	istream_t *strm;
+	int fd;
+	(void)argc; (void)argv;
+
+	fd = mkstemp(path);
+	TEST_ASSERT(fd >= 0);
+
+	for (i = 0; i < FILE_SIZE; i += sizeof(buffer)) {
+		for (j = 0; j < sizeof(buffer); ++j)
+			buffer[j] = byte_at(i + j);
+
+		j = FILE_SIZE - i;
+		if (j > sizeof(buffer))
+			j = sizeof(buffer);
+
+		TEST_EQUAL_I(write(fd, buffer, j), (int)j);
+	}
+
+	close(fd);
+
+	strm = istream_open_file(path);
+	TEST_NOT_NULL(strm);
+	TEST_ASSERT(strm->skip != NULL);
+
+	/* skip within the buffer */
+	check_read(strm, 0, 10);
+	TEST_EQUAL_I(istream_skip(strm, 1000), 0);
+	check_read(strm, 1010, 10);
+
+	/* skip past the buffered data */
+	TEST_EQUAL_I(istream_skip(strm, 500000), 0);
+	check_read(strm, 501020, 64);
+
+	/* up to the last byte */
+	TEST_EQUAL_I(istream_skip(strm, FILE_SIZE - 501085), 0);
+	check_read(strm, FILE_SIZE - 1, 1);
+	TEST_EQUAL_I(istream_read(strm, buffer, sizeof(buffer)), 0);
+
+	sqfs_destroy(strm);
+
+	/* skipping past the end is an error */
+	strm = istream_open_file(path);
+	TEST_NOT_NULL(strm);
+	check_read(strm, 0, 10);
+	TEST_ASSERT(istream_skip(strm, FILE_SIZE) != 0);
+	sqfs_destroy(strm);
+
+	unlink(path);
+	return EXIT_SUCCESS;
+}
@@ -328,6 +328,126 @@ static sqfs_u8 data_in[] = {
 	0x98, 0x50, 0x5a, 0xc2, 0xcf, 0xe1, 0x08, 0x02,
 	0x00, 0x0f, 0x1e, 0x44,	0x40, 0x79, 0x50, 0x67,
 	0x3d, 0xd3, 0x35, 0x8f
+#elif defined(TEST_LZ4)
+	0x04, 0x22, 0x4d, 0x18, 0x64, 0x40, 0xa7, 0xa8,
+	0x01, 0x00, 0x00, 0xf2, 0x57, 0x4c, 0x6f, 0x72,
+	0x65, 0x6d, 0x20, 0x69, 0x70, 0x73, 0x75, 0x6d,
+	0x20, 0x64, 0x6f, 0x6c, 0x6f, 0x72, 0x20, 0x73,
+	0x69, 0x74, 0x20, 0x61, 0x6d, 0x65, 0x74, 0x2c,
+	0x20, 0x63, 0x6f, 0x6e, 0x73, 0x65, 0x63, 0x74,
+	0x65, 0x74, 0x75, 0x72, 0x20, 0x61, 0x64, 0x69,
+	0x70, 0x69, 0x73, 0x63, 0x69, 0x6e, 0x67, 0x20,
+	0x65, 0x6c, 0x69, 0x74, 0x2c, 0x20, 0x73, 0x65,
+	0x64, 0x20, 0x64, 0x6f, 0x20, 0x65, 0x69, 0x75,
+	0x73, 0x6d, 0x6f, 0x64, 0x0a, 0x74, 0x65, 0x6d,
+	0x70, 0x6f, 0x72, 0x20, 0x69, 0x6e, 0x63, 0x69,
+	0x64, 0x69, 0x64, 0x75, 0x6e, 0x74, 0x20, 0x75,
+	0x74, 0x20, 0x6c, 0x61, 0x62, 0x6f, 0x72, 0x65,
+	0x20, 0x65, 0x74, 0x5b, 0x00, 0xf0, 0x0e, 0x65,
+	0x20, 0x6d, 0x61, 0x67, 0x6e, 0x61, 0x20, 0x61,
+	0x6c, 0x69, 0x71, 0x75, 0x61, 0x2e, 0x20, 0x55,
+	0x74, 0x20, 0x65, 0x6e, 0x69, 0x6d, 0x20, 0x61,
+	0x64, 0x20, 0x6d, 0x69, 0x09, 0x00, 0xf2, 0x1a,
+	0x76, 0x65, 0x6e, 0x69, 0x61, 0x6d, 0x2c, 0x0a,
+	0x71, 0x75, 0x69, 0x73, 0x20, 0x6e, 0x6f, 0x73,
+	0x74, 0x72, 0x75, 0x64, 0x20, 0x65, 0x78, 0x65,
+	0x72, 0x63, 0x69, 0x74, 0x61, 0x74, 0x69, 0x6f,
+	0x6e, 0x20, 0x75, 0x6c, 0x6c, 0x61, 0x6d, 0x63,
+	0x6f, 0x5a, 0x00, 0x00, 0x25, 0x00, 0x62, 0x69,
+	0x73, 0x69, 0x20, 0x75, 0x74, 0x53, 0x00, 0xf1,
+	0x02, 0x69, 0x70, 0x20, 0x65, 0x78, 0x20, 0x65,
+	0x61, 0x20, 0x63, 0x6f, 0x6d, 0x6d, 0x6f, 0x64,
+	0x6f, 0x0a, 0xc1, 0x00, 0x70, 0x71, 0x75, 0x61,
+	0x74, 0x2e, 0x20, 0x44, 0x53, 0x00, 0xa2, 0x61,
+	0x75, 0x74, 0x65, 0x20, 0x69, 0x72, 0x75, 0x72,
+	0x65, 0x91, 0x00, 0xf0, 0x02, 0x20, 0x69, 0x6e,
+	0x20, 0x72, 0x65, 0x70, 0x72, 0x65, 0x68, 0x65,
+	0x6e, 0x64, 0x65, 0x72, 0x69, 0x74, 0x11, 0x00,
+	0xb0, 0x76, 0x6f, 0x6c, 0x75, 0x70, 0x74, 0x61,
+	0x74, 0x65, 0x20, 0x76, 0xea, 0x00, 0xa4, 0x20,
+	0x65, 0x73, 0x73, 0x65, 0x0a, 0x63, 0x69, 0x6c,
+	0x6c, 0x22, 0x01, 0xd0, 0x65, 0x20, 0x65, 0x75,
+	0x20, 0x66, 0x75, 0x67, 0x69, 0x61, 0x74, 0x20,
+	0x6e, 0x91, 0x00, 0xf0, 0x04, 0x20, 0x70, 0x61,
+	0x72, 0x69, 0x61, 0x74, 0x75, 0x72, 0x2e, 0x20,
+	0x45, 0x78, 0x63, 0x65, 0x70, 0x74, 0x65, 0x75,
+	0x47, 0x01, 0xf0, 0x04, 0x6e, 0x74, 0x20, 0x6f,
+	0x63, 0x63, 0x61, 0x65, 0x63, 0x61, 0x74, 0x20,
+	0x63, 0x75, 0x70, 0x69, 0x64, 0x61, 0x74, 0x32,
+	0x00, 0xa0, 0x6f, 0x6e, 0x0a, 0x70, 0x72, 0x6f,
+	0x69, 0x64, 0x65, 0x6e, 0x46, 0x01, 0x00, 0x2a,
+	0x01, 0xf0, 0x0b, 0x69, 0x6e, 0x20, 0x63, 0x75,
+	0x6c, 0x70, 0x61, 0x20, 0x71, 0x75, 0x69, 0x20,
+	0x6f, 0x66, 0x66, 0x69, 0x63, 0x69, 0x61, 0x20,
+	0x64, 0x65, 0x73, 0x65, 0x72, 0x1e, 0x00, 0x40,
+	0x6d, 0x6f, 0x6c, 0x6c, 0x93, 0x01, 0x00, 0x21,
+	0x01, 0xf0, 0x01, 0x69, 0x64, 0x20, 0x65, 0x73,
+	0x74, 0x20, 0x6c, 0x61, 0x62, 0x6f, 0x72, 0x75,
+	0x6d, 0x2e, 0x0a, 0x00, 0x00, 0x00, 0x00, 0xdc,
+	0x65, 0x9f, 0x99,
+#elif defined(TEST_LZ42)
+	0x04, 0x22, 0x4d, 0x18, 0x7c, 0x40, 0x2c, 0x01,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xfa, 0x1f,
+	0x01, 0x00, 0x00, 0xf2, 0x57, 0x4c, 0x6f, 0x72,
+	0x65, 0x6d, 0x20, 0x69, 0x70, 0x73, 0x75, 0x6d,
+	0x20, 0x64, 0x6f, 0x6c, 0x6f, 0x72, 0x20, 0x73,
+	0x69, 0x74, 0x20, 0x61, 0x6d, 0x65, 0x74, 0x2c,
+	0x20, 0x63, 0x6f, 0x6e, 0x73, 0x65, 0x63, 0x74,
+	0x65, 0x74, 0x75, 0x72, 0x20, 0x61, 0x64, 0x69,
+	0x70, 0x69, 0x73, 0x63, 0x69, 0x6e, 0x67, 0x20,
+	0x65, 0x6c, 0x69, 0x74, 0x2c, 0x20, 0x73, 0x65,
+	0x64, 0x20, 0x64, 0x6f, 0x20, 0x65, 0x69, 0x75,
+	0x73, 0x6d, 0x6f, 0x64, 0x0a, 0x74, 0x65, 0x6d,
+	0x70, 0x6f, 0x72, 0x20, 0x69, 0x6e, 0x63, 0x69,
+	0x64, 0x69, 0x64, 0x75, 0x6e, 0x74, 0x20, 0x75,
+	0x74, 0x20, 0x6c, 0x61, 0x62, 0x6f, 0x72, 0x65,
+	0x20, 0x65, 0x74, 0x5b, 0x00, 0xf0, 0x0e, 0x65,
+	0x20, 0x6d, 0x61, 0x67, 0x6e, 0x61, 0x20, 0x61,
+	0x6c, 0x69, 0x71, 0x75, 0x61, 0x2e, 0x20, 0x55,
+	0x74, 0x20, 0x65, 0x6e, 0x69, 0x6d, 0x20, 0x61,
+	0x64, 0x20, 0x6d, 0x69, 0x09, 0x00, 0xf2, 0x1a,
+	0x76, 0x65, 0x6e, 0x69, 0x61, 0x6d, 0x2c, 0x0a,
+	0x71, 0x75, 0x69, 0x73, 0x20, 0x6e, 0x6f, 0x73,
+	0x74, 0x72, 0x75, 0x64, 0x20, 0x65, 0x78, 0x65,
+	0x72, 0x63, 0x69, 0x74, 0x61, 0x74, 0x69, 0x6f,
+	0x6e, 0x20, 0x75, 0x6c, 0x6c, 0x61, 0x6d, 0x63,
+	0x6f, 0x5a, 0x00, 0x00, 0x25, 0x00, 0x62, 0x69,
+	0x73, 0x69, 0x20, 0x75, 0x74, 0x53, 0x00, 0xf1,
+	0x02, 0x69, 0x70, 0x20, 0x65, 0x78, 0x20, 0x65,
+	0x61, 0x20, 0x63, 0x6f, 0x6d, 0x6d, 0x6f, 0x64,
+	0x6f, 0x0a, 0xc1, 0x00, 0x70, 0x71, 0x75, 0x61,
+	0x74, 0x2e, 0x20, 0x44, 0x53, 0x00, 0xa2, 0x61,
+	0x75, 0x74, 0x65, 0x20, 0x69, 0x72, 0x75, 0x72,
+	0x65, 0x91, 0x00, 0xf0, 0x02, 0x20, 0x69, 0x6e,
+	0x20, 0x72, 0x65, 0x70, 0x72, 0x65, 0x68, 0x65,
+	0x6e, 0x64, 0x65, 0x72, 0x69, 0x74, 0x11, 0x00,
+	0xb0, 0x76, 0x6f, 0x6c, 0x75, 0x70, 0x74, 0x61,
+	0x74, 0x65, 0x20, 0x76, 0xea, 0x00, 0xb0, 0x20,
+	0x65, 0x73, 0x73, 0x65, 0x0a, 0x63, 0x69, 0x6c,
+	0x6c, 0x75, 0xbe, 0xfa, 0x28, 0xcb, 0x00, 0x00,
+	0x00, 0x00, 0x53, 0x97, 0xf4, 0x6f, 0x52, 0x2a,
+	0x4d, 0x18, 0x03, 0x00, 0x00, 0x00, 0x61, 0x62,
+	0x63, 0x04, 0x22, 0x4d, 0x18, 0x60, 0x40, 0x82,
+	0x92, 0x00, 0x00, 0x80, 0x6d, 0x20, 0x64, 0x6f,
+	0x6c, 0x6f, 0x72, 0x65, 0x20, 0x65, 0x75, 0x20,
+	0x66, 0x75, 0x67, 0x69, 0x61, 0x74, 0x20, 0x6e,
+	0x75, 0x6c, 0x6c, 0x61, 0x20, 0x70, 0x61, 0x72,
+	0x69, 0x61, 0x74, 0x75, 0x72, 0x2e, 0x20, 0x45,
+	0x78, 0x63, 0x65, 0x70, 0x74, 0x65, 0x75, 0x72,
+	0x20, 0x73, 0x69, 0x6e, 0x74, 0x20, 0x6f, 0x63,
+	0x63, 0x61, 0x65, 0x63, 0x61, 0x74, 0x20, 0x63,
+	0x75, 0x70, 0x69, 0x64, 0x61, 0x74, 0x61, 0x74,
+	0x20, 0x6e, 0x6f, 0x6e, 0x0a, 0x70, 0x72, 0x6f,
+	0x69, 0x64, 0x65, 0x6e, 0x74, 0x2c, 0x20, 0x73,
+	0x75, 0x6e, 0x74, 0x20, 0x69, 0x6e, 0x20, 0x63,
+	0x75, 0x6c, 0x70, 0x61, 0x20, 0x71, 0x75, 0x69,
+	0x20, 0x6f, 0x66, 0x66, 0x69, 0x63, 0x69, 0x61,
+	0x20, 0x64, 0x65, 0x73, 0x65, 0x72, 0x75, 0x6e,
+	0x74, 0x20, 0x6d, 0x6f, 0x6c, 0x6c, 0x69, 0x74,
+	0x20, 0x61, 0x6e, 0x69, 0x6d, 0x20, 0x69, 0x64,
+	0x20, 0x65, 0x73, 0x74, 0x20, 0x6c, 0x61, 0x62,
+	0x6f, 0x72, 0x75, 0x6d, 0x2e, 0x0a, 0x00, 0x00,
+	0x00, 0x00,
 #endif
 };
 
@@ -351,6 +471,9 @@ static const char orig[] =
 #elif defined(TEST_ZSTD) || defined(TEST_ZSTD2)
 #define COMP_NAME "zstd"
 #define COMP_ID FSTREAM_COMPRESSOR_ZSTD
+#elif defined(TEST_LZ4) || defined(TEST_LZ42)
+#define COMP_NAME "lz4"
+#define COMP_ID FSTREAM_COMPRESSOR_LZ4
 #endif
 
 static void destroy_noop(sqfs_object_t *obj)
@@ -0,0 +1,212 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * uncompress_parallel.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "config.h"
+
+#include "fstream.h"
+#include "../test.h"
+
+#include <zlib.h>
+
+#define MEM_BUFSZ (262144)
+
+#define SMALL_MEMBERS (40)
+#define SMALL_SIZE (200 * 1024)
+#define STORED_SIZE (3 * 1024 * 1024)
+#define HUGE_SIZE (17 * 1024 * 1024)
+
+#define TOTAL_SIZE (STORED_SIZE + SMALL_MEMBERS * SMALL_SIZE + HUGE_SIZE)
+
+#define ZERO_SIZE (64 * 1024 * 1024)
+
+static sqfs_u8 *expected;
+static size_t expected_size;
+
+static sqfs_u8 *compressed;
+static size_t compressed_size;
+
+typedef struct {
+	istream_t base;
+	size_t offset;
+
+	sqfs_u8 buffer[MEM_BUFSZ];
+} mem_istream_t;
+
+/* never produces 0x1F, so the only member header lookalike is planted */
+static sqfs_u8 byte_at(size_t offset)
+{
+	return ((offset * 7 + offset / 251) & 0x3F) | 0x20;
+}
+
+static void add_member(sqfs_u8 *data, size_t size, int level)
+{
+	z_stream strm;
+	int ret;
+
+	memset(&strm, 0, sizeof(strm));
+	ret = deflateInit2(&strm, level, Z_DEFLATED, 16 + 15, 8,
+			   Z_DEFAULT_STRATEGY);
+	TEST_EQUAL_I(ret, Z_OK);
+
+	strm.next_in = data;
+	strm.avail_in = size;
+	strm.next_out = compressed + compressed_size;
+	strm.avail_out = deflateBound(&strm, size);
+
+	ret = deflate(&strm, Z_FINISH);
+	TEST_EQUAL_I(ret, Z_STREAM_END);
+
+	compressed_size += strm.total_out;
+	deflateEnd(&strm);
+}
+
+static void generate(void)
+{
+	static const sqfs_u8 fake_header[10] = {
+		0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03,
+	};
+	size_t i, start;
+
+	expected = malloc(TOTAL_SIZE);
+	TEST_NOT_NULL(expected);
+
+	compressed = malloc(TOTAL_SIZE + 1024 * 1024);
+	TEST_NOT_NULL(compressed);
+
+	for (i = 0; i < TOTAL_SIZE; ++i)
+		expected[i] = byte_at(i);
+
+	/*
+	  Stored blocks with something that looks like a member header in the
+	  middle, so the decompressor has to recover from a bad guess.
+	*/
+	memcpy(expected + STORED_SIZE / 2 + 100, fake_header,
+	       sizeof(fake_header));
+	add_member(expected, STORED_SIZE, 0);
+	start = STORED_SIZE;
+
+	/* lots of small members that can be processed in parallel */
+	for (i = 0; i < SMALL_MEMBERS; ++i) {
+		add_member(expected + start, SMALL_SIZE, 6);
+		start += SMALL_SIZE;
+	}
+
+	/* a member too big to be processed in one piece */
+	add_member(expected + start, HUGE_SIZE, 0);
+	start += HUGE_SIZE;
+
+	/* trailing zero padding is ignored */
+	memset(compressed + compressed_size, 0, 100);
+	compressed_size += 100;
+
+	expected_size = start;
+}
+
+/* a single, small member that uncompresses to a lot of zeros */
+static void generate_zeros(void)
+{
+	expected = calloc(1, ZERO_SIZE);
+	TEST_NOT_NULL(expected);
+
+	compressed = malloc(ZERO_SIZE / 100);
+	TEST_NOT_NULL(compressed);
+
+	compressed_size = 0;
+	add_member(expected, ZERO_SIZE, 9);
+	TEST_ASSERT(compressed_size < ZERO_SIZE / 500);
+
+	expected_size = ZERO_SIZE;
+}
+
+static int mem_precache(istream_t *strm)
+{
+	mem_istream_t *mem = (mem_istream_t *)strm;
+	size_t diff = MEM_BUFSZ - strm->buffer_used;
+
+	if (diff > compressed_size - mem->offset)
+		diff = compressed_size - mem->offset;
+
+	memcpy(strm->buffer + strm->buffer_used,
+	       compressed + mem->offset, diff);
+
+	strm->buffer_used += diff;
+	mem->offset += diff;
+
+	if (mem->offset == compressed_size)
+		strm->eof = true;
+
+	return 0;
+}
+
+static const char *mem_get_filename(istream_t *strm)
+{
+	(void)strm;
+	return "memory";
+}
+
+static void mem_destroy(sqfs_object_t *obj)
+{
+	free(obj);
+}
+
+static void run_test(size_t num_jobs)
+{
+	size_t offset = 0, size = 1;
+	sqfs_u8 buffer[70000];
+	mem_istream_t *mem;
+	istream_t *strm;
+	sqfs_s32 ret;
+
+	mem = calloc(1, sizeof(*mem));
+	TEST_NOT_NULL(mem);
+
+	mem->base.buffer = mem->buffer;
+	mem->base.precache = mem_precache;
+	mem->base.get_filename = mem_get_filename;
+	((sqfs_object_t *)mem)->destroy = mem_destroy;
+
+	strm = istream_compressor_create_parallel((istream_t *)mem,
+						  FSTREAM_COMPRESSOR_GZIP,
+						  num_jobs);
+	TEST_NOT_NULL(strm);
+
+	for (;;) {
+		ret = istream_read(strm, buffer, size);
+		TEST_ASSERT(ret >= 0);
+
+		if (ret == 0)
+			break;
+
+		TEST_ASSERT((size_t)ret <= expected_size - offset);
+		TEST_ASSERT(memcmp(buffer, expected + offset, ret) == 0);
+
+		offset += ret;
+		size = (size * 7) % sizeof(buffer) + 1;
+	}
+
+	TEST_EQUAL_UI(offset, expected_size);
+	sqfs_destroy(strm);
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc; (void)argv;
+
+	generate();
+	run_test(4);
+	run_test(1);
+
+	free(expected);
+	free(compressed);
+
+	generate_zeros();
+	run_test(4);
+	run_test(1);
+
+	free(expected);
+	free(compressed);
+	return EXIT_SUCCESS;
+}
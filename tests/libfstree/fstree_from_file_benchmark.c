@@ -0,0 +1,170 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * fstree_from_file_benchmark.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "config.h"
+#include "compat.h"
+#include "fstree.h"
+
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <stdio.h>
+
+static struct option long_opts[] = {
+	{ "entries", required_argument, NULL, 'n' },
+	{ "dir-size", required_argument, NULL, 'd' },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL, 0, NULL, 0 },
+};
+
+static const char *short_opts = "n:d:h";
+
+static const char *help_string =
+"Usage: fstree_from_file_benchmark [OPTIONS...]\n"
+"\n"
+"Generates a sorted, gensquashfs style listing on the fly and parses it\n"
+"into an fstree, e.g. `time fstree_from_file_benchmark -n 5000000`.\n"
+"\n"
+"Possible options:\n"
+"\n"
+"  --entries, -n <count>   How many lines to generate in total.\n"
+"  --dir-size, -d <count>  How many entries to put into each directory.\n"
+"                          Defaults to 1000.\n"
+"\n";
+
+#define BUFSZ (262144)
+
+typedef struct {
+	istream_t base;
+
+	unsigned long line, entries, dir_size;
+
+	sqfs_u8 buffer[BUFSZ];
+} gen_istream_t;
+
+static int gen_precache(istream_t *strm)
+{
+	gen_istream_t *gen = (gen_istream_t *)strm;
+	unsigned long dir, idx;
+	int ret;
+
+	while (gen->line < gen->entries) {
+		dir = gen->line / gen->dir_size;
+		idx = gen->line % gen->dir_size;
+
+		if (idx == 0) {
+			ret = snprintf((char *)strm->buffer + strm->buffer_used,
+				       BUFSZ - strm->buffer_used,
+				       "dir /usr/share/dir%08lu 0755 0 0\n",
+				       dir);
+		} else if ((idx % 10) == 0) {
+			ret = snprintf((char *)strm->buffer + strm->buffer_used,
+				       BUFSZ - strm->buffer_used,
+				       "slink /usr/share/dir%08lu/entry%08lu "
+				       "0777 0 0 entry%08lu\n",
+				       dir, idx, idx - 1);
+		} else {
+			ret = snprintf((char *)strm->buffer + strm->buffer_used,
+				       BUFSZ - strm->buffer_used,
+				       "file /usr/share/dir%08lu/entry%08lu "
+				       "0644 0 0 /dev/null\n",
+				       dir, idx);
+		}
+
+		if (ret < 0 || (size_t)ret >= (BUFSZ - strm->buffer_used))
+			return 0;
+
+		strm->buffer_used += ret;
+		gen->line += 1;
+	}
+
+	strm->eof = true;
+	return 0;
+}
+
+static const char *gen_get_filename(istream_t *strm)
+{
+	(void)strm;
+	return "generated listing";
+}
+
+static void gen_destroy(sqfs_object_t *obj)
+{
+	free(obj);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long entries = 0, dir_size = 1000;
+	gen_istream_t *gen;
+	fstree_t fs;
+	int ret;
+
+	for (;;) {
+		int i = getopt_long(argc, argv, short_opts, long_opts, NULL);
+		if (i == -1)
+			break;
+
+		switch (i) {
+		case 'n':
+			entries = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			dir_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			fputs(help_string, stdout);
+			return EXIT_SUCCESS;
+		default:
+			goto fail_arg;
+		}
+	}
+
+	if (entries == 0) {
+		fputs("An entry count > 0 must be specified.\n", stderr);
+		goto fail_arg;
+	}
+
+	if (dir_size == 0) {
+		fputs("A directory size > 0 must be specified.\n", stderr);
+		goto fail_arg;
+	}
+
+	gen = calloc(1, sizeof(*gen));
+	if (gen == NULL) {
+		perror("creating listing generator");
+		return EXIT_FAILURE;
+	}
+
+	gen->entries = entries;
+	gen->dir_size = dir_size;
+	gen->base.buffer = gen->buffer;
+	gen->base.precache = gen_precache;
+	gen->base.get_filename = gen_get_filename;
+	((sqfs_object_t *)gen)->destroy = gen_destroy;
+
+	if (fstree_init(&fs, NULL)) {
+		sqfs_destroy(gen);
+		return EXIT_FAILURE;
+	}
+
+	ret = fstree_from_file_stream(&fs, (istream_t *)gen, NULL);
+	if (ret == 0)
+		ret = fstree_post_process(&fs);
+
+	if (ret == 0) {
+		printf("%lu lines, " PRI_SZ " inodes\n",
+		       entries, fs.unique_inode_count);
+	}
+
+	fstree_cleanup(&fs);
+	sqfs_destroy(gen);
+	return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+fail_arg:
+	fputs("Try `fstree_from_file_benchmark --help' for more "
+	      "information.\n", stderr);
+	return EXIT_FAILURE;
+}
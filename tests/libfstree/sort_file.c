@@ -39,6 +39,10 @@ static const char *sort_file =
 "  30 [glob] /bin/d*\n"
 "  40        /bin/cp\n"
 "  50 [glob] /bin/*\n"
+"  60        /bin/cp\n"
+"\n"
+"# Without path globbing, * also matches slashes\n"
+"  -5 [glob_no_path] *ssl*\n"
 "\n"
 "# Make this file appear first\n"
 "  -10000 [dont_compress,dont_fragment,align] /usr/share/bla.txt";
@@ -61,8 +65,8 @@ static const char *initial_order[] = {
 
 static const char *after_sort_order[] = {
 	"usr/share/bla.txt",
-	"lib/libfoobar.so",
 	"lib/libssl.so",
+	"lib/libfoobar.so",
 	"lib/libwhatever.so",
 	"bin/mkdir",
 	"bin/mknod",
@@ -77,7 +81,7 @@ static const char *after_sort_order[] = {
 
 static sqfs_s64 priorities[] = {
 	-10000,
-	0,
+	-5,
 	0,
 	0,
 	10,
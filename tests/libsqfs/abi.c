@@ -9,6 +9,7 @@
 #include "sqfs/block_processor.h"
 #include "sqfs/compressor.h"
 #include "sqfs/block.h"
+#include "sqfs/io.h"
 #include "../test.h"
 
 #include <stddef.h>
@@ -81,12 +82,14 @@ static void test_blockproc_stats(void)
 	TEST_EQUAL_UI(sizeof(stats.sparse_block_count), sizeof(sqfs_u64));
 	TEST_EQUAL_UI(sizeof(stats.total_frag_count), sizeof(sqfs_u64));
 	TEST_EQUAL_UI(sizeof(stats.actual_frag_count), sizeof(sqfs_u64));
+	TEST_EQUAL_UI(sizeof(stats.raw_block_count), sizeof(sqfs_u64));
+	TEST_EQUAL_UI(sizeof(stats.raw_bytes_read), sizeof(sqfs_u64));
 
 	if (__alignof__(stats) == __alignof__(sqfs_u32)) {
 		TEST_ASSERT(sizeof(stats) >=
-			    (sizeof(sqfs_u32) + 7 * sizeof(sqfs_u64)));
+			    (sizeof(sqfs_u32) + 9 * sizeof(sqfs_u64)));
 	} else if (__alignof__(stats) == __alignof__(sqfs_u64)) {
-		TEST_ASSERT(sizeof(stats) >= (8 * sizeof(sqfs_u64)));
+		TEST_ASSERT(sizeof(stats) >= (10 * sizeof(sqfs_u64)));
 	}
 
 	TEST_EQUAL_UI(offsetof(sqfs_block_processor_stats_t, size), 0);
@@ -125,6 +128,78 @@ static void test_blockproc_stats(void)
 
 	TEST_EQUAL_UI(offsetof(sqfs_block_processor_stats_t,
 			       actual_frag_count), off);
+	off += sizeof(sqfs_u64);
+
+	TEST_EQUAL_UI(offsetof(sqfs_block_processor_stats_t,
+			       raw_block_count), off);
+	off += sizeof(sqfs_u64);
+
+	TEST_EQUAL_UI(offsetof(sqfs_block_processor_stats_t,
+			       raw_bytes_read), off);
+}
+
+static void test_file_stats(void)
+{
+	sqfs_file_stats_t stats;
+	size_t off;
+
+	TEST_EQUAL_UI(sizeof(stats.size), sizeof(size_t));
+	TEST_EQUAL_UI(sizeof(stats.read_calls), sizeof(sqfs_u64));
+	TEST_EQUAL_UI(sizeof(stats.bytes_read), sizeof(sqfs_u64));
+	TEST_EQUAL_UI(sizeof(stats.read_time_us), sizeof(sqfs_u64));
+	TEST_EQUAL_UI(sizeof(stats.write_calls), sizeof(sqfs_u64));
+	TEST_EQUAL_UI(sizeof(stats.bytes_written), sizeof(sqfs_u64));
+	TEST_EQUAL_UI(sizeof(stats.write_time_us), sizeof(sqfs_u64));
+
+	TEST_EQUAL_UI(offsetof(sqfs_file_stats_t, size), 0);
+
+	/* the first sqfs_u64 may need padding after a 32 bit size_t */
+	off = sizeof(stats.size) + __alignof__(sqfs_file_stats_t) - 1;
+	off -= off % __alignof__(sqfs_file_stats_t);
+
+	TEST_EQUAL_UI(offsetof(sqfs_file_stats_t, read_calls), off);
+	off += sizeof(sqfs_u64);
+
+	TEST_EQUAL_UI(offsetof(sqfs_file_stats_t, bytes_read), off);
+	off += sizeof(sqfs_u64);
+
+	TEST_EQUAL_UI(offsetof(sqfs_file_stats_t, read_time_us), off);
+	off += sizeof(sqfs_u64);
+
+	TEST_EQUAL_UI(offsetof(sqfs_file_stats_t, write_calls), off);
+	off += sizeof(sqfs_u64);
+
+	TEST_EQUAL_UI(offsetof(sqfs_file_stats_t, bytes_written), off);
+	off += sizeof(sqfs_u64);
+
+	TEST_EQUAL_UI(offsetof(sqfs_file_stats_t, write_time_us), off);
+	off += sizeof(sqfs_u64);
+
+	TEST_EQUAL_UI(offsetof(sqfs_file_stats_t, read_seq_calls), off);
+	off += sizeof(sqfs_u64);
+
+	TEST_EQUAL_UI(offsetof(sqfs_file_stats_t, read_back_calls), off);
+	off += sizeof(sqfs_u64);
+
+	TEST_EQUAL_UI(offsetof(sqfs_file_stats_t, read_unique_bytes), off);
+	off += sizeof(sqfs_u64);
+
+	TEST_EQUAL_UI(offsetof(sqfs_file_stats_t, write_seq_calls), off);
+	off += sizeof(sqfs_u64);
+
+	TEST_EQUAL_UI(offsetof(sqfs_file_stats_t, read_size_hist), off);
+	off += SQFS_FILE_STATS_HIST_SIZE * sizeof(sqfs_u64);
+
+	TEST_EQUAL_UI(offsetof(sqfs_file_stats_t, read_time_hist), off);
+	off += SQFS_FILE_STATS_HIST_SIZE * sizeof(sqfs_u64);
+
+	TEST_EQUAL_UI(offsetof(sqfs_file_stats_t, read_seek_hist), off);
+	off += SQFS_FILE_STATS_HIST_SIZE * sizeof(sqfs_u64);
+
+	TEST_EQUAL_UI(offsetof(sqfs_file_stats_t, write_size_hist), off);
+	off += SQFS_FILE_STATS_HIST_SIZE * sizeof(sqfs_u64);
+
+	TEST_EQUAL_UI(offsetof(sqfs_file_stats_t, write_time_hist), off);
 }
 
 static void test_blockproc_desc(void)
@@ -170,5 +245,6 @@ int main(int argc, char **argv)
 	test_compressor_names();
 	test_blockproc_stats();
 	test_blockproc_desc();
+	test_file_stats();
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,259 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * block_processor.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "config.h"
+#include "../test.h"
+
+#include "sqfs/block_processor.h"
+#include "sqfs/block.h"
+#include "sqfs/block_writer.h"
+#include "sqfs/compressor.h"
+#include "sqfs/frag_table.h"
+#include "sqfs/error.h"
+#include "sqfs/inode.h"
+
+#define BLK_SIZE (4096)
+#define MAX_BLOCKS (8)
+
+typedef struct {
+	sqfs_block_writer_t base;
+
+	size_t count;
+	sqfs_u32 size[MAX_BLOCKS];
+	sqfs_u32 flags[MAX_BLOCKS];
+	sqfs_u8 data[MAX_BLOCKS][BLK_SIZE];
+} dummy_writer_t;
+
+static sqfs_u8 byte_at(size_t offset)
+{
+	return ((offset * 7 + offset / 251) & 0x7F) | 0x01;
+}
+
+static int dummy_write_data_block(sqfs_block_writer_t *base, void *user,
+				  sqfs_u32 size, sqfs_u32 checksum,
+				  sqfs_u32 flags, const sqfs_u8 *data,
+				  sqfs_u64 *location)
+{
+	dummy_writer_t *wr = (dummy_writer_t *)base;
+	(void)user; (void)checksum;
+
+	TEST_ASSERT(wr->count < MAX_BLOCKS);
+	TEST_ASSERT(size <= BLK_SIZE);
+
+	wr->size[wr->count] = size;
+	wr->flags[wr->count] = flags;
+	memcpy(wr->data[wr->count], data, size);
+
+	*location = wr->count * BLK_SIZE;
+	wr->count += 1;
+	return 0;
+}
+
+static sqfs_u64 dummy_get_block_count(const sqfs_block_writer_t *base)
+{
+	return ((const dummy_writer_t *)base)->count;
+}
+
+static void dummy_writer_destroy(sqfs_object_t *obj)
+{
+	(void)obj;
+}
+
+/* never manages to compress anything, so the blocks are stored as is */
+static sqfs_s32 dummy_do_block(sqfs_compressor_t *cmp, const sqfs_u8 *in,
+			       sqfs_u32 size, sqfs_u8 *out, sqfs_u32 outsize)
+{
+	(void)cmp; (void)in; (void)size; (void)out; (void)outsize;
+	return 0;
+}
+
+static void dummy_cmp_destroy(sqfs_object_t *obj)
+{
+	free(obj);
+}
+
+static sqfs_object_t *dummy_cmp_copy(const sqfs_object_t *obj)
+{
+	sqfs_compressor_t *copy = malloc(sizeof(*copy));
+
+	if (copy != NULL)
+		memcpy(copy, obj, sizeof(*copy));
+
+	return (sqfs_object_t *)copy;
+}
+
+static sqfs_compressor_t *dummy_cmp_create(void)
+{
+	sqfs_compressor_t *cmp = calloc(1, sizeof(*cmp));
+
+	TEST_NOT_NULL(cmp);
+	cmp->do_block = dummy_do_block;
+	((sqfs_object_t *)cmp)->copy = dummy_cmp_copy;
+	((sqfs_object_t *)cmp)->destroy = dummy_cmp_destroy;
+	return cmp;
+}
+
+static sqfs_block_processor_t *create(dummy_writer_t *wr,
+				      sqfs_compressor_t *cmp,
+				      sqfs_frag_table_t *tbl)
+{
+	sqfs_block_processor_t *proc;
+
+	memset(wr, 0, sizeof(*wr));
+	wr->base.write_data_block = dummy_write_data_block;
+	wr->base.get_block_count = dummy_get_block_count;
+	((sqfs_object_t *)wr)->destroy = dummy_writer_destroy;
+
+	proc = sqfs_block_processor_create(BLK_SIZE, cmp, 1, 10,
+					   (sqfs_block_writer_t *)wr, tbl);
+	TEST_NOT_NULL(proc);
+	return proc;
+}
+
+static void fill(void *data, size_t offset, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < size; ++i)
+		((sqfs_u8 *)data)[i] = byte_at(offset + i);
+}
+
+static void append(sqfs_block_processor_t *proc, size_t offset, size_t size)
+{
+	sqfs_u8 buffer[BLK_SIZE * 3];
+
+	TEST_ASSERT(size <= sizeof(buffer));
+	fill(buffer, offset, size);
+	TEST_EQUAL_I(sqfs_block_processor_append(proc, buffer, size), 0);
+}
+
+int main(int argc, char **argv)
+{
+	sqfs_inode_generic_t *inode = NULL;
+	sqfs_block_processor_t *proc;
+	dummy_writer_t wr_mixed, wr_append;
+	sqfs_compressor_t *cmp;
+	sqfs_frag_table_t *tbl;
+	sqfs_u8 *ptr, *first;
+	sqfs_u64 filesize;
+	size_t i, size;
+	void *data;
+	(void)argc; (void)argv;
+
+	cmp = dummy_cmp_create();
+	tbl = sqfs_frag_table_create(0);
+	TEST_NOT_NULL(tbl);
+
+	/* writing into the block buffer directly */
+	proc = create(&wr_mixed, cmp, tbl);
+
+	TEST_EQUAL_I(sqfs_block_processor_get_buffer(proc, &data, &size),
+		     SQFS_ERROR_SEQUENCE);
+	TEST_EQUAL_I(sqfs_block_processor_commit(proc, 0),
+		     SQFS_ERROR_SEQUENCE);
+
+	TEST_EQUAL_I(sqfs_block_processor_begin_file(proc, &inode, NULL,
+						     SQFS_BLK_DONT_FRAGMENT),
+		     0);
+	TEST_NOT_NULL(inode);
+
+	/* nothing to commit to yet */
+	TEST_EQUAL_I(sqfs_block_processor_commit(proc, 0),
+		     SQFS_ERROR_SEQUENCE);
+
+	TEST_EQUAL_I(sqfs_block_processor_get_buffer(proc, &data, &size), 0);
+	TEST_EQUAL_UI(size, BLK_SIZE);
+	first = data;
+
+	/* partial commit, the rest of the block is still available */
+	fill(data, 0, 1000);
+	TEST_EQUAL_I(sqfs_block_processor_commit(proc, 1000), 0);
+
+	TEST_EQUAL_I(sqfs_block_processor_get_buffer(proc, &data, &size), 0);
+	TEST_EQUAL_UI(size, BLK_SIZE - 1000);
+	TEST_ASSERT((sqfs_u8 *)data == first + 1000);
+
+	TEST_EQUAL_I(sqfs_block_processor_commit(proc, size + 1),
+		     SQFS_ERROR_OVERFLOW);
+
+	sqfs_inode_get_file_size(inode, &filesize);
+	TEST_EQUAL_UI(filesize, 1000);
+
+	/* mix in regular appends, filling up the block */
+	append(proc, 1000, 1000);
+
+	TEST_EQUAL_I(sqfs_block_processor_get_buffer(proc, &data, &size), 0);
+	TEST_EQUAL_UI(size, BLK_SIZE - 2000);
+	ptr = data;
+	fill(ptr, 2000, size);
+
+	/* completing the block submits it and starts a new one */
+	TEST_EQUAL_I(sqfs_block_processor_commit(proc, size), 0);
+
+	TEST_EQUAL_I(sqfs_block_processor_commit(proc, 0),
+		     SQFS_ERROR_SEQUENCE);
+
+	TEST_EQUAL_I(sqfs_block_processor_get_buffer(proc, &data, &size), 0);
+	TEST_EQUAL_UI(size, BLK_SIZE);
+
+	fill(data, BLK_SIZE, 500);
+	TEST_EQUAL_I(sqfs_block_processor_commit(proc, 500), 0);
+	append(proc, BLK_SIZE + 500, BLK_SIZE);
+
+	TEST_EQUAL_I(sqfs_block_processor_end_file(proc), 0);
+
+	TEST_EQUAL_I(sqfs_block_processor_get_buffer(proc, &data, &size),
+		     SQFS_ERROR_SEQUENCE);
+	TEST_EQUAL_I(sqfs_block_processor_commit(proc, 0),
+		     SQFS_ERROR_SEQUENCE);
+
+	TEST_EQUAL_I(sqfs_block_processor_finish(proc), 0);
+
+	sqfs_inode_get_file_size(inode, &filesize);
+	TEST_EQUAL_UI(filesize, 2 * BLK_SIZE + 500);
+	TEST_EQUAL_UI(sqfs_inode_get_file_block_count(inode), 3);
+
+	sqfs_destroy(proc);
+	sqfs_free(inode);
+	inode = NULL;
+
+	/* the same data, using only regular appends */
+	proc = create(&wr_append, cmp, tbl);
+
+	TEST_EQUAL_I(sqfs_block_processor_begin_file(proc, &inode, NULL,
+						     SQFS_BLK_DONT_FRAGMENT),
+		     0);
+	append(proc, 0, 2 * BLK_SIZE + 500);
+	TEST_EQUAL_I(sqfs_block_processor_end_file(proc), 0);
+	TEST_EQUAL_I(sqfs_block_processor_finish(proc), 0);
+
+	sqfs_destroy(proc);
+	sqfs_free(inode);
+
+	/* both must have produced exactly the same blocks */
+	TEST_EQUAL_UI(wr_mixed.count, 3);
+	TEST_EQUAL_UI(wr_append.count, wr_mixed.count);
+
+	for (i = 0; i < wr_mixed.count; ++i) {
+		TEST_EQUAL_UI(wr_mixed.size[i], wr_append.size[i]);
+		TEST_EQUAL_UI(wr_mixed.flags[i], wr_append.flags[i]);
+		TEST_ASSERT(memcmp(wr_mixed.data[i], wr_append.data[i],
+				   wr_mixed.size[i]) == 0);
+	}
+
+	TEST_EQUAL_UI(wr_mixed.size[0], BLK_SIZE);
+	TEST_EQUAL_UI(wr_mixed.size[1], BLK_SIZE);
+	TEST_EQUAL_UI(wr_mixed.size[2], 500);
+
+	for (i = 0; i < 2 * BLK_SIZE + 500; ++i) {
+		TEST_EQUAL_UI(wr_mixed.data[i / BLK_SIZE][i % BLK_SIZE],
+			      byte_at(i));
+	}
+
+	sqfs_destroy(tbl);
+	sqfs_destroy(cmp);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * io_stats.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "config.h"
+#include "../test.h"
+
+#include "sqfs/error.h"
+#include "sqfs/io.h"
+
+static sqfs_u8 file_data[65536];
+static size_t file_used = 0;
+static int num_copies = 0;
+
+static int dummy_read_at(sqfs_file_t *file, sqfs_u64 offset,
+			 void *buffer, size_t size)
+{
+	(void)file;
+
+	if (offset > file_used || size > (file_used - offset))
+		return SQFS_ERROR_OUT_OF_BOUNDS;
+
+	memcpy(buffer, file_data + offset, size);
+	return 0;
+}
+
+static int dummy_write_at(sqfs_file_t *file, sqfs_u64 offset,
+			  const void *buffer, size_t size)
+{
+	(void)file;
+
+	if (offset > sizeof(file_data) || size > (sizeof(file_data) - offset))
+		return SQFS_ERROR_OUT_OF_BOUNDS;
+
+	memcpy(file_data + offset, buffer, size);
+
+	if ((offset + size) > file_used)
+		file_used = offset + size;
+	return 0;
+}
+
+static sqfs_u64 dummy_get_size(const sqfs_file_t *file)
+{
+	(void)file;
+	return file_used;
+}
+
+static void dummy_destroy(sqfs_object_t *obj)
+{
+	if (obj != NULL)
+		--num_copies;
+}
+
+static sqfs_object_t *dummy_copy(const sqfs_object_t *obj);
+
+static sqfs_file_t dummy_file = {
+	{ dummy_destroy, dummy_copy },
+	dummy_read_at,
+	dummy_write_at,
+	dummy_get_size,
+	NULL,
+};
+
+static sqfs_object_t *dummy_copy(const sqfs_object_t *obj)
+{
+	(void)obj;
+	++num_copies;
+	return (sqfs_object_t *)&dummy_file;
+}
+
+static size_t hist_sum(const sqfs_u64 *hist)
+{
+	size_t i, sum = 0;
+
+	for (i = 0; i < SQFS_FILE_STATS_HIST_SIZE; ++i)
+		sum += hist[i];
+
+	return sum;
+}
+
+int main(int argc, char **argv)
+{
+	const sqfs_file_stats_t *stats;
+	sqfs_file_t *file, *copy;
+	sqfs_u8 buffer[4096];
+	size_t i;
+	(void)argc; (void)argv;
+
+	TEST_NULL(sqfs_file_stats_get(&dummy_file));
+
+	file = sqfs_file_stats_create(&dummy_file);
+	TEST_NOT_NULL(file);
+
+	stats = sqfs_file_stats_get(file);
+	TEST_NOT_NULL(stats);
+	TEST_EQUAL_UI(stats->size, sizeof(*stats));
+
+	/* sequential writes */
+	memset(buffer, 0xAA, sizeof(buffer));
+
+	for (i = 0; i < 16; ++i) {
+		TEST_EQUAL_I(file->write_at(file, i * sizeof(buffer), buffer,
+					    sizeof(buffer)), 0);
+	}
+
+	TEST_EQUAL_I(file->write_at(file, 0, buffer, 96), 0);
+
+	TEST_EQUAL_UI(file->get_size(file), 16 * sizeof(buffer));
+	TEST_EQUAL_UI(stats->write_calls, 17);
+	TEST_EQUAL_UI(stats->write_seq_calls, 16);
+	TEST_EQUAL_UI(stats->bytes_written, 16 * sizeof(buffer) + 96);
+	TEST_EQUAL_UI(stats->write_size_hist[13], 16);
+	TEST_EQUAL_UI(stats->write_size_hist[7], 1);
+	TEST_EQUAL_UI(hist_sum(stats->write_time_hist), 17);
+
+	/* reads, partially overlapping or adjacent to each other */
+	TEST_EQUAL_I(file->read_at(file, 1000, buffer, 1000), 0);
+	TEST_EQUAL_I(file->read_at(file, 2000, buffer, 1000), 0);
+	TEST_EQUAL_I(file->read_at(file, 10000, buffer, 100), 0);
+	TEST_EQUAL_I(file->read_at(file, 500, buffer, 1000), 0);
+	TEST_EQUAL_I(file->read_at(file, 2500, buffer, 2000), 0);
+	TEST_EQUAL_I(file->read_at(file, 9000, buffer, 0), 0);
+
+	TEST_EQUAL_UI(stats->read_calls, 6);
+	TEST_EQUAL_UI(stats->bytes_read, 5100);
+	TEST_EQUAL_UI(stats->read_seq_calls, 1);
+	TEST_EQUAL_UI(stats->read_back_calls, 1);
+	TEST_EQUAL_UI(stats->read_unique_bytes, 4000 + 100);
+	TEST_EQUAL_UI(stats->read_size_hist[0], 1);
+	TEST_EQUAL_UI(stats->read_size_hist[7], 1);
+	TEST_EQUAL_UI(stats->read_size_hist[10], 3);
+	TEST_EQUAL_UI(stats->read_size_hist[11], 1);
+	TEST_EQUAL_UI(hist_sum(stats->read_seek_hist), 5);
+	TEST_EQUAL_UI(hist_sum(stats->read_time_hist), 6);
+
+	/* a read that bridges the gap between two ranges */
+	TEST_EQUAL_I(file->read_at(file, 4000, buffer, 4096), 0);
+	TEST_EQUAL_I(file->read_at(file, 8096, buffer, 2000), 0);
+	TEST_EQUAL_UI(stats->read_unique_bytes, 10100 - 500);
+
+	TEST_EQUAL_I(file->read_at(file, 65000, buffer, 1000),
+		     SQFS_ERROR_OUT_OF_BOUNDS);
+	TEST_EQUAL_UI(stats->read_calls, 9);
+	TEST_EQUAL_UI(stats->read_unique_bytes, 10100 - 500);
+
+	/* copies count on their own and are added up when destroyed */
+	copy = sqfs_copy(file);
+	TEST_NOT_NULL(copy);
+	TEST_EQUAL_I(num_copies, 1);
+
+	TEST_EQUAL_UI(sqfs_file_stats_get(copy)->read_calls, 0);
+
+	TEST_EQUAL_I(copy->read_at(copy, 20000, buffer, 1000), 0);
+	TEST_EQUAL_I(copy->read_at(copy, 1000, buffer, 1000), 0);
+	TEST_EQUAL_UI(sqfs_file_stats_get(copy)->read_calls, 2);
+	TEST_EQUAL_UI(sqfs_file_stats_get(copy)->read_unique_bytes, 2000);
+	TEST_EQUAL_UI(stats->read_calls, 9);
+
+	sqfs_destroy(copy);
+	TEST_EQUAL_I(num_copies, 0);
+
+	TEST_EQUAL_UI(stats->read_calls, 11);
+	TEST_EQUAL_UI(stats->read_back_calls, 3);
+	TEST_EQUAL_UI(stats->read_unique_bytes, 10100 - 500 + 1000);
+
+	sqfs_destroy(file);
+	TEST_EQUAL_I(num_copies, -1);
+	return EXIT_SUCCESS;
+}
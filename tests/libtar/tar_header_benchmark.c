@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * tar_header_benchmark.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "config.h"
+#include "compat.h"
+#include "tar.h"
+
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <stdio.h>
+
+static struct option long_opts[] = {
+	{ "entries", required_argument, NULL, 'n' },
+	{ "arena", no_argument, NULL, 'a' },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL, 0, NULL, 0 },
+};
+
+static const char *short_opts = "n:ah";
+
+static const char *help_string =
+"Usage: tar_header_benchmark [OPTIONS...]\n"
+"\n"
+"Generates a tarball on the fly, where every entry has a PAX header with\n"
+"a long path and an extended attribute, and every fourth entry also has a\n"
+"GNU sparse map, and decodes all headers in it. For instance, compare\n"
+"`time tar_header_benchmark -n 1000000` with the same command using `-a`.\n"
+"\n"
+"Possible options:\n"
+"\n"
+"  --entries, -n <count>  How many tar entries to generate.\n"
+"  --arena, -a            Decode the headers into an arena, instead of\n"
+"                         allocating every part of them separately.\n"
+"\n";
+
+#define BUFSZ (262144)
+
+/* PAX header, PAX data and the ustar header of the actual entry */
+#define ENTRY_SIZE (3 * TAR_RECORD_SIZE)
+
+typedef struct {
+	istream_t base;
+
+	unsigned long entry, entries;
+	bool trailer_done;
+
+	sqfs_u8 buffer[BUFSZ];
+} gen_istream_t;
+
+static void gen_header(char *out, char type, const char *name, size_t size,
+		       unsigned long mtime)
+{
+	tar_header_t *hdr = (tar_header_t *)out;
+	unsigned int chksum = 0;
+	size_t i;
+
+	memset(hdr, 0, sizeof(*hdr));
+	strncpy(hdr->name, name, sizeof(hdr->name) - 1);
+	sprintf(hdr->mode, "%07o", 0644U);
+	sprintf(hdr->uid, "%07o", 1000U);
+	sprintf(hdr->gid, "%07o", 1000U);
+	sprintf(hdr->size, "%011o", (unsigned int)size);
+	sprintf(hdr->mtime, "%011o", (unsigned int)(mtime & 0xFFFFFFFF));
+	hdr->typeflag = type;
+	memcpy(hdr->magic, TAR_MAGIC, sizeof(hdr->magic));
+	memcpy(hdr->version, TAR_VERSION, sizeof(hdr->version));
+	memset(hdr->chksum, ' ', sizeof(hdr->chksum));
+
+	for (i = 0; i < sizeof(*hdr); ++i)
+		chksum += ((const unsigned char *)hdr)[i];
+
+	sprintf(hdr->chksum, "%06o", chksum);
+	hdr->chksum[7] = ' ';
+}
+
+/* the length prefix of a PAX record includes its own digits */
+static size_t pax_record(char *out, const char *key, const char *value)
+{
+	size_t len = strlen(key) + strlen(value) + 3, total, digits = 1;
+
+	for (;;) {
+		total = len + digits;
+		if (total < 10 || (digits > 1 && total < 100) || digits > 2)
+			break;
+		++digits;
+	}
+
+	return sprintf(out, "%u %s=%s\n", (unsigned int)total, key, value);
+}
+
+static void gen_entry(gen_istream_t *gen, char *out)
+{
+	unsigned long dir = gen->entry / 1000, idx = gen->entry % 1000;
+	char path[128], value[64];
+	size_t size = 0;
+
+	memset(out, 0, ENTRY_SIZE);
+
+	sprintf(path, "usr/share/benchmark/directory%06lu/"
+		"a/somewhat/longer/path/entry%06lu.txt", dir, idx);
+	size += pax_record(out + TAR_RECORD_SIZE + size, "path", path);
+
+	sprintf(value, "%lu", gen->entry);
+	size += pax_record(out + TAR_RECORD_SIZE + size, "mtime", value);
+	size += pax_record(out + TAR_RECORD_SIZE + size,
+			   "SCHILY.xattr.user.mime_type", "text/plain");
+
+	if ((gen->entry % 4) == 0) {
+		size += pax_record(out + TAR_RECORD_SIZE + size,
+				   "GNU.sparse.size", "16384");
+		size += pax_record(out + TAR_RECORD_SIZE + size,
+				   "GNU.sparse.map",
+				   "0,0,4096,0,8192,0,12288,0,16384,0");
+	}
+
+	sprintf(value, "PaxHeaders/%lu", gen->entry);
+	gen_header(out, TAR_TYPE_PAX, value, size, 0);
+	gen_header(out + 2 * TAR_RECORD_SIZE, TAR_TYPE_FILE, "entry", 0, 0);
+}
+
+static int gen_precache(istream_t *strm)
+{
+	gen_istream_t *gen = (gen_istream_t *)strm;
+
+	while (gen->entry < gen->entries) {
+		if ((BUFSZ - strm->buffer_used) < ENTRY_SIZE)
+			return 0;
+
+		gen_entry(gen, (char *)strm->buffer + strm->buffer_used);
+		strm->buffer_used += ENTRY_SIZE;
+		gen->entry += 1;
+	}
+
+	if (!gen->trailer_done) {
+		if ((BUFSZ - strm->buffer_used) < 2 * TAR_RECORD_SIZE)
+			return 0;
+
+		memset(strm->buffer + strm->buffer_used, 0,
+		       2 * TAR_RECORD_SIZE);
+		strm->buffer_used += 2 * TAR_RECORD_SIZE;
+		gen->trailer_done = true;
+	}
+
+	strm->eof = true;
+	return 0;
+}
+
+static const char *gen_get_filename(istream_t *strm)
+{
+	(void)strm;
+	return "generated tarball";
+}
+
+static void gen_destroy(sqfs_object_t *obj)
+{
+	free(obj);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long entries = 0, count = 0, xattr_count = 0;
+	tar_arena_t *arena = NULL;
+	tar_header_decoded_t hdr;
+	bool use_arena = false;
+	gen_istream_t *gen;
+	int ret;
+
+	for (;;) {
+		int i = getopt_long(argc, argv, short_opts, long_opts, NULL);
+		if (i == -1)
+			break;
+
+		switch (i) {
+		case 'n':
+			entries = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			use_arena = true;
+			break;
+		case 'h':
+			fputs(help_string, stdout);
+			return EXIT_SUCCESS;
+		default:
+			goto fail_arg;
+		}
+	}
+
+	if (entries == 0) {
+		fputs("An entry count > 0 must be specified.\n", stderr);
+		goto fail_arg;
+	}
+
+	gen = calloc(1, sizeof(*gen));
+	if (gen == NULL) {
+		perror("creating tarball generator");
+		return EXIT_FAILURE;
+	}
+
+	gen->entries = entries;
+	gen->base.buffer = gen->buffer;
+	gen->base.precache = gen_precache;
+	gen->base.get_filename = gen_get_filename;
+	((sqfs_object_t *)gen)->destroy = gen_destroy;
+
+	if (use_arena) {
+		arena = tar_arena_create();
+		if (arena == NULL) {
+			sqfs_destroy(gen);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (;;) {
+		ret = read_header_arena((istream_t *)gen, &hdr, arena);
+		if (ret != 0)
+			break;
+
+		count += 1;
+		xattr_count += (hdr.xattr != NULL);
+
+		ret = skip_entry((istream_t *)gen, hdr.record_size);
+		clear_header(&hdr);
+		if (ret != 0)
+			break;
+	}
+
+	if (ret >= 0)
+		printf("%lu headers, %lu with xattrs\n", count, xattr_count);
+
+	tar_arena_destroy(arena);
+	sqfs_destroy(gen);
+	return ret >= 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+fail_arg:
+	fputs("Try `tar_header_benchmark --help' for more "
+	      "information.\n", stderr);
+	return EXIT_FAILURE;
+}
@@ -8,7 +8,7 @@
 #include "tar.h"
 #include "../test.h"
 
-static void test_case_sparse(const char *path)
+static void test_case_sparse(const char *path, tar_arena_t *arena)
 {
 	tar_header_decoded_t hdr;
 	sparse_map_t *sparse;
@@ -16,7 +16,7 @@ static void test_case_sparse(const char *path)
 
 	fp = istream_open_file(path);
 	TEST_NOT_NULL(fp);
-	TEST_ASSERT(read_header(fp, &hdr) == 0);
+	TEST_ASSERT(read_header_arena(fp, &hdr, arena) == 0);
 	TEST_EQUAL_UI(hdr.mode, S_IFREG | 0644);
 	TEST_EQUAL_UI(hdr.uid, 01750);
 	TEST_EQUAL_UI(hdr.gid, 01750);
@@ -79,7 +79,14 @@ static void test_case_sparse(const char *path)
 
 int main(int argc, char **argv)
 {
+	tar_arena_t *arena;
 	(void)argc; (void)argv;
-	test_case_sparse( STRVALUE(TESTPATH) "/" STRVALUE(TESTFILE) );
+
+	test_case_sparse(STRVALUE(TESTPATH) "/" STRVALUE(TESTFILE), NULL);
+
+	arena = tar_arena_create();
+	TEST_NOT_NULL(arena);
+	test_case_sparse(STRVALUE(TESTPATH) "/" STRVALUE(TESTFILE), arena);
+	tar_arena_destroy(arena);
 	return EXIT_SUCCESS;
 }
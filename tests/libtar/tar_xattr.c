@@ -8,16 +8,15 @@
 #include "tar.h"
 #include "../test.h"
 
-int main(int argc, char **argv)
+static void test_case_xattr(tar_arena_t *arena)
 {
 	tar_header_decoded_t hdr;
 	char buffer[6];
 	istream_t *fp;
-	(void)argc; (void)argv;
 
 	fp = istream_open_file(STRVALUE(TESTPATH) "/" STRVALUE(TESTFILE));
 	TEST_NOT_NULL(fp);
-	TEST_ASSERT(read_header(fp, &hdr) == 0);
+	TEST_ASSERT(read_header_arena(fp, &hdr, arena) == 0);
 	TEST_EQUAL_UI(hdr.mode, S_IFREG | 0644);
 	TEST_EQUAL_UI(hdr.uid, 01750);
 	TEST_EQUAL_UI(hdr.gid, 01750);
@@ -37,5 +36,18 @@ int main(int argc, char **argv)
 
 	clear_header(&hdr);
 	sqfs_destroy(fp);
+}
+
+int main(int argc, char **argv)
+{
+	tar_arena_t *arena;
+	(void)argc; (void)argv;
+
+	test_case_xattr(NULL);
+
+	arena = tar_arena_create();
+	TEST_NOT_NULL(arena);
+	test_case_xattr(arena);
+	tar_arena_destroy(arena);
 	return EXIT_SUCCESS;
 }
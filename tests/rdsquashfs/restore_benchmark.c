@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * restore_benchmark.c
+ *
+ * Copyright (C) 2021 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "rdsquashfs.h"
+
+static struct option long_opts[] = {
+	{ "depth", required_argument, NULL, 'd' },
+	{ "fan-out", required_argument, NULL, 'f' },
+	{ "files", required_argument, NULL, 'n' },
+	{ "attribs", no_argument, NULL, 'a' },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL, 0, NULL, 0 },
+};
+
+static const char *short_opts = "d:f:n:ah";
+
+static const char *help_string =
+"Usage: restore_benchmark [OPTIONS...] <directory>\n"
+"\n"
+"Generates a synthetic directory tree in memory and lets the rdsquashfs\n"
+"unpacking code create it inside the given, existing directory, e.g.\n"
+"`time restore_benchmark -d 12 -f 2 -n 32 -a /tmp/out`.\n"
+"\n"
+"Possible options:\n"
+"\n"
+"  --depth, -d <count>    How many levels of directories to generate.\n"
+"                         Defaults to 8.\n"
+"  --fan-out, -f <count>  How many sub directories each directory has.\n"
+"                         Defaults to 2.\n"
+"  --files, -n <count>    How many files to put into each directory.\n"
+"                         Defaults to 16.\n"
+"  --attribs, -a          Also restore permissions and timestamps.\n"
+"\n";
+
+static unsigned long node_count = 0;
+
+static sqfs_tree_node_t *mknode(sqfs_tree_node_t *parent, const char *name,
+				bool is_dir)
+{
+	sqfs_tree_node_t *n = calloc(1, sizeof(*n) + strlen(name) + 1);
+
+	if (n == NULL)
+		return NULL;
+
+	n->inode = calloc(1, sizeof(*n->inode));
+	if (n->inode == NULL) {
+		free(n);
+		return NULL;
+	}
+
+	if (is_dir) {
+		n->inode->base.type = SQFS_INODE_DIR;
+		n->inode->base.mode = S_IFDIR | 0750;
+	} else {
+		n->inode->base.type = SQFS_INODE_FILE;
+		n->inode->base.mode = S_IFREG | 0640;
+	}
+
+	n->inode->base.mod_time = 1234567890;
+	n->uid = getuid();
+	n->gid = getgid();
+	strcpy((char *)n->name, name);
+
+	if (parent != NULL) {
+		n->parent = parent;
+		n->next = parent->children;
+		parent->children = n;
+	}
+
+	node_count += 1;
+	return n;
+}
+
+static int gen_tree(sqfs_tree_node_t *dir, unsigned long depth,
+		    unsigned long fan_out, unsigned long files)
+{
+	sqfs_tree_node_t *n;
+	unsigned long i;
+	char name[64];
+
+	for (i = 0; i < files; ++i) {
+		sprintf(name, "some_file_with_a_long_name_%06lu.txt", i);
+
+		if (mknode(dir, name, false) == NULL)
+			return -1;
+	}
+
+	if (depth == 0)
+		return 0;
+
+	for (i = 0; i < fan_out; ++i) {
+		sprintf(name, "a_sub_directory_%04lu", i);
+
+		n = mknode(dir, name, true);
+		if (n == NULL)
+			return -1;
+
+		if (gen_tree(n, depth - 1, fan_out, files))
+			return -1;
+	}
+
+	return 0;
+}
+
+static void free_tree(sqfs_tree_node_t *n)
+{
+	sqfs_tree_node_t *c;
+
+	while (n->children != NULL) {
+		c = n->children;
+		n->children = c->next;
+		free_tree(c);
+	}
+
+	free(n->inode);
+	free(n);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long depth = 8, fan_out = 2, files = 16;
+	int flags = UNPACK_QUIET, ret;
+	sqfs_tree_node_t *root;
+
+	for (;;) {
+		int i = getopt_long(argc, argv, short_opts, long_opts, NULL);
+		if (i == -1)
+			break;
+
+		switch (i) {
+		case 'd':
+			depth = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			fan_out = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			files = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			flags |= UNPACK_CHMOD | UNPACK_SET_TIMES;
+			break;
+		case 'h':
+			fputs(help_string, stdout);
+			return EXIT_SUCCESS;
+		default:
+			goto fail_arg;
+		}
+	}
+
+	if (optind >= argc) {
+		fputs("Missing output directory argument\n", stderr);
+		goto fail_arg;
+	}
+
+	if (chdir(argv[optind])) {
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	root = mknode(NULL, "", true);
+	if (root == NULL || gen_tree(root, depth, fan_out, files)) {
+		perror("generating directory tree");
+		if (root != NULL)
+			free_tree(root);
+		return EXIT_FAILURE;
+	}
+
+	ret = restore_fstree(root, flags);
+	if (ret == 0)
+		ret = update_tree_attribs(NULL, root, flags);
+
+	if (ret == 0)
+		printf("%lu entries\n", node_count - 1);
+
+	free_tree(root);
+	return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+fail_arg:
+	fputs("Try `restore_benchmark --help' for more information.\n",
+	      stderr);
+	return EXIT_FAILURE;
+}